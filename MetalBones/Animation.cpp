@@ -0,0 +1,70 @@
+//
+//  Animation.cpp
+//  MetalBones
+//
+
+#include "Animation.hpp"
+
+#include <cassert>
+
+JointTransform blend(const JointTransform& a, const JointTransform& b, float t) {
+    return {
+        nlerp(a.rotation, b.rotation, t),
+        lerp(a.translation, b.translation, t),
+        lerp(a.scale, b.scale, t),
+    };
+}
+
+AnimationClip::AnimationClip(uint32_t jointCount, uint32_t frameCount, float sampleRate)
+    : joints(jointCount)
+    , frames(frameCount)
+    , rate(sampleRate)
+    , samples(size_t(jointCount) * frameCount, {{0, 0, 0, 1}, {0, 0, 0}, {1, 1, 1}})
+{
+    assert(frameCount > 0 && sampleRate > 0.0f);
+}
+
+float AnimationClip::duration() const {
+    return float(frames) / rate;
+}
+
+void AnimationClip::sample(float time, JointTransform* pose, uint32_t count) const {
+    assert(count <= joints);
+
+    float position = std::fmod(time * rate, float(frames));
+    if (position < 0.0f) {
+        position += float(frames);
+    }
+
+    uint32_t f0 = uint32_t(position) % frames;
+    uint32_t f1 = (f0 + 1) % frames;
+    float t = position - std::floor(position);
+
+    const JointTransform* a = frame(f0);
+    const JointTransform* b = frame(f1);
+    for (uint32_t j = 0; j < count; ++j) {
+        pose[j] = blend(a[j], b[j], t);
+    }
+}
+
+void buildModelMatrices(const Skeleton& skeleton, const JointTransform* localPose, Float4x4* model) {
+    const uint32_t count = skeleton.jointCount();
+    for (uint32_t i = 0; i < count; ++i) {
+        const JointTransform& local = localPose[i];
+        Float4x4 m = makeTransform(local.translation, local.rotation, local.scale);
+        int16_t parent = skeleton.parents[i];
+        model[i] = parent >= 0 ? model[parent] * m : m;
+    }
+}
+
+void buildMatrixPalette(const Skeleton& skeleton, const JointTransform* localPose, Float4x4* palette) {
+    const uint32_t count = skeleton.jointCount();
+
+    static thread_local std::vector<Float4x4> model;
+    model.resize(count);
+    buildModelMatrices(skeleton, localPose, model.data());
+
+    for (uint32_t i = 0; i < count; ++i) {
+        palette[i] = model[i] * skeleton.inverseBindMatrices[i];
+    }
+}
@@ -0,0 +1,58 @@
+//
+//  Animation.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.hpp"
+
+struct JointTransform {
+    Quat rotation;
+    Float3 translation;
+    Float3 scale;
+};
+
+JointTransform blend(const JointTransform& a, const JointTransform& b, float t);
+
+// Joints are stored parents-first (parents[i] < i, root has -1) and ordered by
+// importance, so a joint LOD is simply a prefix of the joint array.
+struct Skeleton {
+    std::vector<int16_t> parents;
+    std::vector<JointTransform> bindPose;
+    std::vector<Float4x4> inverseBindMatrices;
+
+    uint32_t jointCount() const { return static_cast<uint32_t>(parents.size()); }
+};
+
+// Uniformly resampled clip, frame-major: frame f of joint j is samples[f * jointCount + j].
+class AnimationClip {
+public:
+    AnimationClip(uint32_t jointCount, uint32_t frameCount, float sampleRate);
+
+    uint32_t jointCount() const { return joints; }
+    uint32_t frameCount() const { return frames; }
+    float sampleRate() const { return rate; }
+    float duration() const;
+
+    JointTransform* frame(uint32_t index) { return &samples[index * joints]; }
+    const JointTransform* frame(uint32_t index) const { return &samples[index * joints]; }
+
+    // Samples the first `count` joints at `time` (looping) into `pose`.
+    void sample(float time, JointTransform* pose, uint32_t count) const;
+
+private:
+    uint32_t joints;
+    uint32_t frames;
+    float rate;
+    std::vector<JointTransform> samples;
+};
+
+// Writes the model-space transform of every joint.
+void buildModelMatrices(const Skeleton& skeleton, const JointTransform* localPose, Float4x4* model);
+
+// Writes model-space skinning matrices (model * inverseBind) for every joint of the skeleton.
+void buildMatrixPalette(const Skeleton& skeleton, const JointTransform* localPose, Float4x4* palette);
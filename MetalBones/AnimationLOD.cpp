@@ -0,0 +1,207 @@
+//
+//  AnimationLOD.cpp
+//  MetalBones
+//
+
+#include "AnimationLOD.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static uint32_t updatePeriod(AnimationLODTier tier) {
+    switch (tier) {
+        case AnimationLODTier::EveryFrame:       return 1;
+        case AnimationLODTier::EverySecondFrame: return 2;
+        case AnimationLODTier::EveryFourthFrame: return 4;
+        default:                                 return 0;
+    }
+}
+
+static void lerpPalette(const Float4x4* a, const Float4x4* b, float t, uint32_t count, Float4x4* out) {
+    const float* pa = a->m;
+    const float* pb = b->m;
+    float* po = out->m;
+    for (uint32_t i = 0; i < count * 16; ++i) {
+        po[i] = pa[i] + (pb[i] - pa[i]) * t;
+    }
+}
+
+AnimationLODManager::AnimationLODManager(const AnimationLODSettings& settings)
+    : settings(settings)
+{
+}
+
+AnimationLODManager::InstanceId AnimationLODManager::addInstance(const Skeleton* skeleton, const AnimationClip* clip, float startTime) {
+    assert(skeleton && clip && clip->jointCount() == skeleton->jointCount());
+
+    InstanceId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = static_cast<InstanceId>(instances.size());
+        instances.emplace_back();
+    }
+
+    const uint32_t count = skeleton->jointCount();
+
+    Instance& instance = instances[id];
+    instance.skeleton = skeleton;
+    instance.clip = clip;
+    instance.time = startTime;
+    instance.screenSize = 1.0f;
+    instance.tier = AnimationLODTier::EveryFrame;
+    instance.activeJoints = count;
+    instance.phase = 0;
+    instance.framesSinceSample = 0;
+    instance.sampledOnce = false;
+    instance.fromCache = false;
+    instance.alive = true;
+    instance.pose = skeleton->bindPose;
+    instance.previous.resize(count);
+    instance.target.resize(count);
+    instance.palette.resize(count);
+
+    buildMatrixPalette(*skeleton, instance.pose.data(), instance.palette.data());
+
+    return id;
+}
+
+void AnimationLODManager::removeInstance(InstanceId id) {
+    Instance& instance = instances[id];
+    assert(instance.alive);
+
+    instance.alive = false;
+    instance.pose = {};
+    instance.previous = {};
+    instance.target = {};
+    instance.palette = {};
+    freeIds.push_back(id);
+}
+
+void AnimationLODManager::setScreenSize(InstanceId id, float screenSize) {
+    instances[id].screenSize = screenSize;
+}
+
+float AnimationLODManager::projectedSize(float boundingRadius, float distance, float fovY) {
+    if (distance <= boundingRadius) {
+        return 1.0f;
+    }
+    return boundingRadius / (distance * std::tan(fovY * 0.5f));
+}
+
+AnimationLODTier AnimationLODManager::selectTier(const Instance& instance) const {
+    const float size = instance.screenSize;
+    const float up = 1.0f + settings.hysteresis;
+    const float down = 1.0f - settings.hysteresis;
+
+    int t = static_cast<int>(instance.tier);
+    while (t > 0 && size >= settings.screenSizeThresholds[t - 1] * up) {
+        --t;
+    }
+    while (t < 3 && size < settings.screenSizeThresholds[t] * down) {
+        ++t;
+    }
+    return static_cast<AnimationLODTier>(t);
+}
+
+void AnimationLODManager::applyTier(Instance& instance, AnimationLODTier tier) {
+    const Skeleton& skeleton = *instance.skeleton;
+    const uint32_t count = skeleton.jointCount();
+
+    float fraction = settings.jointFractions[static_cast<int>(tier)];
+    uint32_t active = std::clamp(uint32_t(std::ceil(fraction * float(count))), 1u, count);
+
+    // Dropped joints fall back to their bind pose so they follow their parent rigidly.
+    std::copy(skeleton.bindPose.begin() + active, skeleton.bindPose.end(), instance.pose.begin() + active);
+
+    instance.tier = tier;
+    instance.activeJoints = active;
+    instance.sampledOnce = false;
+
+    // Round-robin the update phase across instances of the tier so that a
+    // crowd on a 4-frame period is spread evenly over the four frames.
+    uint32_t period = updatePeriod(tier);
+    instance.phase = period ? nextPhase[static_cast<int>(tier)]++ % period : 0;
+}
+
+void AnimationLODManager::sample(Instance& instance, float time) {
+    if (poseCache) {
+        const AnimationClip* clip = instance.clip;
+        const uint32_t active = instance.activeJoints;
+        PoseKey key = {instance.skeleton, clip, poseCache->quantize(*clip, time), active};
+
+        CachedPose cached = poseCache->acquire(key, [clip, active](float t, JointTransform* pose) {
+            clip->sample(t, pose, active);
+        });
+        std::copy(cached.palette, cached.palette + cached.jointCount, instance.target.begin());
+        instance.poseKey = key;
+        return;
+    }
+
+    instance.clip->sample(time, instance.pose.data(), instance.activeJoints);
+    buildMatrixPalette(*instance.skeleton, instance.pose.data(), instance.target.data());
+}
+
+void AnimationLODManager::update(float deltaTime) {
+    frameStats = {};
+
+    for (Instance& instance : instances) {
+        if (!instance.alive) {
+            continue;
+        }
+        instance.fromCache = false;
+
+        AnimationLODTier tier = selectTier(instance);
+        if (tier != instance.tier) {
+            applyTier(instance, tier);
+        }
+
+        instance.time += deltaTime;
+
+        const int tierIndex = static_cast<int>(tier);
+        const uint32_t period = updatePeriod(tier);
+        const uint32_t count = instance.skeleton->jointCount();
+        frameStats.instances[tierIndex]++;
+
+        if (period == 0) {
+            if (!instance.sampledOnce) {
+                sample(instance, instance.time);
+                instance.palette.swap(instance.target);
+                instance.fromCache = poseCache != nullptr;
+                instance.sampledOnce = true;
+                frameStats.sampled[tierIndex]++;
+            }
+            continue;
+        }
+
+        const bool interpolate = settings.interpolatePalettes && period > 1 && instance.sampledOnce;
+
+        if (!instance.sampledOnce || (frameIndex + instance.phase) % period == 0) {
+            if (interpolate) {
+                // Sample where the next update will land and walk towards it
+                // from what is currently on screen.
+                instance.previous.swap(instance.palette);
+                sample(instance, instance.time + float(period - 1) * deltaTime);
+                lerpPalette(instance.previous.data(), instance.target.data(), 1.0f / float(period), count, instance.palette.data());
+            } else {
+                sample(instance, instance.time);
+                instance.palette = instance.target;
+                instance.fromCache = poseCache != nullptr;
+                if (settings.interpolatePalettes) {
+                    instance.previous = instance.target;
+                }
+            }
+            instance.framesSinceSample = 0;
+            instance.sampledOnce = true;
+            frameStats.sampled[tierIndex]++;
+        } else if (interpolate) {
+            instance.framesSinceSample++;
+            float t = std::min(float(instance.framesSinceSample + 1) / float(period), 1.0f);
+            lerpPalette(instance.previous.data(), instance.target.data(), t, count, instance.palette.data());
+            frameStats.interpolated++;
+        }
+    }
+
+    frameIndex++;
+}
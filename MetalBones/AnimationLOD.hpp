@@ -0,0 +1,96 @@
+//
+//  AnimationLOD.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Animation.hpp"
+#include "PoseCache.hpp"
+
+enum class AnimationLODTier : uint8_t {
+    EveryFrame,
+    EverySecondFrame,
+    EveryFourthFrame,
+    Frozen,
+    Count
+};
+
+struct AnimationLODSettings {
+    // Projected height as a fraction of the viewport; anything below the last
+    // threshold is frozen.
+    float screenSizeThresholds[3] = {0.15f, 0.06f, 0.015f};
+    float jointFractions[4] = {1.0f, 1.0f, 0.5f, 0.25f};
+    float hysteresis = 0.15f;
+    bool interpolatePalettes = true;
+};
+
+struct AnimationLODStats {
+    uint32_t instances[4];
+    uint32_t sampled[4];
+    uint32_t interpolated;
+};
+
+class AnimationLODManager {
+public:
+    using InstanceId = uint32_t;
+
+    explicit AnimationLODManager(const AnimationLODSettings& settings = {});
+
+    InstanceId addInstance(const Skeleton* skeleton, const AnimationClip* clip, float startTime = 0.0f);
+    void removeInstance(InstanceId id);
+
+    // Instances sampling the same clip, time step and joint LOD share one palette.
+    void setPoseCache(PoseCache* cache) { poseCache = cache; }
+
+    void setScreenSize(InstanceId id, float screenSize);
+    static float projectedSize(float boundingRadius, float distance, float fovY);
+
+    void update(float deltaTime);
+
+    const Float4x4* palette(InstanceId id) const { return instances[id].palette.data(); }
+    AnimationLODTier tier(InstanceId id) const { return instances[id].tier; }
+    uint32_t activeJointCount(InstanceId id) const { return instances[id].activeJoints; }
+    // The pose cache entry the palette is an unchanged copy of, when the last
+    // update() took it from the cache; null when it sampled, interpolated or
+    // skipped the instance.
+    const PoseKey* cachedPose(InstanceId id) const { return instances[id].fromCache ? &instances[id].poseKey : nullptr; }
+
+    const AnimationLODStats& stats() const { return frameStats; }
+
+private:
+    struct Instance {
+        const Skeleton* skeleton;
+        const AnimationClip* clip;
+        float time;
+        float screenSize;
+        AnimationLODTier tier;
+        uint32_t activeJoints;
+        uint32_t phase;
+        uint32_t framesSinceSample;
+        bool sampledOnce;
+        bool fromCache;
+        bool alive;
+        PoseKey poseKey;
+
+        std::vector<JointTransform> pose;
+        std::vector<Float4x4> previous;
+        std::vector<Float4x4> target;
+        std::vector<Float4x4> palette;
+    };
+
+    AnimationLODTier selectTier(const Instance& instance) const;
+    void applyTier(Instance& instance, AnimationLODTier tier);
+    void sample(Instance& instance, float time);
+
+    AnimationLODSettings settings;
+    PoseCache* poseCache = nullptr;
+    std::vector<Instance> instances;
+    std::vector<InstanceId> freeIds;
+    uint64_t frameIndex = 0;
+    uint32_t nextPhase[4] = {};
+    AnimationLODStats frameStats = {};
+};
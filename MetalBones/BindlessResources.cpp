@@ -0,0 +1,124 @@
+//
+//  BindlessResources.cpp
+//  MetalBones
+//
+
+#include "BindlessResources.hpp"
+
+static constexpr uint32_t notResident = ~0u;
+
+BindlessResources::Table::Table(MTL::Device* device, uint32_t capacity, NS::UInteger bufferIndex)
+    : slots(capacity)
+    , entries(device->newBuffer(capacity * sizeof(uint64_t), MTL::ResourceStorageModeShared))
+    , bufferIndex(bufferIndex)
+    , objects(capacity, nullptr)
+    , residentIndex(capacity, notResident)
+{
+}
+
+BindlessResources::BindlessResources(MTL::Device* device, uint32_t textureCapacity, uint32_t samplerCapacity,
+                                     uint32_t bufferCapacity)
+    : device(device->retain())
+    , textures(device, textureCapacity, bindlessTextureTableIndex)
+    , samplers(device, samplerCapacity, bindlessSamplerTableIndex)
+    , buffers(device, bufferCapacity, bindlessBufferTableIndex)
+{
+}
+
+BindlessResources::~BindlessResources() {
+    releases.flush();
+    release(buffers);
+    release(samplers);
+    release(textures);
+    device->release();
+}
+
+void BindlessResources::release(Table& table) {
+    for (NS::Object* object : table.objects) {
+        if (object) {
+            object->release();
+        }
+    }
+    table.entries->release();
+}
+
+bool BindlessResources::supported(MTL::Device* device) {
+    return device->argumentBuffersSupport() == MTL::ArgumentBuffersTier2;
+}
+
+uint32_t BindlessResources::add(Table& table, NS::Object* object, MTL::Resource* resource, uint64_t entry) {
+    uint32_t slot = table.slots.allocate();
+    if (slot == DescriptorTable::invalidSlot) {
+        __builtin_printf("Bindless table of %u entries is full\n", table.slots.capacity());
+        return slot;
+    }
+
+    // Nothing in flight can read a slot that was just allocated.
+    static_cast<uint64_t*>(table.entries->contents())[slot] = entry;
+    table.objects[slot] = object->retain();
+    if (resource) {
+        table.residentIndex[slot] = uint32_t(table.resident.size());
+        table.resident.push_back(resource);
+        table.residentSlots.push_back(slot);
+    }
+    return slot;
+}
+
+void BindlessResources::remove(Table& table, uint32_t slot, uint64_t lastUsedFrame) {
+    uint32_t index = table.residentIndex[slot];
+    if (index != notResident) {
+        // Frames already encoded made it resident themselves.
+        uint32_t lastSlot = table.residentSlots.back();
+        table.resident[index] = table.resident.back();
+        table.residentSlots[index] = lastSlot;
+        table.residentIndex[lastSlot] = index;
+        table.resident.pop_back();
+        table.residentSlots.pop_back();
+        table.residentIndex[slot] = notResident;
+    }
+    releases.release(table.objects[slot], lastUsedFrame);
+    table.objects[slot] = nullptr;
+    table.slots.release(slot, lastUsedFrame);
+}
+
+uint32_t BindlessResources::addTexture(MTL::Texture* texture) {
+    return add(textures, texture, texture, texture->gpuResourceID()._impl);
+}
+
+uint32_t BindlessResources::addSampler(MTL::SamplerState* sampler) {
+    return add(samplers, sampler, nullptr, sampler->gpuResourceID()._impl);
+}
+
+uint32_t BindlessResources::addBuffer(MTL::Buffer* buffer, size_t offset) {
+    return add(buffers, buffer, buffer, buffer->gpuAddress() + offset);
+}
+
+void BindlessResources::removeTexture(uint32_t slot, uint64_t lastUsedFrame) {
+    remove(textures, slot, lastUsedFrame);
+}
+
+void BindlessResources::removeSampler(uint32_t slot, uint64_t lastUsedFrame) {
+    remove(samplers, slot, lastUsedFrame);
+}
+
+void BindlessResources::removeBuffer(uint32_t slot, uint64_t lastUsedFrame) {
+    remove(buffers, slot, lastUsedFrame);
+}
+
+void BindlessResources::collect(uint64_t completedFrame) {
+    releases.collect(completedFrame);
+    textures.slots.collect(completedFrame);
+    samplers.slots.collect(completedFrame);
+    buffers.slots.collect(completedFrame);
+}
+
+void BindlessResources::bind(MTL::RenderCommandEncoder* encoder) {
+    const MTL::RenderStages bothStages = MTL::RenderStages(MTL::RenderStageVertex | MTL::RenderStageFragment);
+    for (Table* table : {&buffers, &textures, &samplers}) {
+        encoder->setVertexBuffer(table->entries, 0, table->bufferIndex);
+        encoder->setFragmentBuffer(table->entries, 0, table->bufferIndex);
+        if (!table->resident.empty()) {
+            encoder->useResources(table->resident.data(), table->resident.size(), MTL::ResourceUsageRead, bothStages);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+//
+//  BindlessResources.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <vector>
+
+#include "DeferredRelease.hpp"
+#include "DescriptorTable.hpp"
+
+// Buffer indices of the tables, shared by both stages; match general.metal.
+constexpr NS::UInteger bindlessBufferTableIndex = 7;
+constexpr NS::UInteger bindlessTextureTableIndex = 8;
+constexpr NS::UInteger bindlessSamplerTableIndex = 9;
+
+// Every texture, sampler and buffer a shader may reach, in three tables of
+// Tier 2 argument buffer entries: resource IDs for textures and samplers, GPU
+// addresses for buffers. Draws then only pass an index and bind() is once per
+// encoder. Entries are written when added and never change, see
+// DescriptorTable.
+class BindlessResources {
+public:
+    BindlessResources(MTL::Device* device, uint32_t textureCapacity = 4096, uint32_t samplerCapacity = 64,
+                      uint32_t bufferCapacity = 16384);
+    ~BindlessResources();
+
+    BindlessResources(const BindlessResources&) = delete;
+    BindlessResources& operator=(const BindlessResources&) = delete;
+
+    // False when the device can't read resources out of argument buffers.
+    static bool supported(MTL::Device* device);
+
+    // Slots, DescriptorTable::invalidSlot when a table is full. The tables hold
+    // a reference until the slot is removed and frames using it complete.
+    uint32_t addTexture(MTL::Texture* texture);
+    uint32_t addSampler(MTL::SamplerState* sampler);
+    uint32_t addBuffer(MTL::Buffer* buffer, size_t offset = 0);
+
+    void removeTexture(uint32_t slot, uint64_t lastUsedFrame);
+    void removeSampler(uint32_t slot, uint64_t lastUsedFrame);
+    void removeBuffer(uint32_t slot, uint64_t lastUsedFrame);
+
+    // Once per frame, with the last frame the GPU has finished.
+    void collect(uint64_t completedFrame);
+    // Binds the tables and makes what they point at resident.
+    void bind(MTL::RenderCommandEncoder* encoder);
+
+private:
+    struct Table {
+        DescriptorTable slots;
+        MTL::Buffer* entries;
+        NS::UInteger bufferIndex;
+        std::vector<NS::Object*> objects;           // by slot
+        // What useResources() is given, the slot of each, and each slot's place in it.
+        std::vector<MTL::Resource*> resident;
+        std::vector<uint32_t> residentSlots;
+        std::vector<uint32_t> residentIndex;
+
+        Table(MTL::Device* device, uint32_t capacity, NS::UInteger bufferIndex);
+    };
+
+    // `resource` is null for what needs no residency, like samplers.
+    uint32_t add(Table& table, NS::Object* object, MTL::Resource* resource, uint64_t entry);
+    void remove(Table& table, uint32_t slot, uint64_t lastUsedFrame);
+    static void release(Table& table);
+
+    MTL::Device* device;
+    Table textures;
+    Table samplers;
+    Table buffers;
+    DeferredReleaseQueue releases;
+};
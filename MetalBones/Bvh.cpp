@@ -0,0 +1,735 @@
+//
+//  Bvh.cpp
+//  MetalBones
+//
+
+#include "Bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "JobSystem.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef float Lanes __attribute__((vector_size(16)));
+typedef int32_t LaneMask __attribute__((vector_size(16)));
+
+static constexpr float infinity = std::numeric_limits<float>::infinity();
+static constexpr uint32_t noSubtree = ~0u;
+// Past this depth ranges are split at the median, which bounds the depth of
+// the tree and with it the traversal stacks below.
+static constexpr uint32_t maxSahDepth = 32;
+static constexpr uint32_t maxStackSize = 256;
+static constexpr uint32_t binningChunk = 16384;
+
+static inline Lanes loadLanes(const float* p) {
+    Lanes v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline Lanes splat(float v) {
+    return Lanes{v, v, v, v};
+}
+
+static inline Lanes minLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_min_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vminq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]), std::min(a[3], b[3])};
+#endif
+}
+
+static inline Lanes maxLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_max_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vmaxq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::max(a[0], b[0]), std::max(a[1], b[1]), std::max(a[2], b[2]), std::max(a[3], b[3])};
+#endif
+}
+
+static inline uint32_t laneBits(LaneMask mask) {
+#if defined(__SSE2__)
+    return uint32_t(_mm_movemask_ps((__m128)mask));
+#elif defined(__ARM_NEON)
+    const uint32x4_t weights = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32((uint32x4_t)mask, weights));
+#else
+    return uint32_t(mask[0] & 1) | uint32_t(mask[1] & 2) | uint32_t(mask[2] & 4) | uint32_t(mask[3] & 8);
+#endif
+}
+
+static inline Aabb emptyAabb() {
+    return {{infinity, infinity, infinity}, {-infinity, -infinity, -infinity}};
+}
+
+static inline void grow(Aabb& a, const Aabb& b) {
+    a.min = {std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)};
+    a.max = {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)};
+}
+
+static inline void grow(Aabb& a, const Float3& p) {
+    grow(a, Aabb{p, p});
+}
+
+static inline float surfaceArea(const Aabb& a) {
+    Float3 d = a.max - a.min;
+    if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f) {
+        return 0.0f;
+    }
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static inline Aabb slotBounds(const BvhNode& node, uint32_t slot) {
+    return {{node.minX[slot], node.minY[slot], node.minZ[slot]}, {node.maxX[slot], node.maxY[slot], node.maxZ[slot]}};
+}
+
+static inline void setSlotBounds(BvhNode& node, uint32_t slot, const Aabb& box) {
+    node.minX[slot] = box.min.x;
+    node.minY[slot] = box.min.y;
+    node.minZ[slot] = box.min.z;
+    node.maxX[slot] = box.max.x;
+    node.maxY[slot] = box.max.y;
+    node.maxZ[slot] = box.max.z;
+}
+
+static inline bool boxesOverlap(const Aabb& a, const Aabb& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y
+        && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+static inline bool boxInFrustum(const FrustumPlanes& frustum, const Aabb& box) {
+    Float3 center = (box.min + box.max) * 0.5f;
+    Float3 extents = (box.max - box.min) * 0.5f;
+    for (const float* plane : frustum.planes) {
+        float distance = plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3];
+        float reach = std::fabs(plane[0]) * extents.x + std::fabs(plane[1]) * extents.y + std::fabs(plane[2]) * extents.z;
+        if (distance + reach < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Slab test; `distance` is where the ray enters, 0 when it starts inside.
+static inline bool rayHitsBox(const Aabb& box, const Float3& origin, const Float3& inverseDirection, float maxDistance, float& distance) {
+    float tx0 = (box.min.x - origin.x) * inverseDirection.x, tx1 = (box.max.x - origin.x) * inverseDirection.x;
+    float ty0 = (box.min.y - origin.y) * inverseDirection.y, ty1 = (box.max.y - origin.y) * inverseDirection.y;
+    float tz0 = (box.min.z - origin.z) * inverseDirection.z, tz1 = (box.max.z - origin.z) * inverseDirection.z;
+    float near = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+    float far = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), maxDistance));
+    distance = near;
+    return near <= far;
+}
+
+// Binary tree the builder produces before it is collapsed into BvhNodes.
+struct BuildNode {
+    Aabb bounds;
+    uint32_t left, right;       // when count is 0
+    uint32_t first, count;      // range of Bvh::objects, when a leaf
+    uint32_t subtree;           // placeholder for a subtree built on its own
+};
+
+struct BuildTask {
+    uint32_t begin, end;
+    uint32_t depth;
+};
+
+// x, y, z and a lane nothing reads.
+struct BuildBox {
+    Lanes min;
+    Lanes max;
+};
+
+// Partitioned in place, so every pass over a range reads memory in order.
+struct BuildObject {
+    BuildBox bounds;
+    Lanes centroid;
+    uint32_t object;
+};
+
+struct BvhBuilder {
+    std::vector<BuildObject> objects;
+    JobSystem* jobs;
+    // Ranges at least this large are split in the top tree with parallel
+    // binning; smaller ones become tasks, each built into its own tree.
+    uint32_t parallelThreshold;
+    std::vector<std::vector<BuildNode>> trees;      // top tree, then one per task
+    std::vector<BuildTask> tasks;
+};
+
+struct RangeBounds {
+    BuildBox bounds;
+    BuildBox centroids;
+};
+
+struct Bins {
+    BuildBox bounds[3][Bvh::binCount];
+    uint32_t counts[3][Bvh::binCount];
+};
+
+static inline BuildBox emptyBuildBox() {
+    return {splat(infinity), splat(-infinity)};
+}
+
+static inline void grow(BuildBox& a, const BuildBox& b) {
+    a.min = minLanes(a.min, b.min);
+    a.max = maxLanes(a.max, b.max);
+}
+
+static inline void grow(BuildBox& a, Lanes p) {
+    a.min = minLanes(a.min, p);
+    a.max = maxLanes(a.max, p);
+}
+
+static inline float surfaceArea(const BuildBox& a) {
+    Lanes d = a.max - a.min;
+    if (d[0] < 0.0f || d[1] < 0.0f || d[2] < 0.0f) {
+        return 0.0f;
+    }
+    return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+static inline Aabb toAabb(const BuildBox& a) {
+    return {{a.min[0], a.min[1], a.min[2]}, {a.max[0], a.max[1], a.max[2]}};
+}
+
+// Bins per unit of centroid extent along each axis, 0 without extent.
+static inline Lanes binScales(const BuildBox& centroids) {
+    Lanes extent = centroids.max - centroids.min;
+    Lanes scale = {};
+    for (int axis = 0; axis < 3; ++axis) {
+        scale[axis] = extent[axis] > 0.0f ? Bvh::binCount / extent[axis] : 0.0f;
+    }
+    return scale;
+}
+
+// The centroid's bin along each axis.
+static inline LaneMask binIndices(Lanes centroid, Lanes low, Lanes scale) {
+    Lanes bin = minLanes(maxLanes((centroid - low) * scale, splat(0.0f)), splat(float(Bvh::binCount - 1)));
+    return __builtin_convertvector(bin, LaneMask);
+}
+
+static void boundRange(const BvhBuilder& b, uint32_t begin, uint32_t end, RangeBounds& out) {
+    out = {emptyBuildBox(), emptyBuildBox()};
+    for (uint32_t i = begin; i < end; ++i) {
+        grow(out.bounds, b.objects[i].bounds);
+        grow(out.centroids, b.objects[i].centroid);
+    }
+}
+
+static void binRange(const BvhBuilder& b, uint32_t begin, uint32_t end, const BuildBox& centroids, Bins& bins) {
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        std::fill(std::begin(bins.bounds[axis]), std::end(bins.bounds[axis]), emptyBuildBox());
+        std::fill(std::begin(bins.counts[axis]), std::end(bins.counts[axis]), 0u);
+    }
+    Lanes scale = binScales(centroids);
+    for (uint32_t i = begin; i < end; ++i) {
+        const BuildObject& object = b.objects[i];
+        LaneMask bin = binIndices(object.centroid, centroids.min, scale);
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            grow(bins.bounds[axis][bin[axis]], object.bounds);
+            bins.counts[axis][bin[axis]]++;
+        }
+    }
+}
+
+static uint32_t chunkCount(uint32_t begin, uint32_t end, bool parallel) {
+    return parallel ? (end - begin + binningChunk - 1) / binningChunk : 1;
+}
+
+// The passes over large ranges run in chunks across the jobs when `parallel`.
+// Chunks merge into exactly what one pass would produce.
+static void boundRange(const BvhBuilder& b, uint32_t begin, uint32_t end, bool parallel, RangeBounds& range) {
+    uint32_t chunks = chunkCount(begin, end, parallel);
+    if (chunks <= 1) {
+        boundRange(b, begin, end, range);
+        return;
+    }
+    std::vector<RangeBounds> chunkBounds(chunks);
+    b.jobs->parallelFor(chunks, 1, [&](uint32_t first, uint32_t last) {
+        for (uint32_t chunk = first; chunk < last; ++chunk) {
+            boundRange(b, begin + chunk * binningChunk, std::min(end, begin + (chunk + 1) * binningChunk), chunkBounds[chunk]);
+        }
+    });
+    range = {emptyBuildBox(), emptyBuildBox()};
+    for (const RangeBounds& chunk : chunkBounds) {
+        grow(range.bounds, chunk.bounds);
+        grow(range.centroids, chunk.centroids);
+    }
+}
+
+static void binRange(const BvhBuilder& b, uint32_t begin, uint32_t end, bool parallel, const BuildBox& centroids, Bins& bins) {
+    uint32_t chunks = chunkCount(begin, end, parallel);
+    if (chunks <= 1) {
+        binRange(b, begin, end, centroids, bins);
+        return;
+    }
+    std::vector<Bins> chunkBins(chunks);
+    b.jobs->parallelFor(chunks, 1, [&](uint32_t first, uint32_t last) {
+        for (uint32_t chunk = first; chunk < last; ++chunk) {
+            binRange(b, begin + chunk * binningChunk, std::min(end, begin + (chunk + 1) * binningChunk), centroids, chunkBins[chunk]);
+        }
+    });
+    bins = chunkBins[0];
+    for (uint32_t chunk = 1; chunk < chunks; ++chunk) {
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            for (uint32_t bin = 0; bin < Bvh::binCount; ++bin) {
+                grow(bins.bounds[axis][bin], chunkBins[chunk].bounds[axis][bin]);
+                bins.counts[axis][bin] += chunkBins[chunk].counts[axis][bin];
+            }
+        }
+    }
+}
+
+// Picks where to split [begin, end) and partitions the objects there.
+// Returns false when the range is better off as one leaf.
+static bool splitRange(BvhBuilder& b, uint32_t begin, uint32_t end, uint32_t depth, bool parallel, Aabb& bounds, uint32_t& mid) {
+    RangeBounds range;
+    boundRange(b, begin, end, parallel, range);
+    bounds = toAabb(range.bounds);
+
+    // A four-wide node tests as many boxes as a full leaf does, so there is
+    // nothing to gain from splitting one.
+    uint32_t count = end - begin;
+    if (count <= Bvh::maxLeafSize) {
+        return false;
+    }
+    Bins bins;
+    binRange(b, begin, end, parallel, range.centroids, bins);
+
+    // Binned SAH: the best bin boundary has the fewest objects in the least
+    // area on either side.
+    Lanes scale = binScales(range.centroids);
+    float bestCost = infinity;
+    uint32_t bestAxis = 0, bestBin = 0;
+    if (depth < maxSahDepth) {
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            if (scale[axis] == 0.0f) {
+                continue;
+            }
+            float rightArea[Bvh::binCount];
+            uint32_t rightCount[Bvh::binCount];
+            BuildBox box = emptyBuildBox();
+            uint32_t objects = 0;
+            for (uint32_t bin = Bvh::binCount - 1; bin > 0; --bin) {
+                grow(box, bins.bounds[axis][bin]);
+                objects += bins.counts[axis][bin];
+                rightArea[bin] = surfaceArea(box);
+                rightCount[bin] = objects;
+            }
+            box = emptyBuildBox();
+            objects = 0;
+            for (uint32_t bin = 0; bin + 1 < Bvh::binCount; ++bin) {
+                grow(box, bins.bounds[axis][bin]);
+                objects += bins.counts[axis][bin];
+                if (objects == 0 || rightCount[bin + 1] == 0) {
+                    continue;
+                }
+                float cost = surfaceArea(box) * objects + rightArea[bin + 1] * rightCount[bin + 1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+    }
+
+    BuildObject* objects = b.objects.data();
+    if (bestCost < infinity) {
+        mid = uint32_t(std::partition(objects + begin, objects + end, [&](const BuildObject& object) {
+            return uint32_t(binIndices(object.centroid, range.centroids.min, scale)[bestAxis]) <= bestBin;
+        }) - objects);
+        return true;
+    }
+
+    // Too deep, or every centroid in one spot: halve along the widest axis.
+    Lanes extent = range.centroids.max - range.centroids.min;
+    uint32_t axis = extent[0] >= extent[1] && extent[0] >= extent[2] ? 0 : extent[1] >= extent[2] ? 1 : 2;
+    mid = begin + count / 2;
+    std::nth_element(objects + begin, objects + mid, objects + end, [&](const BuildObject& l, const BuildObject& r) {
+        return l.centroid[axis] < r.centroid[axis];
+    });
+    return true;
+}
+
+static uint32_t buildSubtree(BvhBuilder& b, std::vector<BuildNode>& tree, uint32_t begin, uint32_t end, uint32_t depth) {
+    uint32_t index = uint32_t(tree.size());
+    tree.push_back({emptyAabb(), 0, 0, begin, end - begin, noSubtree});
+
+    Aabb bounds;
+    uint32_t mid;
+    bool split = splitRange(b, begin, end, depth, false, bounds, mid);
+    tree[index].bounds = bounds;
+    if (!split) {
+        return index;
+    }
+    uint32_t left = buildSubtree(b, tree, begin, mid, depth + 1);
+    uint32_t right = buildSubtree(b, tree, mid, end, depth + 1);
+    tree[index].left = left;
+    tree[index].right = right;
+    tree[index].count = 0;
+    return index;
+}
+
+static uint32_t buildTop(BvhBuilder& b, uint32_t begin, uint32_t end, uint32_t depth) {
+    std::vector<BuildNode>& top = b.trees[0];
+    uint32_t index = uint32_t(top.size());
+    if (end - begin < b.parallelThreshold) {
+        top.push_back({emptyAabb(), 0, 0, begin, end - begin, uint32_t(b.tasks.size())});
+        b.tasks.push_back({begin, end, depth});
+        return index;
+    }
+    top.push_back({emptyAabb(), 0, 0, begin, end - begin, noSubtree});
+
+    Aabb bounds;
+    uint32_t mid;
+    bool split = splitRange(b, begin, end, depth, true, bounds, mid);
+    b.trees[0][index].bounds = bounds;
+    if (!split) {
+        return index;
+    }
+    uint32_t left = buildTop(b, begin, mid, depth + 1);
+    uint32_t right = buildTop(b, mid, end, depth + 1);
+    b.trees[0][index].left = left;
+    b.trees[0][index].right = right;
+    b.trees[0][index].count = 0;
+    return index;
+}
+
+struct BuildRef {
+    uint32_t tree, node;
+};
+
+static BuildRef resolve(const BvhBuilder& b, BuildRef ref) {
+    uint32_t subtree = b.trees[ref.tree][ref.node].subtree;
+    return subtree == noSubtree ? ref : BuildRef{1 + subtree, 0};
+}
+
+static const BuildNode& buildNode(const BvhBuilder& b, BuildRef ref) {
+    return b.trees[ref.tree][ref.node];
+}
+
+// Collapses the binary node and up to three levels below it into one
+// four-wide node, opening the largest child first, and emits it before its
+// children.
+static uint32_t emitNode(const BvhBuilder& b, BuildRef ref, uint32_t depth, std::vector<BvhNode>& nodes, uint32_t& maxDepth) {
+    ref = resolve(b, ref);
+    BuildRef children[4];
+    uint32_t childCount = 0;
+    if (buildNode(b, ref).count > 0) {
+        children[childCount++] = ref;
+    } else {
+        children[childCount++] = resolve(b, {ref.tree, buildNode(b, ref).left});
+        children[childCount++] = resolve(b, {ref.tree, buildNode(b, ref).right});
+        while (childCount < 4) {
+            uint32_t largest = 4;
+            float largestArea = -1.0f;
+            for (uint32_t i = 0; i < childCount; ++i) {
+                const BuildNode& child = buildNode(b, children[i]);
+                if (child.count == 0 && surfaceArea(child.bounds) > largestArea) {
+                    largest = i;
+                    largestArea = surfaceArea(child.bounds);
+                }
+            }
+            if (largest == 4) {
+                break;
+            }
+            const BuildNode& opened = buildNode(b, children[largest]);
+            uint32_t tree = children[largest].tree;
+            children[largest] = resolve(b, {tree, opened.left});
+            children[childCount++] = resolve(b, {tree, opened.right});
+        }
+    }
+
+    uint32_t index = uint32_t(nodes.size());
+    nodes.emplace_back();
+    for (uint32_t slot = 0; slot < 4; ++slot) {
+        setSlotBounds(nodes[index], slot, emptyAabb());
+        nodes[index].child[slot] = Bvh::emptySlot;
+        nodes[index].count[slot] = 0;
+    }
+    maxDepth = std::max(maxDepth, depth);
+
+    for (uint32_t slot = 0; slot < childCount; ++slot) {
+        const BuildNode& child = buildNode(b, children[slot]);
+        setSlotBounds(nodes[index], slot, child.bounds);
+        if (child.count > 0) {
+            nodes[index].child[slot] = child.first;
+            nodes[index].count[slot] = child.count;
+        } else {
+            uint32_t childIndex = emitNode(b, children[slot], depth + 1, nodes, maxDepth);
+            nodes[index].child[slot] = childIndex;
+        }
+    }
+    return index;
+}
+
+void Bvh::build(const Aabb* bounds, uint32_t count, JobSystem* jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    objects.resize(count);
+    positions.resize(count);
+    leafBounds.resize(count);
+    nodes.clear();
+    lastStats = {};
+    lastStats.objects = count;
+
+    if (count > 0) {
+        BvhBuilder b;
+        b.jobs = jobs;
+        b.parallelThreshold = jobs ? std::max(count / (jobs->threadCount() * 4), binningChunk) : ~0u;
+        b.objects.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            Lanes min = {bounds[i].min.x, bounds[i].min.y, bounds[i].min.z, 0.0f};
+            Lanes max = {bounds[i].max.x, bounds[i].max.y, bounds[i].max.z, 0.0f};
+            b.objects[i] = {{min, max}, (min + max) * 0.5f, i};
+        }
+
+        b.trees.emplace_back();
+        buildTop(b, 0, count, 0);
+        b.trees.resize(1 + b.tasks.size());
+        auto buildTasks = [&](uint32_t first, uint32_t last) {
+            for (uint32_t task = first; task < last; ++task) {
+                buildSubtree(b, b.trees[1 + task], b.tasks[task].begin, b.tasks[task].end, b.tasks[task].depth);
+            }
+        };
+        if (jobs) {
+            jobs->parallelFor(uint32_t(b.tasks.size()), 1, buildTasks);
+        } else {
+            buildTasks(0, uint32_t(b.tasks.size()));
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            objects[i] = b.objects[i].object;
+            positions[objects[i]] = i;
+            leafBounds[i] = bounds[objects[i]];
+        }
+        nodes.reserve(count / 2 + 1);
+        emitNode(b, {0, 0}, 1, nodes, lastStats.depth);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    lastStats.nodes = uint32_t(nodes.size());
+    lastStats.builtCost = lastStats.cost = sahCost();
+    lastStats.buildSeconds = std::chrono::duration<double>(end - start).count();
+}
+
+void Bvh::refit() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Children come after their parent, so walking backwards sees them first.
+    for (uint32_t n = uint32_t(nodes.size()); n-- > 0;) {
+        BvhNode& node = nodes[n];
+        for (uint32_t slot = 0; slot < 4; ++slot) {
+            if (node.child[slot] == emptySlot) {
+                continue;
+            }
+            Aabb box = emptyAabb();
+            if (node.count[slot] > 0) {
+                for (uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; ++i) {
+                    grow(box, leafBounds[i]);
+                }
+            } else {
+                const BvhNode& child = nodes[node.child[slot]];
+                for (uint32_t c = 0; c < 4; ++c) {
+                    grow(box, slotBounds(child, c));
+                }
+            }
+            setSlotBounds(node, slot, box);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    lastStats.cost = sahCost();
+    lastStats.refitSeconds = std::chrono::duration<double>(end - start).count();
+}
+
+// Expected cost of a query hitting a random point of the root, with node
+// and object tests costing the same.
+float Bvh::sahCost() const {
+    if (nodes.empty()) {
+        return 0.0f;
+    }
+    Aabb root = emptyAabb();
+    for (uint32_t slot = 0; slot < 4; ++slot) {
+        grow(root, slotBounds(nodes[0], slot));
+    }
+    double rootArea = surfaceArea(root);
+    if (rootArea <= 0.0) {
+        return 0.0f;
+    }
+
+    double cost = rootArea;
+    for (const BvhNode& node : nodes) {
+        for (uint32_t slot = 0; slot < 4; ++slot) {
+            if (node.child[slot] != emptySlot) {
+                cost += surfaceArea(slotBounds(node, slot)) * double(node.count[slot] > 0 ? node.count[slot] : 1);
+            }
+        }
+    }
+    return float(cost / rootArea);
+}
+
+void Bvh::overlapping(const Aabb& box, std::vector<uint32_t>& out) const {
+    if (nodes.empty()) {
+        return;
+    }
+    Lanes minX = splat(box.min.x), minY = splat(box.min.y), minZ = splat(box.min.z);
+    Lanes maxX = splat(box.max.x), maxY = splat(box.max.y), maxZ = splat(box.max.z);
+
+    uint32_t stack[maxStackSize];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = nodes[stack[--top]];
+        LaneMask hit = (loadLanes(node.minX) <= maxX) & (loadLanes(node.maxX) >= minX)
+                     & (loadLanes(node.minY) <= maxY) & (loadLanes(node.maxY) >= minY)
+                     & (loadLanes(node.minZ) <= maxZ) & (loadLanes(node.maxZ) >= minZ);
+        for (uint32_t bits = laneBits(hit); bits; bits &= bits - 1) {
+            uint32_t slot = uint32_t(__builtin_ctz(bits));
+            // Empty slots are inverted boxes, which an infinite query still overlaps.
+            if (node.child[slot] == emptySlot) {
+                continue;
+            }
+            if (node.count[slot] == 0) {
+                assert(top < maxStackSize);
+                stack[top++] = node.child[slot];
+                continue;
+            }
+            for (uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; ++i) {
+                if (boxesOverlap(leafBounds[i], box)) {
+                    out.push_back(objects[i]);
+                }
+            }
+        }
+    }
+}
+
+void Bvh::visible(const FrustumPlanes& frustum, std::vector<uint32_t>& out) const {
+    if (nodes.empty()) {
+        return;
+    }
+    Lanes planes[6][7];
+    for (int p = 0; p < 6; ++p) {
+        for (int i = 0; i < 4; ++i) {
+            planes[p][i] = splat(frustum.planes[p][i]);
+        }
+        for (int i = 0; i < 3; ++i) {
+            planes[p][4 + i] = splat(std::fabs(frustum.planes[p][i]));
+        }
+    }
+
+    uint32_t stack[maxStackSize];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BvhNode& node = nodes[stack[--top]];
+        Lanes minX = loadLanes(node.minX), minY = loadLanes(node.minY), minZ = loadLanes(node.minZ);
+        Lanes maxX = loadLanes(node.maxX), maxY = loadLanes(node.maxY), maxZ = loadLanes(node.maxZ);
+        Lanes x = (minX + maxX) * 0.5f, y = (minY + maxY) * 0.5f, z = (minZ + maxZ) * 0.5f;
+        Lanes ex = (maxX - minX) * 0.5f, ey = (maxY - minY) * 0.5f, ez = (maxZ - minZ) * 0.5f;
+        // Empty slots have a NaN center and fail every plane.
+        LaneMask inside = ~LaneMask{};
+        for (const Lanes* plane : planes) {
+            Lanes distance = plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+            Lanes reach = plane[4] * ex + plane[5] * ey + plane[6] * ez;
+            inside &= distance + reach >= 0.0f;
+        }
+        for (uint32_t bits = laneBits(inside); bits; bits &= bits - 1) {
+            uint32_t slot = uint32_t(__builtin_ctz(bits));
+            if (node.count[slot] == 0) {
+                assert(top < maxStackSize);
+                stack[top++] = node.child[slot];
+                continue;
+            }
+            for (uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; ++i) {
+                if (node.count[slot] == 1 || boxInFrustum(frustum, leafBounds[i])) {
+                    out.push_back(objects[i]);
+                }
+            }
+        }
+    }
+}
+
+uint32_t Bvh::raycast(const Float3& origin, const Float3& direction, float maxDistance, float* distance) const {
+    if (nodes.empty()) {
+        return noObject;
+    }
+    Float3 inverse = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+    Lanes originX = splat(origin.x), originY = splat(origin.y), originZ = splat(origin.z);
+    Lanes inverseX = splat(inverse.x), inverseY = splat(inverse.y), inverseZ = splat(inverse.z);
+
+    struct Entry {
+        uint32_t node;
+        float near;
+    };
+
+    uint32_t nearest = noObject;
+    float nearestDistance = maxDistance;
+    Entry stack[maxStackSize];
+    uint32_t top = 0;
+    stack[top++] = {0, 0.0f};
+    while (top > 0) {
+        Entry entry = stack[--top];
+        // Something nearer turned up since it was pushed.
+        if (entry.near > nearestDistance) {
+            continue;
+        }
+        const BvhNode& node = nodes[entry.node];
+        Lanes tx0 = (loadLanes(node.minX) - originX) * inverseX, tx1 = (loadLanes(node.maxX) - originX) * inverseX;
+        Lanes ty0 = (loadLanes(node.minY) - originY) * inverseY, ty1 = (loadLanes(node.maxY) - originY) * inverseY;
+        Lanes tz0 = (loadLanes(node.minZ) - originZ) * inverseZ, tz1 = (loadLanes(node.maxZ) - originZ) * inverseZ;
+        Lanes near = maxLanes(maxLanes(minLanes(tx0, tx1), minLanes(ty0, ty1)), maxLanes(minLanes(tz0, tz1), splat(0.0f)));
+        Lanes far = minLanes(minLanes(maxLanes(tx0, tx1), maxLanes(ty0, ty1)), minLanes(maxLanes(tz0, tz1), splat(nearestDistance)));
+
+        Entry children[4];
+        uint32_t childCount = 0;
+        for (uint32_t bits = laneBits(near <= far); bits; bits &= bits - 1) {
+            uint32_t slot = uint32_t(__builtin_ctz(bits));
+            // Empty slots span everything along a slab test.
+            if (node.child[slot] == emptySlot) {
+                continue;
+            }
+            if (node.count[slot] == 0) {
+                children[childCount++] = {node.child[slot], near[slot]};
+                continue;
+            }
+            for (uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; ++i) {
+                float t;
+                if (rayHitsBox(leafBounds[i], origin, inverse, nearestDistance, t) && (t < nearestDistance || nearest == noObject)) {
+                    nearest = objects[i];
+                    nearestDistance = t;
+                }
+            }
+        }
+        // Farthest first, so the nearest child is searched next.
+        for (uint32_t i = 1; i < childCount; ++i) {
+            for (uint32_t j = i; j > 0 && children[j - 1].near < children[j].near; --j) {
+                std::swap(children[j - 1], children[j]);
+            }
+        }
+        for (uint32_t i = 0; i < childCount; ++i) {
+            assert(top < maxStackSize);
+            stack[top++] = children[i];
+        }
+    }
+    if (nearest != noObject && distance) {
+        *distance = nearestDistance;
+    }
+    return nearest;
+}
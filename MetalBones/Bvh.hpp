@@ -0,0 +1,76 @@
+//
+//  Bvh.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GpuCulling.hpp"
+
+class JobSystem;
+
+// Four children per node, their boxes as separate coordinate arrays so one
+// node is tested in a single pass of four lanes. Two cache lines.
+struct alignas(64) BvhNode {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    uint32_t child[4];          // node index, first leaf object, or emptySlot
+    uint32_t count[4];          // objects in a leaf, 0 for a node
+};
+
+struct BvhStats {
+    uint32_t objects;
+    uint32_t nodes;
+    uint32_t depth;
+    float builtCost;            // SAH cost right after the last build
+    float cost;                 // and after the last refit
+    double buildSeconds;
+    double refitSeconds;
+};
+
+// Bounding volume hierarchy over object boxes for culling, picking and light
+// queries. Built top-down with binned SAH into a binary tree, then collapsed
+// into four-wide nodes laid out depth first, so children always come after
+// their parent and refit is one backward pass. Boxes of moving objects are
+// updated in place and refit; when that has pushed the SAH cost far enough
+// above what the build produced, shouldRebuild() says so.
+class Bvh {
+public:
+    static constexpr uint32_t emptySlot = ~0u;
+    static constexpr uint32_t noObject = ~0u;
+    static constexpr uint32_t maxLeafSize = 4;
+    static constexpr uint32_t binCount = 16;
+
+    // With jobs, the top levels bin in parallel and the subtrees below them
+    // build in parallel; the tree is the same either way.
+    void build(const Aabb* bounds, uint32_t count, JobSystem* jobs = nullptr);
+
+    void update(uint32_t object, const Aabb& bounds) { leafBounds[positions[object]] = bounds; }
+    void refit();
+    bool shouldRebuild(float tolerance = 1.3f) const { return lastStats.cost > lastStats.builtCost * tolerance; }
+
+    // Append object indices to `out`, in no particular order.
+    void overlapping(const Aabb& box, std::vector<uint32_t>& out) const;
+    void visible(const FrustumPlanes& frustum, std::vector<uint32_t>& out) const;
+    // The object whose box the ray enters first, noObject when none within
+    // `maxDistance`. `direction` needn't be normalized; distances are in its units.
+    uint32_t raycast(const Float3& origin, const Float3& direction, float maxDistance, float* distance = nullptr) const;
+
+    uint32_t size() const { return uint32_t(objects.size()); }
+    const std::vector<BvhNode>& flattened() const { return nodes; }
+    const BvhStats& stats() const { return lastStats; }
+
+private:
+    float sahCost() const;
+
+    // Leaves are ranges of these; bounds are kept in the same order so that
+    // refit and leaf tests read them front to back.
+    std::vector<uint32_t> objects;
+    std::vector<Aabb> leafBounds;
+    std::vector<uint32_t> positions;    // of each object in `objects`
+    std::vector<BvhNode> nodes;         // root first
+    BvhStats lastStats = {};
+};
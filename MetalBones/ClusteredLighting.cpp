@@ -0,0 +1,69 @@
+//
+//  ClusteredLighting.cpp
+//  MetalBones
+//
+
+#include "ClusteredLighting.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static size_t alignUp(size_t offset) {
+    return (offset + 15) & ~size_t(15);
+}
+
+ClusteredLighting::ClusteredLighting(MTL::Device* device, uint32_t tilesX, uint32_t tilesY, uint32_t slices,
+                                     uint32_t framesInFlight)
+    : device(device->retain())
+    , grid(tilesX, tilesY, slices)
+{
+    uploads.resize(std::max(framesInFlight, 1u), Upload{nullptr, 0});
+}
+
+ClusteredLighting::~ClusteredLighting() {
+    for (Upload& upload : uploads) {
+        if (upload.buffer) {
+            upload.buffer->release();
+        }
+    }
+    device->release();
+}
+
+void ClusteredLighting::update(const Float4x4& view, const PointLight* lights, uint32_t count, JobSystem* jobs) {
+    grid.assign(view, lights, count, jobs);
+
+    // Constants, lights, cluster ranges and index lists, each on a 16 byte boundary.
+    const uint32_t indexCount = grid.stats().indices;
+    lightsOffset = alignUp(sizeof(LightClusterConstants));
+    clustersOffset = alignUp(lightsOffset + size_t(count) * sizeof(PointLight));
+    indicesOffset = alignUp(clustersOffset + size_t(grid.clusterCount()) * sizeof(LightCluster));
+    // Never empty, so every buffer binding has something behind it.
+    const size_t length = indicesOffset + std::max<size_t>(indexCount, 1) * sizeof(uint16_t);
+
+    Upload& upload = uploads[uploadIndex];
+    uploadIndex = (uploadIndex + 1) % uploads.size();
+
+    if (upload.capacity < length) {
+        if (upload.buffer) {
+            upload.buffer->release();
+        }
+        // Grow geometrically so a few more lights don't reallocate every frame.
+        upload.capacity = std::max(length, upload.capacity * 2);
+        upload.buffer = device->newBuffer(upload.capacity, MTL::ResourceStorageModeManaged);
+    }
+
+    uint8_t* contents = static_cast<uint8_t*>(upload.buffer->contents());
+    memcpy(contents, &grid.constants(), sizeof(LightClusterConstants));
+    memcpy(contents + lightsOffset, lights, count * sizeof(PointLight));
+    memcpy(contents + clustersOffset, grid.clusters(), grid.clusterCount() * sizeof(LightCluster));
+    memcpy(contents + indicesOffset, grid.lightIndices(), indexCount * sizeof(uint16_t));
+    upload.buffer->didModifyRange(NS::Range::Make(0, length));
+    current = upload.buffer;
+}
+
+void ClusteredLighting::bind(MTL::RenderCommandEncoder* encoder) {
+    encoder->setFragmentBuffer(current, 0, lightConstantsIndex);
+    encoder->setFragmentBuffer(current, lightsOffset, lightBufferIndex);
+    encoder->setFragmentBuffer(current, clustersOffset, lightClusterIndex);
+    encoder->setFragmentBuffer(current, indicesOffset, lightIndexListIndex);
+}
@@ -0,0 +1,56 @@
+//
+//  ClusteredLighting.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <vector>
+
+#include "LightClusters.hpp"
+
+// Fragment buffer indices of the light data; match general.metal.
+constexpr NS::UInteger lightConstantsIndex = 10;
+constexpr NS::UInteger lightBufferIndex = 11;
+constexpr NS::UInteger lightClusterIndex = 12;
+constexpr NS::UInteger lightIndexListIndex = 13;
+
+// Assigns point lights to clusters on the CPU every frame and hands the
+// result to fragmentMain: the lights, every cluster's range and the index
+// lists they point into, packed into one upload buffer. Upload buffers
+// rotate, so at most `framesInFlight` command buffers may be in flight at once.
+class ClusteredLighting {
+public:
+    ClusteredLighting(MTL::Device* device, uint32_t tilesX = 16, uint32_t tilesY = 9, uint32_t slices = 24,
+                      uint32_t framesInFlight = 3);
+    ~ClusteredLighting();
+
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    void setProjection(float fovY, float aspect, float zNear, float zFar) { grid.setProjection(fovY, aspect, zNear, zFar); }
+
+    // Once per frame, before bind().
+    void update(const Float4x4& view, const PointLight* lights, uint32_t count, JobSystem* jobs = nullptr);
+    void bind(MTL::RenderCommandEncoder* encoder);
+
+    const LightClusterStats& stats() const { return grid.stats(); }
+
+private:
+    struct Upload {
+        MTL::Buffer* buffer;
+        size_t capacity;
+    };
+
+    MTL::Device* device;
+    LightClusterGrid grid;
+
+    std::vector<Upload> uploads;
+    uint32_t uploadIndex = 0;
+    MTL::Buffer* current = nullptr;
+    size_t lightsOffset = 0;
+    size_t clustersOffset = 0;
+    size_t indicesOffset = 0;
+};
@@ -0,0 +1,39 @@
+//
+//  DeferredRelease.cpp
+//  MetalBones
+//
+
+#include "DeferredRelease.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+DeferredReleaseQueue::~DeferredReleaseQueue() {
+    assert(entries.empty() && "flush() once the GPU is idle");
+}
+
+void DeferredReleaseQueue::push(void* object, void (*release)(void*), uint64_t frame) {
+    assert(entries.empty() || entries.back().frame <= frame);
+
+    entries.push_back({object, release, frame});
+    counters.queued++;
+    counters.pending = uint32_t(entries.size());
+    counters.peakPending = std::max(counters.peakPending, counters.pending);
+}
+
+uint32_t DeferredReleaseQueue::collect(uint64_t completedFrame) {
+    uint32_t count = 0;
+    while (!entries.empty() && entries.front().frame <= completedFrame) {
+        Entry entry = entries.front();
+        entries.pop_front();
+        entry.release(entry.object);
+        count++;
+    }
+    counters.released += count;
+    counters.pending = uint32_t(entries.size());
+    return count;
+}
+
+uint32_t DeferredReleaseQueue::flush() {
+    return collect(~uint64_t(0));
+}
@@ -0,0 +1,61 @@
+//
+//  DeferredRelease.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+struct DeferredReleaseStats {
+    uint64_t queued;
+    uint64_t released;
+    uint32_t pending;
+    uint32_t peakPending;
+};
+
+// Holds the last reference of objects that in-flight command buffers may
+// still use, and drops it once the frame that last used them has completed.
+// Works with anything that has release(): metal-cpp objects, or SharedPtr-like
+// handles that can detach() their reference.
+class DeferredReleaseQueue {
+public:
+    DeferredReleaseQueue() = default;
+    ~DeferredReleaseQueue();
+
+    DeferredReleaseQueue(const DeferredReleaseQueue&) = delete;
+    DeferredReleaseQueue& operator=(const DeferredReleaseQueue&) = delete;
+
+    // Takes over one reference; `lastUsedFrame` must not decrease between calls.
+    template <typename Object>
+    void release(Object* object, uint64_t lastUsedFrame) {
+        if (object) {
+            push(object, [](void* o) { static_cast<Object*>(o)->release(); }, lastUsedFrame);
+        }
+    }
+
+    template <template <typename> class Pointer, typename Object>
+    void release(Pointer<Object>&& pointer, uint64_t lastUsedFrame) {
+        release(pointer.detach(), lastUsedFrame);
+    }
+
+    // Releases everything last used in a frame <= completedFrame; returns how many.
+    uint32_t collect(uint64_t completedFrame);
+    // Releases everything, only once the GPU is idle.
+    uint32_t flush();
+
+    const DeferredReleaseStats& stats() const { return counters; }
+
+private:
+    struct Entry {
+        void* object;
+        void (*release)(void* object);
+        uint64_t frame;
+    };
+
+    void push(void* object, void (*release)(void*), uint64_t frame);
+
+    std::deque<Entry> entries;
+    DeferredReleaseStats counters = {};
+};
@@ -0,0 +1,106 @@
+//
+//  DemoScene.cpp
+//  MetalBones
+//
+
+#include "DemoScene.hpp"
+
+#include <simd/simd.h>
+
+#include <cmath>
+
+#include "Renderer.hpp"
+
+DemoScene::DemoScene(Renderer& renderer)
+    : renderer(renderer)
+{
+    buildLattice();
+    buildLights();
+}
+
+void DemoScene::buildLattice() {
+    GpuDrivenScene* scene = renderer.gpuDrivenScene();
+    if (!scene) {
+        return;
+    }
+
+    // vertexMain's layout without skinning.
+    struct Vertex {
+        simd::float3 position;
+        simd::float3 color;
+    };
+
+    // A unit cube with one color per face, each face spanned by u and v
+    // around its center.
+    struct Face {
+        simd::float3 center, u, v, color;
+    };
+    const float s = 0.5f;
+    const Face faces[] = {
+        {{0, 0, +s}, {+s, 0, 0}, {0, +s, 0}, {1.0f, 0.0f, 0.0f}},   // front
+        {{+s, 0, 0}, {0, 0, -s}, {0, +s, 0}, {0.0f, 1.0f, 0.0f}},   // right
+        {{0, 0, -s}, {-s, 0, 0}, {0, +s, 0}, {0.0f, 0.0f, 1.0f}},   // back
+        {{-s, 0, 0}, {0, 0, +s}, {0, +s, 0}, {1.0f, 0.4f, 0.0f}},   // left
+        {{0, +s, 0}, {+s, 0, 0}, {0, 0, -s}, {1.0f, 0.0f, 1.0f}},   // top
+        {{0, -s, 0}, {+s, 0, 0}, {0, 0, +s}, {0.0f, 1.0f, 1.0f}},   // bottom
+    };
+
+    Vertex vertices[24];
+    uint16_t indices[36];
+    for (uint32_t f = 0; f < 6; ++f) {
+        const Face& face = faces[f];
+        vertices[f * 4 + 0] = {face.center - face.u - face.v, face.color};
+        vertices[f * 4 + 1] = {face.center + face.u - face.v, face.color};
+        vertices[f * 4 + 2] = {face.center + face.u + face.v, face.color};
+        vertices[f * 4 + 3] = {face.center - face.u + face.v, face.color};
+
+        const uint16_t quad[] = {0, 1, 2, 2, 3, 0};
+        for (uint32_t i = 0; i < 6; ++i) {
+            indices[f * 6 + i] = uint16_t(f * 4 + quad[i]);
+        }
+    }
+    uint32_t cube = scene->addMesh(vertices, 24, indices, 36);
+
+    // More than half of it is outside the view at any time.
+    const uint32_t gridSize = 12;
+    const float spacing = 0.25f, scale = 0.08f;
+    for (uint32_t i = 0; i < gridSize * gridSize * gridSize; ++i) {
+        simd::float3 center = {
+            (float(i % gridSize) - gridSize * 0.5f) * spacing,
+            (float(i / gridSize % gridSize) - gridSize * 0.5f) * spacing,
+            (float(i / (gridSize * gridSize)) - gridSize * 0.5f) * spacing,
+        };
+        simd::float4x4 transform = matrix_identity_float4x4;
+        transform.columns[0].x = transform.columns[1].y = transform.columns[2].z = scale;
+        transform.columns[3] = simd_make_float4(center, 1.0f);
+
+        uint32_t object = renderer.addObject(transform);
+        scene->addObject(cube, {center.x, center.y, center.z, scale * s * std::sqrt(3.0f)}, object);
+    }
+}
+
+void DemoScene::buildLights() {
+    // Small colored lights scattered through the volume the lattice fills.
+    const uint32_t lightCount = 512;
+    uint32_t seed = 1;
+    auto random = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return float(seed >> 8) / float(1u << 24);
+    };
+    std::vector<PointLight>& lights = renderer.pointLights();
+    firstLight = uint32_t(lights.size());
+    for (uint32_t i = 0; i < lightCount; ++i) {
+        Float3 origin = {random() * 3.0f - 1.5f, random() * 3.0f - 1.5f, random() * 3.0f - 1.5f};
+        lightOrigins.push_back(origin);
+        lights.push_back({origin, 0.2f + random() * 0.3f, {random(), random(), random()}, 1.5f});
+    }
+}
+
+void DemoScene::update() {
+    float t = renderer.time();
+    std::vector<PointLight>& lights = renderer.pointLights();
+    for (uint32_t i = 0; i < lightOrigins.size(); ++i) {
+        float phase = t + float(i) * 0.37f;
+        lights[firstLight + i].position = lightOrigins[i] + Float3{std::sin(phase), std::cos(phase * 0.7f), std::sin(phase * 1.3f)} * 0.2f;
+    }
+}
@@ -0,0 +1,31 @@
+//
+//  DemoScene.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <vector>
+
+#include "LightClusters.hpp"
+
+class Renderer;
+
+// What the app shows besides the renderer's own cube: a lattice of small
+// cubes for the GPU-driven scene to cull, when the device has bindless
+// support, and point lights drifting through the same volume.
+class DemoScene {
+public:
+    explicit DemoScene(Renderer& renderer);
+
+    // Before each Renderer::draw().
+    void update();
+
+private:
+    void buildLattice();
+    void buildLights();
+
+    Renderer& renderer;
+    uint32_t firstLight = 0;    // in Renderer::pointLights()
+    std::vector<Float3> lightOrigins;
+};
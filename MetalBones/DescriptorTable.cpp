@@ -0,0 +1,63 @@
+//
+//  DescriptorTable.cpp
+//  MetalBones
+//
+
+#include "DescriptorTable.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+DescriptorTable::DescriptorTable(uint32_t capacity)
+    : used(capacity, false)
+{
+    freeSlots.reserve(capacity);
+    for (uint32_t slot = capacity; slot-- > 0;) {
+        freeSlots.push_back(slot);
+    }
+    counters.capacity = capacity;
+}
+
+uint32_t DescriptorTable::allocate() {
+    if (freeSlots.empty()) {
+        counters.failures++;
+        return invalidSlot;
+    }
+    uint32_t slot = freeSlots.back();
+    freeSlots.pop_back();
+    used[slot] = true;
+
+    counters.allocations++;
+    counters.live++;
+    counters.peakLive = std::max(counters.peakLive, counters.live);
+    return slot;
+}
+
+void DescriptorTable::release(uint32_t slot, uint64_t lastUsedFrame) {
+    assert(live(slot));
+    assert(retired.empty() || retired.back().frame <= lastUsedFrame);
+
+    used[slot] = false;
+    retired.push_back({slot, lastUsedFrame});
+    counters.live--;
+    counters.retiring = uint32_t(retired.size());
+}
+
+uint32_t DescriptorTable::replace(uint32_t slot, uint64_t lastUsedFrame) {
+    uint32_t fresh = allocate();
+    if (fresh != invalidSlot) {
+        release(slot, lastUsedFrame);
+    }
+    return fresh;
+}
+
+uint32_t DescriptorTable::collect(uint64_t completedFrame) {
+    uint32_t count = 0;
+    while (!retired.empty() && retired.front().frame <= completedFrame) {
+        freeSlots.push_back(retired.front().slot);
+        retired.pop_front();
+        count++;
+    }
+    counters.retiring = uint32_t(retired.size());
+    return count;
+}
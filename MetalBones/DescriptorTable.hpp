@@ -0,0 +1,60 @@
+//
+//  DescriptorTable.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct DescriptorTableStats {
+    uint32_t capacity;
+    uint32_t live;
+    uint32_t retiring;
+    uint32_t peakLive;
+    uint64_t allocations;
+    uint64_t failures;          // allocations that found the table full
+};
+
+// Slots of a GPU-visible table that shaders index into. A released slot
+// isn't handed out again until the last frame that may read it has
+// completed, so allocating a slot and writing it never races the GPU. The
+// flip side is that a live slot must not be rewritten: replace() moves the
+// entry to a fresh slot instead.
+class DescriptorTable {
+public:
+    static constexpr uint32_t invalidSlot = ~0u;
+
+    explicit DescriptorTable(uint32_t capacity);
+
+    // invalidSlot when every slot is live or retiring.
+    uint32_t allocate();
+    // `lastUsedFrame` must not decrease between calls.
+    void release(uint32_t slot, uint64_t lastUsedFrame);
+    // A fresh slot for new contents, with `slot` retiring; invalidSlot, and
+    // `slot` left as it was, when the table is full.
+    uint32_t replace(uint32_t slot, uint64_t lastUsedFrame);
+
+    // Recycles slots last used in a frame <= completedFrame; returns how many.
+    uint32_t collect(uint64_t completedFrame);
+
+    bool live(uint32_t slot) const { return slot < used.size() && used[slot]; }
+    uint32_t capacity() const { return uint32_t(used.size()); }
+
+    const DescriptorTableStats& stats() const { return counters; }
+
+private:
+    struct Retired {
+        uint32_t slot;
+        uint64_t frame;
+    };
+
+    // Taken from the back: recycled slots first, then the lowest unused one,
+    // so the live part of the table stays dense.
+    std::vector<uint32_t> freeSlots;
+    std::deque<Retired> retired;
+    std::vector<bool> used;
+    DescriptorTableStats counters = {};
+};
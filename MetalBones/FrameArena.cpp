@@ -0,0 +1,88 @@
+//
+//  FrameArena.cpp
+//  MetalBones
+//
+
+#include "FrameArena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#include "JobSystem.hpp"
+
+FrameArena::FrameArena(uint32_t threadCount, size_t blockSize)
+    : blockSize(blockSize)
+    , threads(std::max(threadCount, 1u))
+{
+}
+
+FrameArena::~FrameArena() {
+    for (ThreadArena& arena : threads) {
+        for (Block& block : arena.blocks) {
+            std::free(block.data);
+        }
+    }
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+    assert(JobSystem::threadIndex() < threads.size() && "arena has fewer slots than the job system has threads");
+
+    ThreadArena& arena = threads[JobSystem::threadIndex()];
+    if (arena.current < arena.blocks.size()) {
+        Block& block = arena.blocks[arena.current];
+        uintptr_t address = reinterpret_cast<uintptr_t>(block.data) + arena.offset;
+        size_t padding = (alignment - (address & (alignment - 1))) & (alignment - 1);
+        if (arena.offset + padding + size <= block.size) {
+            arena.offset += padding + size;
+            arena.used += padding + size;
+            return reinterpret_cast<void*>(address + padding);
+        }
+    }
+    return allocateSlow(arena, size, alignment);
+}
+
+void* FrameArena::allocateSlow(ThreadArena& arena, size_t size, size_t alignment) {
+    // The tail of the current block is abandoned until the next reset.
+    if (arena.current < arena.blocks.size()) {
+        arena.used += arena.blocks[arena.current].size - arena.offset;
+        arena.current++;
+    }
+
+    // Reuse blocks kept from earlier frames before asking for a new one.
+    while (arena.current < arena.blocks.size() && arena.blocks[arena.current].size < size + alignment) {
+        arena.used += arena.blocks[arena.current].size;
+        arena.current++;
+    }
+    if (arena.current == arena.blocks.size()) {
+        size_t bytes = std::max(blockSize, size + alignment);
+        arena.blocks.push_back({static_cast<uint8_t*>(std::malloc(bytes)), bytes});
+    }
+
+    arena.offset = 0;
+    return allocate(size, alignment);
+}
+
+void FrameArena::reset() {
+    size_t used = 0;
+    for (ThreadArena& arena : threads) {
+        used += arena.used;
+        arena.current = 0;
+        arena.offset = 0;
+        arena.used = 0;
+    }
+    highWaterMark = std::max(highWaterMark, used);
+}
+
+FrameArenaStats FrameArena::stats() const {
+    FrameArenaStats stats = {};
+    for (const ThreadArena& arena : threads) {
+        stats.bytesThisFrame += arena.used;
+        stats.blocks += uint32_t(arena.blocks.size());
+        for (const Block& block : arena.blocks) {
+            stats.reservedBytes += block.size;
+        }
+    }
+    stats.highWaterMark = std::max(highWaterMark, stats.bytesThisFrame);
+    return stats;
+}
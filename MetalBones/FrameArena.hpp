@@ -0,0 +1,84 @@
+//
+//  FrameArena.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct FrameArenaStats {
+    size_t bytesThisFrame;
+    size_t highWaterMark;       // largest single frame so far, all threads together
+    size_t reservedBytes;
+    uint32_t blocks;
+};
+
+// Linear allocator for data that dies at the end of the frame. Every thread
+// of a JobSystem bumps its own chain of blocks, picked by
+// JobSystem::threadIndex(), so allocating never takes a lock. reset() rewinds
+// all threads at once and keeps the blocks for the next frame; it must not
+// run while other threads allocate.
+class FrameArena {
+public:
+    explicit FrameArena(uint32_t threadCount, size_t blockSize = 1 << 20);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocateArray(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+    void reset();
+
+    FrameArenaStats stats() const;
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t size;
+    };
+
+    // Own cache line each, threads bump their offsets constantly.
+    struct alignas(64) ThreadArena {
+        std::vector<Block> blocks;
+        uint32_t current = 0;
+        size_t offset = 0;
+        size_t used = 0;        // bytes handed out this frame, including padding
+    };
+
+    void* allocateSlow(ThreadArena& arena, size_t size, size_t alignment);
+
+    size_t blockSize;
+    std::vector<ThreadArena> threads;
+    size_t highWaterMark = 0;
+};
+
+// Lets standard containers live in the arena; deallocate() is a no-op, the
+// memory comes back on the next reset().
+template <typename T>
+struct FrameAllocator {
+    using value_type = T;
+
+    FrameArena* arena;
+
+    explicit FrameAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocateArray<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
@@ -0,0 +1,181 @@
+//
+//  FrustumCulling.cpp
+//  MetalBones
+//
+
+#include "FrustumCulling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "JobSystem.hpp"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// A block of eight boxes is one AVX register, or two SSE/NEON ones.
+#if defined(__AVX__)
+typedef __m256 Lanes;
+#else
+typedef float Lanes __attribute__((vector_size(16)));
+typedef int32_t LaneMask __attribute__((vector_size(16)));
+#endif
+static constexpr uint32_t laneCount = sizeof(Lanes) / sizeof(float);
+
+static inline Lanes loadLanes(const float* p) {
+#if defined(__AVX__)
+    return _mm256_loadu_ps(p);
+#else
+    Lanes v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#endif
+}
+
+static inline Lanes splat(float v) {
+#if defined(__AVX__)
+    return _mm256_set1_ps(v);
+#else
+    return Lanes{} + v;
+#endif
+}
+
+// Per plane: normal, distance and absolute normal.
+typedef Lanes PlaneLanes[6][7];
+
+// A box is outside a plane when its center is further behind it than the
+// box reaches along the normal. Bit i is set for lane i inside all six.
+static inline uint32_t insideBits(const PlaneLanes& planes, const float* const fields[6], uint32_t i) {
+    Lanes x = loadLanes(fields[0] + i), y = loadLanes(fields[1] + i), z = loadLanes(fields[2] + i);
+    Lanes ex = loadLanes(fields[3] + i), ey = loadLanes(fields[4] + i), ez = loadLanes(fields[5] + i);
+#if defined(__AVX__)
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const Lanes* plane : planes) {
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane[0], x), _mm256_mul_ps(plane[1], y)),
+                                        _mm256_add_ps(_mm256_mul_ps(plane[2], z), plane[3]));
+        __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(plane[4], ex), _mm256_mul_ps(plane[5], ey)),
+                                     _mm256_mul_ps(plane[6], ez));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+    }
+    return uint32_t(_mm256_movemask_ps(inside));
+#else
+    LaneMask inside = ~LaneMask{};
+    for (const Lanes* plane : planes) {
+        Lanes distance = (plane[0] * x + plane[1] * y) + (plane[2] * z + plane[3]);
+        Lanes reach = (plane[4] * ex + plane[5] * ey) + plane[6] * ez;
+        inside &= distance + reach >= 0.0f;
+    }
+#if defined(__SSE2__)
+    return uint32_t(_mm_movemask_ps((__m128)inside));
+#elif defined(__ARM_NEON)
+    const uint32x4_t weights = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32((uint32x4_t)inside, weights));
+#else
+    return uint32_t(inside[0] & 1) | uint32_t(inside[1] & 2) | uint32_t(inside[2] & 4) | uint32_t(inside[3] & 8);
+#endif
+#endif
+}
+
+uint32_t FrustumCuller::add(const Float3& center, const Float3& extents) {
+    uint32_t index = count++;
+    if (index % lanes == 0) {
+        for (std::vector<float>* field : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) {
+            field->resize(field->size() + lanes, 0.0f);
+        }
+    }
+    set(index, center, extents);
+    return index;
+}
+
+void FrustumCuller::set(uint32_t index, const Float3& center, const Float3& extents) {
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = extents.x;
+    extentY[index] = extents.y;
+    extentZ[index] = extents.z;
+}
+
+void FrustumCuller::clear() {
+    for (std::vector<float>* field : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) {
+        field->clear();
+    }
+    count = 0;
+}
+
+uint32_t FrustumCuller::cullChunk(const FrustumPlanes& frustum, uint32_t begin, uint32_t end, uint32_t* out) const {
+    PlaneLanes planes;
+    for (int p = 0; p < 6; ++p) {
+        for (int i = 0; i < 4; ++i) {
+            planes[p][i] = splat(frustum.planes[p][i]);
+        }
+        for (int i = 0; i < 3; ++i) {
+            planes[p][4 + i] = splat(std::fabs(frustum.planes[p][i]));
+        }
+    }
+    const float* const fields[6] = {
+        centerX.data(), centerY.data(), centerZ.data(), extentX.data(), extentY.data(), extentZ.data(),
+    };
+
+    uint32_t visible = 0;
+    for (uint32_t i = begin; i < end; i += lanes) {
+        uint32_t bits = 0;
+        for (uint32_t lane = 0; lane < lanes; lane += laneCount) {
+            bits |= insideBits(planes, fields, i + lane) << lane;
+        }
+        if (end - i < lanes) {
+            bits &= (1u << (end - i)) - 1;
+        }
+        // Branch-free: store every index, only advance past visible ones.
+        for (uint32_t lane = 0; lane < lanes; ++lane) {
+            out[visible] = i + lane;
+            visible += bits >> lane & 1;
+        }
+    }
+    return visible;
+}
+
+uint32_t FrustumCuller::cull(const FrustumPlanes& frustum, JobSystem* jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t chunks = (count + chunkSize - 1) / chunkSize;
+    // Whole blocks are written, padding included.
+    if (visibleIndices.size() < centerX.size()) {
+        visibleIndices.resize(centerX.size());
+    }
+    chunkVisible.resize(chunks);
+
+    auto cullChunks = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t chunk = begin; chunk < end; ++chunk) {
+            uint32_t first = chunk * chunkSize;
+            uint32_t last = std::min(first + chunkSize, count);
+            chunkVisible[chunk] = cullChunk(frustum, first, last, &visibleIndices[first]);
+        }
+    };
+    if (jobs) {
+        jobs->parallelFor(chunks, 1, cullChunks);
+    } else {
+        cullChunks(0, chunks);
+    }
+
+    // Chunk c wrote from c * chunkSize on; slide each down behind the previous one.
+    uint32_t visible = 0;
+    for (uint32_t chunk = 0; chunk < chunks; ++chunk) {
+        uint32_t* from = &visibleIndices[chunk * chunkSize];
+        if (visible != chunk * chunkSize) {
+            memmove(&visibleIndices[visible], from, chunkVisible[chunk] * sizeof(uint32_t));
+        }
+        visible += chunkVisible[chunk];
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    lastStats = {count, visible, chunks, std::chrono::duration<double>(end - start).count()};
+    return visible;
+}
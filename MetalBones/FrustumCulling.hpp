@@ -0,0 +1,59 @@
+//
+//  FrustumCulling.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GpuCulling.hpp"
+
+class JobSystem;
+
+struct FrustumCullingStats {
+    uint32_t objects;
+    uint32_t visible;
+    uint32_t chunks;
+    double seconds;
+
+    double objectsPerMillisecond() const { return seconds > 0.0 ? objects / (seconds * 1e3) : 0.0; }
+};
+
+// World-space boxes, stored as separate center and extent arrays, tested
+// against the six planes eight at a time. Jobs cull fixed chunks into their
+// own part of the output and the chunks are then packed together, so the
+// visible list is in index order whatever the thread count.
+class FrustumCuller {
+public:
+    static constexpr uint32_t lanes = 8;
+    static constexpr uint32_t chunkSize = 4096;     // objects per job
+
+    uint32_t add(const Float3& center, const Float3& extents);
+    // Bounding spheres go in as the cube around them.
+    uint32_t addSphere(const Float3& center, float radius) { return add(center, {radius, radius, radius}); }
+    void set(uint32_t index, const Float3& center, const Float3& extents);
+    void clear();
+
+    uint32_t size() const { return count; }
+
+    // Returns how many boxes touch the frustum; visible() lists them in
+    // ascending order until the next cull.
+    uint32_t cull(const FrustumPlanes& frustum, JobSystem* jobs = nullptr);
+
+    const uint32_t* visible() const { return visibleIndices.data(); }
+    const FrustumCullingStats& stats() const { return lastStats; }
+
+private:
+    uint32_t cullChunk(const FrustumPlanes& frustum, uint32_t begin, uint32_t end, uint32_t* out) const;
+
+    // Padded to a multiple of `lanes` with boxes that never pass.
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    uint32_t count = 0;
+
+    std::vector<uint32_t> visibleIndices;       // room for every block, only ever grows
+    std::vector<uint32_t> chunkVisible;
+    FrustumCullingStats lastStats = {};
+};
@@ -0,0 +1,127 @@
+//
+//  GpuCulling.cpp
+//  MetalBones
+//
+
+#include "GpuCulling.hpp"
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef float Lanes __attribute__((vector_size(16)));
+typedef int32_t LaneMask __attribute__((vector_size(16)));
+
+FrustumPlanes frustumPlanes(const Float4x4& viewProjection) {
+    // Rows of the column-major matrix.
+    const float* m = viewProjection.m;
+    float rows[4][4];
+    for (int row = 0; row < 4; ++row) {
+        for (int column = 0; column < 4; ++column) {
+            rows[row][column] = m[column * 4 + row];
+        }
+    }
+
+    FrustumPlanes frustum;
+    for (int i = 0; i < 4; ++i) {
+        frustum.planes[0][i] = rows[3][i] + rows[0][i];
+        frustum.planes[1][i] = rows[3][i] - rows[0][i];
+        frustum.planes[2][i] = rows[3][i] + rows[1][i];
+        frustum.planes[3][i] = rows[3][i] - rows[1][i];
+        frustum.planes[4][i] = rows[2][i];
+        frustum.planes[5][i] = rows[3][i] - rows[2][i];
+    }
+    for (float* plane : frustum.planes) {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        float inv = length > 0.0f ? 1.0f / length : 0.0f;
+        for (int i = 0; i < 4; ++i) {
+            plane[i] *= inv;
+        }
+    }
+    return frustum;
+}
+
+static inline bool sphereVisible(const FrustumPlanes& frustum, const CullSphere& sphere) {
+    for (const float* plane : frustum.planes) {
+        if (plane[0] * sphere.x + plane[1] * sphere.y + plane[2] * sphere.z + plane[3] < -sphere.radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t cullDrawsScalar(const FrustumPlanes& frustum, const CullSphere* spheres, const CullDraw* draws,
+                         uint32_t count, CullDraw* out) {
+    uint32_t visible = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (sphereVisible(frustum, spheres[i])) {
+            out[visible++] = draws[i];
+        }
+    }
+    return visible;
+}
+
+// Four spheres as x, y, z and radius lanes.
+static inline void loadSpheres(const CullSphere* spheres, Lanes& x, Lanes& y, Lanes& z, Lanes& r) {
+#if defined(__SSE2__)
+    __m128 a = _mm_loadu_ps(&spheres[0].x);
+    __m128 b = _mm_loadu_ps(&spheres[1].x);
+    __m128 c = _mm_loadu_ps(&spheres[2].x);
+    __m128 d = _mm_loadu_ps(&spheres[3].x);
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    x = (Lanes)a;
+    y = (Lanes)b;
+    z = (Lanes)c;
+    r = (Lanes)d;
+#elif defined(__ARM_NEON)
+    float32x4x4_t lanes = vld4q_f32(&spheres[0].x);
+    x = (Lanes)lanes.val[0];
+    y = (Lanes)lanes.val[1];
+    z = (Lanes)lanes.val[2];
+    r = (Lanes)lanes.val[3];
+#else
+    for (int i = 0; i < 4; ++i) {
+        x[i] = spheres[i].x;
+        y[i] = spheres[i].y;
+        z[i] = spheres[i].z;
+        r[i] = spheres[i].radius;
+    }
+#endif
+}
+
+uint32_t cullDrawsSimd(const FrustumPlanes& frustum, const CullSphere* spheres, const CullDraw* draws,
+                       uint32_t count, CullDraw* out) {
+    Lanes planeLanes[6][4];
+    for (int p = 0; p < 6; ++p) {
+        for (int i = 0; i < 4; ++i) {
+            float v = frustum.planes[p][i];
+            planeLanes[p][i] = Lanes{v, v, v, v};
+        }
+    }
+
+    uint32_t visible = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        Lanes x, y, z, r;
+        loadSpheres(spheres + i, x, y, z, r);
+        Lanes negativeRadius = -r;
+        LaneMask inside = {-1, -1, -1, -1};
+        for (const Lanes* plane : planeLanes) {
+            Lanes distance = plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+            inside &= distance >= negativeRadius;
+        }
+        // Branch-free compaction: always store, only advance past visible ones.
+        for (int lane = 0; lane < 4; ++lane) {
+            out[visible] = draws[i + lane];
+            visible += uint32_t(inside[lane]) & 1;
+        }
+    }
+    for (; i < count; ++i) {
+        if (sphereVisible(frustum, spheres[i])) {
+            out[visible++] = draws[i];
+        }
+    }
+    return visible;
+}
@@ -0,0 +1,45 @@
+//
+//  GpuCulling.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "Math.hpp"
+
+// Layouts shared with shaders/culling.metal.
+
+// World space bounding sphere.
+struct CullSphere {
+    float x, y, z, radius;
+};
+
+// The indexed draw the kernel encodes for a visible object.
+struct CullDraw {
+    uint32_t indexCount;
+    uint32_t indexStart;
+    int32_t baseVertex;
+    uint32_t baseInstance;      // ObjectData slot
+};
+
+// Inward facing, (nx, ny, nz, d): a point p is inside when dot(n, p) + d >= 0.
+// Left, right, bottom, top, near, far.
+struct FrustumPlanes {
+    float planes[6][4];
+};
+
+// For Metal's clip space, z in [0, w]. Planes aren't normalized, which the
+// sphere test needs, so this does.
+FrustumPlanes frustumPlanes(const Float4x4& viewProjection);
+
+// CPU reference for cullObjects in culling.metal: copies the draws of
+// objects whose sphere touches the frustum to `out`, keeping their order, and
+// returns how many. `out` needs room for `count` draws. The kernel appends
+// with an atomic, in no fixed order.
+uint32_t cullDrawsScalar(const FrustumPlanes& frustum, const CullSphere* spheres, const CullDraw* draws,
+                         uint32_t count, CullDraw* out);
+// The same, testing four spheres against each plane at once.
+uint32_t cullDrawsSimd(const FrustumPlanes& frustum, const CullSphere* spheres, const CullDraw* draws,
+                       uint32_t count, CullDraw* out);
@@ -0,0 +1,132 @@
+//
+//  GpuDrivenScene.cpp
+//  MetalBones
+//
+
+#include "GpuDrivenScene.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+// Matches CullParams in culling.metal.
+struct CullParams {
+    FrustumPlanes frustum;
+    uint32_t objectCount;
+    uint32_t padding[3];
+};
+
+GpuDrivenScene::GpuDrivenScene(MTL::Device* device, MTL::Library* library, UploadManager& uploads, uint32_t maxObjects,
+                               uint32_t maxVertices, uint32_t maxIndices, uint32_t vertexStride)
+    : device(device->retain())
+    , uploads(uploads)
+    , maxObjects(maxObjects)
+    , maxVertices(maxVertices)
+    , maxIndices(maxIndices)
+    , vertexStride(vertexStride)
+{
+    buildPipeline(library);
+
+    vertexBuffer = device->newBuffer(size_t(maxVertices) * vertexStride, MTL::ResourceStorageModePrivate);
+    indexBuffer = device->newBuffer(size_t(maxIndices) * sizeof(uint16_t), MTL::ResourceStorageModePrivate);
+    sphereBuffer = device->newBuffer(size_t(maxObjects) * sizeof(CullSphere), MTL::ResourceStorageModePrivate);
+    drawBuffer = device->newBuffer(size_t(maxObjects) * sizeof(CullDraw), MTL::ResourceStorageModePrivate);
+    // MTLIndirectCommandBufferExecutionRange: location, length.
+    rangeBuffer = device->newBuffer(2 * sizeof(uint32_t), MTL::ResourceStorageModePrivate);
+
+    MTL::IndirectCommandBufferDescriptor* descriptor = MTL::IndirectCommandBufferDescriptor::alloc()->init();
+    descriptor->setCommandTypes(MTL::IndirectCommandTypeDrawIndexed);
+    descriptor->setInheritPipelineState(true);
+    descriptor->setInheritBuffers(true);
+    commands = device->newIndirectCommandBuffer(descriptor, maxObjects, MTL::ResourceStorageModePrivate);
+    descriptor->release();
+
+    // The kernel's argument buffer: just the command buffer's resource ID.
+    commandsArgument = device->newBuffer(sizeof(MTL::ResourceID), MTL::ResourceStorageModeShared);
+    *static_cast<MTL::ResourceID*>(commandsArgument->contents()) = commands->gpuResourceID();
+}
+
+GpuDrivenScene::~GpuDrivenScene() {
+    commands->release();
+    commandsArgument->release();
+    rangeBuffer->release();
+    drawBuffer->release();
+    sphereBuffer->release();
+    indexBuffer->release();
+    vertexBuffer->release();
+    cullPipeline->release();
+    device->release();
+}
+
+void GpuDrivenScene::buildPipeline(MTL::Library* library) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    MTL::Function* function = library->newFunction(NS::String::string("cullObjects", UTF8StringEncoding));
+
+    NS::Error* error = nullptr;
+    cullPipeline = device->newComputePipelineState(function, &error);
+    if (!cullPipeline) {
+        __builtin_printf("%s", error->localizedDescription()->utf8String());
+        assert(false);
+    }
+
+    function->release();
+}
+
+uint32_t GpuDrivenScene::addMesh(const void* meshVertices, uint32_t vertexCount, const uint16_t* meshIndices, uint32_t indexCount) {
+    // Index offsets stay 4 byte aligned.
+    uint32_t indexStart = (indices + 1) & ~1u;
+    assert(vertices + vertexCount <= maxVertices && indexStart + indexCount <= maxIndices);
+
+    uploads.upload(vertexBuffer, size_t(vertices) * vertexStride, meshVertices, size_t(vertexCount) * vertexStride);
+    uploads.upload(indexBuffer, indexStart * sizeof(uint16_t), meshIndices, indexCount * sizeof(uint16_t));
+    meshes.push_back({indexCount, indexStart, int32_t(vertices), 0});
+    vertices += vertexCount;
+    indices = indexStart + indexCount;
+    return uint32_t(meshes.size() - 1);
+}
+
+void GpuDrivenScene::addObject(uint32_t mesh, const CullSphere& bounds, uint32_t objectSlot) {
+    assert(objects < maxObjects && mesh < meshes.size());
+
+    CullDraw draw = meshes[mesh];
+    draw.baseInstance = objectSlot;
+    uploads.upload(sphereBuffer, objects * sizeof(CullSphere), &bounds, sizeof(bounds));
+    uploads.upload(drawBuffer, objects * sizeof(CullDraw), &draw, sizeof(draw));
+    objects++;
+}
+
+void GpuDrivenScene::cull(MTL::CommandBuffer* commandBuffer, const FrustumPlanes& frustum) {
+    if (objects == 0) {
+        return;
+    }
+
+    MTL::BlitCommandEncoder* blit = commandBuffer->blitCommandEncoder();
+    blit->fillBuffer(rangeBuffer, NS::Range::Make(0, rangeBuffer->length()), 0);
+    blit->endEncoding();
+
+    CullParams params = {frustum, objects, {}};
+    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder();
+    encoder->setComputePipelineState(cullPipeline);
+    encoder->setBytes(&params, sizeof(params), 0);
+    encoder->setBuffer(sphereBuffer, 0, 1);
+    encoder->setBuffer(drawBuffer, 0, 2);
+    encoder->setBuffer(indexBuffer, 0, 3);
+    encoder->setBuffer(rangeBuffer, 0, 4);
+    encoder->setBuffer(commandsArgument, 0, 5);
+    encoder->useResource(commands, MTL::ResourceUsageWrite);
+
+    NS::UInteger width = std::min<NS::UInteger>(cullPipeline->maxTotalThreadsPerThreadgroup(), cullPipeline->threadExecutionWidth() * 4);
+    encoder->dispatchThreads(MTL::Size::Make(objects, 1, 1), MTL::Size::Make(width, 1, 1));
+    encoder->endEncoding();
+}
+
+void GpuDrivenScene::draw(MTL::RenderCommandEncoder* encoder) {
+    if (objects == 0) {
+        return;
+    }
+    encoder->setVertexBuffer(vertexBuffer, 0, 0);
+    // The commands point into the index buffer on their own.
+    encoder->useResource(commands, MTL::ResourceUsageRead);
+    encoder->useResource(indexBuffer, MTL::ResourceUsageRead);
+    encoder->executeCommandsInBuffer(commands, rangeBuffer, 0);
+}
@@ -0,0 +1,63 @@
+//
+//  GpuDrivenScene.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <vector>
+
+#include "GpuCulling.hpp"
+#include "UploadManager.hpp"
+
+// Static objects the GPU culls and draws on its own: bounds and draw
+// arguments live in GPU buffers, a compute pass writes the visible draws into
+// an indirect command buffer and the render pass executes it, so the CPU cost
+// doesn't grow with the object count. All meshes share one vertex and one
+// index buffer, and every draw inherits pipeline state and buffers from the
+// render encoder; objects reach their own data through their base instance.
+class GpuDrivenScene {
+public:
+    GpuDrivenScene(MTL::Device* device, MTL::Library* library, UploadManager& uploads, uint32_t maxObjects,
+                   uint32_t maxVertices, uint32_t maxIndices, uint32_t vertexStride);
+    ~GpuDrivenScene();
+
+    GpuDrivenScene(const GpuDrivenScene&) = delete;
+    GpuDrivenScene& operator=(const GpuDrivenScene&) = delete;
+
+    uint32_t addMesh(const void* vertices, uint32_t vertexCount, const uint16_t* indices, uint32_t indexCount);
+    void addObject(uint32_t mesh, const CullSphere& bounds, uint32_t objectSlot);
+
+    uint32_t objectCount() const { return objects; }
+
+    // Before the render pass, in the same command buffer.
+    void cull(MTL::CommandBuffer* commandBuffer, const FrustumPlanes& frustum);
+    // With the pipeline state and every buffer but the vertex buffer bound.
+    void draw(MTL::RenderCommandEncoder* encoder);
+
+private:
+    void buildPipeline(MTL::Library* library);
+
+    MTL::Device* device;
+    UploadManager& uploads;
+    MTL::ComputePipelineState* cullPipeline;
+
+    MTL::Buffer* vertexBuffer;
+    MTL::Buffer* indexBuffer;
+    MTL::Buffer* sphereBuffer;
+    MTL::Buffer* drawBuffer;
+    MTL::Buffer* rangeBuffer;
+    MTL::Buffer* commandsArgument;
+    MTL::IndirectCommandBuffer* commands;
+
+    std::vector<CullDraw> meshes;       // baseInstance unused
+    uint32_t maxObjects;
+    uint32_t maxVertices;
+    uint32_t maxIndices;
+    uint32_t vertexStride;
+    uint32_t vertices = 0;
+    uint32_t indices = 0;
+    uint32_t objects = 0;
+};
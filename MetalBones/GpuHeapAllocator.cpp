@@ -0,0 +1,104 @@
+//
+//  GpuHeapAllocator.cpp
+//  MetalBones
+//
+
+#include "GpuHeapAllocator.hpp"
+
+#include <algorithm>
+
+static MTL::ResourceOptions resourceOptions(MTL::StorageMode storageMode) {
+    MTL::ResourceOptions storage = storageMode == MTL::StorageModeShared ? MTL::ResourceStorageModeShared
+                                 : storageMode == MTL::StorageModeMemoryless ? MTL::ResourceStorageModeMemoryless
+                                 : MTL::ResourceStorageModePrivate;
+    return storage | MTL::ResourceHazardTrackingModeTracked;
+}
+
+GpuHeapAllocator::GpuHeapAllocator(MTL::Device* device, MTL::StorageMode storageMode, size_t blockSize)
+    : device(device->retain())
+    , storageMode(storageMode)
+    , options(resourceOptions(storageMode))
+    , blockSize(blockSize)
+{
+    assert(storageMode != MTL::StorageModeManaged && "heaps can't be managed");
+}
+
+GpuHeapAllocator::~GpuHeapAllocator() {
+    assert(allocator.stats().allocations == 0);
+
+    for (MTL::Heap* heap : heaps) {
+        heap->release();
+    }
+    device->release();
+}
+
+TlsfAllocation GpuHeapAllocator::place(MTL::SizeAndAlign sizeAndAlign) {
+    TlsfAllocation allocation = allocator.allocate(sizeAndAlign.size, sizeAndAlign.align);
+    if (allocation.valid()) {
+        return allocation;
+    }
+
+    MTL::HeapDescriptor* descriptor = MTL::HeapDescriptor::alloc()->init();
+    descriptor->setType(MTL::HeapTypePlacement);
+    descriptor->setStorageMode(storageMode);
+    descriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+    // A block, or for larger resources a heap of their own with room for
+    // the allocator's size class rounding and alignment padding.
+    descriptor->setSize(std::max<size_t>(blockSize, allocator.poolSizeFor(sizeAndAlign.size, sizeAndAlign.align)));
+
+    MTL::Heap* heap = device->newHeap(descriptor);
+    if (!heap) {
+        __builtin_printf("Failed to reserve a %zu byte heap\n", size_t(descriptor->size()));
+        assert(false);
+    }
+    descriptor->release();
+
+    heaps.push_back(heap);
+    allocator.addPool(heap->size());
+    allocation = allocator.allocate(sizeAndAlign.size, sizeAndAlign.align);
+    if (!allocation.valid()) {
+        __builtin_printf("No room for %zu bytes in a new %zu byte heap\n", size_t(sizeAndAlign.size), size_t(heap->size()));
+        assert(false);
+    }
+    return allocation;
+}
+
+GpuBuffer GpuHeapAllocator::newBuffer(size_t length) {
+    GpuBuffer result;
+    result.allocation = place(device->heapBufferSizeAndAlign(length, options));
+    result.buffer = heaps[result.allocation.pool]->newBuffer(length, options, result.allocation.offset);
+    return result;
+}
+
+GpuBuffer GpuHeapAllocator::newBuffer(const void* data, size_t length) {
+    assert(storageMode == MTL::StorageModeShared && "use an upload for private buffers");
+
+    GpuBuffer result = newBuffer(length);
+    memcpy(result.buffer->contents(), data, length);
+    return result;
+}
+
+GpuTexture GpuHeapAllocator::newTexture(const MTL::TextureDescriptor* descriptor) {
+    assert(descriptor->storageMode() == storageMode);
+
+    GpuTexture result;
+    result.allocation = place(device->heapTextureSizeAndAlign(descriptor));
+    result.texture = heaps[result.allocation.pool]->newTexture(descriptor, result.allocation.offset);
+    return result;
+}
+
+void GpuHeapAllocator::release(GpuBuffer& buffer) {
+    if (buffer.buffer) {
+        buffer.buffer->release();
+        allocator.free(buffer.allocation);
+    }
+    buffer = {};
+}
+
+void GpuHeapAllocator::release(GpuTexture& texture) {
+    if (texture.texture) {
+        texture.texture->release();
+        allocator.free(texture.allocation);
+    }
+    texture = {};
+}
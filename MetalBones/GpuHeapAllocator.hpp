@@ -0,0 +1,50 @@
+//
+//  GpuHeapAllocator.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "TlsfAllocator.hpp"
+
+struct GpuBuffer {
+    MTL::Buffer* buffer = nullptr;
+    TlsfAllocation allocation;
+};
+
+struct GpuTexture {
+    MTL::Texture* texture = nullptr;
+    TlsfAllocation allocation;
+};
+
+// Places buffers and textures into large placement heaps instead of asking
+// the driver for every resource. A new heap block is reserved whenever the
+// existing ones can't fit a request, resources larger than a block get a heap
+// of their own. Freeing is immediate: the caller makes sure the GPU is done.
+class GpuHeapAllocator {
+public:
+    GpuHeapAllocator(MTL::Device* device, MTL::StorageMode storageMode, size_t blockSize = 64 << 20);
+    ~GpuHeapAllocator();
+
+    GpuBuffer newBuffer(size_t length);
+    GpuBuffer newBuffer(const void* data, size_t length);
+    GpuTexture newTexture(const MTL::TextureDescriptor* descriptor);
+
+    void release(GpuBuffer& buffer);
+    void release(GpuTexture& texture);
+
+    TlsfStats stats() const { return allocator.stats(); }
+
+private:
+    TlsfAllocation place(MTL::SizeAndAlign sizeAndAlign);
+
+    MTL::Device* device;
+    MTL::StorageMode storageMode;
+    MTL::ResourceOptions options;
+    size_t blockSize;
+
+    std::vector<MTL::Heap*> heaps;
+    TlsfAllocator allocator;
+};
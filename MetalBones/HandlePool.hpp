@@ -0,0 +1,134 @@
+//
+//  HandlePool.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// 20 bits of slot index and 12 bits of generation. Value 0 is never handed
+// out, so a default constructed handle is always invalid.
+template <typename Tag>
+struct Handle {
+    static constexpr uint32_t indexBits = 20;
+    static constexpr uint32_t indexMask = (1u << indexBits) - 1;
+    static constexpr uint32_t generationMask = (1u << (32 - indexBits)) - 1;
+
+    uint32_t value = 0;
+
+    uint32_t index() const { return value & indexMask; }
+    uint32_t generation() const { return value >> indexBits; }
+    bool valid() const { return value != 0; }
+
+    bool operator==(const Handle& other) const { return value == other.value; }
+    bool operator!=(const Handle& other) const { return value != other.value; }
+};
+
+// Live items are kept densely packed, one array per column, so iterating over
+// a column touches nothing else. Handles go through a sparse slot table that
+// also holds the generation; destroying an item moves the last one into its
+// place and bumps the slot generation, so stale handles stop resolving.
+template <typename Tag, typename... Columns>
+class HandlePool {
+public:
+    using HandleType = Handle<Tag>;
+
+    HandleType create(const Columns&... values) {
+        uint32_t slot;
+        if (freeSlot != none) {
+            slot = freeSlot;
+            freeSlot = slots[slot].dense;
+        } else {
+            assert(slots.size() < HandleType::indexMask);
+            slot = uint32_t(slots.size());
+            // Generation starts at 1 so that slot 0 never produces handle 0.
+            slots.push_back({0, 1});
+        }
+
+        slots[slot].dense = uint32_t(handles.size());
+        HandleType handle = {slots[slot].generation << HandleType::indexBits | slot};
+        handles.push_back(handle);
+        append(std::index_sequence_for<Columns...>(), values...);
+        return handle;
+    }
+
+    bool destroy(HandleType handle) {
+        if (!alive(handle)) {
+            return false;
+        }
+
+        uint32_t slot = handle.index();
+        uint32_t dense = slots[slot].dense;
+        uint32_t last = uint32_t(handles.size() - 1);
+        if (dense != last) {
+            handles[dense] = handles[last];
+            slots[handles[dense].index()].dense = dense;
+        }
+        handles.pop_back();
+        removeSwap(std::index_sequence_for<Columns...>(), dense, last);
+
+        slots[slot].generation = (slots[slot].generation + 1) & HandleType::generationMask;
+        if (slots[slot].generation == 0) {
+            slots[slot].generation = 1;
+        }
+        slots[slot].dense = freeSlot;
+        freeSlot = slot;
+        return true;
+    }
+
+    bool alive(HandleType handle) const {
+        uint32_t slot = handle.index();
+        return handle.valid() && slot < slots.size() && slots[slot].generation == handle.generation()
+            && slots[slot].dense < handles.size() && handles[slots[slot].dense] == handle;
+    }
+
+    // Null when the handle is stale.
+    template <size_t Column>
+    auto* get(HandleType handle) {
+        return alive(handle) ? &std::get<Column>(columns)[slots[handle.index()].dense] : nullptr;
+    }
+
+    template <size_t Column>
+    const auto* get(HandleType handle) const {
+        return alive(handle) ? &std::get<Column>(columns)[slots[handle.index()].dense] : nullptr;
+    }
+
+    // Dense views over the live items, in no particular order.
+    template <size_t Column>
+    auto& column() { return std::get<Column>(columns); }
+    template <size_t Column>
+    const auto& column() const { return std::get<Column>(columns); }
+    const std::vector<HandleType>& liveHandles() const { return handles; }
+
+    uint32_t size() const { return uint32_t(handles.size()); }
+    uint32_t capacity() const { return uint32_t(slots.size()); }
+
+private:
+    static constexpr uint32_t none = ~0u;
+
+    struct Slot {
+        uint32_t dense;         // next free slot while the slot is unused
+        uint32_t generation;
+    };
+
+    template <size_t... I>
+    void append(std::index_sequence<I...>, const Columns&... values) {
+        (std::get<I>(columns).push_back(values), ...);
+    }
+
+    template <size_t... I>
+    void removeSwap(std::index_sequence<I...>, uint32_t dense, uint32_t last) {
+        ((dense != last ? void(std::get<I>(columns)[dense] = std::move(std::get<I>(columns)[last])) : void()), ...);
+        (std::get<I>(columns).pop_back(), ...);
+    }
+
+    std::vector<Slot> slots;
+    std::vector<HandleType> handles;
+    std::tuple<std::vector<Columns>...> columns;
+    uint32_t freeSlot = none;
+};
@@ -0,0 +1,100 @@
+//
+//  JobSystem.cpp
+//  MetalBones
+//
+
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static thread_local uint32_t currentThreadIndex = 0;
+
+JobSystem::JobSystem(uint32_t workerCount) {
+    workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+uint32_t JobSystem::defaultWorkerCount() {
+    uint32_t hardware = std::thread::hardware_concurrency();
+    return hardware > 1 ? hardware - 1 : 0;
+}
+
+uint32_t JobSystem::threadIndex() {
+    return currentThreadIndex;
+}
+
+void JobSystem::runChunks() {
+    const uint32_t chunks = (jobCount + jobGrain - 1) / jobGrain;
+    for (uint32_t chunk = nextChunk.fetch_add(1, std::memory_order_relaxed); chunk < chunks;
+         chunk = nextChunk.fetch_add(1, std::memory_order_relaxed)) {
+        uint32_t begin = chunk * jobGrain;
+        (*job)(begin, std::min(begin + jobGrain, jobCount));
+    }
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+    currentThreadIndex = index;
+
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return quit || generation != seen; });
+            if (quit) {
+                return;
+            }
+            seen = generation;
+        }
+
+        runChunks();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--activeWorkers == 0) {
+            finished.notify_one();
+        }
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t grain, const RangeFunction& function) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max(grain, 1u);
+
+    if (workers.empty() || count <= grain) {
+        function(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        assert(job == nullptr && "parallelFor is not reentrant");
+        job = &function;
+        jobCount = count;
+        jobGrain = grain;
+        nextChunk.store(0, std::memory_order_relaxed);
+        activeWorkers = uint32_t(workers.size());
+        generation++;
+    }
+    wake.notify_all();
+
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return activeWorkers == 0; });
+    job = nullptr;
+}
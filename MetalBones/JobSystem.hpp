@@ -0,0 +1,57 @@
+//
+//  JobSystem.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads running data-parallel loops. The calling
+// thread takes part in every loop, so a pool with zero workers simply runs
+// everything inline.
+class JobSystem {
+public:
+    using RangeFunction = std::function<void(uint32_t begin, uint32_t end)>;
+
+    explicit JobSystem(uint32_t workerCount = defaultWorkerCount());
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    static uint32_t defaultWorkerCount();
+
+    // Workers plus the calling thread.
+    uint32_t threadCount() const { return uint32_t(workers.size()) + 1; }
+
+    // 0 on any thread that isn't a worker of a JobSystem, 1..N on workers.
+    static uint32_t threadIndex();
+
+    // Splits [0, count) into chunks of `grain` and blocks until all of them ran.
+    void parallelFor(uint32_t count, uint32_t grain, const RangeFunction& function);
+
+private:
+    void workerLoop(uint32_t index);
+    void runChunks();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const RangeFunction* job = nullptr;
+    uint32_t jobCount = 0;
+    uint32_t jobGrain = 1;
+    std::atomic<uint32_t> nextChunk{0};
+    uint32_t activeWorkers = 0;
+    uint64_t generation = 0;
+    bool quit = false;
+};
@@ -0,0 +1,247 @@
+//
+//  LightClusters.cpp
+//  MetalBones
+//
+
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "JobSystem.hpp"
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef float Lanes __attribute__((vector_size(16)));
+typedef int32_t LaneMask __attribute__((vector_size(16)));
+
+static inline Lanes loadLanes(const float* p) {
+    Lanes v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline Lanes maxLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_max_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vmaxq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::max(a[0], b[0]), std::max(a[1], b[1]), std::max(a[2], b[2]), std::max(a[3], b[3])};
+#endif
+}
+
+static inline uint32_t laneBits(LaneMask mask) {
+#if defined(__SSE2__)
+    return uint32_t(_mm_movemask_ps((__m128)mask));
+#elif defined(__ARM_NEON)
+    const uint32x4_t weights = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32((uint32x4_t)mask, weights));
+#else
+    return uint32_t(mask[0] & 1) | uint32_t(mask[1] & 2) | uint32_t(mask[2] & 4) | uint32_t(mask[3] & 8);
+#endif
+}
+
+void LightClusterGrid::LightLanes::clear() {
+    for (std::vector<float>* field : {&x, &y, &z, &radius}) {
+        field->clear();
+    }
+    light.clear();
+}
+
+void LightClusterGrid::LightLanes::push(float lightX, float lightY, float lightZ, float lightRadius, uint16_t index) {
+    x.push_back(lightX);
+    y.push_back(lightY);
+    z.push_back(lightZ);
+    radius.push_back(lightRadius);
+    light.push_back(index);
+}
+
+void LightClusterGrid::LightLanes::pad() {
+    while (light.size() % 4 != 0) {
+        // Infinitely far away and of no size, so it never reaches a box.
+        push(INFINITY, 0.0f, 0.0f, 0.0f, 0);
+    }
+}
+
+// Bit i is set when light i + lane of `lights` reaches into the box: the
+// squared distance from the center to the box is within the squared radius.
+static inline uint32_t overlapBits(const float* const lights[4], uint32_t i, const Aabb& box) {
+    Lanes x = loadLanes(lights[0] + i), y = loadLanes(lights[1] + i), z = loadLanes(lights[2] + i);
+    Lanes radius = loadLanes(lights[3] + i);
+    const Lanes zero = {};
+    Lanes dx = maxLanes(maxLanes(box.min.x - x, x - box.max.x), zero);
+    Lanes dy = maxLanes(maxLanes(box.min.y - y, y - box.max.y), zero);
+    Lanes dz = maxLanes(maxLanes(box.min.z - z, z - box.max.z), zero);
+    return laneBits(dx * dx + dy * dy + dz * dz <= radius * radius);
+}
+
+LightClusterGrid::LightClusterGrid(uint32_t tilesX, uint32_t tilesY, uint32_t slices)
+    : tilesX(tilesX)
+    , tilesY(tilesY)
+    , slices(slices)
+    , sliceData(slices)
+    , clusterRanges(tilesX * tilesY * slices)
+{
+    setProjection(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+}
+
+void LightClusterGrid::setProjection(float fovY, float aspect, float near, float far) {
+    projectionY = 1.0f / std::tan(fovY * 0.5f);
+    projectionX = projectionY / aspect;
+    zNear = near;
+    zFar = far;
+    sliceDepths.resize(slices + 1);
+    for (uint32_t s = 0; s <= slices; ++s) {
+        sliceDepths[s] = zNear * std::pow(zFar / zNear, float(s) / slices);
+    }
+    sliceDepths[slices] = zFar;
+}
+
+uint32_t LightClusterGrid::clusterAt(const Float3& viewPosition) const {
+    float depth = -viewPosition.z;
+    if (!(depth > zNear && depth < zFar)) {
+        return ~0u;
+    }
+    float tileX = std::floor((viewPosition.x * projectionX / depth * 0.5f + 0.5f) * tilesX);
+    float tileY = std::floor((0.5f - viewPosition.y * projectionY / depth * 0.5f) * tilesY);
+    if (tileX < 0.0f || tileX >= tilesX || tileY < 0.0f || tileY >= tilesY) {
+        return ~0u;
+    }
+    float slice = std::floor(std::log(depth) * shaderConstants.sliceScale + shaderConstants.sliceBias);
+    slice = std::min(std::max(slice, 0.0f), float(slices - 1));
+    return (uint32_t(slice) * tilesY + uint32_t(tileY)) * tilesX + uint32_t(tileX);
+}
+
+void LightClusterGrid::assign(const Float4x4& view, const PointLight* lights, uint32_t count, JobSystem* jobs) {
+    auto start = std::chrono::steady_clock::now();
+    assert(count <= maxLights);
+
+    float sliceScale = slices / std::log(zFar / zNear);
+    shaderConstants = {view, projectionX, projectionY, sliceScale, -std::log(zNear) * sliceScale, zNear, zFar,
+                       tilesX, tilesY, slices, count, {}};
+
+    // Bucket the lights by the slices their depth range touches, nudged
+    // outwards so rounding can only add a slice; the box tests sort it out.
+    for (Slice& slice : sliceData) {
+        slice.lights.clear();
+    }
+    auto sliceOf = [&](float depth, float nudge) {
+        float slice = depth > zNear ? std::floor(std::log(depth) * sliceScale + shaderConstants.sliceBias + nudge) : 0.0f;
+        return uint32_t(std::min(std::max(slice, 0.0f), float(slices - 1)));
+    };
+    uint32_t inRange = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        Float3 p = transformPoint(view, lights[i].position);
+        float depth = -p.z, radius = lights[i].radius;
+        if (depth + radius <= zNear || depth - radius >= zFar) {
+            continue;
+        }
+        uint32_t last = sliceOf(depth + radius, 1e-3f);
+        for (uint32_t s = sliceOf(depth - radius, -1e-3f); s <= last; ++s) {
+            sliceData[s].lights.push(p.x, p.y, p.z, radius, uint16_t(i));
+        }
+        inRange++;
+    }
+
+    auto assignSlices = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t s = begin; s < end; ++s) {
+            assignSlice(s);
+        }
+    };
+    if (jobs) {
+        jobs->parallelFor(slices, 1, assignSlices);
+    } else {
+        assignSlices(0, slices);
+    }
+
+    // Slices listed their clusters' lights from 0; put them one after another.
+    uint32_t total = 0;
+    for (const Slice& slice : sliceData) {
+        total += uint32_t(slice.indices.size());
+    }
+    indices.resize(total);
+    uint32_t offset = 0, maxPerCluster = 0;
+    for (uint32_t s = 0; s < slices; ++s) {
+        const std::vector<uint16_t>& sliceIndices = sliceData[s].indices;
+        memcpy(indices.data() + offset, sliceIndices.data(), sliceIndices.size() * sizeof(uint16_t));
+        LightCluster* cluster = &clusterRanges[s * tilesX * tilesY];
+        for (uint32_t c = 0; c < tilesX * tilesY; ++c) {
+            cluster[c].offset += offset;
+            maxPerCluster = std::max(maxPerCluster, cluster[c].count);
+        }
+        offset += uint32_t(sliceIndices.size());
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    lastStats = {count, inRange, total, maxPerCluster, std::chrono::duration<double>(end - start).count()};
+}
+
+void LightClusterGrid::assignSlice(uint32_t s) {
+    Slice& slice = sliceData[s];
+    slice.lights.pad();
+    slice.indices.clear();
+
+    // Boxes grow by a hair so a point the shader rounds into a neighbouring
+    // cluster is still inside that cluster's box.
+    float near = sliceDepths[s], far = sliceDepths[s + 1];
+    float margin = far * 1e-4f;
+    float minZ = -far - margin, maxZ = -near + margin;
+    auto extent = [&](float ndc0, float ndc1, float projection, float& low, float& high) {
+        low = std::min(ndc0 * near, ndc0 * far) / projection - margin;
+        high = std::max(ndc1 * near, ndc1 * far) / projection + margin;
+    };
+
+    const float* const sliceLights[4] = {slice.lights.x.data(), slice.lights.y.data(), slice.lights.z.data(),
+                                         slice.lights.radius.data()};
+    uint32_t used = 0;
+    for (uint32_t tileY = 0; tileY < tilesY; ++tileY) {
+        // Screen rows go down, view-space y goes up.
+        Aabb rowBox;
+        extent(-1.0f, 1.0f, projectionX, rowBox.min.x, rowBox.max.x);
+        extent(1.0f - 2.0f * (tileY + 1) / tilesY, 1.0f - 2.0f * tileY / tilesY, projectionY, rowBox.min.y, rowBox.max.y);
+        rowBox.min.z = minZ;
+        rowBox.max.z = maxZ;
+
+        slice.row.clear();
+        for (uint32_t i = 0; i < slice.lights.size(); i += 4) {
+            for (uint32_t bits = overlapBits(sliceLights, i, rowBox); bits; bits &= bits - 1) {
+                uint32_t lane = i + uint32_t(__builtin_ctz(bits));
+                slice.row.push(sliceLights[0][lane], sliceLights[1][lane], sliceLights[2][lane], sliceLights[3][lane],
+                               slice.lights.light[lane]);
+            }
+        }
+        slice.row.pad();
+
+        const float* const rowLights[4] = {slice.row.x.data(), slice.row.y.data(), slice.row.z.data(), slice.row.radius.data()};
+        const uint16_t* rowIndices = slice.row.light.data();
+        for (uint32_t tileX = 0; tileX < tilesX; ++tileX) {
+            Aabb box = rowBox;
+            extent(2.0f * tileX / tilesX - 1.0f, 2.0f * (tileX + 1) / tilesX - 1.0f, projectionX, box.min.x, box.max.x);
+
+            if (slice.indices.size() < used + slice.row.size()) {
+                slice.indices.resize(std::max<size_t>(used + slice.row.size(), slice.indices.size() * 2));
+            }
+            uint16_t* out = slice.indices.data() + used;
+            uint32_t found = 0;
+            for (uint32_t i = 0; i < slice.row.size(); i += 4) {
+                uint32_t bits = overlapBits(rowLights, i, box);
+                // Branch-free: store every index, only advance past lights that reach.
+                for (uint32_t lane = 0; lane < 4; ++lane) {
+                    out[found] = rowIndices[i + lane];
+                    found += bits >> lane & 1;
+                }
+            }
+            clusterRanges[(s * tilesY + tileY) * tilesX + tileX] = {used, found};
+            used += found;
+        }
+    }
+    slice.indices.resize(used);
+}
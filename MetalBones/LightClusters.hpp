@@ -0,0 +1,122 @@
+//
+//  LightClusters.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.hpp"
+
+class JobSystem;
+
+// Matches PointLight in general.metal.
+struct PointLight {
+    Float3 position;            // world space
+    float radius;               // no light at all past it
+    Float3 color;
+    float intensity;
+};
+
+// A cluster's lights are lightIndices()[offset, offset + count).
+struct LightCluster {
+    uint32_t offset;
+    uint32_t count;
+};
+
+// Matches LightClusterConstants in general.metal: what a fragment needs to
+// find its cluster from its world-space position.
+struct LightClusterConstants {
+    Float4x4 view;
+    float projectionX;          // projection m[0] and m[5]
+    float projectionY;
+    float sliceScale;           // slice = log(depth) * sliceScale + sliceBias
+    float sliceBias;
+    float zNear;
+    float zFar;
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint32_t slices;
+    uint32_t lightCount;
+    uint32_t padding[2];
+};
+
+struct LightClusterStats {
+    uint32_t lights;
+    uint32_t inRange;           // lights overlapping at least one slice
+    uint32_t indices;
+    uint32_t maxPerCluster;
+    double seconds;
+};
+
+// Clustered forward lighting: the view frustum of a perspective camera is
+// cut into tiles across the screen and exponentially spaced slices along the
+// view depth, and every cluster gets the list of point lights whose sphere
+// touches its view-space box. Fragments then only loop over their cluster's
+// lights.
+//
+// Lights are bucketed by slice first; jobs then take a slice each, narrow its
+// lights down per row of tiles and test them against each tile's box four at
+// a time. The lists come out in light order within a cluster and clusters are
+// laid out tile by tile, row by row, slice by slice, whatever the thread count.
+class LightClusterGrid {
+public:
+    static constexpr uint32_t maxLights = 65536;    // indices are 16 bit
+
+    LightClusterGrid(uint32_t tilesX, uint32_t tilesY, uint32_t slices);
+
+    // Right handed, looking down -z; the same camera perspective() in the
+    // bench describes.
+    void setProjection(float fovY, float aspect, float zNear, float zFar);
+
+    // Assigns `lights` as seen through `view`, world to view space.
+    void assign(const Float4x4& view, const PointLight* lights, uint32_t count, JobSystem* jobs = nullptr);
+
+    // The cluster holding a view-space point, ~0u outside the frustum. Does
+    // what the fragment shader does.
+    uint32_t clusterAt(const Float3& viewPosition) const;
+
+    uint32_t clusterCount() const { return tilesX * tilesY * slices; }
+    const LightCluster* clusters() const { return clusterRanges.data(); }
+    const uint16_t* lightIndices() const { return indices.data(); }
+    const LightClusterConstants& constants() const { return shaderConstants; }
+    const LightClusterStats& stats() const { return lastStats; }
+
+private:
+    // View-space lights of one slice, as separate arrays padded to a
+    // multiple of four with lights that touch nothing.
+    struct LightLanes {
+        std::vector<float> x, y, z, radius;
+        std::vector<uint16_t> light;
+
+        void clear();
+        void push(float x, float y, float z, float radius, uint16_t light);
+        void pad();
+        uint32_t size() const { return uint32_t(light.size()); }
+    };
+
+    struct Slice {
+        LightLanes lights;
+        LightLanes row;
+        std::vector<uint16_t> indices;
+    };
+
+    void assignSlice(uint32_t slice);
+
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint32_t slices;
+    float projectionX = 1.0f;
+    float projectionY = 1.0f;
+    float zNear = 0.1f;
+    float zFar = 100.0f;
+    std::vector<float> sliceDepths;     // slices + 1 boundaries
+
+    std::vector<Slice> sliceData;
+    std::vector<LightCluster> clusterRanges;
+    std::vector<uint16_t> indices;
+    LightClusterConstants shaderConstants = {};
+    LightClusterStats lastStats = {};
+};
@@ -0,0 +1,174 @@
+//
+//  Math.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Plain math types for code that has to build without <simd/simd.h>.
+// Float4x4 is column-major, matching simd::float4x4 and Metal's float4x4.
+
+struct Float3 {
+    float x, y, z;
+};
+
+struct Quat {
+    float x, y, z, w;
+};
+
+struct Float4x4 {
+    float m[16];
+};
+
+struct Aabb {
+    Float3 min;
+    Float3 max;
+};
+
+inline Float3 operator+(Float3 a, Float3 b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Float3 operator-(Float3 a, Float3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Float3 operator*(Float3 a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+
+inline float dot(Float3 a, Float3 b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Float3 cross(Float3 a, Float3 b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+inline float length(Float3 a) {
+    return std::sqrt(dot(a, a));
+}
+
+inline Float3 lerp(Float3 a, Float3 b, float t) {
+    return a + (b - a) * t;
+}
+
+inline Quat normalize(Quat q) {
+    float len = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+    float inv = len > 0.0f ? 1.0f / len : 0.0f;
+    return {q.x * inv, q.y * inv, q.z * inv, q.w * inv};
+}
+
+inline Quat nlerp(Quat a, Quat b, float t) {
+    float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    float s = d < 0.0f ? -t : t;
+    float r = 1.0f - t;
+    return normalize({a.x * r + b.x * s, a.y * r + b.y * s, a.z * r + b.z * s, a.w * r + b.w * s});
+}
+
+inline Quat operator*(Quat a, Quat b) {
+    return {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+    };
+}
+
+inline Float3 rotate(Quat q, Float3 v) {
+    Float3 u = {q.x, q.y, q.z};
+    Float3 t = cross(u, v) * 2.0f;
+    return v + t * q.w + cross(u, t);
+}
+
+inline Float4x4 identity4x4() {
+    return {{1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1}};
+}
+
+inline Float4x4 operator*(const Float4x4& a, const Float4x4& b) {
+    Float4x4 r;
+    for (int c = 0; c < 4; ++c) {
+        for (int row = 0; row < 4; ++row) {
+            r.m[c * 4 + row] = a.m[0 * 4 + row] * b.m[c * 4 + 0]
+                             + a.m[1 * 4 + row] * b.m[c * 4 + 1]
+                             + a.m[2 * 4 + row] * b.m[c * 4 + 2]
+                             + a.m[3 * 4 + row] * b.m[c * 4 + 3];
+        }
+    }
+    return r;
+}
+
+inline Float3 transformPoint(const Float4x4& a, Float3 p) {
+    return {
+        a.m[0] * p.x + a.m[4] * p.y + a.m[8]  * p.z + a.m[12],
+        a.m[1] * p.x + a.m[5] * p.y + a.m[9]  * p.z + a.m[13],
+        a.m[2] * p.x + a.m[6] * p.y + a.m[10] * p.z + a.m[14],
+    };
+}
+
+inline Float3 transformVector(const Float4x4& a, Float3 v) {
+    return {
+        a.m[0] * v.x + a.m[4] * v.y + a.m[8]  * v.z,
+        a.m[1] * v.x + a.m[5] * v.y + a.m[9]  * v.z,
+        a.m[2] * v.x + a.m[6] * v.y + a.m[10] * v.z,
+    };
+}
+
+inline Float4x4 makeTransform(Float3 t, Quat q, Float3 s) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    return {{
+        (1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x,          2.0f * (xz - wy) * s.x,          0.0f,
+        2.0f * (xy - wz) * s.y,          (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y,          0.0f,
+        2.0f * (xz + wy) * s.z,          2.0f * (yz - wx) * s.z,          (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f,
+        t.x,                             t.y,                             t.z,                             1.0f,
+    }};
+}
+
+// IEEE binary16 conversion, round-to-nearest-even, for data uploaded as half textures/buffers.
+inline uint16_t floatToHalf(float value) {
+    uint32_t f;
+    std::memcpy(&f, &value, sizeof(f));
+
+    uint32_t sign = (f >> 16) & 0x8000u;
+    uint32_t magnitude = f & 0x7fffffffu;
+
+    if (magnitude >= 0x7f800000u) {
+        return uint16_t(sign | (magnitude > 0x7f800000u ? 0x7e00u : 0x7c00u));
+    }
+    if (magnitude >= 0x477ff000u) {
+        return uint16_t(sign | 0x7c00u);
+    }
+    if (magnitude < 0x38800000u) {
+        // Subnormal half: let the FPU do the rounding.
+        float shifted;
+        std::memcpy(&shifted, &magnitude, sizeof(shifted));
+        shifted += 0.5f;
+        uint32_t bits;
+        std::memcpy(&bits, &shifted, sizeof(bits));
+        return uint16_t(sign | (bits - 0x3f000000u));
+    }
+
+    uint32_t mantissaOdd = (magnitude >> 13) & 1u;
+    magnitude += 0xc8000fffu + mantissaOdd;
+    return uint16_t(sign | (magnitude >> 13));
+}
+
+inline float halfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000u) << 16;
+    uint32_t exponent = (h >> 10) & 0x1fu;
+    uint32_t mantissa = h & 0x3ffu;
+
+    uint32_t bits;
+    if (exponent == 0) {
+        float f = float(mantissa) * (1.0f / 16777216.0f);
+        std::memcpy(&bits, &f, sizeof(bits));
+        bits |= sign;
+    } else if (exponent == 31) {
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
@@ -0,0 +1,117 @@
+//
+//  MorphTargetEvaluator.cpp
+//  MetalBones
+//
+
+#include "MorphTargetEvaluator.hpp"
+
+#include <algorithm>
+
+static MTL::Buffer* newManagedBuffer(MTL::Device* device, const void* data, size_t length) {
+    MTL::Buffer* buffer = device->newBuffer(std::max<size_t>(length, 16), MTL::ResourceStorageModeManaged);
+    if (length > 0) {
+        memcpy(buffer->contents(), data, length);
+        buffer->didModifyRange(NS::Range::Make(0, length));
+    }
+    return buffer;
+}
+
+MorphTargetEvaluator::MorphTargetEvaluator(MTL::Device* device, MTL::Library* library, const MorphTargetSet& targetSet,
+                                           const float* basePositions, const float* baseNormals)
+    : device(device->retain())
+    , vertexCount(targetSet.vertexCount())
+{
+    copyPipeline = buildPipeline(library, "morphCopyBase");
+    accumulatePipeline = buildPipeline(library, "morphAccumulate");
+
+    const size_t vertexBytes = size_t(vertexCount) * 4 * sizeof(float);
+    const size_t deltaCount = targetSet.deltaCount();
+
+    basePositionBuffer = newManagedBuffer(device, basePositions, vertexBytes);
+    baseNormalBuffer = newManagedBuffer(device, baseNormals, vertexBytes);
+    deltaVertexBuffer = newManagedBuffer(device, targetSet.deltaVertices(), deltaCount * sizeof(uint32_t));
+    positionDeltaBuffer = newManagedBuffer(device, targetSet.positionDeltas(), deltaCount * 4 * sizeof(int16_t));
+    normalDeltaBuffer = newManagedBuffer(device, targetSet.normalDeltas(), deltaCount * 4 * sizeof(int16_t));
+
+    positionBuffer = device->newBuffer(vertexBytes, MTL::ResourceStorageModePrivate);
+    normalBuffer = device->newBuffer(vertexBytes, MTL::ResourceStorageModePrivate);
+
+    for (uint32_t t = 0; t < targetSet.targetCount(); ++t) {
+        targets.push_back(targetSet.target(t));
+    }
+}
+
+MorphTargetEvaluator::~MorphTargetEvaluator() {
+    normalBuffer->release();
+    positionBuffer->release();
+    normalDeltaBuffer->release();
+    positionDeltaBuffer->release();
+    deltaVertexBuffer->release();
+    baseNormalBuffer->release();
+    basePositionBuffer->release();
+    accumulatePipeline->release();
+    copyPipeline->release();
+    device->release();
+}
+
+MTL::ComputePipelineState* MorphTargetEvaluator::buildPipeline(MTL::Library* library, const char* name) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    MTL::Function* function = library->newFunction(NS::String::string(name, UTF8StringEncoding));
+
+    NS::Error* error = nullptr;
+    MTL::ComputePipelineState* pipeline = device->newComputePipelineState(function, &error);
+    if (!pipeline) {
+        __builtin_printf("%s", error->localizedDescription()->utf8String());
+        assert(false);
+    }
+
+    function->release();
+    return pipeline;
+}
+
+void MorphTargetEvaluator::dispatch(MTL::ComputeCommandEncoder* encoder, MTL::ComputePipelineState* pipeline, uint32_t threads) {
+    NS::UInteger width = std::min<NS::UInteger>(pipeline->maxTotalThreadsPerThreadgroup(), pipeline->threadExecutionWidth() * 4);
+    encoder->dispatchThreads(MTL::Size::Make(threads, 1, 1), MTL::Size::Make(width, 1, 1));
+}
+
+void MorphTargetEvaluator::encode(MTL::CommandBuffer* commandBuffer, const float* weights, float epsilon) {
+    struct MorphDispatch {
+        uint32_t first;
+        uint32_t count;
+        float positionScale;
+        float normalScale;
+    };
+
+    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder(MTL::DispatchTypeSerial);
+
+    encoder->setComputePipelineState(copyPipeline);
+    encoder->setBuffer(basePositionBuffer, 0, 0);
+    encoder->setBuffer(baseNormalBuffer, 0, 1);
+    encoder->setBuffer(positionBuffer, 0, 2);
+    encoder->setBuffer(normalBuffer, 0, 3);
+    encoder->setBytes(&vertexCount, sizeof(uint32_t), 4);
+    dispatch(encoder, copyPipeline, vertexCount);
+
+    encoder->setComputePipelineState(accumulatePipeline);
+    encoder->setBuffer(deltaVertexBuffer, 0, 0);
+    encoder->setBuffer(positionDeltaBuffer, 0, 1);
+    encoder->setBuffer(normalDeltaBuffer, 0, 2);
+    encoder->setBuffer(positionBuffer, 0, 3);
+    encoder->setBuffer(normalBuffer, 0, 4);
+
+    lastActiveTargets = 0;
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const MorphTarget& target = targets[t];
+        if (std::fabs(weights[t]) <= epsilon || target.count == 0) {
+            continue;
+        }
+
+        MorphDispatch params = {target.first, target.count, weights[t] * target.positionScale, weights[t] * target.normalScale};
+        encoder->setBytes(&params, sizeof(params), 5);
+        dispatch(encoder, accumulatePipeline, target.count);
+        lastActiveTargets++;
+    }
+
+    encoder->endEncoding();
+}
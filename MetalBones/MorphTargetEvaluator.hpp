@@ -0,0 +1,46 @@
+//
+//  MorphTargetEvaluator.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "MorphTargets.hpp"
+
+// Runs the morph accumulation on the GPU ahead of skinning. Output buffers
+// hold one float4 position and normal per vertex.
+class MorphTargetEvaluator {
+public:
+    MorphTargetEvaluator(MTL::Device* device, MTL::Library* library, const MorphTargetSet& targets,
+                         const float* basePositions, const float* baseNormals);
+    ~MorphTargetEvaluator();
+
+    // Encodes the base copy plus one dispatch per target with |weight| > epsilon.
+    void encode(MTL::CommandBuffer* commandBuffer, const float* weights, float epsilon = 1e-3f);
+
+    MTL::Buffer* positions() const { return positionBuffer; }
+    MTL::Buffer* normals() const { return normalBuffer; }
+    uint32_t activeTargets() const { return lastActiveTargets; }
+
+private:
+    MTL::ComputePipelineState* buildPipeline(MTL::Library* library, const char* name);
+    void dispatch(MTL::ComputeCommandEncoder* encoder, MTL::ComputePipelineState* pipeline, uint32_t threads);
+
+    MTL::Device* device;
+    MTL::ComputePipelineState* copyPipeline;
+    MTL::ComputePipelineState* accumulatePipeline;
+
+    MTL::Buffer* basePositionBuffer;
+    MTL::Buffer* baseNormalBuffer;
+    MTL::Buffer* deltaVertexBuffer;
+    MTL::Buffer* positionDeltaBuffer;
+    MTL::Buffer* normalDeltaBuffer;
+    MTL::Buffer* positionBuffer;
+    MTL::Buffer* normalBuffer;
+
+    std::vector<MorphTarget> targets;
+    uint32_t vertexCount;
+    uint32_t lastActiveTargets = 0;
+};
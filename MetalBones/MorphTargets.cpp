@@ -0,0 +1,141 @@
+//
+//  MorphTargets.cpp
+//  MetalBones
+//
+
+#include "MorphTargets.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static float maxComponent(Float3 v) {
+    return std::max({std::fabs(v.x), std::fabs(v.y), std::fabs(v.z)});
+}
+
+static void quantize(Float3 v, float inverseScale, int16_t* out) {
+    out[0] = int16_t(std::lround(v.x * inverseScale));
+    out[1] = int16_t(std::lround(v.y * inverseScale));
+    out[2] = int16_t(std::lround(v.z * inverseScale));
+    out[3] = 0;
+}
+
+MorphTargetSet::MorphTargetSet(const Float3* positionDeltas, const Float3* normalDeltas,
+                               uint32_t vertexCount, uint32_t targetCount, float epsilon)
+    : vertices(vertexCount)
+{
+    targets.reserve(targetCount);
+
+    for (uint32_t t = 0; t < targetCount; ++t) {
+        const Float3* positions = positionDeltas + size_t(t) * vertexCount;
+        const Float3* normals = normalDeltas ? normalDeltas + size_t(t) * vertexCount : nullptr;
+
+        float positionMax = 0.0f;
+        float normalMax = 0.0f;
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            positionMax = std::max(positionMax, maxComponent(positions[v]));
+            if (normals) {
+                normalMax = std::max(normalMax, maxComponent(normals[v]));
+            }
+        }
+
+        MorphTarget target = {
+            static_cast<uint32_t>(deltaVertexStream.size()), 0,
+            positionMax / 32767.0f, normalMax / 32767.0f,
+        };
+        const float positionInverse = positionMax > 0.0f ? 32767.0f / positionMax : 0.0f;
+        const float normalInverse = normalMax > 0.0f ? 32767.0f / normalMax : 0.0f;
+
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            Float3 n = normals ? normals[v] : Float3{0, 0, 0};
+            if (maxComponent(positions[v]) <= epsilon && maxComponent(n) <= epsilon) {
+                continue;
+            }
+
+            int16_t p[4], q[4];
+            quantize(positions[v], positionInverse, p);
+            quantize(n, normalInverse, q);
+
+            deltaVertexStream.push_back(v);
+            positionStream.insert(positionStream.end(), p, p + 4);
+            normalStream.insert(normalStream.end(), q, q + 4);
+            target.count++;
+        }
+
+        targets.push_back(target);
+    }
+}
+
+MorphTargetMemory MorphTargetSet::memory() const {
+    const size_t dense = size_t(vertices) * targets.size() * sizeof(Float3) * 2;
+    const size_t sparse = deltaVertexStream.size() * sizeof(uint32_t)
+                        + positionStream.size() * sizeof(int16_t)
+                        + normalStream.size() * sizeof(int16_t)
+                        + targets.size() * sizeof(MorphTarget);
+    return {dense, sparse, deltaVertexStream.size()};
+}
+
+// out[v].xyzw += q[i].xyzw * scale, four lanes at a time.
+static void accumulate(const uint32_t* indices, const int16_t* deltas, uint32_t count, float scale, float* out) {
+#if defined(__ARM_NEON)
+    const float32x4_t s = vdupq_n_f32(scale);
+    for (uint32_t i = 0; i < count; ++i) {
+        float* dst = out + size_t(indices[i]) * 4;
+        float32x4_t d = vcvtq_f32_s32(vmovl_s16(vld1_s16(deltas + size_t(i) * 4)));
+        vst1q_f32(dst, vmlaq_f32(vld1q_f32(dst), d, s));
+    }
+#elif defined(__SSE2__)
+    const __m128 s = _mm_set1_ps(scale);
+    for (uint32_t i = 0; i < count; ++i) {
+        float* dst = out + size_t(indices[i]) * 4;
+        __m128i q = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(deltas + size_t(i) * 4));
+        __m128 d = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16));
+        _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_mul_ps(d, s)));
+    }
+#else
+    for (uint32_t i = 0; i < count; ++i) {
+        float* dst = out + size_t(indices[i]) * 4;
+        const int16_t* d = deltas + size_t(i) * 4;
+        for (int c = 0; c < 4; ++c) {
+            dst[c] += float(d[c]) * scale;
+        }
+    }
+#endif
+}
+
+MorphTargetStats MorphTargetSet::apply(const float* weights, float epsilon,
+                                       const float* basePositions, const float* baseNormals,
+                                       float* positions, float* normals) const {
+    auto start = std::chrono::steady_clock::now();
+
+    std::memcpy(positions, basePositions, size_t(vertices) * 4 * sizeof(float));
+    std::memcpy(normals, baseNormals, size_t(vertices) * 4 * sizeof(float));
+
+    MorphTargetStats stats = {};
+    for (uint32_t t = 0; t < targets.size(); ++t) {
+        const float weight = weights[t];
+        if (std::fabs(weight) <= epsilon) {
+            continue;
+        }
+
+        const MorphTarget& target = targets[t];
+        const uint32_t* indices = deltaVertexStream.data() + target.first;
+        accumulate(indices, positionStream.data() + size_t(target.first) * 4, target.count, weight * target.positionScale, positions);
+        accumulate(indices, normalStream.data() + size_t(target.first) * 4, target.count, weight * target.normalScale, normals);
+
+        stats.activeTargets++;
+        stats.deltasApplied += target.count;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    stats.secondsPerActiveTarget = stats.activeTargets ? stats.seconds / stats.activeTargets : 0.0;
+    return stats;
+}
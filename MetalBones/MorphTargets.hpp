@@ -0,0 +1,67 @@
+//
+//  MorphTargets.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Math.hpp"
+
+// Deltas of one target occupy [first, first + count) of the shared streams.
+// Quantized deltas are int16 xyz (w = 0) scaled by the per-target scale.
+struct MorphTarget {
+    uint32_t first;
+    uint32_t count;
+    float positionScale;
+    float normalScale;
+};
+
+struct MorphTargetMemory {
+    size_t denseBytes;
+    size_t sparseBytes;
+    size_t nonZeroDeltas;
+};
+
+struct MorphTargetStats {
+    uint32_t activeTargets;
+    uint32_t deltasApplied;
+    double seconds;
+    double secondsPerActiveTarget;
+};
+
+class MorphTargetSet {
+public:
+    // Dense deltas are target-major: delta of vertex v in target t is at [t * vertexCount + v].
+    // normalDeltas may be null. A vertex is dropped from a target when every
+    // component of both of its deltas is within epsilon.
+    MorphTargetSet(const Float3* positionDeltas, const Float3* normalDeltas,
+                   uint32_t vertexCount, uint32_t targetCount, float epsilon = 1e-5f);
+
+    uint32_t vertexCount() const { return vertices; }
+    uint32_t targetCount() const { return static_cast<uint32_t>(targets.size()); }
+    const MorphTarget& target(uint32_t index) const { return targets[index]; }
+
+    const uint32_t* deltaVertices() const { return deltaVertexStream.data(); }
+    const int16_t* positionDeltas() const { return positionStream.data(); }
+    const int16_t* normalDeltas() const { return normalStream.data(); }
+    uint32_t deltaCount() const { return static_cast<uint32_t>(deltaVertexStream.size()); }
+
+    MorphTargetMemory memory() const;
+
+    // CPU reference: positions/normals are float4 per vertex (w ignored), in and out.
+    // Targets with |weight| <= epsilon are skipped entirely.
+    MorphTargetStats apply(const float* weights, float epsilon,
+                           const float* basePositions, const float* baseNormals,
+                           float* positions, float* normals) const;
+
+private:
+    uint32_t vertices;
+    std::vector<MorphTarget> targets;
+    std::vector<uint32_t> deltaVertexStream;
+    std::vector<int16_t> positionStream;
+    std::vector<int16_t> normalStream;
+};
@@ -0,0 +1,385 @@
+//
+//  MotionMatching.cpp
+//  MetalBones
+//
+
+#include "MotionMatching.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Value written into the padding lanes of every column; its squared
+// distance to any sane query is far above any real cost.
+static constexpr float paddingValue = 1e15f;
+
+static constexpr uint32_t leafSize = 16;
+
+uint32_t MotionFeatureSchema::dimension() const {
+    return uint32_t(positionJoints.size() * 3 + velocityJoints.size() * 3 + trajectoryTimes.size() * 4);
+}
+
+std::vector<float> MotionFeatureSchema::weights() const {
+    std::vector<float> w;
+    w.insert(w.end(), positionJoints.size() * 3, positionWeight);
+    w.insert(w.end(), velocityJoints.size() * 3, velocityWeight);
+    w.insert(w.end(), trajectoryTimes.size() * 2, trajectoryPositionWeight);
+    w.insert(w.end(), trajectoryTimes.size() * 2, trajectoryDirectionWeight);
+    return w;
+}
+
+MotionDatabase::MotionDatabase(const float* rawFeatures, uint32_t frameCount, uint32_t dimension,
+                               const float* weights, std::vector<MotionFrame> frames)
+    : count(frameCount)
+    , dims(dimension)
+    , paddedCount((frameCount + 7) & ~7u)
+    , offsets(dimension)
+    , scales(dimension)
+    , columns(size_t(dimension) * paddedCount, paddingValue)
+    , frames(std::move(frames))
+{
+    assert(frameCount > 0 && this->frames.size() == frameCount);
+
+    for (uint32_t d = 0; d < dims; ++d) {
+        double sum = 0.0, sumSquares = 0.0;
+        for (uint32_t i = 0; i < count; ++i) {
+            double v = rawFeatures[size_t(i) * dims + d];
+            sum += v;
+            sumSquares += v * v;
+        }
+        double mean = sum / count;
+        double deviation = std::sqrt(std::max(0.0, sumSquares / count - mean * mean));
+
+        offsets[d] = float(mean);
+        scales[d] = weights[d] / float(deviation > 1e-6 ? deviation : 1.0);
+
+        float* out = &columns[size_t(d) * paddedCount];
+        for (uint32_t i = 0; i < count; ++i) {
+            out[i] = (rawFeatures[size_t(i) * dims + d] - offsets[d]) * scales[d];
+        }
+    }
+}
+
+void MotionDatabase::normalize(const float* raw, float* out) const {
+    for (uint32_t d = 0; d < dims; ++d) {
+        out[d] = (raw[d] - offsets[d]) * scales[d];
+    }
+}
+
+MotionDatabaseBuilder::MotionDatabaseBuilder(const Skeleton& skeleton, const MotionFeatureSchema& schema, float sampleRate)
+    : skeleton(skeleton)
+    , schema(schema)
+    , sampleRate(sampleRate)
+{
+}
+
+static Float3 toRootSpace(const Float4x4& root, Float3 p) {
+    Float3 d = {p.x - root.m[12], p.y - root.m[13], p.z - root.m[14]};
+    return {
+        root.m[0] * d.x + root.m[1] * d.y + root.m[2]  * d.z,
+        root.m[4] * d.x + root.m[5] * d.y + root.m[6]  * d.z,
+        root.m[8] * d.x + root.m[9] * d.y + root.m[10] * d.z,
+    };
+}
+
+static Float3 position(const Float4x4& m) {
+    return {m.m[12], m.m[13], m.m[14]};
+}
+
+void MotionDatabaseBuilder::computeFeatures(const AnimationClip& clip, float time, float* out) const {
+    const uint32_t joints = skeleton.jointCount();
+    const float lastTime = clip.duration() - 1.0f / clip.sampleRate();
+
+    std::vector<JointTransform> pose(joints);
+    std::vector<Float4x4> model(joints);
+    std::vector<Float4x4> other(joints);
+
+    auto modelAt = [&](float t, std::vector<Float4x4>& result) {
+        clip.sample(std::clamp(t, 0.0f, lastTime), pose.data(), joints);
+        buildModelMatrices(skeleton, pose.data(), result.data());
+    };
+
+    modelAt(time, model);
+    const Float4x4 root = model[schema.rootJoint];
+
+    for (uint16_t j : schema.positionJoints) {
+        Float3 p = toRootSpace(root, position(model[j]));
+        *out++ = p.x;
+        *out++ = p.y;
+        *out++ = p.z;
+    }
+
+    // Forward difference, or backward at the end of the clip.
+    float h = 1.0f / sampleRate;
+    if (time + h > lastTime) {
+        h = -h;
+    }
+    modelAt(time + h, other);
+    for (uint16_t j : schema.velocityJoints) {
+        Float3 v = (toRootSpace(root, position(other[j])) - toRootSpace(root, position(model[j]))) * (1.0f / h);
+        *out++ = v.x;
+        *out++ = v.y;
+        *out++ = v.z;
+    }
+
+    std::vector<Float3> directions;
+    for (float offset : schema.trajectoryTimes) {
+        modelAt(time + offset, other);
+        const Float4x4& future = other[schema.rootJoint];
+        Float3 p = toRootSpace(root, position(future));
+        *out++ = p.x;
+        *out++ = p.z;
+
+        Float3 forward = {future.m[8], future.m[9], future.m[10]};
+        directions.push_back(toRootSpace(root, position(root) + forward));
+    }
+    for (Float3 d : directions) {
+        *out++ = d.x;
+        *out++ = d.z;
+    }
+}
+
+void MotionDatabaseBuilder::addClip(const AnimationClip& clip, uint32_t clipId) {
+    const uint32_t dims = schema.dimension();
+    const uint32_t count = std::max(1u, uint32_t(clip.duration() * sampleRate));
+
+    for (uint32_t f = 0; f < count; ++f) {
+        size_t offset = features.size();
+        features.resize(offset + dims);
+        computeFeatures(clip, float(f) / sampleRate, &features[offset]);
+        frames.push_back({clipId, f});
+    }
+}
+
+MotionDatabase MotionDatabaseBuilder::build() const {
+    std::vector<float> weights = schema.weights();
+    return MotionDatabase(features.data(), uint32_t(frames.size()), schema.dimension(), weights.data(), frames);
+}
+
+MotionMatcher::MotionMatcher(const MotionDatabase& database, MotionSearchBackend backend)
+    : database(database)
+    , selected(MotionSearchBackend::BruteForce)
+{
+    setBackend(backend);
+}
+
+void MotionMatcher::setBackend(MotionSearchBackend backend) {
+    selected = backend;
+    if (backend == MotionSearchBackend::KDTree && nodes.empty()) {
+        buildTree();
+    }
+}
+
+MotionMatch MotionMatcher::search(const float* rawQuery) const {
+    std::vector<float> query(database.dimension());
+    database.normalize(rawQuery, query.data());
+    return searchNormalized(query.data());
+}
+
+MotionMatch MotionMatcher::searchNormalized(const float* query) const {
+    return selected == MotionSearchBackend::KDTree ? searchTree(query) : searchBruteForce(query);
+}
+
+static void takeBest(const float* costs, uint32_t base, uint32_t count, MotionMatch& best) {
+    for (uint32_t lane = 0; lane < 8 && base + lane < count; ++lane) {
+        if (costs[lane] < best.cost) {
+            best = {base + lane, costs[lane]};
+        }
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma")))
+static MotionMatch scanAVX2(const MotionDatabase& db, const float* query) {
+    const uint32_t dims = db.dimension();
+    const uint32_t stride = db.stride();
+    const float* data = db.column(0);
+
+    MotionMatch best = {0, FLT_MAX};
+    alignas(32) float costs[8];
+
+    for (uint32_t i = 0; i < stride; i += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        bool rejected = false;
+        for (uint32_t d = 0; d < dims; ++d) {
+            __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(data + size_t(d) * stride + i), _mm256_set1_ps(query[d]));
+            acc = _mm256_fmadd_ps(diff, diff, acc);
+            // Every 8 dimensions, give up on the block once all lanes are worse.
+            if ((d & 7) == 7 && !_mm256_movemask_ps(_mm256_cmp_ps(acc, _mm256_set1_ps(best.cost), _CMP_LT_OQ))) {
+                rejected = true;
+                break;
+            }
+        }
+        if (!rejected) {
+            _mm256_store_ps(costs, acc);
+            takeBest(costs, i, db.frameCount(), best);
+        }
+    }
+    return best;
+}
+
+static bool hasAVX2() {
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+}
+#endif
+
+static MotionMatch scanPortable(const MotionDatabase& db, const float* query) {
+    const uint32_t dims = db.dimension();
+    const uint32_t stride = db.stride();
+    const float* data = db.column(0);
+
+    MotionMatch best = {0, FLT_MAX};
+    alignas(16) float costs[8];
+
+    for (uint32_t i = 0; i < stride; i += 8) {
+#if defined(__ARM_NEON)
+        float32x4_t lo = vdupq_n_f32(0.0f), hi = vdupq_n_f32(0.0f);
+        for (uint32_t d = 0; d < dims; ++d) {
+            const float* column = data + size_t(d) * stride + i;
+            float32x4_t q = vdupq_n_f32(query[d]);
+            float32x4_t a = vsubq_f32(vld1q_f32(column), q);
+            float32x4_t b = vsubq_f32(vld1q_f32(column + 4), q);
+            lo = vfmaq_f32(lo, a, a);
+            hi = vfmaq_f32(hi, b, b);
+        }
+        vst1q_f32(costs, lo);
+        vst1q_f32(costs + 4, hi);
+#else
+        for (int lane = 0; lane < 8; ++lane) {
+            costs[lane] = 0.0f;
+        }
+        for (uint32_t d = 0; d < dims; ++d) {
+            const float* column = data + size_t(d) * stride + i;
+            for (int lane = 0; lane < 8; ++lane) {
+                float diff = column[lane] - query[d];
+                costs[lane] += diff * diff;
+            }
+        }
+#endif
+        takeBest(costs, i, db.frameCount(), best);
+    }
+    return best;
+}
+
+MotionMatch MotionMatcher::searchBruteForce(const float* query) const {
+#if defined(__x86_64__)
+    if (hasAVX2()) {
+        return scanAVX2(database, query);
+    }
+#endif
+    return scanPortable(database, query);
+}
+
+void MotionMatcher::buildTree() {
+    const uint32_t count = database.frameCount();
+    const uint32_t dims = database.dimension();
+
+    order.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        order[i] = i;
+    }
+
+    nodes.clear();
+    nodes.reserve(2 * count / leafSize + 1);
+    buildNode(0, count);
+
+    points.resize(size_t(count) * dims);
+    for (uint32_t i = 0; i < count; ++i) {
+        for (uint32_t d = 0; d < dims; ++d) {
+            points[size_t(i) * dims + d] = database.column(d)[order[i]];
+        }
+    }
+}
+
+uint32_t MotionMatcher::buildNode(uint32_t begin, uint32_t end) {
+    const uint32_t index = uint32_t(nodes.size());
+    nodes.push_back({begin, end, 0, 0, true, 0.0f});
+
+    if (end - begin <= leafSize) {
+        return index;
+    }
+
+    // Split the widest dimension at its median.
+    uint16_t bestDimension = 0;
+    float bestSpread = -1.0f;
+    for (uint32_t d = 0; d < database.dimension(); ++d) {
+        const float* column = database.column(d);
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        for (uint32_t i = begin; i < end; ++i) {
+            lo = std::min(lo, column[order[i]]);
+            hi = std::max(hi, column[order[i]]);
+        }
+        if (hi - lo > bestSpread) {
+            bestSpread = hi - lo;
+            bestDimension = uint16_t(d);
+        }
+    }
+
+    const float* column = database.column(bestDimension);
+    const uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                     [column](uint32_t a, uint32_t b) { return column[a] < column[b]; });
+
+    nodes[index].leaf = false;
+    nodes[index].splitDimension = bestDimension;
+    nodes[index].splitValue = column[order[mid]];
+
+    buildNode(begin, mid);
+    uint32_t right = buildNode(mid, end);
+    nodes[index].right = right;
+    return index;
+}
+
+MotionMatch MotionMatcher::searchTree(const float* query) const {
+    struct Pending {
+        uint32_t node;
+        float bound;
+    };
+
+    const uint32_t dims = database.dimension();
+    MotionMatch best = {0, FLT_MAX};
+
+    Pending stack[64];
+    uint32_t top = 0;
+    stack[top++] = {0, 0.0f};
+
+    while (top > 0) {
+        Pending pending = stack[--top];
+        if (pending.bound >= best.cost) {
+            continue;
+        }
+
+        const KDNode& node = nodes[pending.node];
+        if (node.leaf) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const float* point = &points[size_t(i) * dims];
+                float cost = 0.0f;
+                uint32_t d = 0;
+                for (; d < dims && cost < best.cost; ++d) {
+                    float diff = point[d] - query[d];
+                    cost += diff * diff;
+                }
+                if (d == dims && cost < best.cost) {
+                    best = {order[i], cost};
+                }
+            }
+            continue;
+        }
+
+        float diff = query[node.splitDimension] - node.splitValue;
+        uint32_t nearNode = diff < 0.0f ? pending.node + 1 : node.right;
+        uint32_t farNode = diff < 0.0f ? node.right : pending.node + 1;
+
+        stack[top++] = {farNode, std::max(pending.bound, diff * diff)};
+        stack[top++] = {nearNode, pending.bound};
+    }
+
+    return best;
+}
@@ -0,0 +1,123 @@
+//
+//  MotionMatching.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Animation.hpp"
+
+// Layout of one feature vector, in order: joint positions (xyz each), joint
+// velocities (xyz each), future root positions (xz each), future root
+// facing directions (xz each). Everything is expressed in the root's frame.
+struct MotionFeatureSchema {
+    uint16_t rootJoint = 0;
+    std::vector<uint16_t> positionJoints;
+    std::vector<uint16_t> velocityJoints;
+    std::vector<float> trajectoryTimes = {0.33f, 0.66f, 1.0f};
+
+    float positionWeight = 1.0f;
+    float velocityWeight = 1.0f;
+    float trajectoryPositionWeight = 1.0f;
+    float trajectoryDirectionWeight = 1.5f;
+
+    uint32_t dimension() const;
+    std::vector<float> weights() const;
+};
+
+struct MotionFrame {
+    uint32_t clip;
+    uint32_t frame;
+};
+
+// Normalized, weighted features stored column-major (one contiguous column per
+// dimension, padded to a multiple of 8 frames) for SIMD scans.
+class MotionDatabase {
+public:
+    // rawFeatures is row-major, one `dimension`-wide row per frame.
+    MotionDatabase(const float* rawFeatures, uint32_t frameCount, uint32_t dimension,
+                   const float* weights, std::vector<MotionFrame> frames);
+
+    uint32_t frameCount() const { return count; }
+    uint32_t dimension() const { return dims; }
+    uint32_t stride() const { return paddedCount; }
+    const float* column(uint32_t d) const { return &columns[size_t(d) * paddedCount]; }
+    const MotionFrame& frame(uint32_t index) const { return frames[index]; }
+
+    void normalize(const float* raw, float* out) const;
+
+private:
+    uint32_t count;
+    uint32_t dims;
+    uint32_t paddedCount;
+    std::vector<float> offsets;
+    std::vector<float> scales;
+    std::vector<float> columns;
+    std::vector<MotionFrame> frames;
+};
+
+class MotionDatabaseBuilder {
+public:
+    MotionDatabaseBuilder(const Skeleton& skeleton, const MotionFeatureSchema& schema, float sampleRate = 30.0f);
+
+    void addClip(const AnimationClip& clip, uint32_t clipId);
+    MotionDatabase build() const;
+
+    // Raw features of `clip` at `time`; what a runtime query is built from.
+    void computeFeatures(const AnimationClip& clip, float time, float* out) const;
+
+private:
+    const Skeleton& skeleton;
+    MotionFeatureSchema schema;
+    float sampleRate;
+
+    std::vector<float> features;
+    std::vector<MotionFrame> frames;
+};
+
+enum class MotionSearchBackend : uint8_t {
+    BruteForce,
+    KDTree,
+};
+
+struct MotionMatch {
+    uint32_t index;
+    float cost;
+};
+
+class MotionMatcher {
+public:
+    explicit MotionMatcher(const MotionDatabase& database, MotionSearchBackend backend = MotionSearchBackend::BruteForce);
+
+    void setBackend(MotionSearchBackend backend);
+    MotionSearchBackend backend() const { return selected; }
+
+    MotionMatch search(const float* rawQuery) const;
+    MotionMatch searchNormalized(const float* query) const;
+
+private:
+    struct KDNode {
+        uint32_t begin;
+        uint32_t end;
+        uint32_t right;     // left child is always the next node
+        uint16_t splitDimension;
+        bool leaf;
+        float splitValue;
+    };
+
+    void buildTree();
+    uint32_t buildNode(uint32_t begin, uint32_t end);
+
+    MotionMatch searchBruteForce(const float* query) const;
+    MotionMatch searchTree(const float* query) const;
+
+    const MotionDatabase& database;
+    MotionSearchBackend selected;
+
+    std::vector<KDNode> nodes;
+    std::vector<uint32_t> order;
+    std::vector<float> points;  // row-major, in tree order
+};
@@ -0,0 +1,272 @@
+//
+//  OcclusionCulling.cpp
+//  MetalBones
+//
+
+#include "OcclusionCulling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef float Lanes __attribute__((vector_size(16)));
+typedef int32_t LaneMask __attribute__((vector_size(16)));
+
+// Anything this close to the eye plane, or behind it, can't be projected.
+static constexpr float minW = 1e-4f;
+
+static inline uint32_t laneBits(LaneMask mask) {
+#if defined(__SSE2__)
+    return uint32_t(_mm_movemask_ps((__m128)mask));
+#elif defined(__ARM_NEON)
+    const uint32x4_t weights = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32((uint32x4_t)mask, weights));
+#else
+    return uint32_t(mask[0] & 1) | uint32_t(mask[1] & 2) | uint32_t(mask[2] & 4) | uint32_t(mask[3] & 8);
+#endif
+}
+
+static inline Lanes minLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_min_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vminq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]), std::min(a[3], b[3])};
+#endif
+}
+
+static inline Lanes maxLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_max_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vmaxq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::max(a[0], b[0]), std::max(a[1], b[1]), std::max(a[2], b[2]), std::max(a[3], b[3])};
+#endif
+}
+
+static inline void toClip(const Float4x4& m, const Float3& p, float* clip) {
+    for (int row = 0; row < 4; ++row) {
+        clip[row] = m.m[row] * p.x + m.m[4 + row] * p.y + m.m[8 + row] * p.z + m.m[12 + row];
+    }
+}
+
+OcclusionCuller::OcclusionCuller(uint32_t width, uint32_t height)
+    : tilesX((width + tileWidth - 1) / tileWidth)
+    , tilesY((height + tileHeight - 1) / tileHeight)
+    , tiles(tilesX * tilesY)
+{
+}
+
+void OcclusionCuller::begin(const Float4x4& matrix) {
+    viewProjection = matrix;
+    std::fill(tiles.begin(), tiles.end(), Tile{1.0f, 0.0f, 0});
+    counters = {};
+}
+
+void OcclusionCuller::renderOccluder(const Float3* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t triangleCount) {
+    clipVertices.resize(vertexCount * 4);
+    for (uint32_t i = 0; i < vertexCount; ++i) {
+        toClip(viewProjection, vertices[i], &clipVertices[i * 4]);
+    }
+
+    const float halfWidth = width() * 0.5f, halfHeight = height() * 0.5f;
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        float screen[3][3];
+        bool projectable = true;
+        for (int corner = 0; corner < 3; ++corner) {
+            const float* clip = &clipVertices[indices[t * 3 + corner] * 4];
+            if (clip[3] <= minW) {
+                projectable = false;
+                break;
+            }
+            float inverseW = 1.0f / clip[3];
+            screen[corner][0] = (clip[0] * inverseW + 1.0f) * halfWidth;
+            screen[corner][1] = (1.0f - clip[1] * inverseW) * halfHeight;
+            screen[corner][2] = clip[2] * inverseW;
+        }
+        if (projectable) {
+            rasterize(screen);
+        } else {
+            counters.skipped++;
+        }
+    }
+}
+
+// Merges a triangle covering `coverage` of the tile, nowhere farther than
+// `triangleDepth`.
+static inline void mergeIntoTile(float& depth, float& layerDepth, uint32_t& layerMask, uint32_t coverage, float triangleDepth) {
+    if (triangleDepth >= depth) {
+        return;
+    }
+    // Much nearer than the working layer: start a new layer with it rather
+    // than let the old one hold its depth back.
+    if (layerDepth - triangleDepth > depth - layerDepth) {
+        layerMask = 0;
+        layerDepth = 0.0f;
+    }
+    layerMask |= coverage;
+    layerDepth = std::max(layerDepth, triangleDepth);
+    if (layerMask == ~0u) {
+        depth = layerDepth;
+        layerMask = 0;
+        layerDepth = 0.0f;
+    }
+}
+
+void OcclusionCuller::rasterize(const float (&v)[3][3]) {
+    float area = (v[1][0] - v[0][0]) * (v[2][1] - v[0][1]) - (v[2][0] - v[0][0]) * (v[1][1] - v[0][1]);
+    if (!(std::fabs(area) > 1e-6f)) {
+        counters.skipped++;
+        return;
+    }
+    counters.triangles++;
+
+    float minX = std::min({v[0][0], v[1][0], v[2][0]}), maxX = std::max({v[0][0], v[1][0], v[2][0]});
+    float minY = std::min({v[0][1], v[1][1], v[2][1]}), maxY = std::max({v[0][1], v[1][1], v[2][1]});
+    if (maxX < 0.0f || maxY < 0.0f || minX >= float(width()) || minY >= float(height())) {
+        return;
+    }
+    int32_t tileX0 = int32_t(std::max(minX, 0.0f)) / int32_t(tileWidth);
+    int32_t tileX1 = int32_t(std::min(maxX, float(width() - 1))) / int32_t(tileWidth);
+    int32_t tileY0 = int32_t(std::max(minY, 0.0f)) / int32_t(tileHeight);
+    int32_t tileY1 = int32_t(std::min(maxY, float(height() - 1))) / int32_t(tileHeight);
+
+    // Edge i runs from vertex i to the next; a pixel center is inside where
+    // all three are non-negative, whichever way the triangle winds.
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    float edgeX[3], edgeY[3], edgeC[3];
+    for (int i = 0; i < 3; ++i) {
+        const float* a = v[i];
+        const float* b = v[(i + 1) % 3];
+        edgeX[i] = -(b[1] - a[1]) * sign;
+        edgeY[i] = (b[0] - a[0]) * sign;
+        edgeC[i] = -(edgeX[i] * a[0] + edgeY[i] * a[1]);
+    }
+
+    // Depth plane, for a bound on the triangle's depth within each tile.
+    float depthX = ((v[1][2] - v[0][2]) * (v[2][1] - v[0][1]) - (v[2][2] - v[0][2]) * (v[1][1] - v[0][1])) / area;
+    float depthY = ((v[2][2] - v[0][2]) * (v[1][0] - v[0][0]) - (v[1][2] - v[0][2]) * (v[2][0] - v[0][0])) / area;
+    float depthC = v[0][2] - depthX * v[0][0] - depthY * v[0][1];
+    float maxDepth = std::max({v[0][2], v[1][2], v[2][2]});
+
+    // Per edge, the offsets from a tile's corner to the pixel centers where
+    // the edge function is least and greatest.
+    float edgeLow[3], edgeHigh[3];
+    for (int i = 0; i < 3; ++i) {
+        float x0 = edgeX[i] * 0.5f, x1 = edgeX[i] * (tileWidth - 0.5f);
+        float y0 = edgeY[i] * 0.5f, y1 = edgeY[i] * (tileHeight - 0.5f);
+        edgeLow[i] = std::min(x0, x1) + std::min(y0, y1);
+        edgeHigh[i] = std::max(x0, x1) + std::max(y0, y1);
+    }
+
+    const Lanes columns = {0.5f, 1.5f, 2.5f, 3.5f};
+    for (int32_t ty = tileY0; ty <= tileY1; ++ty) {
+        for (int32_t tx = tileX0; tx <= tileX1; ++tx) {
+            float x = float(tx * int32_t(tileWidth)), y = float(ty * int32_t(tileHeight));
+            float cornerDepth = depthC + depthX * x + depthY * y;
+            float tileDepth = std::max({cornerDepth, cornerDepth + depthX * tileWidth, cornerDepth + depthY * tileHeight,
+                                        cornerDepth + depthX * tileWidth + depthY * tileHeight});
+            Tile& tile = tiles[uint32_t(ty) * tilesX + uint32_t(tx)];
+            tileDepth = std::min(tileDepth, maxDepth);
+            if (tileDepth >= tile.depth) {
+                continue;
+            }
+
+            // Most tiles of a large triangle are entirely in or out of it.
+            bool outside = false, inside = true;
+            float corner[3];
+            for (int i = 0; i < 3; ++i) {
+                corner[i] = edgeX[i] * x + edgeY[i] * y + edgeC[i];
+                outside |= corner[i] + edgeHigh[i] < 0.0f;
+                inside &= corner[i] + edgeLow[i] >= 0.0f;
+            }
+            if (outside) {
+                continue;
+            }
+            uint32_t coverage = ~0u;
+            if (!inside) {
+                coverage = 0;
+                for (uint32_t row = 0; row < tileHeight; ++row) {
+                    LaneMask left = ~LaneMask{}, right = ~LaneMask{};
+                    for (int i = 0; i < 3; ++i) {
+                        Lanes e = (corner[i] + edgeY[i] * (row + 0.5f)) + edgeX[i] * columns;
+                        left &= e >= 0.0f;
+                        right &= e + edgeX[i] * 4.0f >= 0.0f;
+                    }
+                    coverage |= (laneBits(left) | laneBits(right) << 4) << (row * tileWidth);
+                }
+                if (coverage == 0) {
+                    continue;
+                }
+            }
+            mergeIntoTile(tile.depth, tile.layerDepth, tile.layerMask, coverage, tileDepth);
+        }
+    }
+}
+
+bool OcclusionCuller::visible(const Aabb& box) {
+    counters.tested++;
+
+    // The corners four at a time, near z then far z, into clip space.
+    const float* m = viewProjection.m;
+    const Lanes xs = {box.min.x, box.max.x, box.min.x, box.max.x};
+    const Lanes ys = {box.min.y, box.min.y, box.max.y, box.max.y};
+    Lanes clip[4][2];
+    for (int row = 0; row < 4; ++row) {
+        Lanes base = m[row] * xs + m[4 + row] * ys + m[12 + row];
+        clip[row][0] = base + m[8 + row] * box.min.z;
+        clip[row][1] = base + m[8 + row] * box.max.z;
+    }
+    if (laneBits((clip[3][0] <= minW) | (clip[3][1] <= minW))) {
+        return true;
+    }
+    Lanes x[2], y[2], depth[2];
+    for (int half = 0; half < 2; ++half) {
+        Lanes inverseW = 1.0f / clip[3][half];
+        x[half] = (clip[0][half] * inverseW + 1.0f) * (width() * 0.5f);
+        y[half] = (1.0f - clip[1][half] * inverseW) * (height() * 0.5f);
+        depth[half] = clip[2][half] * inverseW;
+    }
+    Lanes lowX = minLanes(x[0], x[1]), highX = maxLanes(x[0], x[1]);
+    Lanes lowY = minLanes(y[0], y[1]), highY = maxLanes(y[0], y[1]);
+    Lanes lowDepth = minLanes(depth[0], depth[1]);
+    float minX = std::min({lowX[0], lowX[1], lowX[2], lowX[3]}), maxX = std::max({highX[0], highX[1], highX[2], highX[3]});
+    float minY = std::min({lowY[0], lowY[1], lowY[2], lowY[3]}), maxY = std::max({highY[0], highY[1], highY[2], highY[3]});
+    float minDepth = std::min({lowDepth[0], lowDepth[1], lowDepth[2], lowDepth[3]});
+    // Off screen is frustum culling's business.
+    if (maxX <= 0.0f || maxY <= 0.0f || minX >= float(width()) || minY >= float(height())) {
+        return true;
+    }
+
+    // Every pixel the box's rectangle touches.
+    uint32_t x0 = uint32_t(std::max(minX, 0.0f)), x1 = uint32_t(std::min(std::ceil(maxX), float(width()))) - 1;
+    uint32_t y0 = uint32_t(std::max(minY, 0.0f)), y1 = uint32_t(std::min(std::ceil(maxY), float(height()))) - 1;
+    for (uint32_t ty = y0 / tileHeight; ty <= y1 / tileHeight; ++ty) {
+        uint32_t row0 = std::max(y0, ty * tileHeight) - ty * tileHeight;
+        uint32_t row1 = std::min(y1, ty * tileHeight + tileHeight - 1) - ty * tileHeight;
+        for (uint32_t tx = x0 / tileWidth; tx <= x1 / tileWidth; ++tx) {
+            uint32_t column0 = std::max(x0, tx * tileWidth) - tx * tileWidth;
+            uint32_t column1 = std::min(x1, tx * tileWidth + tileWidth - 1) - tx * tileWidth;
+            uint32_t rowBits = (2u << column1) - (1u << column0);
+            uint32_t mask = 0;
+            for (uint32_t row = row0; row <= row1; ++row) {
+                mask |= rowBits << (row * tileWidth);
+            }
+
+            const Tile& tile = tiles[ty * tilesX + tx];
+            float depth = (mask & ~tile.layerMask) == 0 ? tile.layerDepth : tile.depth;
+            if (minDepth <= depth) {
+                return true;
+            }
+        }
+    }
+    counters.occluded++;
+    return false;
+}
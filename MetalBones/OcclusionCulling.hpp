@@ -0,0 +1,67 @@
+//
+//  OcclusionCulling.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.hpp"
+
+struct OcclusionStats {
+    uint32_t triangles;         // rasterized
+    uint32_t skipped;           // crossing the near plane, or seen edge-on
+    uint32_t tested;
+    uint32_t occluded;
+};
+
+// Software occlusion culling in the style of masked occlusion culling: a few
+// large occluders are rasterized on the CPU into a small depth buffer, then
+// bounding boxes are tested against it before their draws are submitted.
+//
+// The buffer is made of 8x4 pixel tiles. Instead of per-pixel depth a tile
+// keeps a depth that all its pixels are known to be in front of, plus a
+// working layer: a coverage mask and the farthest depth within it. Triangles
+// merge into the working layer, and once it covers the whole tile it becomes
+// the tile's depth. Depth is Metal's z / w, smaller is nearer.
+class OcclusionCuller {
+public:
+    static constexpr uint32_t tileWidth = 8;
+    static constexpr uint32_t tileHeight = 4;
+
+    // In pixels, rounded up to whole tiles.
+    OcclusionCuller(uint32_t width, uint32_t height);
+
+    // Clears the buffer for a new frame.
+    void begin(const Float4x4& viewProjection);
+
+    // World-space triangles, either winding. Triangles crossing the near
+    // plane are left out, which can only make the culling less effective.
+    void renderOccluder(const Float3* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t triangleCount);
+
+    // False only when everything rendered so far hides the box.
+    bool visible(const Aabb& box);
+
+    uint32_t width() const { return tilesX * tileWidth; }
+    uint32_t height() const { return tilesY * tileHeight; }
+    const OcclusionStats& stats() const { return counters; }
+
+private:
+    struct Tile {
+        float depth;            // every pixel is nearer than this
+        float layerDepth;       // every pixel in layerMask is nearer than this
+        uint32_t layerMask;     // bit row * tileWidth + column
+    };
+
+    // Screen-space x and y in pixels, and depth.
+    void rasterize(const float (&vertices)[3][3]);
+
+    uint32_t tilesX;
+    uint32_t tilesY;
+    std::vector<Tile> tiles;
+    std::vector<float> clipVertices;    // x, y, z, w per occluder vertex
+    Float4x4 viewProjection = {};
+    OcclusionStats counters = {};
+};
@@ -0,0 +1,92 @@
+//
+//  PaletteDeltas.cpp
+//  MetalBones
+//
+
+#include "PaletteDeltas.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static PaletteRows toRows(const Float4x4& m) {
+    // Column-major in, row-major out.
+    return {{
+        m.m[0], m.m[4], m.m[8],  m.m[12],
+        m.m[1], m.m[5], m.m[9],  m.m[13],
+        m.m[2], m.m[6], m.m[10], m.m[14],
+    }};
+}
+
+// The last row of an affine palette matrix never changes, comparing all
+// sixteen floats is just the cheapest way to load them.
+static bool differs(const Float4x4& a, const Float4x4& b, float epsilon) {
+#if defined(__ARM_NEON)
+    float32x4_t limit = vdupq_n_f32(epsilon);
+    uint32x4_t over = vcagtq_f32(vsubq_f32(vld1q_f32(a.m), vld1q_f32(b.m)), limit);
+    for (int i = 4; i < 16; i += 4) {
+        over = vorrq_u32(over, vcagtq_f32(vsubq_f32(vld1q_f32(a.m + i), vld1q_f32(b.m + i)), limit));
+    }
+    return vmaxvq_u32(over) != 0;
+#elif defined(__SSE2__)
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 limit = _mm_set1_ps(epsilon);
+    __m128 over = _mm_cmpgt_ps(_mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(a.m), _mm_loadu_ps(b.m))), limit);
+    for (int i = 4; i < 16; i += 4) {
+        over = _mm_or_ps(over, _mm_cmpgt_ps(_mm_andnot_ps(sign, _mm_sub_ps(_mm_loadu_ps(a.m + i), _mm_loadu_ps(b.m + i))), limit));
+    }
+    return _mm_movemask_ps(over) != 0;
+#else
+    float difference = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        difference = std::max(difference, std::fabs(a.m[i] - b.m[i]));
+    }
+    return difference > epsilon;
+#endif
+}
+
+uint32_t PaletteDeltaEncoder::addCharacter(uint32_t jointCount) {
+    characters.push_back({uint32_t(shadow.size()), jointCount, false});
+    shadow.resize(shadow.size() + jointCount);
+    return uint32_t(characters.size() - 1);
+}
+
+void PaletteDeltaEncoder::beginFrame() {
+    joints.clear();
+    rows.clear();
+    frameStats = {};
+}
+
+uint32_t PaletteDeltaEncoder::update(uint32_t index, const Float4x4* palette) {
+    auto start = std::chrono::steady_clock::now();
+
+    Character& character = characters[index];
+    Float4x4* sent = &shadow[character.firstJoint];
+    const uint32_t before = uint32_t(joints.size());
+
+    for (uint32_t j = 0; j < character.jointCount; ++j) {
+        if (character.resident && !differs(palette[j], sent[j], epsilon)) {
+            continue;
+        }
+        sent[j] = palette[j];
+        joints.push_back(character.firstJoint + j);
+        rows.push_back(toRows(palette[j]));
+    }
+    character.resident = true;
+
+    const uint32_t dirty = uint32_t(joints.size()) - before;
+    frameStats.characters++;
+    frameStats.joints += character.jointCount;
+    frameStats.dirtyJoints += dirty;
+    frameStats.bytesUploaded += updateBytes(dirty);
+    frameStats.fullUploadBytes += character.jointCount * sizeof(Float4x4);
+
+    auto end = std::chrono::steady_clock::now();
+    frameStats.seconds += std::chrono::duration<double>(end - start).count();
+    return dirty;
+}
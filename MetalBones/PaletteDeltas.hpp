@@ -0,0 +1,75 @@
+//
+//  PaletteDeltas.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Math.hpp"
+
+// Affine part of a palette matrix as three rows, the bottom row is always 0 0 0 1.
+struct PaletteRows {
+    float rows[12];
+};
+
+static_assert(sizeof(PaletteRows) == 48);
+
+struct PaletteStreamStats {
+    uint32_t characters;
+    uint32_t joints;
+    uint32_t dirtyJoints;
+    size_t bytesUploaded;
+    size_t fullUploadBytes;     // what uploading every palette in full would have cost
+    double seconds;             // dirty detection and packing
+};
+
+// Keeps a copy of what every character last sent to the GPU and collects only
+// the joints that moved by more than epsilon since then. Updates are packed as
+// a destination joint index stream plus a 3x4 row stream, ready to be scattered
+// into a persistent palette buffer.
+class PaletteDeltaEncoder {
+public:
+    explicit PaletteDeltaEncoder(float epsilon = 1e-5f) : epsilon(epsilon) {}
+
+    // Reserves a contiguous region; returns the character id.
+    uint32_t addCharacter(uint32_t jointCount);
+
+    uint32_t jointCount(uint32_t character) const { return characters[character].jointCount; }
+    // First joint of the character's region in the persistent buffer.
+    uint32_t firstJoint(uint32_t character) const { return characters[character].firstJoint; }
+    uint32_t totalJoints() const { return uint32_t(shadow.size()); }
+
+    void beginFrame();
+
+    // Appends the joints of `palette` that differ from the last sent values.
+    // The first update of a character, or one after invalidate(), sends everything.
+    uint32_t update(uint32_t character, const Float4x4* palette);
+    void invalidate(uint32_t character) { characters[character].resident = false; }
+
+    const uint32_t* updateJoints() const { return joints.data(); }
+    const PaletteRows* updateRows() const { return rows.data(); }
+    uint32_t updateCount() const { return uint32_t(joints.size()); }
+    static size_t updateBytes(uint32_t count) { return count * (sizeof(uint32_t) + sizeof(PaletteRows)); }
+
+    const PaletteStreamStats& stats() const { return frameStats; }
+
+private:
+    struct Character {
+        uint32_t firstJoint;
+        uint32_t jointCount;
+        bool resident;
+    };
+
+    float epsilon;
+    std::vector<Character> characters;
+    std::vector<Float4x4> shadow;
+
+    std::vector<uint32_t> joints;
+    std::vector<PaletteRows> rows;
+
+    PaletteStreamStats frameStats = {};
+};
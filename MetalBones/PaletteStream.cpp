@@ -0,0 +1,90 @@
+//
+//  PaletteStream.cpp
+//  MetalBones
+//
+
+#include "PaletteStream.hpp"
+
+#include <algorithm>
+
+PaletteStream::PaletteStream(MTL::Device* device, MTL::Library* library, uint32_t maxJoints,
+                             uint32_t framesInFlight, float epsilon)
+    : device(device->retain())
+    , maxJoints(maxJoints)
+    , deltas(epsilon)
+{
+    buildPipeline(library);
+
+    paletteBuffer = device->newBuffer(std::max<size_t>(maxJoints, 1) * sizeof(Float4x4), MTL::ResourceStorageModePrivate);
+    uploads.resize(std::max(framesInFlight, 1u), Upload{nullptr, 0});
+}
+
+PaletteStream::~PaletteStream() {
+    for (Upload& upload : uploads) {
+        if (upload.buffer) {
+            upload.buffer->release();
+        }
+    }
+    paletteBuffer->release();
+    scatterPipeline->release();
+    device->release();
+}
+
+void PaletteStream::buildPipeline(MTL::Library* library) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    MTL::Function* function = library->newFunction(NS::String::string("paletteScatter", UTF8StringEncoding));
+
+    NS::Error* error = nullptr;
+    scatterPipeline = device->newComputePipelineState(function, &error);
+    if (!scatterPipeline) {
+        __builtin_printf("%s", error->localizedDescription()->utf8String());
+        assert(false);
+    }
+
+    function->release();
+}
+
+uint32_t PaletteStream::addCharacter(uint32_t jointCount) {
+    assert(deltas.totalJoints() + jointCount <= maxJoints);
+    return deltas.addCharacter(jointCount);
+}
+
+void PaletteStream::encode(MTL::CommandBuffer* commandBuffer) {
+    const uint32_t count = deltas.updateCount();
+    if (count == 0) {
+        return;
+    }
+
+    // Joint indices first, rows after them on a 16 byte boundary.
+    const size_t rowsOffset = (size_t(count) * sizeof(uint32_t) + 15) & ~size_t(15);
+    const size_t length = rowsOffset + size_t(count) * sizeof(PaletteRows);
+
+    Upload& upload = uploads[uploadIndex];
+    uploadIndex = (uploadIndex + 1) % uploads.size();
+
+    if (upload.capacity < length) {
+        if (upload.buffer) {
+            upload.buffer->release();
+        }
+        // Grow geometrically so a burst of full uploads doesn't reallocate every frame.
+        upload.capacity = std::max(length, upload.capacity * 2);
+        upload.buffer = device->newBuffer(upload.capacity, MTL::ResourceStorageModeManaged);
+    }
+
+    uint8_t* contents = static_cast<uint8_t*>(upload.buffer->contents());
+    memcpy(contents, deltas.updateJoints(), count * sizeof(uint32_t));
+    memcpy(contents + rowsOffset, deltas.updateRows(), count * sizeof(PaletteRows));
+    upload.buffer->didModifyRange(NS::Range::Make(0, length));
+
+    MTL::ComputeCommandEncoder* encoder = commandBuffer->computeCommandEncoder();
+    encoder->setComputePipelineState(scatterPipeline);
+    encoder->setBuffer(upload.buffer, 0, 0);
+    encoder->setBuffer(upload.buffer, rowsOffset, 1);
+    encoder->setBuffer(paletteBuffer, 0, 2);
+    encoder->setBytes(&count, sizeof(uint32_t), 3);
+
+    NS::UInteger width = std::min<NS::UInteger>(scatterPipeline->maxTotalThreadsPerThreadgroup(), scatterPipeline->threadExecutionWidth() * 4);
+    encoder->dispatchThreads(MTL::Size::Make(count, 1, 1), MTL::Size::Make(width, 1, 1));
+    encoder->endEncoding();
+}
@@ -0,0 +1,56 @@
+//
+//  PaletteStream.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "PaletteDeltas.hpp"
+
+// Owns a private float4x4 palette buffer that persists across frames. Each
+// frame only the dirty joints are written to a small upload buffer and a
+// compute pass scatters them into place, ahead of any skinning in the same
+// command buffer. Upload buffers rotate, so at most `framesInFlight` command
+// buffers may be in flight at once.
+class PaletteStream {
+public:
+    PaletteStream(MTL::Device* device, MTL::Library* library, uint32_t maxJoints,
+                  uint32_t framesInFlight = 3, float epsilon = 1e-5f);
+    ~PaletteStream();
+
+    uint32_t addCharacter(uint32_t jointCount);
+
+    void beginFrame() { deltas.beginFrame(); }
+    uint32_t update(uint32_t character, const Float4x4* palette) { return deltas.update(character, palette); }
+    void invalidate(uint32_t character) { deltas.invalidate(character); }
+    // For systems that drive the updates themselves, like SkinnedCrowd.
+    PaletteDeltaEncoder& encoder() { return deltas; }
+
+    // Does nothing when no joint changed.
+    void encode(MTL::CommandBuffer* commandBuffer);
+
+    MTL::Buffer* palette() const { return paletteBuffer; }
+    NS::UInteger paletteOffset(uint32_t character) const { return deltas.firstJoint(character) * sizeof(Float4x4); }
+
+    const PaletteStreamStats& stats() const { return deltas.stats(); }
+
+private:
+    struct Upload {
+        MTL::Buffer* buffer;
+        size_t capacity;
+    };
+
+    void buildPipeline(MTL::Library* library);
+
+    MTL::Device* device;
+    MTL::ComputePipelineState* scatterPipeline;
+    MTL::Buffer* paletteBuffer;
+
+    std::vector<Upload> uploads;
+    uint32_t uploadIndex = 0;
+    uint32_t maxJoints;
+
+    PaletteDeltaEncoder deltas;
+};
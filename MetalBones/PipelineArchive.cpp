@@ -0,0 +1,135 @@
+//
+//  PipelineArchive.cpp
+//  MetalBones
+//
+
+#include "PipelineArchive.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// Everything after "name " up to the end of the line; device names have spaces.
+static bool readField(std::istream& in, const char* name, std::string& value) {
+    std::string line;
+    size_t length = strlen(name);
+    if (!std::getline(in, line) || line.compare(0, length, name) != 0 || line.size() <= length || line[length] != ' ') {
+        return false;
+    }
+    value = line.substr(length + 1);
+    return true;
+}
+
+// Always written with all 16 digits, so a truncated line doesn't parse.
+static bool parseHex(const std::string& text, uint64_t& value) {
+    if (text.size() != 16) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        uint32_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = uint32_t(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = uint32_t(c - 'a' + 10);
+        } else {
+            return false;
+        }
+        value = value << 4 | digit;
+    }
+    return true;
+}
+
+static std::string hex(uint64_t value) {
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+    return text;
+}
+
+PipelineArchiveManifest::PipelineArchiveManifest(const PipelineArchiveVersion& version)
+    : current(version)
+{
+}
+
+PipelineArchiveStatus PipelineArchiveManifest::load(const std::string& path) {
+    keys.clear();
+
+    std::ifstream in(path);
+    if (!in) {
+        return PipelineArchiveStatus::Missing;
+    }
+
+    std::string format, count;
+    PipelineArchiveVersion stored;
+    std::string shaderHash;
+    uint64_t keyCount = 0;
+    if (!readField(in, "MetalBonesPipelineArchive", format) || !readField(in, "device", stored.device)
+        || !readField(in, "os", stored.osBuild) || !readField(in, "shaders", shaderHash)
+        || !parseHex(shaderHash, stored.shaderHash) || !readField(in, "pipelines", count)) {
+        return PipelineArchiveStatus::Corrupt;
+    }
+    std::istringstream countStream(count);
+    if (!(countStream >> keyCount)) {
+        return PipelineArchiveStatus::Corrupt;
+    }
+    if (format != std::to_string(formatVersion) || !(stored == current)) {
+        return PipelineArchiveStatus::Stale;
+    }
+
+    std::string line;
+    for (uint64_t i = 0; i < keyCount; ++i) {
+        uint64_t key;
+        if (!std::getline(in, line) || !parseHex(line, key)) {
+            keys.clear();
+            return PipelineArchiveStatus::Corrupt;
+        }
+        keys.insert(key);
+    }
+    return PipelineArchiveStatus::Valid;
+}
+
+bool PipelineArchiveManifest::save(const std::string& path) const {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << "MetalBonesPipelineArchive " << formatVersion << '\n'
+            << "device " << current.device << '\n'
+            << "os " << current.osBuild << '\n'
+            << "shaders " << hex(current.shaderHash) << '\n'
+            << "pipelines " << keys.size() << '\n';
+        for (uint64_t key : keys) {
+            out << hex(key) << '\n';
+        }
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool PipelineArchiveManifest::contains(uint64_t key) {
+    counters.lookups++;
+    bool found = keys.count(key) != 0;
+    counters.hits += found;
+    return found;
+}
+
+uint64_t hashFileContents(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return 0;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    std::vector<char> buffer(1 << 16);
+    while (in) {
+        in.read(buffer.data(), std::streamsize(buffer.size()));
+        std::streamsize read = in.gcount();
+        for (std::streamsize i = 0; i < read; ++i) {
+            hash = (hash ^ uint8_t(buffer[size_t(i)])) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,59 @@
+//
+//  PipelineArchive.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+
+// What a binary archive was built for. Compiled pipelines are only good for
+// the GPU, OS build and shader library that produced them.
+struct PipelineArchiveVersion {
+    std::string device;
+    std::string osBuild;
+    uint64_t shaderHash = 0;
+
+    bool operator==(const PipelineArchiveVersion&) const = default;
+};
+
+enum class PipelineArchiveStatus { Valid, Missing, Corrupt, Stale };
+
+struct PipelineArchiveStats {
+    uint64_t lookups;
+    uint64_t hits;
+};
+
+// The pipeline keys (see hashPipelineDesc) serialized into an on-disk binary
+// archive, saved next to it as a small text file. An archive whose manifest
+// doesn't match the running version, or doesn't parse, must be thrown away.
+class PipelineArchiveManifest {
+public:
+    static constexpr uint32_t formatVersion = 1;
+
+    explicit PipelineArchiveManifest(const PipelineArchiveVersion& version);
+
+    // Anything but Valid leaves the manifest empty.
+    PipelineArchiveStatus load(const std::string& path);
+    // Writes a temporary file and renames it over `path`.
+    bool save(const std::string& path) const;
+
+    // Counts towards the hit rate.
+    bool contains(uint64_t key);
+    void add(uint64_t key) { keys.insert(key); }
+    void clear() { keys.clear(); }
+
+    size_t size() const { return keys.size(); }
+    const PipelineArchiveVersion& version() const { return current; }
+    const PipelineArchiveStats& stats() const { return counters; }
+
+private:
+    PipelineArchiveVersion current;
+    std::unordered_set<uint64_t> keys;
+    PipelineArchiveStats counters = {};
+};
+
+// Hash of a file's bytes, for the shader library; 0 when it can't be read.
+uint64_t hashFileContents(const std::string& path);
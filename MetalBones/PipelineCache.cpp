@@ -0,0 +1,197 @@
+//
+//  PipelineCache.cpp
+//  MetalBones
+//
+
+#include "PipelineCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static void hashInteger(uint64_t& hash, uint64_t value) {
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 32;
+}
+
+// Eight bytes at a time, little-endian whatever the host is.
+static void hashString(uint64_t& hash, const std::string& string) {
+    hashInteger(hash, string.size());
+    for (size_t i = 0; i < string.size(); i += 8) {
+        uint64_t word = 0;
+        for (size_t j = i; j < std::min(i + 8, string.size()); ++j) {
+            word |= uint64_t(uint8_t(string[j])) << ((j - i) * 8);
+        }
+        hashInteger(hash, word);
+    }
+}
+
+uint64_t hashPipelineDesc(const PipelineDesc& desc) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hashString(hash, desc.vertexFunction);
+    hashString(hash, desc.fragmentFunction);
+    hashInteger(hash, desc.features);
+    for (const VertexAttributeDesc& attribute : desc.attributes) {
+        hashInteger(hash, attribute.format | uint64_t(attribute.offset) << 32);
+        hashInteger(hash, attribute.bufferIndex);
+    }
+    for (uint32_t stride : desc.vertexStrides) {
+        hashInteger(hash, stride);
+    }
+    for (uint32_t format : desc.colorFormats) {
+        hashInteger(hash, format);
+    }
+    for (const BlendDesc& blend : desc.blending) {
+        const uint8_t fields[] = {
+            blend.enabled, blend.writeMask, blend.rgbOperation, blend.alphaOperation,
+            blend.sourceRGBFactor, blend.sourceAlphaFactor, blend.destinationRGBFactor, blend.destinationAlphaFactor,
+        };
+        uint64_t packed = 0;
+        for (uint32_t i = 0; i < 8; ++i) {
+            packed |= uint64_t(fields[i]) << (i * 8);
+        }
+        hashInteger(hash, packed);
+    }
+    hashInteger(hash, desc.depthFormat | uint64_t(desc.stencilFormat) << 32);
+    hashInteger(hash, desc.sampleCount | uint64_t(desc.indirectCommands) << 32);
+    return hash;
+}
+
+PipelineCache::PipelineCache(PipelineCompiler& compiler, uint32_t maxInFlight)
+    : compiler(compiler)
+    , maxInFlight(maxInFlight > 0 ? maxInFlight : 1)
+{
+}
+
+PipelineCache::~PipelineCache() {
+    while (inFlight > 0) {
+        publishFinished(true);
+    }
+    for (auto& [key, entry] : entries) {
+        if (entry.pipeline) {
+            compiler.release(entry.pipeline);
+        }
+    }
+}
+
+PipelineCache::Entry& PipelineCache::entry(const PipelineDesc& desc, uint64_t key) {
+    auto [it, inserted] = entries.try_emplace(key);
+    if (inserted) {
+        it->second.desc = desc;
+    }
+    // Two descriptions sharing 64 bits of hash would silently share a pipeline.
+    assert(it->second.desc == desc);
+    return it->second;
+}
+
+void* PipelineCache::lookup(Entry& entry, uint64_t key) {
+    if (entry.state == State::Ready) {
+        counters.hits++;
+        return entry.pipeline;
+    }
+
+    counters.misses++;
+    if (entry.state == State::Queued && !entry.urgent) {
+        entry.urgent = true;
+        urgent.push_back(key);
+    }
+    return nullptr;
+}
+
+void* PipelineCache::find(const PipelineDesc& desc) {
+    uint64_t key = hashPipelineDesc(desc);
+    return lookup(entry(desc, key), key);
+}
+
+void* PipelineCache::find(uint64_t key) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        counters.misses++;
+        return nullptr;
+    }
+    return lookup(it->second, key);
+}
+
+uint64_t PipelineCache::prewarm(const PipelineDesc& desc) {
+    uint64_t key = hashPipelineDesc(desc);
+    size_t count = entries.size();
+    entry(desc, key);
+    if (entries.size() != count) {
+        background.push_back(key);
+    }
+    return key;
+}
+
+uint64_t PipelineCache::insert(const PipelineDesc& desc, void* pipeline) {
+    uint64_t key = hashPipelineDesc(desc);
+    Entry& inserted = entry(desc, key);
+    assert(inserted.state != State::Compiling);
+    if (inserted.pipeline && inserted.pipeline != pipeline) {
+        compiler.release(inserted.pipeline);
+    }
+    inserted.pipeline = pipeline;
+    inserted.state = State::Ready;
+    return key;
+}
+
+bool PipelineCache::ready(uint64_t key) const {
+    auto it = entries.find(key);
+    return it != entries.end() && it->second.state == State::Ready;
+}
+
+void PipelineCache::publishFinished(bool wait) {
+    std::vector<Finished> done;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wait) {
+            finishedCondition.wait(lock, [this] { return !finished.empty(); });
+        }
+        done.swap(finished);
+    }
+
+    for (const Finished& result : done) {
+        Entry& compiled = entries[result.key];
+        compiled.pipeline = result.pipeline;
+        compiled.state = result.pipeline ? State::Ready : State::Failed;
+        counters.compiled += result.pipeline != nullptr;
+        counters.failed += result.pipeline == nullptr;
+        inFlight--;
+    }
+}
+
+void PipelineCache::start(uint64_t key, Entry& entry) {
+    entry.state = State::Compiling;
+    inFlight++;
+    // May complete before compile() even returns.
+    compiler.compile(entry.desc, [this, key](void* pipeline) {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back({key, pipeline});
+        finishedCondition.notify_all();
+    });
+}
+
+void PipelineCache::update() {
+    publishFinished(false);
+
+    while (inFlight < maxInFlight && (!urgent.empty() || !background.empty())) {
+        std::deque<uint64_t>& queue = urgent.empty() ? background : urgent;
+        uint64_t key = queue.front();
+        queue.pop_front();
+
+        Entry& queued = entries[key];
+        // Urgent descriptions are also still in the background queue.
+        if (queued.state == State::Queued) {
+            start(key, queued);
+        }
+    }
+
+    counters.queued = uint32_t(urgent.size() + background.size());
+    counters.inFlight = inFlight;
+}
+
+void PipelineCache::waitIdle() {
+    update();
+    while (inFlight > 0) {
+        publishFinished(true);
+        update();
+    }
+}
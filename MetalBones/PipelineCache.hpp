@@ -0,0 +1,152 @@
+//
+//  PipelineCache.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint32_t maxVertexAttributes = 8;
+constexpr uint32_t maxVertexBuffers = 4;
+constexpr uint32_t maxColorAttachments = 4;
+
+// Formats, operations and factors are the raw MTL enum values, so that none
+// of this depends on Metal. A zero format means the slot is unused.
+struct VertexAttributeDesc {
+    uint32_t format = 0;
+    uint32_t offset = 0;
+    uint32_t bufferIndex = 0;
+
+    bool operator==(const VertexAttributeDesc&) const = default;
+};
+
+struct BlendDesc {
+    bool enabled = false;
+    uint8_t writeMask = 0xf;
+    uint8_t rgbOperation = 0;               // add
+    uint8_t alphaOperation = 0;
+    uint8_t sourceRGBFactor = 1;            // one
+    uint8_t sourceAlphaFactor = 1;
+    uint8_t destinationRGBFactor = 0;       // zero
+    uint8_t destinationAlphaFactor = 0;
+
+    bool operator==(const BlendDesc&) const = default;
+};
+
+struct PipelineDesc {
+    std::string vertexFunction;
+    std::string fragmentFunction;
+    uint32_t features = 0;                  // ShaderFeatures mask, see ShaderPermutations.hpp
+    VertexAttributeDesc attributes[maxVertexAttributes];
+    uint32_t vertexStrides[maxVertexBuffers] = {};
+    uint32_t colorFormats[maxColorAttachments] = {};
+    BlendDesc blending[maxColorAttachments];
+    uint32_t depthFormat = 0;
+    uint32_t stencilFormat = 0;
+    uint32_t sampleCount = 1;
+    bool indirectCommands = false;          // can be inherited by indirect command buffers
+
+    bool operator==(const PipelineDesc&) const = default;
+};
+
+// Mixes the fields rather than the bytes of the struct, so padding never leaks
+// in and a description hashes the same on every run and every machine.
+uint64_t hashPipelineDesc(const PipelineDesc& desc);
+
+// Compiles descriptions without blocking the caller. `done` can run on any
+// thread, with null when compilation failed; `desc` is only valid during the
+// call to compile().
+class PipelineCompiler {
+public:
+    using Completion = std::function<void(void* pipeline)>;
+
+    virtual ~PipelineCompiler() = default;
+
+    virtual void compile(const PipelineDesc& desc, Completion done) = 0;
+    virtual void release(void* pipeline) = 0;
+};
+
+struct PipelineCacheStats {
+    uint64_t hits;
+    uint64_t misses;            // lookups that got null and drew with a fallback
+    uint64_t compiled;
+    uint64_t failed;
+    uint32_t queued;
+    uint32_t inFlight;
+};
+
+// Compiled pipelines keyed by description hash. Lookups never wait: a miss
+// queues the description and returns null, and the caller draws with a
+// fallback until a later frame finds it ready. update() publishes finished
+// compiles and keeps at most `maxInFlight` running, starting descriptions
+// something tried to draw with ahead of prewarmed ones. Everything but the
+// compiler's completions belongs to one thread.
+class PipelineCache {
+public:
+    explicit PipelineCache(PipelineCompiler& compiler, uint32_t maxInFlight = 4);
+    // Waits for compiles in flight, then releases every pipeline.
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    void* find(const PipelineDesc& desc);
+    // Only finds descriptions the cache has seen, see prewarm().
+    void* find(uint64_t key);
+
+    // Queues a compile nobody waits for yet and returns the key.
+    uint64_t prewarm(const PipelineDesc& desc);
+    // Adds a pipeline compiled elsewhere, which the cache then owns.
+    uint64_t insert(const PipelineDesc& desc, void* pipeline);
+
+    bool ready(uint64_t key) const;
+
+    // Once per frame.
+    void update();
+    // Blocks until everything queued has compiled, for loading screens.
+    void waitIdle();
+
+    const PipelineCacheStats& stats() const { return counters; }
+
+private:
+    enum class State : uint8_t { Queued, Compiling, Ready, Failed };
+
+    struct Entry {
+        PipelineDesc desc;
+        void* pipeline = nullptr;
+        State state = State::Queued;
+        bool urgent = false;
+    };
+
+    struct Finished {
+        uint64_t key;
+        void* pipeline;
+    };
+
+    Entry& entry(const PipelineDesc& desc, uint64_t key);
+    void* lookup(Entry& entry, uint64_t key);
+    void publishFinished(bool wait);
+    void start(uint64_t key, Entry& entry);
+
+    PipelineCompiler& compiler;
+    uint32_t maxInFlight;
+
+    std::unordered_map<uint64_t, Entry> entries;
+    std::deque<uint64_t> urgent;
+    std::deque<uint64_t> background;
+    uint32_t inFlight = 0;
+
+    std::mutex mutex;
+    std::condition_variable finishedCondition;
+    std::vector<Finished> finished;
+
+    PipelineCacheStats counters = {};
+};
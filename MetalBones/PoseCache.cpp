@@ -0,0 +1,122 @@
+//
+//  PoseCache.cpp
+//  MetalBones
+//
+
+#include "PoseCache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+static size_t hashCombine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+size_t PoseKeyHash::operator()(const PoseKey& key) const {
+    size_t h = std::hash<const void*>()(key.skeleton);
+    h = hashCombine(h, std::hash<const void*>()(key.clip));
+    h = hashCombine(h, key.quantizedTime);
+    h = hashCombine(h, size_t(key.blendGraphHash));
+    return h;
+}
+
+PoseCache::PoseCache(size_t budgetBytes, float timeQuantum)
+    : budget(budgetBytes)
+    , quantum(timeQuantum)
+{
+    assert(timeQuantum > 0.0f);
+}
+
+size_t PoseCache::entryBytes(uint32_t jointCount) {
+    return sizeof(Entry) + jointCount * sizeof(Float4x4);
+}
+
+void PoseCache::beginFrame() {
+    frame++;
+    evict();
+}
+
+uint32_t PoseCache::quantize(const AnimationClip& clip, float time) const {
+    uint32_t steps = std::max(1u, uint32_t(std::lround(clip.duration() / quantum)));
+    float wrapped = std::fmod(time, clip.duration());
+    if (wrapped < 0.0f) {
+        wrapped += clip.duration();
+    }
+    return uint32_t(std::lround(wrapped / quantum)) % steps;
+}
+
+CachedPose PoseCache::acquire(const PoseKey& key) {
+    return acquire(key, [&key](float time, JointTransform* pose) {
+        key.clip->sample(time, pose, key.clip->jointCount());
+    });
+}
+
+CachedPose PoseCache::acquire(const PoseKey& key, const Sampler& sampler) {
+    auto found = lookup.find(key);
+    if (found != lookup.end()) {
+        Entry& entry = *found->second;
+        lru.splice(lru.begin(), lru, found->second);
+        entry.lastUsedFrame = frame;
+
+        counters.hits++;
+        if (counters.misses > 0) {
+            counters.savedSeconds += counters.samplingSeconds / double(counters.misses);
+        }
+        return {entry.palette.data(), uint32_t(entry.palette.size())};
+    }
+
+    const Skeleton& skeleton = *key.skeleton;
+    const uint32_t count = skeleton.jointCount();
+
+    auto start = std::chrono::steady_clock::now();
+
+    scratch.assign(skeleton.bindPose.begin(), skeleton.bindPose.end());
+    sampler(dequantize(key.quantizedTime), scratch.data());
+
+    lru.push_front({key, std::vector<Float4x4>(count), frame, 0, ~0u});
+    Entry& entry = lru.front();
+    buildMatrixPalette(skeleton, scratch.data(), entry.palette.data());
+
+    auto end = std::chrono::steady_clock::now();
+    counters.samplingSeconds += std::chrono::duration<double>(end - start).count();
+    counters.misses++;
+
+    lookup.emplace(key, lru.begin());
+    usedBytes += entryBytes(count);
+    evict();
+
+    return {entry.palette.data(), count};
+}
+
+void PoseCache::markUploaded(const PoseKey& key, uint32_t slot) {
+    auto found = lookup.find(key);
+    if (found != lookup.end()) {
+        found->second->uploadedFrame = frame;
+        found->second->uploadSlot = slot;
+    }
+}
+
+uint32_t PoseCache::uploadedSlot(const PoseKey& key) {
+    auto found = lookup.find(key);
+    if (found == lookup.end() || found->second->uploadedFrame != frame) {
+        return ~0u;
+    }
+    counters.uploadsSaved++;
+    return found->second->uploadSlot;
+}
+
+void PoseCache::evict() {
+    while (usedBytes > budget && !lru.empty()) {
+        Entry& oldest = lru.back();
+        if (oldest.lastUsedFrame == frame) {
+            // The least recent entry is in use this frame, so all of them are;
+            // run over budget rather than invalidate palettes handed out already.
+            break;
+        }
+        usedBytes -= entryBytes(uint32_t(oldest.palette.size()));
+        lookup.erase(oldest.key);
+        lru.pop_back();
+        counters.evictions++;
+    }
+}
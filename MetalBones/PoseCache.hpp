@@ -0,0 +1,102 @@
+//
+//  PoseCache.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "Animation.hpp"
+
+struct PoseKey {
+    const Skeleton* skeleton;
+    const AnimationClip* clip;
+    uint32_t quantizedTime;
+    uint64_t blendGraphHash;
+
+    bool operator==(const PoseKey& other) const {
+        return skeleton == other.skeleton && clip == other.clip
+            && quantizedTime == other.quantizedTime && blendGraphHash == other.blendGraphHash;
+    }
+};
+
+struct PoseKeyHash {
+    size_t operator()(const PoseKey& key) const;
+};
+
+struct PoseCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t uploadsSaved;
+    double samplingSeconds;
+    double savedSeconds;
+
+    double hitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+struct CachedPose {
+    const Float4x4* palette;
+    uint32_t jointCount;
+};
+
+// Shares sampled matrix palettes between instances that evaluate the same
+// clip at the same quantized time. Entries used in the current frame are
+// never evicted, so returned palettes stay valid until the next beginFrame().
+class PoseCache {
+public:
+    using Sampler = std::function<void(float time, JointTransform* pose)>;
+
+    PoseCache(size_t budgetBytes, float timeQuantum = 1.0f / 60.0f);
+
+    void beginFrame();
+
+    uint32_t quantize(const AnimationClip& clip, float time) const;
+    float dequantize(uint32_t quantizedTime) const { return float(quantizedTime) * quantum; }
+
+    // Samples the whole clip on a miss.
+    CachedPose acquire(const PoseKey& key);
+    // On a miss `sampler` fills a pose pre-initialized to the skeleton's bind pose.
+    CachedPose acquire(const PoseKey& key, const Sampler& sampler);
+
+    // Palette uploads of a pose are shared within a frame: the first instance
+    // to upload it marks the palette slot it used, and instances showing the
+    // same pose afterwards skin from that slot instead of uploading again.
+    void markUploaded(const PoseKey& key, uint32_t slot);
+    // The slot marked for `key` this frame, or ~0u; a slot counts as an upload saved.
+    uint32_t uploadedSlot(const PoseKey& key);
+
+    size_t bytes() const { return usedBytes; }
+    size_t entries() const { return lookup.size(); }
+    const PoseCacheStats& stats() const { return counters; }
+    void resetStats() { counters = {}; }
+
+private:
+    struct Entry {
+        PoseKey key;
+        std::vector<Float4x4> palette;
+        uint64_t lastUsedFrame;
+        uint64_t uploadedFrame;
+        uint32_t uploadSlot;
+    };
+
+    static size_t entryBytes(uint32_t jointCount);
+    void evict();
+
+    size_t budget;
+    size_t usedBytes = 0;
+    float quantum;
+    uint64_t frame = 1;
+
+    std::list<Entry> lru;
+    std::unordered_map<PoseKey, std::list<Entry>::iterator, PoseKeyHash> lookup;
+    std::vector<JointTransform> scratch;
+
+    PoseCacheStats counters = {};
+};
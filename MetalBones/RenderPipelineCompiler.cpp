@@ -0,0 +1,186 @@
+//
+//  RenderPipelineCompiler.cpp
+//  MetalBones
+//
+
+#include "RenderPipelineCompiler.hpp"
+
+RenderPipelineCompiler::RenderPipelineCompiler(MTL::Device* device, MTL::Library* library)
+    : device(device->retain())
+    , functions(library)
+{
+}
+
+RenderPipelineCompiler::~RenderPipelineCompiler() {
+    if (archive) {
+        archive->release();
+    }
+    device->release();
+}
+
+MTL::RenderPipelineDescriptor* RenderPipelineCompiler::newDescriptor(const PipelineDesc& desc) {
+    ShaderFeatures features = ShaderFeatures::fromMask(desc.features);
+    MTL::Function* vertexFn = functions.function(desc.vertexFunction, features);
+    MTL::Function* fragmentFn = desc.fragmentFunction.empty() ? nullptr : functions.function(desc.fragmentFunction, features);
+    if (!vertexFn || (!fragmentFn && !desc.fragmentFunction.empty())) {
+        __builtin_printf("Missing shader function %s or %s\n", desc.vertexFunction.c_str(), desc.fragmentFunction.c_str());
+        return nullptr;
+    }
+
+    MTL::RenderPipelineDescriptor* descriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    descriptor->setVertexFunction(vertexFn);
+    descriptor->setFragmentFunction(fragmentFn);
+
+    MTL::VertexDescriptor* vertexDescriptor = MTL::VertexDescriptor::alloc()->init();
+    for (uint32_t i = 0; i < maxVertexAttributes; ++i) {
+        const VertexAttributeDesc& attribute = desc.attributes[i];
+        if (attribute.format != 0) {
+            MTL::VertexAttributeDescriptor* attributeDescriptor = vertexDescriptor->attributes()->object(i);
+            attributeDescriptor->setFormat(MTL::VertexFormat(attribute.format));
+            attributeDescriptor->setOffset(attribute.offset);
+            attributeDescriptor->setBufferIndex(attribute.bufferIndex);
+        }
+    }
+    for (uint32_t i = 0; i < maxVertexBuffers; ++i) {
+        if (desc.vertexStrides[i] != 0) {
+            vertexDescriptor->layouts()->object(i)->setStride(desc.vertexStrides[i]);
+        }
+    }
+    descriptor->setVertexDescriptor(vertexDescriptor);
+    vertexDescriptor->release();
+
+    for (uint32_t i = 0; i < maxColorAttachments; ++i) {
+        if (desc.colorFormats[i] == 0) {
+            continue;
+        }
+        const BlendDesc& blend = desc.blending[i];
+        MTL::RenderPipelineColorAttachmentDescriptor* attachment = descriptor->colorAttachments()->object(i);
+        attachment->setPixelFormat(MTL::PixelFormat(desc.colorFormats[i]));
+        attachment->setWriteMask(MTL::ColorWriteMask(blend.writeMask));
+        attachment->setBlendingEnabled(blend.enabled);
+        attachment->setRgbBlendOperation(MTL::BlendOperation(blend.rgbOperation));
+        attachment->setAlphaBlendOperation(MTL::BlendOperation(blend.alphaOperation));
+        attachment->setSourceRGBBlendFactor(MTL::BlendFactor(blend.sourceRGBFactor));
+        attachment->setSourceAlphaBlendFactor(MTL::BlendFactor(blend.sourceAlphaFactor));
+        attachment->setDestinationRGBBlendFactor(MTL::BlendFactor(blend.destinationRGBFactor));
+        attachment->setDestinationAlphaBlendFactor(MTL::BlendFactor(blend.destinationAlphaFactor));
+    }
+    descriptor->setDepthAttachmentPixelFormat(MTL::PixelFormat(desc.depthFormat));
+    descriptor->setStencilAttachmentPixelFormat(MTL::PixelFormat(desc.stencilFormat));
+    descriptor->setRasterSampleCount(desc.sampleCount);
+    descriptor->setSupportIndirectCommandBuffers(desc.indirectCommands);
+
+    return descriptor;
+}
+
+void RenderPipelineCompiler::useArchive(const PipelineDesc& desc, MTL::RenderPipelineDescriptor* descriptor) {
+    if (!archive) {
+        return;
+    }
+    if (manifest.contains(hashPipelineDesc(desc))) {
+        descriptor->setBinaryArchives(NS::Array::array(archive));
+    } else {
+        unarchived.push_back(desc);
+    }
+}
+
+void RenderPipelineCompiler::compile(const PipelineDesc& desc, Completion done) {
+    MTL::RenderPipelineDescriptor* descriptor = newDescriptor(desc);
+    if (!descriptor) {
+        done(nullptr);
+        return;
+    }
+    useArchive(desc, descriptor);
+
+    device->newRenderPipelineState(descriptor, [done](MTL::RenderPipelineState* state, NS::Error* error) {
+        if (!state) {
+            __builtin_printf("%s\n", error->localizedDescription()->utf8String());
+        }
+        // The handler doesn't own the state it is given.
+        done(state ? state->retain() : nullptr);
+    });
+    descriptor->release();
+}
+
+MTL::RenderPipelineState* RenderPipelineCompiler::compileNow(const PipelineDesc& desc) {
+    MTL::RenderPipelineDescriptor* descriptor = newDescriptor(desc);
+    if (!descriptor) {
+        return nullptr;
+    }
+    useArchive(desc, descriptor);
+
+    NS::Error* error = nullptr;
+    MTL::RenderPipelineState* state = device->newRenderPipelineState(descriptor, &error);
+    if (!state) {
+        __builtin_printf("%s\n", error->localizedDescription()->utf8String());
+    }
+    descriptor->release();
+    return state;
+}
+
+PipelineArchiveStatus RenderPipelineCompiler::openArchive(const std::string& directory) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    PipelineArchiveVersion version;
+    version.device = device->name()->utf8String();
+    version.osBuild = NS::ProcessInfo::processInfo()->operatingSystemVersionString()->utf8String();
+    version.shaderHash = hashFileContents(std::string(NS::Bundle::mainBundle()->resourcePath()->utf8String()) + "/default.metallib");
+
+    manifest = PipelineArchiveManifest(version);
+    archivePath = directory + "/pipelines.binarchive";
+    manifestPath = directory + "/pipelines.manifest";
+    PipelineArchiveStatus status = manifest.load(manifestPath);
+
+    MTL::BinaryArchiveDescriptor* descriptor = MTL::BinaryArchiveDescriptor::alloc()->init();
+    if (status == PipelineArchiveStatus::Valid) {
+        descriptor->setUrl(NS::URL::fileURLWithPath(NS::String::string(archivePath.c_str(), UTF8StringEncoding)));
+    }
+
+    NS::Error* error = nullptr;
+    archive = device->newBinaryArchive(descriptor, &error);
+    if (!archive && status == PipelineArchiveStatus::Valid) {
+        // The manifest outlived its archive; start over.
+        manifest.clear();
+        status = PipelineArchiveStatus::Corrupt;
+        descriptor->setUrl(nullptr);
+        archive = device->newBinaryArchive(descriptor, &error);
+    }
+    if (!archive) {
+        __builtin_printf("%s\n", error->localizedDescription()->utf8String());
+    }
+    descriptor->release();
+    return status;
+}
+
+void RenderPipelineCompiler::saveArchive() {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    if (!archive || unarchived.empty()) {
+        return;
+    }
+
+    NS::Error* error = nullptr;
+    for (const PipelineDesc& desc : unarchived) {
+        MTL::RenderPipelineDescriptor* descriptor = newDescriptor(desc);
+        if (!descriptor) {
+            continue;
+        }
+        if (archive->addRenderPipelineFunctions(descriptor, &error)) {
+            manifest.add(hashPipelineDesc(desc));
+        }
+        descriptor->release();
+    }
+    unarchived.clear();
+
+    NS::URL* url = NS::URL::fileURLWithPath(NS::String::string(archivePath.c_str(), UTF8StringEncoding));
+    if (!archive->serializeToURL(url, &error)) {
+        __builtin_printf("%s\n", error->localizedDescription()->utf8String());
+        return;
+    }
+    // Only once the archive is on disk, so the manifest never lists more than it holds.
+    manifest.save(manifestPath);
+}
+
+void RenderPipelineCompiler::release(void* pipeline) {
+    static_cast<MTL::RenderPipelineState*>(pipeline)->release();
+}
@@ -0,0 +1,52 @@
+//
+//  RenderPipelineCompiler.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <string>
+#include <vector>
+
+#include "PipelineArchive.hpp"
+#include "PipelineCache.hpp"
+#include "ShaderFunctionCache.hpp"
+
+// Builds render pipeline states from PipelineDesc with functions out of one
+// library, specialized for the description's features. Asynchronously for
+// PipelineCache, synchronously for the few pipelines that have to exist
+// before the first frame.
+class RenderPipelineCompiler : public PipelineCompiler {
+public:
+    RenderPipelineCompiler(MTL::Device* device, MTL::Library* library);
+    ~RenderPipelineCompiler() override;
+
+    void compile(const PipelineDesc& desc, Completion done) override;
+    void release(void* pipeline) override;
+
+    MTL::RenderPipelineState* compileNow(const PipelineDesc& desc);
+
+    // Loads the binary archive kept in `directory` when its manifest matches
+    // this device, OS build and shader library, or starts an empty one.
+    PipelineArchiveStatus openArchive(const std::string& directory);
+    // Adds what was compiled without the archive to it and writes both files.
+    void saveArchive();
+
+    const PipelineArchiveStats& archiveStats() const { return manifest.stats(); }
+
+private:
+    // Null when a function is missing from the library.
+    MTL::RenderPipelineDescriptor* newDescriptor(const PipelineDesc& desc);
+    void useArchive(const PipelineDesc& desc, MTL::RenderPipelineDescriptor* descriptor);
+
+    MTL::Device* device;
+    ShaderFunctionCache functions;
+
+    MTL::BinaryArchive* archive = nullptr;
+    PipelineArchiveManifest manifest{{}};
+    std::string archivePath;
+    std::string manifestPath;
+    std::vector<PipelineDesc> unarchived;
+};
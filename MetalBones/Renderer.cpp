@@ -7,30 +7,105 @@
 
 #include "Renderer.hpp"
 
+#include <dispatch/dispatch.h>
 #include <simd/simd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+
+#include "ShaderPermutations.hpp"
 
 Renderer::Renderer(MTL::Device* device) 
     : device(device->retain())
 {
     commandQueue = device->newCommandQueue();
+    frameEvent = device->newSharedEvent();
+    frameSemaphore = dispatch_semaphore_create(maxFramesInFlight);
+    bufferHeap = new GpuHeapAllocator(device, MTL::StorageModePrivate);
+    uploads = new UploadManager(device, commandQueue);
+    lighting = new ClusteredLighting(device, 16, 9, 24, maxFramesInFlight);
+    if (BindlessResources::supported(device)) {
+        bindless = new BindlessResources(device);
+    }
     buildShaders();
+    paletteStream = new PaletteStream(device, shaderLibrary, maxPaletteJoints, maxFramesInFlight);
+    crowd = new SkinnedCrowd(paletteStream->encoder(), 4 << 20);
     buildDepthStencilStates();
     buildBuffers();
 }
 
 Renderer::~Renderer() {
-    indexBuffer->release();
-    vertexBuffer->release();
+    // Taking every frame's slot means every frame has completed. The count
+    // goes back up before the release, which libdispatch insists on.
+    for (uint32_t i = 0; i < maxFramesInFlight; ++i) {
+        dispatch_semaphore_wait(frameSemaphore, DISPATCH_TIME_FOREVER);
+    }
+    for (uint32_t i = 0; i < maxFramesInFlight; ++i) {
+        dispatch_semaphore_signal(frameSemaphore);
+    }
+    dispatch_release(frameSemaphore);
+    releases.flush();
+
+    delete gpuScene;
+    delete crowd;
+    delete paletteStream;
+    delete lighting;
+    delete uploads;
+    delete bindless;
+    bufferHeap->release(objectBuffer);
+    for (GpuBuffer& buffer : meshes.column<MeshIndexBuffer>()) {
+        bufferHeap->release(buffer);
+    }
+    for (GpuBuffer& buffer : meshes.column<MeshVertexBuffer>()) {
+        bufferHeap->release(buffer);
+    }
+    delete bufferHeap;
     depthStencilState->release();
-    renderPipelineState->release();
+    delete pipelineCache;
+    // Next launch then finds everything this one compiled.
+    pipelineCompiler->saveArchive();
+    delete pipelineCompiler;
     shaderLibrary->release();
+    frameEvent->release();
     commandQueue->release();
     device->release();
 }
 
+// The per-user cache directory, which the system may purge.
+static std::string pipelineArchiveDirectory() {
+    char path[PATH_MAX];
+    size_t length = confstr(_CS_DARWIN_USER_CACHE_DIR, path, sizeof(path));
+    std::string directory = length > 0 && length <= sizeof(path) ? path : "/tmp/";
+    directory += "MetalBones";
+    mkdir(directory.c_str(), 0755);
+    return directory;
+}
+
+// vertexMain/fragmentMain with the vertex layout `features` need. Skinned
+// meshes keep joints and weights in a second vertex buffer.
+static PipelineDesc generalPipelineDesc(ShaderFeatures features) {
+    PipelineDesc desc;
+    desc.vertexFunction = "vertexMain";
+    desc.fragmentFunction = "fragmentMain";
+    desc.features = pipelinePermutation(desc.vertexFunction, desc.fragmentFunction, features).mask();
+    desc.attributes[0] = {uint32_t(MTL::VertexFormat::VertexFormatFloat3), 0, 0};
+    desc.attributes[1] = {uint32_t(MTL::VertexFormat::VertexFormatFloat3), 4 * sizeof(float), 0};
+    desc.vertexStrides[0] = 8 * sizeof(float);
+    if (features.has(ShaderFeature::Skinning)) {
+        desc.attributes[2] = {uint32_t(MTL::VertexFormat::VertexFormatUShort4), 0, 1};
+        desc.attributes[3] = {uint32_t(MTL::VertexFormat::VertexFormatFloat4), 4 * sizeof(uint16_t), 1};
+        desc.vertexStrides[1] = 4 * sizeof(uint16_t) + 4 * sizeof(float);
+    }
+    desc.colorFormats[0] = uint32_t(MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB);
+    // GpuDrivenScene draws with whatever bindless pipeline is bound.
+    desc.indirectCommands = features.has(ShaderFeature::Bindless);
+//    desc.depthFormat = uint32_t(MTL::PixelFormat::PixelFormatDepth16Unorm);
+    return desc;
+}
+
 void Renderer::buildShaders() {
-    using NS::StringEncoding::UTF8StringEncoding;
-    
     NS::Error* error = nullptr;
     shaderLibrary = device->newDefaultLibrary();
     if (!shaderLibrary) {
@@ -38,42 +113,33 @@ void Renderer::buildShaders() {
         assert(false);
     }
     
-    MTL::Function* vertexFn = shaderLibrary->newFunction(NS::String::string("vertexMain", UTF8StringEncoding));
-    MTL::Function* fragmentFn = shaderLibrary->newFunction(NS::String::string("fragmentMain", UTF8StringEncoding));
-    
-    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
-    pipelineDescriptor->setVertexFunction(vertexFn);
-    pipelineDescriptor->setFragmentFunction(fragmentFn);
-    pipelineDescriptor->colorAttachments()->object(0)->setPixelFormat(MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB);
-//    pipelineDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormat::PixelFormatDepth16Unorm);
-    
-    MTL::VertexDescriptor* vertexDescriptor = MTL::VertexDescriptor::alloc()->init();
-    MTL::VertexAttributeDescriptorArray* attributes = vertexDescriptor->attributes();
-    
-    MTL::VertexAttributeDescriptor* positionDescriptor = attributes->object(0);
-    positionDescriptor->setFormat(MTL::VertexFormat::VertexFormatFloat3);
-    positionDescriptor->setOffset(0);
-    positionDescriptor->setBufferIndex(0);
-    
-    MTL::VertexAttributeDescriptor* colorDescriptor = attributes->object(1);
-    colorDescriptor->setFormat(MTL::VertexFormat::VertexFormatFloat3);
-    colorDescriptor->setOffset(4 * sizeof(float));
-    colorDescriptor->setBufferIndex(0);
-    
-    MTL::VertexBufferLayoutDescriptor* layoutDescriptor = vertexDescriptor->layouts()->object(0);
-    layoutDescriptor->setStride(8 * sizeof(float));
-    
-    pipelineDescriptor->setVertexDescriptor(vertexDescriptor);
-    
-    renderPipelineState = device->newRenderPipelineState(pipelineDescriptor, &error);
-    if (!renderPipelineState) {
-        __builtin_printf("%s", error->localizedDescription()->utf8String());
+    ShaderFeatures features = {ShaderFeature::VertexColor, ShaderFeature::ClusteredLights};
+    if (bindless) {
+        features = features | ShaderFeatures{ShaderFeature::Bindless};
+    }
+    PipelineDesc desc = generalPipelineDesc(features);
+
+    pipelineCompiler = new RenderPipelineCompiler(device, shaderLibrary);
+    pipelineCompiler->openArchive(pipelineArchiveDirectory());
+    pipelineCache = new PipelineCache(*pipelineCompiler);
+
+    // Everything else compiles in the background and draws with this meanwhile.
+    fallbackPipeline = pipelineCompiler->compileNow(desc);
+    if (!fallbackPipeline) {
         assert(false);
     }
-    
-    fragmentFn->release();
-    vertexFn->release();
-    pipelineDescriptor->release();
+    defaultPipeline = pipelines.create(pipelineCache->insert(desc, fallbackPipeline));
+
+    // Every other permutation of it, so that materials switching features on
+    // don't wait for a compile; with the archive this is only slow once.
+    // Bindless ones only where the device has the argument buffers for them.
+    ShaderFeatures used = usedShaderFeatures(desc.vertexFunction) | usedShaderFeatures(desc.fragmentFunction);
+    if (!bindless) {
+        used = ShaderFeatures::fromMask(used.mask() & ~ShaderFeatures{ShaderFeature::Bindless}.mask());
+    }
+    for (ShaderFeatures features : enumerateShaderPermutations(used)) {
+        pipelineCache->prewarm(generalPipelineDesc(features));
+    }
 }
 
 void Renderer::buildDepthStencilStates() {
@@ -86,6 +152,14 @@ void Renderer::buildDepthStencilStates() {
     depthStencilDescriptor->release();
 }
 
+// Matches ObjectData in general.metal.
+struct ObjectData {
+    simd::float4x4 transform;
+    uint32_t palette;
+    uint32_t texture;
+    uint32_t sampler;
+};
+
 void Renderer::buildBuffers() {
     constexpr size_t numVertices = 24;
     
@@ -143,39 +217,179 @@ void Renderer::buildBuffers() {
        20, 21, 22, 22, 23, 20, /* bottom */
     };
     
-    vertexBuffer = device->newBuffer(numVertices * sizeof(Vertex), MTL::ResourceStorageModeManaged);
-    indexBuffer = device->newBuffer(sizeof(indices), MTL::ResourceStorageModeManaged);
+    GpuBuffer vertexBuffer = bufferHeap->newBuffer(numVertices * sizeof(Vertex));
+    GpuBuffer indexBuffer = bufferHeap->newBuffer(sizeof(indices));
+
+    // Copied on the GPU at the start of the first frame.
+    uploads->upload(vertexBuffer.buffer, 0, vertices, numVertices * sizeof(Vertex));
+    uploads->upload(indexBuffer.buffer, 0, indices, sizeof(indices));
+
+    objectBuffer = bufferHeap->newBuffer(maxObjects * sizeof(ObjectData));
+    uint32_t cubeObject = addObject(matrix_identity_float4x4);
+
+    MeshHandle cube = meshes.create(vertexBuffer, indexBuffer, uint32_t(sizeof(indices) / sizeof(indices[0])));
+    drawItems.push_back({cube, materials.create(defaultPipeline), cubeObject});
 
-    memcpy(vertexBuffer->contents(), vertices, numVertices * sizeof(Vertex));
-    memcpy(indexBuffer->contents(), indices, sizeof(indices));
+    // Clustered through sceneLightView().
+    lighting->setProjection(1.5707963f, 1.0f, 1.0f, 10.0f);
 
-    vertexBuffer->didModifyRange(NS::Range::Make(0, vertexBuffer->length()));
-    indexBuffer->didModifyRange(NS::Range::Make(0, indexBuffer->length()));
+    if (bindless) {
+        gpuScene = new GpuDrivenScene(device, shaderLibrary, *uploads, maxObjects,
+                                      maxSceneVertices, maxSceneIndices, sizeof(Vertex));
+    }
+}
+
+uint32_t Renderer::addObject(const simd::float4x4& transform) {
+    ObjectData data = {transform, DescriptorTable::invalidSlot, DescriptorTable::invalidSlot, DescriptorTable::invalidSlot};
+    uint32_t object = objectSlots.allocate();
+    uploads->upload(objectBuffer.buffer, object * sizeof(ObjectData), &data, sizeof(data));
+    return object;
+}
+
+// The rotation vertexMain applies after the object transform.
+static Float4x4 sceneRotation(float t) {
+    Float4x4 rotX = identity4x4();
+    rotX.m[5] = std::cos(t);
+    rotX.m[6] = std::sin(t);
+    rotX.m[9] = -std::sin(t);
+    rotX.m[10] = std::cos(t);
+
+    Float4x4 rotY = identity4x4();
+    rotY.m[0] = std::cos(t);
+    rotY.m[2] = -std::sin(t);
+    rotY.m[8] = std::sin(t);
+    rotY.m[10] = std::cos(t);
+
+    return rotX * rotY;
+}
+
+// What vertexMain does after the object transform.
+static Float4x4 sceneViewProjection(float t) {
+    Float4x4 normZ = identity4x4();
+    const float zNear = 0.01f;
+    const float zFar = 100.0f;
+    normZ.m[10] = (1 - zNear) / zFar;
+    normZ.m[14] = zNear;
+
+    return normZ * sceneRotation(t);
+}
+
+// The scene projects without perspective, so the light clusters use their
+// own camera: the rotated scene mirrored to face down -z and pushed six units
+// into a 90 degree frustum, which it fits whichever way it turns. Mirroring
+// keeps distances, and fragments find their cluster through the same matrix.
+static Float4x4 sceneLightView(float t) {
+    Float4x4 view = identity4x4();
+    view.m[10] = -1.0f;
+    view.m[14] = -6.0f;
+    return view * sceneRotation(t);
+}
+
+// Where sceneLightView() puts its camera, in world space.
+static Float3 sceneCameraPosition(float t) {
+    Float4x4 rotation = sceneRotation(t);
+    return Float3{rotation.m[2], rotation.m[6], rotation.m[10]} * -6.0f;
 }
 
 void Renderer::draw(MTK::View* view) {
     NS::AutoreleasePool* pool = NS::AutoreleasePool::alloc()->init();
     
+    // Per-frame uploads are reused after maxFramesInFlight frames, and the
+    // drawable pool only throttles once a render pass asks for a drawable.
+    // Blocks until the command buffer of that many frames ago has completed.
+    dispatch_semaphore_wait(frameSemaphore, DISPATCH_TIME_FOREVER);
+    frameIndex++;
+    uint64_t completedFrame = frameEvent->signaledValue();
+    releases.collect(completedFrame);
+    objectSlots.collect(completedFrame);
+    if (bindless) {
+        bindless->collect(completedFrame);
+    }
+    frameArena.reset();
+    pipelineCache->update();
+
     MTL::CommandBuffer* commandBuffer = commandQueue->commandBuffer();
+
+    uploads->reclaim();
+    uploads->flush(commandBuffer);
+
+    t += 0.016;
+    // Palettes are scattered ahead of the render pass that skins with them.
+    paletteStream->beginFrame();
+    crowd->update(0.016f, sceneCameraPosition(t), 1.5707963f);
+    paletteStream->encode(commandBuffer);
+
+    if (gpuScene) {
+        gpuScene->cull(commandBuffer, frustumPlanes(sceneViewProjection(t)));
+    }
+
+    lighting->update(sceneLightView(t), lights.data(), uint32_t(lights.size()), &jobs);
+
     MTL::RenderPassDescriptor* renderPassDescriptor = view->currentRenderPassDescriptor();
     MTL::RenderCommandEncoder* encoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
     
-    encoder->setRenderPipelineState(renderPipelineState);
-    encoder->setVertexBuffer(vertexBuffer, 0, 0);
-    
-    t += 0.016;
     encoder->setVertexBytes(&t, sizeof(float), 3);
+    // Per pass rather than per draw: draws only pass their object index.
+    encoder->setVertexBuffer(objectBuffer.buffer, 0, 6);
+    encoder->setFragmentBuffer(objectBuffer.buffer, 0, 6);
+    if (bindless) {
+        bindless->bind(encoder);
+    }
+    lighting->bind(encoder);
     
-    encoder->drawIndexedPrimitives(
-        MTL::PrimitiveType::PrimitiveTypeTriangle,
-        36, MTL::IndexType::IndexTypeUInt16,
-        indexBuffer,
-        0, 1
-    );
+    // Grouped by material so pipeline changes only happen between groups.
+    FrameVector<DrawItem> sortedItems(drawItems.begin(), drawItems.end(), FrameAllocator<DrawItem>(frameArena));
+    std::sort(sortedItems.begin(), sortedItems.end(), [](const DrawItem& a, const DrawItem& b) {
+        return a.material.value < b.material.value;
+    });
+
+    MTL::RenderPipelineState* boundPipeline = nullptr;
+    for (const DrawItem& item : sortedItems) {
+        const PipelineHandle* pipeline = materials.get<MaterialPipeline>(item.material);
+        const uint64_t* key = pipeline ? pipelines.get<PipelineKey>(*pipeline) : nullptr;
+        const GpuBuffer* vertexBuffer = meshes.get<MeshVertexBuffer>(item.mesh);
+        if (!key || !vertexBuffer) {
+            continue;
+        }
+
+        MTL::RenderPipelineState* state = static_cast<MTL::RenderPipelineState*>(pipelineCache->find(*key));
+        if (!state) {
+            state = fallbackPipeline;
+        }
+        if (state != boundPipeline) {
+            encoder->setRenderPipelineState(state);
+            boundPipeline = state;
+        }
+        encoder->setVertexBuffer(vertexBuffer->buffer, 0, 0);
+        if (item.character != ~0u) {
+            uint32_t character = crowd->paletteCharacter(item.character);
+            encoder->setVertexBuffer(paletteStream->palette(), paletteStream->paletteOffset(character), 4);
+        }
+
+        encoder->drawIndexedPrimitives(
+            MTL::PrimitiveType::PrimitiveTypeTriangle,
+            *meshes.get<MeshIndexCount>(item.mesh), MTL::IndexType::IndexTypeUInt16,
+            meshes.get<MeshIndexBuffer>(item.mesh)->buffer,
+            0, 1, 0, item.object
+        );
+    }
+
+    if (gpuScene) {
+        // Its cubes have no skinning data, and the fallback matches their layout.
+        if (boundPipeline != fallbackPipeline) {
+            encoder->setRenderPipelineState(fallbackPipeline);
+        }
+        gpuScene->draw(encoder);
+    }
     
     encoder->endEncoding();
     
     commandBuffer->presentDrawable(view->currentDrawable());
+    commandBuffer->encodeSignalEvent(frameEvent, frameIndex);
+    dispatch_semaphore_t semaphore = frameSemaphore;
+    commandBuffer->addCompletedHandler([semaphore](MTL::CommandBuffer*) {
+        dispatch_semaphore_signal(semaphore);
+    });
     commandBuffer->commit();
     
     pool->release();
@@ -7,9 +7,38 @@
 
 #pragma once
 
+#include <dispatch/dispatch.h>
+#include <simd/simd.h>
+
 #include <Metal/Metal.hpp>
 #include <MetalKit/MetalKit.hpp>
 
+#include "BindlessResources.hpp"
+#include "ClusteredLighting.hpp"
+#include "DeferredRelease.hpp"
+#include "DescriptorTable.hpp"
+#include "FrameArena.hpp"
+#include "GpuDrivenScene.hpp"
+#include "GpuHeapAllocator.hpp"
+#include "HandlePool.hpp"
+#include "JobSystem.hpp"
+#include "PaletteStream.hpp"
+#include "PipelineCache.hpp"
+#include "RenderPipelineCompiler.hpp"
+#include "SkinnedCrowd.hpp"
+#include "UploadManager.hpp"
+
+using MeshHandle = Handle<struct MeshTag>;
+using MaterialHandle = Handle<struct MaterialTag>;
+using PipelineHandle = Handle<struct PipelineTag>;
+
+struct DrawItem {
+    MeshHandle mesh;
+    MaterialHandle material;
+    uint32_t object;            // ObjectData slot, passed as the base instance
+    uint32_t character = ~0u;   // SkinnedCrowd character skinning it, ~0u when rigid
+};
+
 class Renderer {
 public:
     Renderer(MTL::Device* device);
@@ -20,16 +49,75 @@ public:
     void buildBuffers();
     
     void draw(MTK::View* view);
+
+    // Releases `object` once every frame encoded so far has completed.
+    void releaseDeferred(NS::Object* object) { releases.release(object, frameIndex); }
+
+    // Characters added here are animated and have their palettes streamed
+    // at the start of every frame.
+    SkinnedCrowd& skinnedCrowd() { return *crowd; }
+
+    // An ObjectData slot with `transform`, for draws and the GPU-driven scene.
+    uint32_t addObject(const simd::float4x4& transform);
+    // Null without bindless support. Meshes use vertexMain's unskinned layout.
+    GpuDrivenScene* gpuDrivenScene() { return gpuScene; }
+    // Assigned to clusters every frame, seen from sceneLightView().
+    std::vector<PointLight>& pointLights() { return lights; }
+    float time() const { return t; }
     
 private:
     MTL::Device* device;
     MTL::CommandQueue* commandQueue;
     MTL::Library* shaderLibrary;
-    MTL::RenderPipelineState* renderPipelineState;
     MTL::DepthStencilState* depthStencilState;
     
-    MTL::Buffer* vertexBuffer;
-    MTL::Buffer* indexBuffer;
+    GpuHeapAllocator* bufferHeap;
+    UploadManager* uploads;
+    // Null without Tier 2 argument buffers.
+    BindlessResources* bindless = nullptr;
+
+    static constexpr uint32_t maxObjects = 4096;
+    GpuBuffer objectBuffer;
+    DescriptorTable objectSlots{maxObjects};
+    // Culled and drawn by the GPU; needs bindless for its per-object data.
+    static constexpr uint32_t maxSceneVertices = 1 << 16;
+    static constexpr uint32_t maxSceneIndices = 1 << 18;
+    GpuDrivenScene* gpuScene = nullptr;
+
+    // Animation LOD, the pose cache and palette deltas, updated every frame.
+    static constexpr uint32_t maxPaletteJoints = 1 << 16;
+    PaletteStream* paletteStream;
+    SkinnedCrowd* crowd;
+
+    // Point lights, assigned to clusters on `jobs`.
+    ClusteredLighting* lighting;
+    std::vector<PointLight> lights;
+    JobSystem jobs;
+
+    enum MeshColumn : size_t { MeshVertexBuffer, MeshIndexBuffer, MeshIndexCount };
+    enum MaterialColumn : size_t { MaterialPipeline };
+    enum PipelineColumn : size_t { PipelineKey };
+
+    HandlePool<MeshTag, GpuBuffer, GpuBuffer, uint32_t> meshes;
+    HandlePool<MaterialTag, PipelineHandle> materials;
+    // Cache keys of pipeline descriptions, drawn with `fallbackPipeline` until compiled.
+    HandlePool<PipelineTag, uint64_t> pipelines;
+    PipelineHandle defaultPipeline;
+    RenderPipelineCompiler* pipelineCompiler;
+    PipelineCache* pipelineCache;
+    MTL::RenderPipelineState* fallbackPipeline;
+    std::vector<DrawItem> drawItems;
     
-    float t;
+    // draw() waits for the GPU rather than encode further ahead than this;
+    // ClusteredLighting rotates that many upload buffers.
+    static constexpr uint32_t maxFramesInFlight = 3;
+    // One count per frame in flight, given back by the command buffer's
+    // completed handler.
+    dispatch_semaphore_t frameSemaphore;
+    MTL::SharedEvent* frameEvent;
+    uint64_t frameIndex = 0;
+    DeferredReleaseQueue releases;
+    FrameArena frameArena{1};
+
+    float t = 0.0f;
 };
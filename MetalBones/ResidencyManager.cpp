@@ -0,0 +1,46 @@
+//
+//  ResidencyManager.cpp
+//  MetalBones
+//
+
+#include "ResidencyManager.hpp"
+
+ResidencyManager::ResidencyManager(MTL::Device* device, float budgetFraction, uint32_t framesInFlight)
+    : device(device->retain())
+    , tracker(uint64_t(double(device->recommendedMaxWorkingSetSize()) * budgetFraction), framesInFlight)
+{
+}
+
+ResidencyManager::~ResidencyManager() {
+    device->release();
+}
+
+ResidencyHandle ResidencyManager::track(MTL::Resource* resource, ResourceCategory category, bool streamable) {
+    return tracker.track(resource, resource->allocatedSize(), category, streamable);
+}
+
+void ResidencyManager::untrack(ResidencyHandle handle) {
+    tracker.untrack(handle);
+}
+
+ResidencyManager::Contents ResidencyManager::use(ResidencyHandle handle) {
+    if (!tracker.use(handle)) {
+        return Contents::Valid;
+    }
+
+    MTL::Resource* resource = static_cast<MTL::Resource*>(tracker.object(handle));
+    if (resource->setPurgeableState(MTL::PurgeableStateNonVolatile) == MTL::PurgeableStateEmpty) {
+        discarded++;
+        return Contents::Discarded;
+    }
+    return Contents::Valid;
+}
+
+void ResidencyManager::endFrame() {
+    evicted.clear();
+    tracker.endFrame(evicted);
+
+    for (void* object : evicted) {
+        static_cast<MTL::Resource*>(object)->setPurgeableState(MTL::PurgeableStateVolatile);
+    }
+}
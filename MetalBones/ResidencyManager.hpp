@@ -0,0 +1,41 @@
+//
+//  ResidencyManager.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include "ResidencyTracker.hpp"
+
+// Keeps the resources we allocate under the device's recommended working set.
+// Evicted streamable resources are marked volatile, so the OS may take their
+// memory back; using one again makes it non-volatile and reports whether its
+// contents survived or have to be streamed in again. Purgeability is per
+// allocation, so streamable resources can't be sub-allocated from a heap.
+class ResidencyManager {
+public:
+    // `budgetFraction` of recommendedMaxWorkingSetSize is what we allow ourselves.
+    ResidencyManager(MTL::Device* device, float budgetFraction = 0.8f, uint32_t framesInFlight = 3);
+    ~ResidencyManager();
+
+    ResidencyHandle track(MTL::Resource* resource, ResourceCategory category, bool streamable);
+    void untrack(ResidencyHandle handle);
+
+    enum class Contents { Valid, Discarded };
+
+    // Call before encoding anything that reads the resource this frame.
+    Contents use(ResidencyHandle handle);
+
+    void endFrame();
+
+    const ResidencyStats& stats() const { return tracker.stats(); }
+    uint64_t discardedRestores() const { return discarded; }
+
+private:
+    MTL::Device* device;
+    ResidencyTracker tracker;
+    std::vector<void*> evicted;
+    uint64_t discarded = 0;
+};
@@ -0,0 +1,99 @@
+//
+//  ResidencyTracker.cpp
+//  MetalBones
+//
+
+#include "ResidencyTracker.hpp"
+
+ResidencyTracker::ResidencyTracker(uint64_t budgetBytes, uint32_t framesInFlight, float lowWater)
+    : budget(budgetBytes)
+    , framesInFlight(framesInFlight)
+    , lowWater(lowWater)
+{
+}
+
+ResidencyHandle ResidencyTracker::track(void* object, uint64_t bytes, ResourceCategory category, bool streamable) {
+    ResidencyHandle handle = resources.create(object, bytes, category, uint8_t(streamable), uint8_t(1), currentFrame, lru.end());
+    if (streamable) {
+        *resources.get<LruPosition>(handle) = lru.insert(lru.end(), handle);
+    }
+
+    counters.residentBytes[size_t(category)] += bytes;
+    counters.trackedBytes[size_t(category)] += bytes;
+    return handle;
+}
+
+void ResidencyTracker::untrack(ResidencyHandle handle) {
+    if (!resources.alive(handle)) {
+        return;
+    }
+
+    size_t category = size_t(*resources.get<Category>(handle));
+    uint64_t bytes = *resources.get<Bytes>(handle);
+    if (*resources.get<Resident>(handle)) {
+        counters.residentBytes[category] -= bytes;
+    }
+    counters.trackedBytes[category] -= bytes;
+
+    if (*resources.get<Streamable>(handle)) {
+        (*resources.get<Resident>(handle) ? lru : evictedList).erase(*resources.get<LruPosition>(handle));
+    }
+    resources.destroy(handle);
+}
+
+bool ResidencyTracker::use(ResidencyHandle handle) {
+    if (!resources.alive(handle)) {
+        return false;
+    }
+
+    uint8_t& isResident = *resources.get<Resident>(handle);
+    *resources.get<LastUsed>(handle) = currentFrame;
+    if (*resources.get<Streamable>(handle)) {
+        lru.splice(lru.end(), isResident ? lru : evictedList, *resources.get<LruPosition>(handle));
+    }
+
+    if (isResident) {
+        return false;
+    }
+    isResident = true;
+    counters.residentBytes[size_t(*resources.get<Category>(handle))] += *resources.get<Bytes>(handle);
+    counters.restores++;
+    return true;
+}
+
+bool ResidencyTracker::resident(ResidencyHandle handle) const {
+    const uint8_t* isResident = resources.get<Resident>(handle);
+    return isResident && *isResident;
+}
+
+void* ResidencyTracker::object(ResidencyHandle handle) const {
+    void* const* object = resources.get<Object>(handle);
+    return object ? *object : nullptr;
+}
+
+void ResidencyTracker::endFrame(std::vector<void*>& evicted) {
+    uint64_t residentBytes = counters.totalResidentBytes();
+    if (residentBytes > budget) {
+        const uint64_t target = uint64_t(double(budget) * lowWater);
+
+        while (!lru.empty() && residentBytes > target) {
+            ResidencyHandle handle = lru.front();
+            // The list is in use order, so everything after this is newer still.
+            if (*resources.get<LastUsed>(handle) + framesInFlight > currentFrame) {
+                break;
+            }
+
+            *resources.get<Resident>(handle) = false;
+            evictedList.splice(evictedList.end(), lru, lru.begin());
+
+            uint64_t bytes = *resources.get<Bytes>(handle);
+            counters.residentBytes[size_t(*resources.get<Category>(handle))] -= bytes;
+            counters.evictions++;
+            counters.evictedBytes += bytes;
+            residentBytes -= bytes;
+            evicted.push_back(*resources.get<Object>(handle));
+        }
+    }
+
+    currentFrame++;
+}
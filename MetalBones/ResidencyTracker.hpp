@@ -0,0 +1,85 @@
+//
+//  ResidencyTracker.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "HandlePool.hpp"
+
+enum class ResourceCategory : uint8_t {
+    Mesh,
+    Texture,
+    RenderTarget,
+    Animation,
+    Other,
+    Count
+};
+
+using ResidencyHandle = Handle<struct ResidencyTag>;
+
+struct ResidencyStats {
+    uint64_t residentBytes[size_t(ResourceCategory::Count)];
+    uint64_t trackedBytes[size_t(ResourceCategory::Count)];
+    uint64_t evictions;
+    uint64_t evictedBytes;
+    uint64_t restores;
+
+    uint64_t totalResidentBytes() const {
+        uint64_t total = 0;
+        for (uint64_t bytes : residentBytes) {
+            total += bytes;
+        }
+        return total;
+    }
+};
+
+// Byte accounting plus an LRU over streamable resources. Once resident bytes
+// exceed the budget, endFrame() evicts the least recently used streamable
+// resources that no in-flight frame can still be reading, down to
+// `lowWater` * budget so that it doesn't evict again on the very next frame.
+class ResidencyTracker {
+public:
+    ResidencyTracker(uint64_t budgetBytes, uint32_t framesInFlight = 3, float lowWater = 0.9f);
+
+    void setBudget(uint64_t bytes) { budget = bytes; }
+    uint64_t budgetBytes() const { return budget; }
+
+    ResidencyHandle track(void* object, uint64_t bytes, ResourceCategory category, bool streamable);
+    void untrack(ResidencyHandle handle);
+
+    // Marks the resource as used by the current frame; returns true when it
+    // was evicted and the caller has to make it resident again.
+    bool use(ResidencyHandle handle);
+    bool resident(ResidencyHandle handle) const;
+    void* object(ResidencyHandle handle) const;
+
+    // Appends the objects of the resources evicted this frame to `evicted`.
+    void endFrame(std::vector<void*>& evicted);
+
+    uint64_t frame() const { return currentFrame; }
+    const ResidencyStats& stats() const { return counters; }
+
+private:
+    enum Column : size_t { Object, Bytes, Category, Streamable, Resident, LastUsed, LruPosition };
+
+    using Lru = std::list<ResidencyHandle>;
+
+    uint64_t budget;
+    uint32_t framesInFlight;
+    float lowWater;
+    uint64_t currentFrame = 1;
+
+    // Flags are bytes, a std::vector<bool> column couldn't hand out pointers.
+    HandlePool<ResidencyTag, void*, uint64_t, ResourceCategory, uint8_t, uint8_t, uint64_t, Lru::iterator> resources;
+    // Resident streamable resources, least recently used first.
+    Lru lru;
+    Lru evictedList;
+
+    ResidencyStats counters = {};
+};
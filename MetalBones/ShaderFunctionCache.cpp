@@ -0,0 +1,65 @@
+//
+//  ShaderFunctionCache.cpp
+//  MetalBones
+//
+
+#include "ShaderFunctionCache.hpp"
+
+ShaderFunctionCache::ShaderFunctionCache(MTL::Library* library)
+    : library(library->retain())
+{
+}
+
+ShaderFunctionCache::~ShaderFunctionCache() {
+    for (auto& [name, permutations] : functions) {
+        for (auto& [mask, function] : permutations) {
+            if (function) {
+                function->release();
+            }
+        }
+    }
+    library->release();
+}
+
+MTL::Function* ShaderFunctionCache::function(const std::string& name, ShaderFeatures features) {
+    ShaderFeatures permutation = shaderPermutation(name, features);
+    auto& permutations = functions[name];
+    auto it = permutations.find(permutation.mask());
+    if (it != permutations.end()) {
+        return it->second;
+    }
+
+    // Missing functions are remembered too, as null.
+    MTL::Function* function = newFunction(name, permutation);
+    permutations.emplace(permutation.mask(), function);
+    count += function != nullptr;
+    return function;
+}
+
+MTL::Function* ShaderFunctionCache::newFunction(const std::string& name, ShaderFeatures permutation) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::String* functionName = NS::String::string(name.c_str(), UTF8StringEncoding);
+    ShaderFeatures used = usedShaderFeatures(name);
+    if (used.empty()) {
+        return library->newFunction(functionName);
+    }
+
+    // Only the constants the function declares, each one set either way.
+    MTL::FunctionConstantValues* values = MTL::FunctionConstantValues::alloc()->init();
+    for (uint32_t i = 0; i < shaderFeatureCount; ++i) {
+        ShaderFeature feature = ShaderFeature(i);
+        if (used.has(feature)) {
+            bool enabled = permutation.has(feature);
+            values->setConstantValue(&enabled, MTL::DataType::DataTypeBool, i);
+        }
+    }
+
+    NS::Error* error = nullptr;
+    MTL::Function* function = library->newFunction(functionName, values, &error);
+    if (!function && error) {
+        __builtin_printf("%s\n", error->localizedDescription()->utf8String());
+    }
+    values->release();
+    return function;
+}
@@ -0,0 +1,37 @@
+//
+//  ShaderFunctionCache.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <string>
+#include <unordered_map>
+
+#include "ShaderPermutations.hpp"
+
+// Functions out of one library, specialized with the function constants of a
+// permutation the first time it is asked for and kept until destruction.
+class ShaderFunctionCache {
+public:
+    explicit ShaderFunctionCache(MTL::Library* library);
+    ~ShaderFunctionCache();
+
+    ShaderFunctionCache(const ShaderFunctionCache&) = delete;
+    ShaderFunctionCache& operator=(const ShaderFunctionCache&) = delete;
+
+    // Null when the library has no such function. The cache keeps the reference.
+    MTL::Function* function(const std::string& name, ShaderFeatures features);
+
+    size_t size() const { return count; }
+
+private:
+    MTL::Function* newFunction(const std::string& name, ShaderFeatures permutation);
+
+    MTL::Library* library;
+    // By name, then by permutation mask.
+    std::unordered_map<std::string, std::unordered_map<uint32_t, MTL::Function*>> functions;
+    size_t count = 0;
+};
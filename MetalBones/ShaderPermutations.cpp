@@ -0,0 +1,29 @@
+//
+//  ShaderPermutations.cpp
+//  MetalBones
+//
+
+#include "ShaderPermutations.hpp"
+
+const char* shaderFeatureName(ShaderFeature feature) {
+    switch (feature) {
+        case ShaderFeature::Skinning:        return "skinning";
+        case ShaderFeature::Instancing:      return "instancing";
+        case ShaderFeature::VertexColor:     return "vertex-color";
+        case ShaderFeature::Fog:             return "fog";
+        case ShaderFeature::Bindless:        return "bindless";
+        case ShaderFeature::ClusteredLights: return "clustered-lights";
+        default:                             return "unknown";
+    }
+}
+
+std::vector<ShaderFeatures> enumerateShaderPermutations(ShaderFeatures used) {
+    std::vector<ShaderFeatures> permutations;
+    uint32_t mask = used.mask();
+    uint32_t subset = 0;
+    do {
+        permutations.push_back(ShaderFeatures::fromMask(subset));
+        subset = (subset - mask) & mask;
+    } while (subset != 0);
+    return permutations;
+}
@@ -0,0 +1,94 @@
+//
+//  ShaderPermutations.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
+
+// Optional parts of the shaders in shaders/general.metal. Each is a bool
+// function constant there, at the index given by its value here.
+enum class ShaderFeature : uint32_t {
+    Skinning,
+    Instancing,
+    VertexColor,
+    Fog,
+    Bindless,
+    ClusteredLights,
+    Count
+};
+
+constexpr uint32_t shaderFeatureCount = uint32_t(ShaderFeature::Count);
+
+const char* shaderFeatureName(ShaderFeature feature);
+
+// One bit per feature, so that sets can be built in constant expressions and
+// stored as a plain word (PipelineDesc::features).
+class ShaderFeatures {
+public:
+    constexpr ShaderFeatures() = default;
+    constexpr ShaderFeatures(std::initializer_list<ShaderFeature> features) {
+        for (ShaderFeature feature : features) {
+            bits |= bit(feature);
+        }
+    }
+
+    static constexpr ShaderFeatures fromMask(uint32_t mask) {
+        ShaderFeatures features;
+        features.bits = mask & allBits;
+        return features;
+    }
+
+    constexpr uint32_t mask() const { return bits; }
+    constexpr bool empty() const { return bits == 0; }
+    constexpr bool has(ShaderFeature feature) const { return (bits & bit(feature)) != 0; }
+
+    constexpr ShaderFeatures operator|(ShaderFeatures other) const { return fromMask(bits | other.bits); }
+    constexpr ShaderFeatures operator&(ShaderFeatures other) const { return fromMask(bits & other.bits); }
+    constexpr bool operator==(const ShaderFeatures&) const = default;
+
+private:
+    static constexpr uint32_t allBits = (1u << shaderFeatureCount) - 1;
+    static constexpr uint32_t bit(ShaderFeature feature) { return 1u << uint32_t(feature); }
+
+    uint32_t bits = 0;
+};
+
+struct ShaderFunctionFeatures {
+    std::string_view function;
+    ShaderFeatures features;
+};
+
+// The features each function reads. Functions that aren't listed have no
+// function constants.
+constexpr ShaderFunctionFeatures shaderFunctionFeatures[] = {
+    {"vertexMain", {ShaderFeature::Skinning, ShaderFeature::Instancing, ShaderFeature::VertexColor, ShaderFeature::Bindless}},
+    {"fragmentMain", {ShaderFeature::Fog, ShaderFeature::Bindless, ShaderFeature::ClusteredLights}},
+};
+
+constexpr ShaderFeatures usedShaderFeatures(std::string_view function) {
+    for (const ShaderFunctionFeatures& entry : shaderFunctionFeatures) {
+        if (entry.function == function) {
+            return entry.features;
+        }
+    }
+    return {};
+}
+
+// Features a function doesn't read can't change its code, so they are dropped
+// and every request for the same code gets the same permutation.
+constexpr ShaderFeatures shaderPermutation(std::string_view function, ShaderFeatures requested) {
+    return requested & usedShaderFeatures(function);
+}
+
+constexpr ShaderFeatures pipelinePermutation(std::string_view vertexFunction, std::string_view fragmentFunction,
+                                             ShaderFeatures requested) {
+    return shaderPermutation(vertexFunction, requested) | shaderPermutation(fragmentFunction, requested);
+}
+
+// Every subset of `used`, the empty one first.
+std::vector<ShaderFeatures> enumerateShaderPermutations(ShaderFeatures used);
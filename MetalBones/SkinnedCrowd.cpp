@@ -0,0 +1,59 @@
+//
+//  SkinnedCrowd.cpp
+//  MetalBones
+//
+
+#include "SkinnedCrowd.hpp"
+
+#include <chrono>
+
+SkinnedCrowd::SkinnedCrowd(PaletteDeltaEncoder& palettes, size_t poseCacheBytes, const AnimationLODSettings& settings)
+    : palettes(palettes)
+    , cache(poseCacheBytes)
+    , lodManager(settings)
+{
+    lodManager.setPoseCache(&cache);
+}
+
+uint32_t SkinnedCrowd::addCharacter(const Skeleton* skeleton, const AnimationClip* clip, float startTime, float boundingRadius) {
+    Character character;
+    character.instance = lodManager.addInstance(skeleton, clip, startTime);
+    character.palette = palettes.addCharacter(skeleton->jointCount());
+    character.source = character.palette;
+    character.boundingRadius = boundingRadius;
+    character.position = {0.0f, 0.0f, 0.0f};
+    characters.push_back(character);
+    return uint32_t(characters.size() - 1);
+}
+
+void SkinnedCrowd::update(float deltaTime, const Float3& cameraPosition, float fovY) {
+    auto start = std::chrono::steady_clock::now();
+
+    cache.beginFrame();
+    for (const Character& character : characters) {
+        float distance = length(character.position - cameraPosition);
+        lodManager.setScreenSize(character.instance, AnimationLODManager::projectedSize(character.boundingRadius, distance, fovY));
+    }
+    lodManager.update(deltaTime);
+
+    frameStats = {uint32_t(characters.size()), 0, 0, 0.0};
+    for (Character& character : characters) {
+        character.source = character.palette;
+        if (const PoseKey* key = lodManager.cachedPose(character.instance)) {
+            uint32_t slot = cache.uploadedSlot(*key);
+            if (slot != ~0u) {
+                // The encoder keeps comparing against what this character's own
+                // region holds, so nothing is lost once it diverges again.
+                character.source = slot;
+                frameStats.palettesShared++;
+                continue;
+            }
+            cache.markUploaded(*key, character.palette);
+        }
+        palettes.update(character.palette, lodManager.palette(character.instance));
+        frameStats.palettesSent++;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    frameStats.seconds = std::chrono::duration<double>(end - start).count();
+}
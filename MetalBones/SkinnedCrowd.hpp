@@ -0,0 +1,60 @@
+//
+//  SkinnedCrowd.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AnimationLOD.hpp"
+#include "PaletteDeltas.hpp"
+#include "PoseCache.hpp"
+
+struct SkinnedCrowdStats {
+    uint32_t characters;
+    uint32_t palettesSent;      // went through the delta encoder
+    uint32_t palettesShared;    // skinned from another character's region instead
+    double seconds;
+};
+
+// The per-frame animation update of skinned characters. Each character's
+// projected size picks its LOD tier, the LOD manager samples through the pose
+// cache, and palettes go to a PaletteDeltaEncoder. Characters showing a
+// cached pose unchanged share the palette region of the first character that
+// sent that pose this frame rather than sending it again.
+class SkinnedCrowd {
+public:
+    SkinnedCrowd(PaletteDeltaEncoder& palettes, size_t poseCacheBytes, const AnimationLODSettings& settings = {});
+
+    uint32_t addCharacter(const Skeleton* skeleton, const AnimationClip* clip, float startTime, float boundingRadius);
+    void setPosition(uint32_t character, const Float3& position) { characters[character].position = position; }
+
+    // Call after the encoder's beginFrame(), before its updates are encoded.
+    void update(float deltaTime, const Float3& cameraPosition, float fovY);
+
+    // The encoder character whose palette region skins `character` this frame.
+    uint32_t paletteCharacter(uint32_t character) const { return characters[character].source; }
+    uint32_t characterCount() const { return uint32_t(characters.size()); }
+
+    const AnimationLODManager& lod() const { return lodManager; }
+    AnimationLODManager::InstanceId instance(uint32_t character) const { return characters[character].instance; }
+    const PoseCache& poseCache() const { return cache; }
+    const SkinnedCrowdStats& stats() const { return frameStats; }
+
+private:
+    struct Character {
+        AnimationLODManager::InstanceId instance;
+        uint32_t palette;       // encoder character
+        uint32_t source;
+        float boundingRadius;
+        Float3 position;
+    };
+
+    PaletteDeltaEncoder& palettes;
+    PoseCache cache;
+    AnimationLODManager lodManager;
+    std::vector<Character> characters;
+    SkinnedCrowdStats frameStats = {};
+};
@@ -0,0 +1,404 @@
+//
+//  SpringBones.cpp
+//  MetalBones
+//
+
+#include "SpringBones.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+#include "JobSystem.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef float Lanes __attribute__((vector_size(16)));
+
+static_assert(SpringBoneSystem::lanes == 4);
+
+static inline Lanes splat(float v) {
+    return Lanes{v, v, v, v};
+}
+
+static inline Lanes maxLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_max_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vmaxq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::max(a[0], b[0]), std::max(a[1], b[1]), std::max(a[2], b[2]), std::max(a[3], b[3])};
+#endif
+}
+
+static inline Lanes minLanes(Lanes a, Lanes b) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_min_ps((__m128)a, (__m128)b);
+#elif defined(__ARM_NEON)
+    return (Lanes)vminq_f32((float32x4_t)a, (float32x4_t)b);
+#else
+    return Lanes{std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]), std::min(a[3], b[3])};
+#endif
+}
+
+static inline Lanes sqrtLanes(Lanes a) {
+#if defined(__SSE2__)
+    return (Lanes)_mm_sqrt_ps((__m128)a);
+#elif defined(__ARM_NEON)
+    return (Lanes)vsqrtq_f32((float32x4_t)a);
+#else
+    return Lanes{std::sqrt(a[0]), std::sqrt(a[1]), std::sqrt(a[2]), std::sqrt(a[3])};
+#endif
+}
+
+enum Field : uint32_t {
+    PositionX, PositionY, PositionZ,
+    PreviousX, PreviousY, PreviousZ,
+    AnimatedX, AnimatedY, AnimatedZ,
+    RestLength,
+    FieldCount
+};
+
+enum ColliderField : uint32_t {
+    ColliderAX, ColliderAY, ColliderAZ,
+    ColliderBX, ColliderBY, ColliderBZ,
+    ColliderRadius,
+    ColliderFieldCount
+};
+
+struct SpringBoneSystem::Batch {
+    uint32_t length;
+    uint32_t chainCount;
+    uint32_t chains[lanes];
+
+    std::vector<Lanes> particles;       // length * FieldCount
+    std::vector<uint32_t> colliderIds;  // slot * lanes + lane, ~0u when empty
+    std::vector<Lanes> colliderLanes;   // slot * ColliderFieldCount, refreshed every frame
+
+    Lanes stiffness;
+    Lanes damping;
+    Lanes gravityX, gravityY, gravityZ; // already scaled by dt^2
+    Lanes radius;
+
+    Lanes& at(uint32_t particle, Field field) { return particles[particle * FieldCount + field]; }
+    const Lanes& at(uint32_t particle, Field field) const { return particles[particle * FieldCount + field]; }
+};
+
+SpringBoneSystem::SpringBoneSystem(float fixedTimeStep, uint32_t maxStepsPerFrame)
+    : timeStep(fixedTimeStep)
+    , maxSteps(maxStepsPerFrame)
+{
+    assert(fixedTimeStep > 0.0f && maxStepsPerFrame > 0);
+}
+
+SpringBoneSystem::~SpringBoneSystem() = default;
+
+uint32_t SpringBoneSystem::addCollider(const SpringCollider& collider) {
+    colliders.push_back(collider);
+    return uint32_t(colliders.size() - 1);
+}
+
+void SpringBoneSystem::setCollider(uint32_t id, const SpringCollider& collider) {
+    colliders[id] = collider;
+}
+
+uint32_t SpringBoneSystem::addChain(const Float3* restPositions, uint32_t count, const SpringBoneSettings& settings,
+                                    const uint32_t* colliderIds, uint32_t colliderCount) {
+    assert(count >= 2);
+
+    Chain chain;
+    chain.length = count;
+    chain.batch = ~0u;
+    chain.lane = 0;
+    chain.settings = settings;
+    chain.colliders.assign(colliderIds, colliderIds + colliderCount);
+    chain.rest.assign(restPositions, restPositions + count);
+
+    chains.push_back(std::move(chain));
+    dirty = true;
+    return uint32_t(chains.size() - 1);
+}
+
+void SpringBoneSystem::setAnimatedPositions(uint32_t index, const Float3* positions) {
+    if (dirty) {
+        pack();
+    }
+
+    const Chain& chain = chains[index];
+    Batch& batch = batches[chain.batch];
+    for (uint32_t p = 0; p < chain.length; ++p) {
+        batch.at(p, AnimatedX)[chain.lane] = positions[p].x;
+        batch.at(p, AnimatedY)[chain.lane] = positions[p].y;
+        batch.at(p, AnimatedZ)[chain.lane] = positions[p].z;
+    }
+}
+
+void SpringBoneSystem::simulatedPositions(uint32_t index, Float3* out) const {
+    const Chain& chain = chains[index];
+    if (chain.batch == ~0u) {
+        std::copy(chain.rest.begin(), chain.rest.end(), out);
+        return;
+    }
+
+    const Batch& batch = batches[chain.batch];
+    for (uint32_t p = 0; p < chain.length; ++p) {
+        out[p] = {batch.at(p, PositionX)[chain.lane], batch.at(p, PositionY)[chain.lane], batch.at(p, PositionZ)[chain.lane]};
+    }
+}
+
+void SpringBoneSystem::pack() {
+    // Carry the state of chains that were already simulating into the new layout.
+    std::vector<std::vector<Lanes>> state(chains.size());
+    for (uint32_t c = 0; c < chains.size(); ++c) {
+        const Chain& chain = chains[c];
+        if (chain.batch == ~0u) {
+            continue;
+        }
+        const Batch& batch = batches[chain.batch];
+        state[c].resize(chain.length * FieldCount);
+        for (uint32_t p = 0; p < chain.length; ++p) {
+            for (uint32_t f = 0; f < FieldCount; ++f) {
+                state[c][p * FieldCount + f] = splat(batch.at(p, Field(f))[chain.lane]);
+            }
+        }
+    }
+
+    // Longest first so that each batch pads as little as possible.
+    std::vector<uint32_t> order(chains.size());
+    for (uint32_t c = 0; c < chains.size(); ++c) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return chains[a].length > chains[b].length;
+    });
+
+    batches.clear();
+    for (size_t first = 0; first < order.size(); first += lanes) {
+        Batch batch = {};
+        batch.chainCount = uint32_t(std::min<size_t>(lanes, order.size() - first));
+        batch.length = chains[order[first]].length;
+
+        uint32_t slots = 0;
+        for (uint32_t lane = 0; lane < batch.chainCount; ++lane) {
+            slots = std::max(slots, uint32_t(chains[order[first + lane]].colliders.size()));
+        }
+
+        batch.particles.assign(batch.length * FieldCount, splat(0.0f));
+        batch.colliderIds.assign(slots * lanes, ~0u);
+        batch.colliderLanes.assign(slots * ColliderFieldCount, splat(0.0f));
+        batch.stiffness = batch.damping = batch.radius = splat(0.0f);
+        batch.gravityX = batch.gravityY = batch.gravityZ = splat(0.0f);
+
+        for (uint32_t lane = 0; lane < batch.chainCount; ++lane) {
+            const uint32_t index = order[first + lane];
+            Chain& chain = chains[index];
+            chain.batch = uint32_t(batches.size());
+            chain.lane = lane;
+            batch.chains[lane] = index;
+
+            const SpringBoneSettings& s = chain.settings;
+            const float dt2 = timeStep * timeStep;
+            batch.stiffness[lane] = s.stiffness;
+            batch.damping[lane] = s.damping;
+            batch.gravityX[lane] = s.gravity.x * dt2;
+            batch.gravityY[lane] = s.gravity.y * dt2;
+            batch.gravityZ[lane] = s.gravity.z * dt2;
+            batch.radius[lane] = s.radius;
+
+            for (uint32_t slot = 0; slot < chain.colliders.size(); ++slot) {
+                batch.colliderIds[slot * lanes + lane] = chain.colliders[slot];
+            }
+
+            for (uint32_t p = 0; p < chain.length; ++p) {
+                if (!state[index].empty()) {
+                    for (uint32_t f = 0; f < FieldCount; ++f) {
+                        batch.at(p, Field(f))[lane] = state[index][p * FieldCount + f][0];
+                    }
+                    continue;
+                }
+                const Float3 r = chain.rest[p];
+                const float rest = p > 0 ? length(r - chain.rest[p - 1]) : 0.0f;
+                const float fields[FieldCount] = {r.x, r.y, r.z, r.x, r.y, r.z, r.x, r.y, r.z, rest};
+                for (uint32_t f = 0; f < FieldCount; ++f) {
+                    batch.at(p, Field(f))[lane] = fields[f];
+                }
+            }
+            // Padding particles of shorter chains collapse onto their last
+            // real particle with zero rest length.
+            for (uint32_t p = chain.length; p < batch.length; ++p) {
+                for (uint32_t f = 0; f < FieldCount; ++f) {
+                    batch.at(p, Field(f))[lane] = f == RestLength ? 0.0f : batch.at(chain.length - 1, Field(f))[lane];
+                }
+            }
+        }
+
+        batches.push_back(std::move(batch));
+    }
+
+    dirty = false;
+}
+
+void SpringBoneSystem::step(Batch& batch) const {
+    const Lanes one = splat(1.0f);
+    const Lanes zero = splat(0.0f);
+    const Lanes epsilon = splat(1e-6f);
+    const Lanes keep = one - batch.damping;
+    const uint32_t slots = uint32_t(batch.colliderLanes.size() / ColliderFieldCount);
+
+    batch.at(0, PositionX) = batch.at(0, PreviousX) = batch.at(0, AnimatedX);
+    batch.at(0, PositionY) = batch.at(0, PreviousY) = batch.at(0, AnimatedY);
+    batch.at(0, PositionZ) = batch.at(0, PreviousZ) = batch.at(0, AnimatedZ);
+
+    for (uint32_t p = 1; p < batch.length; ++p) {
+        Lanes px = batch.at(p, PositionX), py = batch.at(p, PositionY), pz = batch.at(p, PositionZ);
+
+        // Verlet integration plus a spring back towards the animated pose.
+        Lanes vx = (px - batch.at(p, PreviousX)) * keep;
+        Lanes vy = (py - batch.at(p, PreviousY)) * keep;
+        Lanes vz = (pz - batch.at(p, PreviousZ)) * keep;
+        batch.at(p, PreviousX) = px;
+        batch.at(p, PreviousY) = py;
+        batch.at(p, PreviousZ) = pz;
+
+        px = px + vx + batch.gravityX;
+        py = py + vy + batch.gravityY;
+        pz = pz + vz + batch.gravityZ;
+
+        px = px + (batch.at(p, AnimatedX) - px) * batch.stiffness;
+        py = py + (batch.at(p, AnimatedY) - py) * batch.stiffness;
+        pz = pz + (batch.at(p, AnimatedZ) - pz) * batch.stiffness;
+
+        // Keep the bone length to the already solved parent particle.
+        const Lanes parentX = batch.at(p - 1, PositionX);
+        const Lanes parentY = batch.at(p - 1, PositionY);
+        const Lanes parentZ = batch.at(p - 1, PositionZ);
+        Lanes dx = px - parentX, dy = py - parentY, dz = pz - parentZ;
+        Lanes scale = batch.at(p, RestLength) / maxLanes(sqrtLanes(dx * dx + dy * dy + dz * dz), epsilon);
+        px = parentX + dx * scale;
+        py = parentY + dy * scale;
+        pz = parentZ + dz * scale;
+
+        for (uint32_t slot = 0; slot < slots; ++slot) {
+            const Lanes* c = &batch.colliderLanes[slot * ColliderFieldCount];
+            Lanes abx = c[ColliderBX] - c[ColliderAX];
+            Lanes aby = c[ColliderBY] - c[ColliderAY];
+            Lanes abz = c[ColliderBZ] - c[ColliderAZ];
+            Lanes apx = px - c[ColliderAX], apy = py - c[ColliderAY], apz = pz - c[ColliderAZ];
+
+            Lanes t = (apx * abx + apy * aby + apz * abz) / maxLanes(abx * abx + aby * aby + abz * abz, epsilon);
+            t = minLanes(maxLanes(t, zero), one);
+
+            Lanes ox = apx - abx * t, oy = apy - aby * t, oz = apz - abz * t;
+            Lanes distance = maxLanes(sqrtLanes(ox * ox + oy * oy + oz * oz), epsilon);
+            Lanes push = maxLanes(c[ColliderRadius] + batch.radius - distance, zero) / distance;
+            px = px + ox * push;
+            py = py + oy * push;
+            pz = pz + oz * push;
+        }
+
+        batch.at(p, PositionX) = px;
+        batch.at(p, PositionY) = py;
+        batch.at(p, PositionZ) = pz;
+    }
+}
+
+void SpringBoneSystem::simulate(float deltaTime, JobSystem* jobs) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (dirty) {
+        pack();
+    }
+
+    accumulator += deltaTime;
+    uint32_t steps = std::min(uint32_t(accumulator / timeStep), maxSteps);
+    accumulator = std::min(accumulator - float(steps) * timeStep, timeStep);
+
+    auto solve = [this, steps](uint32_t begin, uint32_t end) {
+        for (uint32_t b = begin; b < end; ++b) {
+            Batch& batch = batches[b];
+
+            // Empty slots get a huge negative radius so they never push.
+            const uint32_t slots = uint32_t(batch.colliderLanes.size() / ColliderFieldCount);
+            for (uint32_t slot = 0; slot < slots; ++slot) {
+                Lanes* c = &batch.colliderLanes[slot * ColliderFieldCount];
+                for (uint32_t lane = 0; lane < lanes; ++lane) {
+                    uint32_t id = batch.colliderIds[slot * lanes + lane];
+                    SpringCollider collider = id != ~0u ? colliders[id] : SpringCollider{{0, 0, 0}, {0, 0, 0}, -1e30f};
+                    const float values[ColliderFieldCount] = {
+                        collider.a.x, collider.a.y, collider.a.z,
+                        collider.b.x, collider.b.y, collider.b.z,
+                        collider.radius,
+                    };
+                    for (uint32_t f = 0; f < ColliderFieldCount; ++f) {
+                        c[f][lane] = values[f];
+                    }
+                }
+            }
+
+            for (uint32_t s = 0; s < steps; ++s) {
+                step(batch);
+            }
+        }
+    };
+
+    if (steps > 0) {
+        if (jobs) {
+            jobs->parallelFor(uint32_t(batches.size()), 16, solve);
+        } else {
+            solve(0, uint32_t(batches.size()));
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    lastStats = {uint32_t(chains.size()), uint32_t(batches.size()), steps, std::chrono::duration<double>(end - start).count()};
+}
+
+static Quat rotationBetween(Float3 from, Float3 to) {
+    float lf = length(from), lt = length(to);
+    if (lf < 1e-6f || lt < 1e-6f) {
+        return {0, 0, 0, 1};
+    }
+    from = from * (1.0f / lf);
+    to = to * (1.0f / lt);
+
+    Float3 axis = cross(from, to);
+    float w = 1.0f + dot(from, to);
+    if (w < 1e-6f) {
+        // Opposite vectors: any perpendicular axis will do.
+        axis = std::fabs(from.x) > 0.5f ? Float3{-from.y, from.x, 0.0f} : Float3{0.0f, -from.z, from.y};
+        w = 0.0f;
+    }
+    return normalize({axis.x, axis.y, axis.z, w});
+}
+
+void applySpringChain(Float4x4* model, const uint16_t* joints, uint32_t count, const Float3* simulated) {
+    // Each joint inherits the correction of its parents before aiming its own
+    // bone, so directions are measured against the already rotated chain.
+    Quat accumulated = {0, 0, 0, 1};
+    Float3 position = {model[joints[0]].m[12], model[joints[0]].m[13], model[joints[0]].m[14]};
+
+    for (uint32_t i = 0; i < count; ++i) {
+        Float4x4& m = model[joints[i]];
+
+        if (i + 1 < count) {
+            const Float4x4& child = model[joints[i + 1]];
+            Float3 bone = Float3{child.m[12], child.m[13], child.m[14]} - position;
+            position = {child.m[12], child.m[13], child.m[14]};
+            accumulated = normalize(rotationBetween(rotate(accumulated, bone), simulated[i + 1] - simulated[i]) * accumulated);
+        }
+
+        for (int column = 0; column < 3; ++column) {
+            Float3 axis = rotate(accumulated, Float3{m.m[column * 4], m.m[column * 4 + 1], m.m[column * 4 + 2]});
+            m.m[column * 4] = axis.x;
+            m.m[column * 4 + 1] = axis.y;
+            m.m[column * 4 + 2] = axis.z;
+        }
+        m.m[12] = simulated[i].x;
+        m.m[13] = simulated[i].y;
+        m.m[14] = simulated[i].z;
+    }
+}
@@ -0,0 +1,94 @@
+//
+//  SpringBones.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Animation.hpp"
+
+class JobSystem;
+
+struct SpringBoneSettings {
+    float stiffness = 0.05f;    // pull towards the animated pose per step, 0..1
+    float damping = 0.1f;       // velocity loss per step, 0..1
+    Float3 gravity = {0.0f, -9.8f, 0.0f};
+    float radius = 0.02f;       // particle radius used against colliders
+};
+
+// A sphere when a == b, a capsule otherwise.
+struct SpringCollider {
+    Float3 a;
+    Float3 b;
+    float radius;
+};
+
+struct SpringBoneStats {
+    uint32_t chains;
+    uint32_t batches;
+    uint32_t steps;
+    double seconds;
+
+    double chainsPerMillisecond() const { return seconds > 0.0 ? chains * steps / (seconds * 1e3) : 0.0; }
+};
+
+// Verlet chains solved four at a time: chains are sorted by length and packed
+// into SoA batches, one chain per SIMD lane. The first particle of a chain is
+// pinned to its animated position. Steps use a fixed time step, so for a given
+// build the result only depends on the inputs, never on thread count.
+class SpringBoneSystem {
+public:
+    static constexpr uint32_t lanes = 4;
+
+    explicit SpringBoneSystem(float fixedTimeStep = 1.0f / 60.0f, uint32_t maxStepsPerFrame = 4);
+    ~SpringBoneSystem();
+
+    uint32_t addCollider(const SpringCollider& collider);
+    void setCollider(uint32_t id, const SpringCollider& collider);
+
+    uint32_t addChain(const Float3* restPositions, uint32_t count, const SpringBoneSettings& settings,
+                      const uint32_t* colliders = nullptr, uint32_t colliderCount = 0);
+
+    // World-space positions of the chain joints from the freshly sampled pose.
+    void setAnimatedPositions(uint32_t chain, const Float3* positions);
+
+    void simulate(float deltaTime, JobSystem* jobs = nullptr);
+
+    uint32_t chainLength(uint32_t chain) const { return chains[chain].length; }
+    void simulatedPositions(uint32_t chain, Float3* out) const;
+
+    const SpringBoneStats& stats() const { return lastStats; }
+
+private:
+    struct Chain {
+        uint32_t length;
+        uint32_t batch;
+        uint32_t lane;
+        SpringBoneSettings settings;
+        std::vector<uint32_t> colliders;
+        std::vector<Float3> rest;
+    };
+
+    struct Batch;
+
+    void pack();
+    void step(Batch& batch) const;
+
+    float timeStep;
+    uint32_t maxSteps;
+    float accumulator = 0.0f;
+    bool dirty = false;
+
+    std::vector<Chain> chains;
+    std::vector<SpringCollider> colliders;
+    std::vector<Batch> batches;
+
+    SpringBoneStats lastStats = {};
+};
+
+// Rotates the model-space matrices of a chain so each joint aims at its
+// simulated child, and moves the joints onto the simulated positions.
+void applySpringChain(Float4x4* model, const uint16_t* joints, uint32_t count, const Float3* simulated);
@@ -0,0 +1,301 @@
+//
+//  TlsfAllocator.cpp
+//  MetalBones
+//
+
+#include "TlsfAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static uint32_t log2Floor(uint64_t value) {
+    return 63 - uint32_t(__builtin_clzll(value));
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t granularity)
+    : granularity(granularity)
+    , granularityLog2(log2Floor(granularity))
+{
+    assert(granularity > 0 && (granularity & (granularity - 1)) == 0);
+
+    for (auto& level : heads) {
+        std::fill(std::begin(level), std::end(level), none);
+    }
+}
+
+void TlsfAllocator::mapping(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const {
+    if (units < secondLevelCount) {
+        firstLevel = 0;
+        secondLevel = uint32_t(units);
+        return;
+    }
+    uint32_t log = log2Floor(units);
+    firstLevel = log - secondLevelLog2 + 1;
+    secondLevel = uint32_t(units >> (log - secondLevelLog2)) - secondLevelCount;
+}
+
+bool TlsfAllocator::findFree(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const {
+    // Round up to the next class so that any block found is large enough.
+    if (units >= secondLevelCount) {
+        units += (uint64_t(1) << (log2Floor(units) - secondLevelLog2)) - 1;
+    }
+    mapping(units, firstLevel, secondLevel);
+    if (firstLevel >= firstLevelCount) {
+        return false;
+    }
+
+    uint32_t secondMap = secondLevelBitmaps[firstLevel] & (~0u << secondLevel);
+    if (!secondMap) {
+        uint64_t firstMap = firstLevel + 1 < 64 ? firstLevelBitmap & (~uint64_t(0) << (firstLevel + 1)) : 0;
+        if (!firstMap) {
+            return false;
+        }
+        firstLevel = uint32_t(__builtin_ctzll(firstMap));
+        secondMap = secondLevelBitmaps[firstLevel];
+    }
+    secondLevel = uint32_t(__builtin_ctz(secondMap));
+    return true;
+}
+
+void TlsfAllocator::insertFree(uint32_t node) {
+    Block& block = nodes[node];
+    uint32_t fl, sl;
+    mapping(block.size >> granularityLog2, fl, sl);
+
+    block.free = true;
+    block.previousFree = none;
+    block.nextFree = heads[fl][sl];
+    if (block.nextFree != none) {
+        nodes[block.nextFree].previousFree = node;
+    }
+    heads[fl][sl] = node;
+    firstLevelBitmap |= uint64_t(1) << fl;
+    secondLevelBitmaps[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::removeFree(uint32_t node) {
+    Block& block = nodes[node];
+    uint32_t fl, sl;
+    mapping(block.size >> granularityLog2, fl, sl);
+
+    if (block.previousFree != none) {
+        nodes[block.previousFree].nextFree = block.nextFree;
+    } else {
+        heads[fl][sl] = block.nextFree;
+    }
+    if (block.nextFree != none) {
+        nodes[block.nextFree].previousFree = block.previousFree;
+    }
+    if (heads[fl][sl] == none) {
+        secondLevelBitmaps[fl] &= ~(1u << sl);
+        if (!secondLevelBitmaps[fl]) {
+            firstLevelBitmap &= ~(uint64_t(1) << fl);
+        }
+    }
+    block.free = false;
+}
+
+uint32_t TlsfAllocator::newNode() {
+    if (!unusedNodes.empty()) {
+        uint32_t node = unusedNodes.back();
+        unusedNodes.pop_back();
+        return node;
+    }
+    nodes.push_back({});
+    return uint32_t(nodes.size() - 1);
+}
+
+void TlsfAllocator::releaseNode(uint32_t node) {
+    nodes[node].size = 0;
+    unusedNodes.push_back(node);
+}
+
+uint32_t TlsfAllocator::splitFront(uint32_t node, uint64_t size) {
+    uint32_t front = newNode();
+    Block& block = nodes[node];
+    nodes[front] = {block.offset, size, block.pool, block.previousPhysical, node, none, none, false};
+
+    if (block.previousPhysical != none) {
+        nodes[block.previousPhysical].nextPhysical = front;
+    } else {
+        poolFirst[block.pool] = front;
+    }
+    block.previousPhysical = front;
+    block.offset += size;
+    block.size -= size;
+    return front;
+}
+
+uint32_t TlsfAllocator::addPool(uint64_t size) {
+    size &= ~(granularity - 1);
+    assert(size > 0);
+
+    uint32_t pool = uint32_t(poolFirst.size());
+    uint32_t node = newNode();
+    nodes[node] = {0, size, pool, none, none, none, none, false};
+    poolFirst.push_back(node);
+    poolSizes.push_back(size);
+    insertFree(node);
+    return pool;
+}
+
+uint64_t TlsfAllocator::poolSizeFor(uint64_t size, uint64_t alignment) const {
+    alignment = std::max(alignment, granularity);
+    uint64_t units = std::max<uint64_t>((size + granularity - 1) >> granularityLog2, 1);
+    units += (alignment - granularity) >> granularityLog2;
+    // What findFree() asks for, down to the smallest size of that class.
+    if (units >= secondLevelCount) {
+        units += (uint64_t(1) << (log2Floor(units) - secondLevelLog2)) - 1;
+        uint32_t shift = log2Floor(units) - secondLevelLog2;
+        units = units >> shift << shift;
+    }
+    return units << granularityLog2;
+}
+
+TlsfAllocation TlsfAllocator::allocate(uint64_t size, uint64_t alignment) {
+    alignment = std::max(alignment, granularity);
+    assert((alignment & (alignment - 1)) == 0);
+
+    const uint64_t units = std::max<uint64_t>((size + granularity - 1) >> granularityLog2, 1);
+    // Over-ask by the worst case padding so the aligned range always fits.
+    const uint64_t searchUnits = units + ((alignment - granularity) >> granularityLog2);
+
+    uint32_t fl, sl;
+    if (!findFree(searchUnits, fl, sl)) {
+        return {};
+    }
+
+    uint32_t node = heads[fl][sl];
+    removeFree(node);
+
+    // The neighbours of a free block are always in use, so the pieces cut off
+    // either end can go straight back into the free lists.
+    uint64_t padding = ((nodes[node].offset + alignment - 1) & ~(alignment - 1)) - nodes[node].offset;
+    if (padding) {
+        insertFree(splitFront(node, padding));
+    }
+
+    const uint64_t bytes = units << granularityLog2;
+    if (nodes[node].size > bytes) {
+        uint32_t front = splitFront(node, bytes);
+        insertFree(node);
+        node = front;
+    }
+
+    usedBytes += nodes[node].size;
+    allocationCount++;
+    return {node, nodes[node].pool, nodes[node].offset, nodes[node].size};
+}
+
+void TlsfAllocator::free(const TlsfAllocation& allocation) {
+    if (!allocation.valid()) {
+        return;
+    }
+
+    uint32_t node = allocation.node;
+    assert(!nodes[node].free && nodes[node].offset == allocation.offset && nodes[node].size == allocation.size);
+
+    usedBytes -= nodes[node].size;
+    allocationCount--;
+
+    uint32_t previous = nodes[node].previousPhysical;
+    if (previous != none && nodes[previous].free) {
+        removeFree(previous);
+        nodes[previous].size += nodes[node].size;
+        nodes[previous].nextPhysical = nodes[node].nextPhysical;
+        if (nodes[node].nextPhysical != none) {
+            nodes[nodes[node].nextPhysical].previousPhysical = previous;
+        }
+        releaseNode(node);
+        node = previous;
+    }
+
+    uint32_t next = nodes[node].nextPhysical;
+    if (next != none && nodes[next].free) {
+        removeFree(next);
+        nodes[node].size += nodes[next].size;
+        nodes[node].nextPhysical = nodes[next].nextPhysical;
+        if (nodes[next].nextPhysical != none) {
+            nodes[nodes[next].nextPhysical].previousPhysical = node;
+        }
+        releaseNode(next);
+    }
+
+    insertFree(node);
+}
+
+TlsfStats TlsfAllocator::stats() const {
+    TlsfStats stats = {};
+    stats.pools = poolCount();
+    stats.allocations = allocationCount;
+    stats.usedBytes = usedBytes;
+    for (uint64_t size : poolSizes) {
+        stats.poolBytes += size;
+    }
+    stats.freeBytes = stats.poolBytes - usedBytes;
+
+    for (uint32_t fl = 0; fl < firstLevelCount; ++fl) {
+        for (uint32_t sl = 0; sl < secondLevelCount; ++sl) {
+            for (uint32_t node = heads[fl][sl]; node != none; node = nodes[node].nextFree) {
+                stats.freeBlocks++;
+                stats.largestFreeBlock = std::max(stats.largestFreeBlock, nodes[node].size);
+            }
+        }
+    }
+    return stats;
+}
+
+bool TlsfAllocator::validate() const {
+    uint32_t freeBlocks = 0;
+    uint64_t used = 0;
+
+    for (uint32_t pool = 0; pool < poolFirst.size(); ++pool) {
+        uint64_t offset = 0;
+        uint32_t previous = none;
+        for (uint32_t node = poolFirst[pool]; node != none; node = nodes[node].nextPhysical) {
+            const Block& block = nodes[node];
+            if (block.pool != pool || block.offset != offset || block.size == 0 || block.previousPhysical != previous) {
+                return false;
+            }
+            if (block.size & (granularity - 1)) {
+                return false;
+            }
+            if (block.free && previous != none && nodes[previous].free) {
+                return false;
+            }
+            freeBlocks += block.free;
+            used += block.free ? 0 : block.size;
+            offset += block.size;
+            previous = node;
+        }
+        if (offset != poolSizes[pool]) {
+            return false;
+        }
+    }
+
+    uint32_t listed = 0;
+    for (uint32_t fl = 0; fl < firstLevelCount; ++fl) {
+        bool firstBit = (firstLevelBitmap >> fl) & 1;
+        if (firstBit != (secondLevelBitmaps[fl] != 0)) {
+            return false;
+        }
+        for (uint32_t sl = 0; sl < secondLevelCount; ++sl) {
+            bool secondBit = (secondLevelBitmaps[fl] >> sl) & 1;
+            if (secondBit != (heads[fl][sl] != none)) {
+                return false;
+            }
+            uint32_t previous = none;
+            for (uint32_t node = heads[fl][sl]; node != none; node = nodes[node].nextFree) {
+                uint32_t f, s;
+                mapping(nodes[node].size >> granularityLog2, f, s);
+                if (!nodes[node].free || nodes[node].previousFree != previous || f != fl || s != sl) {
+                    return false;
+                }
+                listed++;
+                previous = node;
+            }
+        }
+    }
+
+    return listed == freeBlocks && used == usedBytes;
+}
@@ -0,0 +1,96 @@
+//
+//  TlsfAllocator.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct TlsfAllocation {
+    uint32_t node = ~0u;
+    uint32_t pool = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+
+    bool valid() const { return node != ~0u; }
+};
+
+struct TlsfStats {
+    uint32_t pools;
+    uint32_t allocations;
+    uint32_t freeBlocks;
+    uint64_t poolBytes;
+    uint64_t usedBytes;
+    uint64_t freeBytes;
+    uint64_t largestFreeBlock;
+
+    // 0 when all free space is one block, approaching 1 as it splinters.
+    double fragmentation() const { return freeBytes ? 1.0 - double(largestFreeBlock) / double(freeBytes) : 0.0; }
+};
+
+// Two-level segregated fit over address ranges it never touches: block
+// headers live in a side table, so the managed memory can be a GPU heap.
+// allocate() and free() are O(1); ranges of different pools never merge.
+class TlsfAllocator {
+public:
+    // Every size and offset is a multiple of `granularity`, a power of two.
+    explicit TlsfAllocator(uint64_t granularity = 256);
+
+    uint32_t addPool(uint64_t size);
+    // The smallest pool in which allocate(size, alignment) is sure to succeed
+    // while the pool is empty: requests are rounded up to the next size class
+    // and over-ask for alignment, so `size` itself is not always enough.
+    uint64_t poolSizeFor(uint64_t size, uint64_t alignment = 0) const;
+    uint32_t poolCount() const { return uint32_t(poolFirst.size()); }
+
+    // Returns an invalid allocation when no free block fits.
+    TlsfAllocation allocate(uint64_t size, uint64_t alignment = 0);
+    void free(const TlsfAllocation& allocation);
+
+    TlsfStats stats() const;
+    // Walks every block and free list checking the allocator invariants.
+    bool validate() const;
+
+private:
+    static constexpr uint32_t secondLevelLog2 = 5;
+    static constexpr uint32_t secondLevelCount = 1u << secondLevelLog2;
+    static constexpr uint32_t firstLevelCount = 64 - secondLevelLog2;
+    static constexpr uint32_t none = ~0u;
+
+    struct Block {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t pool;
+        uint32_t previousPhysical;
+        uint32_t nextPhysical;
+        uint32_t previousFree;
+        uint32_t nextFree;
+        bool free;
+    };
+
+    void mapping(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const;
+    bool findFree(uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel) const;
+    void insertFree(uint32_t node);
+    void removeFree(uint32_t node);
+    uint32_t newNode();
+    void releaseNode(uint32_t node);
+    // Cuts [offset, offset + size) off the front of `node`; returns the new front node.
+    uint32_t splitFront(uint32_t node, uint64_t size);
+
+    uint64_t granularity;
+    uint32_t granularityLog2;
+
+    std::vector<Block> nodes;
+    std::vector<uint32_t> unusedNodes;
+    std::vector<uint32_t> poolFirst;
+    std::vector<uint64_t> poolSizes;
+
+    uint64_t firstLevelBitmap = 0;
+    uint32_t secondLevelBitmaps[firstLevelCount] = {};
+    uint32_t heads[firstLevelCount][secondLevelCount];
+
+    uint64_t usedBytes = 0;
+    uint32_t allocationCount = 0;
+};
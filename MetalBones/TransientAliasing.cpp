@@ -0,0 +1,81 @@
+//
+//  TransientAliasing.cpp
+//  MetalBones
+//
+
+#include "TransientAliasing.hpp"
+
+#include <algorithm>
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+static bool livesOverlap(const TransientResource& a, const TransientResource& b) {
+    return a.firstPass <= b.lastPass && b.firstPass <= a.lastPass;
+}
+
+TransientPlacement placeTransientResources(const TransientResource* resources, uint32_t count) {
+    TransientPlacement placement;
+    placement.offsets.assign(count, 0);
+    placement.heapSize = 0;
+    placement.unaliasedSize = 0;
+
+    std::vector<uint32_t> order(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        order[i] = i;
+        placement.unaliasedSize = alignUp(placement.unaliasedSize, resources[i].alignment) + resources[i].size;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return resources[a].size > resources[b].size;
+    });
+
+    struct Range {
+        uint64_t begin;
+        uint64_t end;
+    };
+    std::vector<uint32_t> placed;
+    std::vector<Range> taken;
+
+    for (uint32_t index : order) {
+        const TransientResource& resource = resources[index];
+
+        taken.clear();
+        for (uint32_t other : placed) {
+            if (livesOverlap(resource, resources[other])) {
+                taken.push_back({placement.offsets[other], placement.offsets[other] + resources[other].size});
+            }
+        }
+        std::sort(taken.begin(), taken.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+
+        // Lowest gap between simultaneously live resources that fits.
+        uint64_t offset = 0;
+        for (const Range& range : taken) {
+            if (offset + resource.size <= range.begin) {
+                break;
+            }
+            offset = std::max(offset, alignUp(range.end, resource.alignment));
+        }
+
+        placement.offsets[index] = offset;
+        placement.heapSize = std::max(placement.heapSize, offset + resource.size);
+        placed.push_back(index);
+    }
+
+    for (uint32_t r = 0; r < count; ++r) {
+        for (uint32_t s = 0; s < count; ++s) {
+            const TransientResource& resource = resources[r];
+            const TransientResource& previous = resources[s];
+            if (previous.lastPass >= resource.firstPass) {
+                continue;
+            }
+            bool memoryOverlaps = placement.offsets[r] < placement.offsets[s] + previous.size
+                               && placement.offsets[s] < placement.offsets[r] + resource.size;
+            if (memoryOverlaps) {
+                placement.barriers.push_back({r, s, resource.firstPass, previous.lastPass});
+            }
+        }
+    }
+
+    return placement;
+}
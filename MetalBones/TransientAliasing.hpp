@@ -0,0 +1,39 @@
+//
+//  TransientAliasing.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// A resource that only lives from the pass that first writes it to the pass
+// that last reads it, both inclusive.
+struct TransientResource {
+    uint64_t size;
+    uint64_t alignment;
+    uint32_t firstPass;
+    uint32_t lastPass;
+};
+
+// Memory reused by `resource` was last used by `previous`, so the first pass
+// of `resource` has to wait for `previous`'s last pass to finish.
+struct AliasingBarrier {
+    uint32_t resource;
+    uint32_t previous;
+    uint32_t waitPass;
+    uint32_t signalPass;
+};
+
+struct TransientPlacement {
+    std::vector<uint64_t> offsets;
+    std::vector<AliasingBarrier> barriers;
+    uint64_t heapSize;
+    uint64_t unaliasedSize;     // what separate allocations would take
+};
+
+// Colors the interval graph of resource lifetimes with memory ranges: largest
+// resources first, each placed at the lowest offset that doesn't overlap any
+// already placed resource whose lifetime intersects its own.
+TransientPlacement placeTransientResources(const TransientResource* resources, uint32_t count);
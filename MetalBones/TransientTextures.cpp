@@ -0,0 +1,126 @@
+//
+//  TransientTextures.cpp
+//  MetalBones
+//
+
+#include "TransientTextures.hpp"
+
+#include <algorithm>
+
+static constexpr MTL::RenderStages allStages = MTL::RenderStageVertex | MTL::RenderStageFragment;
+
+TransientTextures::TransientTextures(MTL::Device* device)
+    : device(device->retain())
+{
+}
+
+TransientTextures::~TransientTextures() {
+    release();
+    for (MTL::TextureDescriptor* descriptor : descriptors) {
+        descriptor->release();
+    }
+    device->release();
+}
+
+void TransientTextures::release() {
+    for (MTL::Fence* fence : signals) {
+        if (fence) {
+            fence->release();
+        }
+    }
+    signals.clear();
+    waits.clear();
+
+    for (MTL::Texture* texture : textures) {
+        texture->release();
+    }
+    textures.clear();
+
+    if (heap) {
+        heap->release();
+        heap = nullptr;
+    }
+}
+
+uint32_t TransientTextures::declare(MTL::TextureDescriptor* descriptor, uint32_t firstPass, uint32_t lastPass) {
+    assert(firstPass <= lastPass);
+    assert(descriptor->storageMode() == MTL::StorageModePrivate);
+
+    MTL::SizeAndAlign sizeAndAlign = device->heapTextureSizeAndAlign(descriptor);
+    descriptors.push_back(descriptor->retain());
+    resources.push_back({sizeAndAlign.size, sizeAndAlign.align, firstPass, lastPass});
+    return uint32_t(resources.size() - 1);
+}
+
+void TransientTextures::build() {
+    release();
+    if (resources.empty()) {
+        return;
+    }
+
+    placement = placeTransientResources(resources.data(), uint32_t(resources.size()));
+
+    MTL::HeapDescriptor* heapDescriptor = MTL::HeapDescriptor::alloc()->init();
+    heapDescriptor->setType(MTL::HeapTypePlacement);
+    heapDescriptor->setStorageMode(MTL::StorageModePrivate);
+    heapDescriptor->setHazardTrackingMode(MTL::HazardTrackingModeTracked);
+    heapDescriptor->setSize(placement.heapSize);
+
+    heap = device->newHeap(heapDescriptor);
+    if (!heap) {
+        __builtin_printf("Failed to create a %llu byte transient heap\n", (unsigned long long)placement.heapSize);
+        assert(false);
+    }
+    heapDescriptor->release();
+
+    for (size_t i = 0; i < resources.size(); ++i) {
+        textures.push_back(heap->newTexture(descriptors[i], placement.offsets[i]));
+    }
+
+    // Metal doesn't track hazards between aliased resources, fences do that.
+    uint32_t passCount = 0;
+    for (const TransientResource& resource : resources) {
+        passCount = std::max(passCount, resource.lastPass + 1);
+    }
+    waits.resize(passCount);
+    signals.assign(passCount, nullptr);
+
+    for (const AliasingBarrier& barrier : placement.barriers) {
+        MTL::Fence*& fence = signals[barrier.signalPass];
+        if (!fence) {
+            fence = device->newFence();
+        }
+        std::vector<MTL::Fence*>& passWaits = waits[barrier.waitPass];
+        if (std::find(passWaits.begin(), passWaits.end(), fence) == passWaits.end()) {
+            passWaits.push_back(fence);
+        }
+    }
+}
+
+void TransientTextures::beginPass(MTL::RenderCommandEncoder* encoder, uint32_t pass) const {
+    if (pass < waits.size()) {
+        for (MTL::Fence* fence : waits[pass]) {
+            encoder->waitForFence(fence, allStages);
+        }
+    }
+}
+
+void TransientTextures::endPass(MTL::RenderCommandEncoder* encoder, uint32_t pass) const {
+    if (pass < signals.size() && signals[pass]) {
+        encoder->updateFence(signals[pass], allStages);
+    }
+}
+
+void TransientTextures::beginPass(MTL::ComputeCommandEncoder* encoder, uint32_t pass) const {
+    if (pass < waits.size()) {
+        for (MTL::Fence* fence : waits[pass]) {
+            encoder->waitForFence(fence);
+        }
+    }
+}
+
+void TransientTextures::endPass(MTL::ComputeCommandEncoder* encoder, uint32_t pass) const {
+    if (pass < signals.size() && signals[pass]) {
+        encoder->updateFence(signals[pass]);
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  TransientTextures.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <vector>
+
+#include "TransientAliasing.hpp"
+
+// Intermediate render targets for a fixed sequence of passes, placed at
+// overlapping offsets of one placement heap when their lifetimes allow it.
+// Encoders bracket each pass with beginPass()/endPass() so that a texture
+// reusing memory waits for the last pass that touched the previous occupant.
+class TransientTextures {
+public:
+    explicit TransientTextures(MTL::Device* device);
+    ~TransientTextures();
+
+    // Lifetimes are pass indices, inclusive. Returns the texture index.
+    uint32_t declare(MTL::TextureDescriptor* descriptor, uint32_t firstPass, uint32_t lastPass);
+
+    // Places everything declared so far and creates the heap and textures.
+    void build();
+
+    MTL::Texture* texture(uint32_t index) const { return textures[index]; }
+
+    void beginPass(MTL::RenderCommandEncoder* encoder, uint32_t pass) const;
+    void endPass(MTL::RenderCommandEncoder* encoder, uint32_t pass) const;
+    void beginPass(MTL::ComputeCommandEncoder* encoder, uint32_t pass) const;
+    void endPass(MTL::ComputeCommandEncoder* encoder, uint32_t pass) const;
+
+    uint64_t heapSize() const { return placement.heapSize; }
+    uint64_t unaliasedSize() const { return placement.unaliasedSize; }
+
+private:
+    void release();
+
+    MTL::Device* device;
+    MTL::Heap* heap = nullptr;
+
+    std::vector<MTL::TextureDescriptor*> descriptors;
+    std::vector<TransientResource> resources;
+    std::vector<MTL::Texture*> textures;
+
+    TransientPlacement placement;
+    // Per pass: fences to wait on before it, and the fence it updates at the end.
+    std::vector<std::vector<MTL::Fence*>> waits;
+    std::vector<MTL::Fence*> signals;
+};
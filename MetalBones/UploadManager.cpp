@@ -0,0 +1,94 @@
+//
+//  UploadManager.cpp
+//  MetalBones
+//
+
+#include "UploadManager.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Buffer blits need 4 byte aligned offsets, 16 keeps staged vectors aligned too.
+static constexpr size_t copyAlignment = 16;
+
+UploadManager::UploadManager(MTL::Device* device, MTL::CommandQueue* commandQueue, size_t capacity)
+    : device(device->retain())
+    , commandQueue(commandQueue->retain())
+    , ring((capacity + copyAlignment - 1) & ~(copyAlignment - 1))
+{
+    stagingBuffer = device->newBuffer(ring.capacity(), MTL::ResourceStorageModeShared | MTL::ResourceCPUCacheModeWriteCombined);
+    completion = device->newSharedEvent();
+}
+
+UploadManager::~UploadManager() {
+    completion->release();
+    stagingBuffer->release();
+    commandQueue->release();
+    device->release();
+}
+
+void UploadManager::waitForSpace() {
+    counters.stalls++;
+
+    if (!pending.empty()) {
+        MTL::CommandBuffer* commandBuffer = commandQueue->commandBuffer();
+        flush(commandBuffer);
+        commandBuffer->commit();
+        commandBuffer->waitUntilCompleted();
+    } else {
+        // Space is held by copies already in flight, wait for the newest one.
+        while (completion->signaledValue() < nextFence - 1) {
+            std::this_thread::yield();
+        }
+    }
+    reclaim();
+}
+
+void UploadManager::upload(MTL::Buffer* destination, size_t destinationOffset, const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    while (length > 0) {
+        size_t chunk = std::min(length, ring.capacity());
+        size_t offset;
+        if (!ring.allocate(chunk, copyAlignment, offset)) {
+            waitForSpace();
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        memcpy(static_cast<uint8_t*>(stagingBuffer->contents()) + offset, bytes, chunk);
+        auto end = std::chrono::steady_clock::now();
+
+        pending.push_back({destination, destinationOffset, offset, chunk});
+        counters.bytes += chunk;
+        counters.copies++;
+        counters.stagingSeconds += std::chrono::duration<double>(end - start).count();
+
+        bytes += chunk;
+        destinationOffset += chunk;
+        length -= chunk;
+    }
+}
+
+void UploadManager::flush(MTL::CommandBuffer* commandBuffer) {
+    if (pending.empty()) {
+        return;
+    }
+
+    MTL::BlitCommandEncoder* encoder = commandBuffer->blitCommandEncoder();
+    for (const Copy& copy : pending) {
+        encoder->copyFromBuffer(stagingBuffer, copy.stagingOffset, copy.destination, copy.destinationOffset, copy.length);
+    }
+    encoder->endEncoding();
+
+    commandBuffer->encodeSignalEvent(completion, nextFence);
+    ring.submit(nextFence++);
+
+    pending.clear();
+    counters.batches++;
+}
+
+void UploadManager::reclaim() {
+    ring.retire(completion->signaledValue());
+}
@@ -0,0 +1,64 @@
+//
+//  UploadManager.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <vector>
+
+#include "UploadRing.hpp"
+
+struct UploadStats {
+    uint64_t bytes;
+    uint64_t copies;
+    uint64_t batches;
+    uint64_t stalls;            // times the ring was full and we waited on the GPU
+    double stagingSeconds;      // CPU time spent writing staging memory
+
+    double bytesPerSecond() const { return stagingSeconds > 0.0 ? double(bytes) / stagingSeconds : 0.0; }
+};
+
+// Fills private buffers through a shared staging ring. Copies are queued by
+// upload() and encoded in one blit pass by flush(), which also signals a
+// shared event so reclaim() knows which staging ranges the GPU is done with.
+class UploadManager {
+public:
+    UploadManager(MTL::Device* device, MTL::CommandQueue* commandQueue, size_t capacity = 16 << 20);
+    ~UploadManager();
+
+    // Uploads larger than the ring are split; when the ring is full the queued
+    // copies are submitted on their own and the call waits for them. Command
+    // buffers passed to flush() must be committed before the next upload.
+    void upload(MTL::Buffer* destination, size_t destinationOffset, const void* data, size_t length);
+
+    // Encodes the queued copies ahead of anything else the caller encodes later.
+    void flush(MTL::CommandBuffer* commandBuffer);
+    void reclaim();
+
+    const UploadStats& stats() const { return counters; }
+    const UploadRingStats& ringStats() const { return ring.stats(); }
+
+private:
+    struct Copy {
+        MTL::Buffer* destination;
+        size_t destinationOffset;
+        size_t stagingOffset;
+        size_t length;
+    };
+
+    void waitForSpace();
+
+    MTL::Device* device;
+    MTL::CommandQueue* commandQueue;
+    MTL::Buffer* stagingBuffer;
+    MTL::SharedEvent* completion;
+
+    UploadRing ring;
+    std::vector<Copy> pending;
+    uint64_t nextFence = 1;
+
+    UploadStats counters = {};
+};
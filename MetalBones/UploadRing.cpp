@@ -0,0 +1,58 @@
+//
+//  UploadRing.cpp
+//  MetalBones
+//
+
+#include "UploadRing.hpp"
+
+#include <cassert>
+
+UploadRing::UploadRing(size_t capacity)
+    : size(capacity)
+{
+    assert(capacity > 0);
+}
+
+bool UploadRing::allocate(size_t length, size_t alignment, size_t& offset) {
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && size % alignment == 0);
+
+    // Nothing is live, so the next allocation may as well start at offset 0.
+    if (head == tail) {
+        head = tail = (head + size - 1) / size * size;
+    }
+
+    uint64_t start = (head + alignment - 1) & ~uint64_t(alignment - 1);
+    // Allocations never straddle the end of the buffer.
+    if (start % size + length > size) {
+        start = (start / size + 1) * size;
+    }
+
+    if (length > size || start + length - tail > size) {
+        counters.failures++;
+        return false;
+    }
+
+    offset = size_t(start % size);
+    counters.allocations++;
+    counters.bytesAllocated += length;
+    counters.bytesWasted += start - head;
+    head = start + length;
+    return true;
+}
+
+void UploadRing::submit(uint64_t fence) {
+    assert(submissions.empty() || submissions.back().fence <= fence);
+
+    if (!submissions.empty() && submissions.back().fence == fence) {
+        submissions.back().end = head;
+    } else {
+        submissions.push_back({fence, head});
+    }
+}
+
+void UploadRing::retire(uint64_t completedFence) {
+    while (!submissions.empty() && submissions.front().fence <= completedFence) {
+        tail = submissions.front().end;
+        submissions.pop_front();
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  UploadRing.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+struct UploadRingStats {
+    uint64_t allocations;
+    uint64_t failures;          // the ring was full until the GPU caught up
+    uint64_t bytesAllocated;
+    uint64_t bytesWasted;       // alignment and wrap-around padding
+};
+
+// Space bookkeeping for a circular staging buffer. Allocations made before
+// submit(fence) become reusable once retire() reports that fence complete.
+// Fences must increase monotonically; nothing here knows about the GPU.
+class UploadRing {
+public:
+    explicit UploadRing(size_t capacity);
+
+    // Returns false when the ring can't fit `size` until older fences retire.
+    bool allocate(size_t size, size_t alignment, size_t& offset);
+
+    // Tags everything allocated since the previous submit with `fence`.
+    void submit(uint64_t fence);
+    // Frees every submission whose fence is <= completedFence.
+    void retire(uint64_t completedFence);
+
+    size_t capacity() const { return size; }
+    size_t used() const { return size_t(head - tail); }
+    size_t pendingSubmissions() const { return submissions.size(); }
+
+    const UploadRingStats& stats() const { return counters; }
+
+private:
+    struct Submission {
+        uint64_t fence;
+        uint64_t end;
+    };
+
+    size_t size;
+    // Monotonic byte positions, the offset in the buffer is position % size.
+    uint64_t head = 0;
+    uint64_t tail = 0;
+    std::deque<Submission> submissions;
+
+    UploadRingStats counters = {};
+};
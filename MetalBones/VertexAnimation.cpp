@@ -0,0 +1,122 @@
+//
+//  VertexAnimation.cpp
+//  MetalBones
+//
+
+#include "VertexAnimation.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static size_t texelOffset(const VertexAnimationTexture& texture, uint32_t vertex, uint32_t frame) {
+    uint32_t x = vertex % texture.width;
+    uint32_t y = frame * texture.rowsPerFrame + vertex / texture.width;
+    return size_t(y) * texture.bytesPerRow() + size_t(x) * texture.bytesPerTexel();
+}
+
+static void writeTexel(VertexAnimationTexture& texture, std::vector<uint8_t>& data, uint32_t vertex, uint32_t frame, Float3 value) {
+    uint8_t* dst = data.data() + texelOffset(texture, vertex, frame);
+    if (texture.format == VertexAnimationFormat::Float32) {
+        const float texel[4] = {value.x, value.y, value.z, 1.0f};
+        std::memcpy(dst, texel, sizeof(texel));
+    } else {
+        const uint16_t texel[4] = {floatToHalf(value.x), floatToHalf(value.y), floatToHalf(value.z), floatToHalf(1.0f)};
+        std::memcpy(dst, texel, sizeof(texel));
+    }
+}
+
+Float3 VertexAnimationTexture::texel(const std::vector<uint8_t>& data, uint32_t vertex, uint32_t frame) const {
+    const uint8_t* src = data.data() + texelOffset(*this, vertex, frame);
+    if (format == VertexAnimationFormat::Float32) {
+        float t[4];
+        std::memcpy(t, src, sizeof(t));
+        return {t[0], t[1], t[2]};
+    }
+    uint16_t t[4];
+    std::memcpy(t, src, sizeof(t));
+    return {halfToFloat(t[0]), halfToFloat(t[1]), halfToFloat(t[2])};
+}
+
+Float3 skinPosition(const Float4x4* palette, const SkinnedVertex& vertex) {
+    Float3 result = {0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+        if (vertex.weights[i] > 0.0f) {
+            result = result + transformPoint(palette[vertex.joints[i]], vertex.position) * vertex.weights[i];
+        }
+    }
+    return result;
+}
+
+Float3 skinNormal(const Float4x4* palette, const SkinnedVertex& vertex) {
+    Float3 result = {0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+        if (vertex.weights[i] > 0.0f) {
+            result = result + transformVector(palette[vertex.joints[i]], vertex.normal) * vertex.weights[i];
+        }
+    }
+    float len = length(result);
+    return len > 0.0f ? result * (1.0f / len) : result;
+}
+
+VertexAnimationTexture bakeVertexAnimation(const Skeleton& skeleton, const AnimationClip& clip,
+                                           const SkinnedVertex* vertices, uint32_t vertexCount,
+                                           const VertexAnimationBakeSettings& settings) {
+    assert(clip.jointCount() == skeleton.jointCount());
+    assert(vertexCount > 0 && settings.frameRate > 0.0f);
+
+    VertexAnimationTexture texture;
+    texture.vertexCount = vertexCount;
+    texture.frameCount = std::max(1u, uint32_t(std::lround(clip.duration() * settings.frameRate)));
+    texture.width = std::min(vertexCount, settings.maxTextureWidth);
+    texture.rowsPerFrame = (vertexCount + texture.width - 1) / texture.width;
+    texture.frameRate = settings.frameRate;
+    texture.format = settings.format;
+
+    const size_t bytes = size_t(texture.height()) * texture.bytesPerRow();
+    texture.positions.assign(bytes, 0);
+    if (settings.bakeNormals) {
+        texture.normals.assign(bytes, 0);
+    }
+
+    std::vector<JointTransform> pose(skeleton.jointCount());
+    std::vector<Float4x4> palette(skeleton.jointCount());
+
+    for (uint32_t f = 0; f < texture.frameCount; ++f) {
+        clip.sample(float(f) / settings.frameRate, pose.data(), clip.jointCount());
+        buildMatrixPalette(skeleton, pose.data(), palette.data());
+
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            writeTexel(texture, texture.positions, v, f, skinPosition(palette.data(), vertices[v]));
+            if (settings.bakeNormals) {
+                writeTexel(texture, texture.normals, v, f, skinNormal(palette.data(), vertices[v]));
+            }
+        }
+    }
+
+    return texture;
+}
+
+static Float3 sampleBaked(const VertexAnimationTexture& texture, const std::vector<uint8_t>& data, uint32_t vertex, float time) {
+    float frames = float(texture.frameCount);
+    float position = std::fmod(time * texture.frameRate, frames);
+    if (position < 0.0f) {
+        position += frames;
+    }
+
+    uint32_t f0 = uint32_t(position) % texture.frameCount;
+    uint32_t f1 = (f0 + 1) % texture.frameCount;
+    float t = position - std::floor(position);
+
+    return lerp(texture.texel(data, vertex, f0), texture.texel(data, vertex, f1), t);
+}
+
+Float3 sampleBakedPosition(const VertexAnimationTexture& texture, uint32_t vertex, float time) {
+    return sampleBaked(texture, texture.positions, vertex, time);
+}
+
+Float3 sampleBakedNormal(const VertexAnimationTexture& texture, uint32_t vertex, float time) {
+    assert(!texture.normals.empty());
+    Float3 n = sampleBaked(texture, texture.normals, vertex, time);
+    float len = length(n);
+    return len > 0.0f ? n * (1.0f / len) : n;
+}
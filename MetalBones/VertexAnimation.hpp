@@ -0,0 +1,63 @@
+//
+//  VertexAnimation.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Animation.hpp"
+
+struct SkinnedVertex {
+    Float3 position;
+    Float3 normal;
+    uint16_t joints[4];
+    float weights[4];
+};
+
+enum class VertexAnimationFormat : uint8_t {
+    Float32,    // MTL::PixelFormatRGBA32Float
+    Float16,    // MTL::PixelFormatRGBA16Float
+};
+
+struct VertexAnimationBakeSettings {
+    float frameRate = 30.0f;
+    uint32_t maxTextureWidth = 16384;
+    VertexAnimationFormat format = VertexAnimationFormat::Float16;
+    bool bakeNormals = true;
+};
+
+// Skinned positions/normals of every frame of a clip. Each frame occupies
+// rowsPerFrame rows of `width` RGBA texels; vertex v of frame f lives at
+// (v % width, f * rowsPerFrame + v / width).
+struct VertexAnimationTexture {
+    uint32_t vertexCount = 0;
+    uint32_t frameCount = 0;
+    uint32_t width = 0;
+    uint32_t rowsPerFrame = 0;
+    float frameRate = 0.0f;
+    VertexAnimationFormat format = VertexAnimationFormat::Float16;
+
+    std::vector<uint8_t> positions;
+    std::vector<uint8_t> normals;
+
+    uint32_t height() const { return frameCount * rowsPerFrame; }
+    uint32_t bytesPerTexel() const { return format == VertexAnimationFormat::Float32 ? 16 : 8; }
+    uint32_t bytesPerRow() const { return width * bytesPerTexel(); }
+
+    Float3 texel(const std::vector<uint8_t>& data, uint32_t vertex, uint32_t frame) const;
+};
+
+Float3 skinPosition(const Float4x4* palette, const SkinnedVertex& vertex);
+Float3 skinNormal(const Float4x4* palette, const SkinnedVertex& vertex);
+
+VertexAnimationTexture bakeVertexAnimation(const Skeleton& skeleton, const AnimationClip& clip,
+                                           const SkinnedVertex* vertices, uint32_t vertexCount,
+                                           const VertexAnimationBakeSettings& settings = {});
+
+// CPU reference of the fetch done by vertexAnimationMain: looping, linearly
+// interpolated between the two nearest baked frames.
+Float3 sampleBakedPosition(const VertexAnimationTexture& texture, uint32_t vertex, float time);
+Float3 sampleBakedNormal(const VertexAnimationTexture& texture, uint32_t vertex, float time);
@@ -0,0 +1,120 @@
+//
+//  VertexAnimationCrowd.cpp
+//  MetalBones
+//
+
+#include "VertexAnimationCrowd.hpp"
+
+#include <algorithm>
+
+struct VertexAnimationParams {
+    simd::float4x4 viewProjection;
+    uint32_t width;
+    uint32_t rowsPerFrame;
+    uint32_t frameCount;
+    float frameRate;
+    float time;
+};
+
+VertexAnimationCrowd::VertexAnimationCrowd(MTL::Device* device, MTL::Library* library, UploadManager& uploads,
+                                           const VertexAnimationTexture& baked,
+                                           const uint16_t* indices, uint32_t indexCount,
+                                           uint32_t maxInstances)
+    : device(device->retain())
+    , uploads(uploads)
+    , width(baked.width)
+    , rowsPerFrame(baked.rowsPerFrame)
+    , frameCount(baked.frameCount)
+    , frameRate(baked.frameRate)
+    , indexCount(indexCount)
+    , maxInstances(maxInstances)
+{
+    assert(!baked.normals.empty());
+
+    buildPipeline(library);
+    buildTextures(baked);
+
+    indexBuffer = device->newBuffer(indexCount * sizeof(uint16_t), MTL::ResourceStorageModeManaged);
+    memcpy(indexBuffer->contents(), indices, indexCount * sizeof(uint16_t));
+    indexBuffer->didModifyRange(NS::Range::Make(0, indexBuffer->length()));
+
+    instanceBuffer = device->newBuffer(maxInstances * sizeof(CrowdInstance), MTL::ResourceStorageModePrivate);
+}
+
+VertexAnimationCrowd::~VertexAnimationCrowd() {
+    instanceBuffer->release();
+    indexBuffer->release();
+    normalTexture->release();
+    positionTexture->release();
+    renderPipelineState->release();
+    device->release();
+}
+
+void VertexAnimationCrowd::buildPipeline(MTL::Library* library) {
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    MTL::Function* vertexFn = library->newFunction(NS::String::string("vertexAnimationMain", UTF8StringEncoding));
+    MTL::Function* fragmentFn = library->newFunction(NS::String::string("vertexAnimationFragment", UTF8StringEncoding));
+
+    MTL::RenderPipelineDescriptor* pipelineDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+    pipelineDescriptor->setVertexFunction(vertexFn);
+    pipelineDescriptor->setFragmentFunction(fragmentFn);
+    pipelineDescriptor->colorAttachments()->object(0)->setPixelFormat(MTL::PixelFormat::PixelFormatBGRA8Unorm_sRGB);
+
+    NS::Error* error = nullptr;
+    renderPipelineState = device->newRenderPipelineState(pipelineDescriptor, &error);
+    if (!renderPipelineState) {
+        __builtin_printf("%s", error->localizedDescription()->utf8String());
+        assert(false);
+    }
+
+    fragmentFn->release();
+    vertexFn->release();
+    pipelineDescriptor->release();
+}
+
+void VertexAnimationCrowd::buildTextures(const VertexAnimationTexture& baked) {
+    MTL::PixelFormat pixelFormat = baked.format == VertexAnimationFormat::Float32
+        ? MTL::PixelFormat::PixelFormatRGBA32Float
+        : MTL::PixelFormat::PixelFormatRGBA16Float;
+
+    MTL::TextureDescriptor* textureDescriptor = MTL::TextureDescriptor::texture2DDescriptor(pixelFormat, baked.width, baked.height(), false);
+    textureDescriptor->setUsage(MTL::TextureUsageShaderRead);
+    textureDescriptor->setStorageMode(MTL::StorageModeManaged);
+
+    positionTexture = device->newTexture(textureDescriptor);
+    normalTexture = device->newTexture(textureDescriptor);
+
+    MTL::Region region = MTL::Region::Make2D(0, 0, baked.width, baked.height());
+    positionTexture->replaceRegion(region, 0, baked.positions.data(), baked.bytesPerRow());
+    normalTexture->replaceRegion(region, 0, baked.normals.data(), baked.bytesPerRow());
+}
+
+void VertexAnimationCrowd::setInstances(const CrowdInstance* instances, uint32_t count) {
+    instanceCount = std::min(count, maxInstances);
+
+    // The blit is ordered after earlier frames' draws reading the buffer by
+    // Metal's hazard tracking; writing it from the CPU here would not be.
+    uploads.upload(instanceBuffer, 0, instances, instanceCount * sizeof(CrowdInstance));
+}
+
+void VertexAnimationCrowd::draw(MTL::RenderCommandEncoder* encoder, const simd::float4x4& viewProjection, float time) {
+    if (instanceCount == 0) {
+        return;
+    }
+
+    VertexAnimationParams params = {viewProjection, width, rowsPerFrame, frameCount, frameRate, time};
+
+    encoder->setRenderPipelineState(renderPipelineState);
+    encoder->setVertexBuffer(instanceBuffer, 0, 1);
+    encoder->setVertexBytes(&params, sizeof(params), 2);
+    encoder->setVertexTexture(positionTexture, 0);
+    encoder->setVertexTexture(normalTexture, 1);
+
+    encoder->drawIndexedPrimitives(
+        MTL::PrimitiveType::PrimitiveTypeTriangle,
+        indexCount, MTL::IndexType::IndexTypeUInt16,
+        indexBuffer,
+        0, instanceCount
+    );
+}
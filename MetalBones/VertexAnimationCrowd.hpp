@@ -0,0 +1,63 @@
+//
+//  VertexAnimationCrowd.hpp
+//  MetalBones
+//
+
+#pragma once
+
+#include <Metal/Metal.hpp>
+
+#include <simd/simd.h>
+
+#include "UploadManager.hpp"
+#include "VertexAnimation.hpp"
+
+// Layout shared with CrowdInstance in vertex_animation.metal.
+struct CrowdInstance {
+    float position[3];
+    float scale;
+    float timeOffset;
+    float playbackRate;
+    float padding[2];
+};
+
+static_assert(sizeof(CrowdInstance) == 32);
+
+// Draws many instances of a baked mesh; all animation happens in the vertex
+// shader, the CPU only uploads the instance buffer when the crowd changes.
+class VertexAnimationCrowd {
+public:
+    VertexAnimationCrowd(MTL::Device* device, MTL::Library* library, UploadManager& uploads,
+                         const VertexAnimationTexture& baked,
+                         const uint16_t* indices, uint32_t indexCount,
+                         uint32_t maxInstances);
+    ~VertexAnimationCrowd();
+
+    // Goes through `uploads`, so frames still in flight keep reading the old
+    // instances. Call before the frame's flush(), which the new ones land with.
+    void setInstances(const CrowdInstance* instances, uint32_t count);
+
+    void draw(MTL::RenderCommandEncoder* encoder, const simd::float4x4& viewProjection, float time);
+
+private:
+    void buildPipeline(MTL::Library* library);
+    void buildTextures(const VertexAnimationTexture& baked);
+
+    MTL::Device* device;
+    UploadManager& uploads;
+    MTL::RenderPipelineState* renderPipelineState;
+
+    MTL::Texture* positionTexture;
+    MTL::Texture* normalTexture;
+    MTL::Buffer* indexBuffer;
+    MTL::Buffer* instanceBuffer;    // private, written by the upload blit
+
+    uint32_t width;
+    uint32_t rowsPerFrame;
+    uint32_t frameCount;
+    float frameRate;
+
+    uint32_t indexCount;
+    uint32_t instanceCount = 0;
+    uint32_t maxInstances;
+};
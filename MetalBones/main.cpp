@@ -13,6 +13,7 @@
 #include <AppKit/AppKit.hpp>
 #include <MetalKit/MetalKit.hpp>
 
+#include "DemoScene.hpp"
 #include "Renderer.hpp"
 
 class MTKViewDelegate : public MTK::ViewDelegate {
@@ -25,6 +26,7 @@ public:
 
 private:
     Renderer* renderer;
+    DemoScene* scene;
 };
 
 class AppDelegate : public NS::ApplicationDelegate {
@@ -135,13 +137,16 @@ bool AppDelegate::applicationShouldTerminateAfterLastWindowClosed(NS::Applicatio
 MTKViewDelegate::MTKViewDelegate(MTL::Device* device)
     : MTK::ViewDelegate()
     , renderer(new Renderer(device))
+    , scene(new DemoScene(*renderer))
 {
 }
 
 MTKViewDelegate::~MTKViewDelegate() {
+    delete scene;
     delete renderer;
 }
 
 void MTKViewDelegate::drawInMTKView(MTK::View* view) {
+    scene->update();
     renderer->draw(view);
 }
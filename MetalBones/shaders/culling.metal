@@ -0,0 +1,58 @@
+//
+//  culling.metal
+//  MetalBones
+//
+
+#include <metal_stdlib>
+using namespace metal;
+
+// Matches CullDraw in GpuCulling.hpp.
+struct CullDraw {
+    uint indexCount;
+    uint indexStart;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// Matches FrustumPlanes plus the object count, see GpuDrivenScene.cpp.
+struct CullParams {
+    float4 planes[6];
+    uint objectCount;
+};
+
+// MTLIndirectCommandBufferExecutionRange, cleared every frame.
+struct ExecutionRange {
+    uint location;
+    atomic_uint length;
+};
+
+struct CullCommands {
+    command_buffer commands;
+};
+
+// One thread per object: draws whose bounding sphere touches the frustum are
+// appended to the indirect command buffer, which inherits pipeline state and
+// buffers from the render encoder. See cullDrawsScalar() for the reference.
+kernel void cullObjects(constant CullParams& params [[buffer(0)]],
+                        const device float4* spheres [[buffer(1)]],
+                        const device CullDraw* draws [[buffer(2)]],
+                        const device ushort* indices [[buffer(3)]],
+                        device ExecutionRange& range [[buffer(4)]],
+                        device CullCommands& commands [[buffer(5)]],
+                        uint id [[thread_position_in_grid]]) {
+    if (id >= params.objectCount) {
+        return;
+    }
+    float4 sphere = spheres[id];
+    for (uint p = 0; p < 6; ++p) {
+        if (dot(params.planes[p].xyz, sphere.xyz) + params.planes[p].w < -sphere.w) {
+            return;
+        }
+    }
+
+    CullDraw draw = draws[id];
+    uint slot = atomic_fetch_add_explicit(&range.length, 1, memory_order_relaxed);
+    render_command command(commands.commands, slot);
+    command.draw_indexed_primitives(primitive_type::triangle, draw.indexCount, indices + draw.indexStart, 1,
+                                    draw.baseVertex, draw.baseInstance);
+}
@@ -8,17 +8,119 @@
 #include <metal_stdlib>
 using namespace metal;
 
+// Indices are ShaderFeature values, see ShaderPermutations.hpp.
+constant bool hasSkinning [[function_constant(0)]];
+constant bool hasInstancing [[function_constant(1)]];
+constant bool hasVertexColor [[function_constant(2)]];
+constant bool hasFog [[function_constant(3)]];
+constant bool hasBindless [[function_constant(4)]];
+constant bool hasClusteredLights [[function_constant(5)]];
+constant bool hasBoundPalette = hasSkinning && !hasBindless;
+
+constant half3 fogColor = half3(0.1h, 0.1h, 0.12h);
+constant float fogDensity = 1.5f;
+constant half3 ambientLight = half3(0.25h);
+
 struct VertexInput {
     float3 position [[attribute(0)]];
-    float3 color [[attribute(1)]];
+    float3 color [[attribute(1), function_constant(hasVertexColor)]];
+    ushort4 joints [[attribute(2), function_constant(hasSkinning)]];
+    float4 weights [[attribute(3), function_constant(hasSkinning)]];
 };
 
 struct VertexOutput {
     float4 position [[position]];
     half3 color;
+    float3 worldPosition;
+    uint object [[flat]];
+};
+
+// Indexed by the draw's base instance; matches ObjectData in Renderer.cpp.
+struct ObjectData {
+    float4x4 transform;
+    uint palette;           // buffer slot, for skinned objects
+    uint texture;           // texture slot, or ~0 for none
+    uint sampler;
+};
+
+// Table entries written by BindlessResources.
+struct BufferEntry {
+    const device float4x4* matrices;
+};
+
+struct TextureEntry {
+    texture2d<half> texture;
+};
+
+struct SamplerEntry {
+    sampler state;
 };
 
-VertexOutput vertex vertexMain(VertexInput vertexInput [[stage_in]], const constant float &t [[buffer(3)]]) {
+// Match PointLight, LightCluster and LightClusterConstants in LightClusters.hpp.
+struct PointLight {
+    packed_float3 position;
+    float radius;
+    packed_float3 color;
+    float intensity;
+};
+
+struct LightCluster {
+    uint offset;
+    uint count;
+};
+
+struct LightClusterConstants {
+    float4x4 view;
+    float projectionX;
+    float projectionY;
+    float sliceScale;
+    float sliceBias;
+    float zNear;
+    float zFar;
+    uint tilesX;
+    uint tilesY;
+    uint slices;
+    uint lightCount;
+};
+
+// The lights of the cluster `world` falls in, the same way as
+// LightClusterGrid::clusterAt() finds it.
+static half3 clusteredLight(float3 world,
+                            constant LightClusterConstants& grid,
+                            const device PointLight* lights,
+                            const device LightCluster* clusters,
+                            const device ushort* indices) {
+    float3 view = (grid.view * float4(world, 1.0f)).xyz;
+    float depth = -view.z;
+    if (!(depth > grid.zNear && depth < grid.zFar)) {
+        return half3(0.0h);
+    }
+    float tileX = floor((view.x * grid.projectionX / depth * 0.5f + 0.5f) * grid.tilesX);
+    float tileY = floor((0.5f - view.y * grid.projectionY / depth * 0.5f) * grid.tilesY);
+    if (tileX < 0.0f || tileX >= grid.tilesX || tileY < 0.0f || tileY >= grid.tilesY) {
+        return half3(0.0h);
+    }
+    float slice = clamp(floor(log(depth) * grid.sliceScale + grid.sliceBias), 0.0f, float(grid.slices - 1));
+    LightCluster cluster = clusters[(uint(slice) * grid.tilesY + uint(tileY)) * grid.tilesX + uint(tileX)];
+
+    float3 sum = float3(0.0f);
+    for (uint i = 0; i < cluster.count; ++i) {
+        PointLight light = lights[indices[cluster.offset + i]];
+        float3 offset = float3(light.position) - world;
+        float falloff = max(1.0f - dot(offset, offset) / (light.radius * light.radius), 0.0f);
+        sum += float3(light.color) * (light.intensity * falloff * falloff);
+    }
+    return half3(sum);
+}
+
+VertexOutput vertex vertexMain(VertexInput vertexInput [[stage_in]],
+                               uint instanceId [[instance_id]],
+                               uint baseInstance [[base_instance]],
+                               const constant float &t [[buffer(3)]],
+                               const device float4x4* palette [[buffer(4), function_constant(hasBoundPalette)]],
+                               const device float4x4* instances [[buffer(5), function_constant(hasInstancing)]],
+                               const device ObjectData* objects [[buffer(6), function_constant(hasBindless)]],
+                               const device BufferEntry* buffers [[buffer(7), function_constant(hasBindless)]]) {
     float4x4 rotX = float4x4(1.0f);
     rotX[1][1] = cos(t);
     rotX[1][2] = sin(t);
@@ -37,12 +139,59 @@ VertexOutput vertex vertexMain(VertexInput vertexInput [[stage_in]], const const
     normZ[2][2] = (1 - zNear) / zFar;
     normZ[3][2] = zNear;
     
+    float4 position = float4(vertexInput.position, 1.0);
+    if (hasSkinning) {
+        const device float4x4* skin;
+        if (hasBindless) {
+            skin = buffers[objects[baseInstance].palette].matrices;
+        } else {
+            skin = palette;
+        }
+        float4 w = vertexInput.weights;
+        ushort4 j = vertexInput.joints;
+        position = (skin[j.x] * w.x + skin[j.y] * w.y + skin[j.z] * w.z + skin[j.w] * w.w) * position;
+    }
+    if (hasInstancing) {
+        // instance_id counts from the base instance.
+        position = instances[instanceId - baseInstance] * position;
+    }
+    if (hasBindless) {
+        position = objects[baseInstance].transform * position;
+    }
+
     VertexOutput o;
-    o.position = normZ * rotX * rotY * float4(vertexInput.position, 1.0);
-    o.color = half3(vertexInput.color);
+    o.position = normZ * rotX * rotY * position;
+    o.worldPosition = position.xyz;
+    o.object = baseInstance;
+    o.color = half3(1.0h);
+    if (hasVertexColor) {
+        o.color = half3(vertexInput.color);
+    }
     return o;
 }
 
-half4 fragment fragmentMain(VertexOutput in [[stage_in]]) {
-    return half4(in.color, 1.0);
+half4 fragment fragmentMain(VertexOutput in [[stage_in]],
+                            const device ObjectData* objects [[buffer(6), function_constant(hasBindless)]],
+                            const device TextureEntry* textures [[buffer(8), function_constant(hasBindless)]],
+                            const device SamplerEntry* samplers [[buffer(9), function_constant(hasBindless)]],
+                            constant LightClusterConstants& lightGrid [[buffer(10), function_constant(hasClusteredLights)]],
+                            const device PointLight* lights [[buffer(11), function_constant(hasClusteredLights)]],
+                            const device LightCluster* lightClusters [[buffer(12), function_constant(hasClusteredLights)]],
+                            const device ushort* lightIndices [[buffer(13), function_constant(hasClusteredLights)]]) {
+    half3 color = in.color;
+    if (hasBindless) {
+        ObjectData object = objects[in.object];
+        if (object.texture != ~0u) {
+            float2 uv = in.position.xy / 64.0f;
+            color *= textures[object.texture].texture.sample(samplers[object.sampler].state, uv).rgb;
+        }
+    }
+    if (hasClusteredLights) {
+        color *= ambientLight + clusteredLight(in.worldPosition, lightGrid, lights, lightClusters, lightIndices);
+    }
+    if (hasFog) {
+        half fog = half(exp(-fogDensity * in.position.z));
+        color = mix(fogColor, color, fog);
+    }
+    return half4(color, 1.0);
 }
@@ -0,0 +1,45 @@
+//
+//  morph_targets.metal
+//  MetalBones
+//
+
+#include <metal_stdlib>
+using namespace metal;
+
+struct MorphDispatch {
+    uint first;
+    uint count;
+    float positionScale;
+    float normalScale;
+};
+
+kernel void morphCopyBase(const device float4* basePositions [[buffer(0)]],
+                          const device float4* baseNormals [[buffer(1)]],
+                          device float4* positions [[buffer(2)]],
+                          device float4* normals [[buffer(3)]],
+                          constant uint& vertexCount [[buffer(4)]],
+                          uint id [[thread_position_in_grid]]) {
+    if (id >= vertexCount) {
+        return;
+    }
+    positions[id] = basePositions[id];
+    normals[id] = baseNormals[id];
+}
+
+// One dispatch per active target: a vertex appears at most once per target,
+// so no atomics are needed as long as dispatches run serially.
+kernel void morphAccumulate(const device uint* vertices [[buffer(0)]],
+                            const device short4* positionDeltas [[buffer(1)]],
+                            const device short4* normalDeltas [[buffer(2)]],
+                            device float4* positions [[buffer(3)]],
+                            device float4* normals [[buffer(4)]],
+                            constant MorphDispatch& params [[buffer(5)]],
+                            uint id [[thread_position_in_grid]]) {
+    if (id >= params.count) {
+        return;
+    }
+    uint delta = params.first + id;
+    uint v = vertices[delta];
+    positions[v] += float4(positionDeltas[delta]) * params.positionScale;
+    normals[v] += float4(normalDeltas[delta]) * params.normalScale;
+}
@@ -0,0 +1,26 @@
+//
+//  palette_stream.metal
+//  MetalBones
+//
+
+#include <metal_stdlib>
+using namespace metal;
+
+// Expands the packed 3x4 rows of every dirty joint into the persistent
+// float4x4 palette. Each joint appears at most once per frame.
+kernel void paletteScatter(const device uint* joints [[buffer(0)]],
+                           const device float4* rows [[buffer(1)]],
+                           device float4x4* palette [[buffer(2)]],
+                           constant uint& count [[buffer(3)]],
+                           uint id [[thread_position_in_grid]]) {
+    if (id >= count) {
+        return;
+    }
+    float4 r0 = rows[id * 3 + 0];
+    float4 r1 = rows[id * 3 + 1];
+    float4 r2 = rows[id * 3 + 2];
+    palette[joints[id]] = float4x4(float4(r0.x, r1.x, r2.x, 0.0),
+                                   float4(r0.y, r1.y, r2.y, 0.0),
+                                   float4(r0.z, r1.z, r2.z, 0.0),
+                                   float4(r0.w, r1.w, r2.w, 1.0));
+}
@@ -0,0 +1,72 @@
+//
+//  vertex_animation.metal
+//  MetalBones
+//
+
+#include <metal_stdlib>
+using namespace metal;
+
+struct CrowdInstance {
+    packed_float3 position;
+    float scale;
+    float timeOffset;
+    float playbackRate;
+    float2 padding;
+};
+
+struct VertexAnimationParams {
+    float4x4 viewProjection;
+    uint width;
+    uint rowsPerFrame;
+    uint frameCount;
+    float frameRate;
+    float time;
+};
+
+struct VertexAnimationOutput {
+    float4 position [[position]];
+    half3 color;
+};
+
+static uint2 texelCoord(uint vertexId, uint frame, constant VertexAnimationParams& params) {
+    return uint2(vertexId % params.width, frame * params.rowsPerFrame + vertexId / params.width);
+}
+
+// Must stay in sync with sampleBakedPosition() in VertexAnimation.cpp.
+static float3 sampleBaked(texture2d<float, access::read> texture, uint vertexId, float time, constant VertexAnimationParams& params) {
+    float frames = float(params.frameCount);
+    float position = fmod(time * params.frameRate, frames);
+    position += position < 0.0f ? frames : 0.0f;
+
+    uint f0 = uint(position) % params.frameCount;
+    uint f1 = (f0 + 1) % params.frameCount;
+
+    float3 a = texture.read(texelCoord(vertexId, f0, params)).xyz;
+    float3 b = texture.read(texelCoord(vertexId, f1, params)).xyz;
+    return mix(a, b, fract(position));
+}
+
+VertexAnimationOutput vertex vertexAnimationMain(uint vertexId [[vertex_id]],
+                                                 uint instanceId [[instance_id]],
+                                                 const device CrowdInstance* instances [[buffer(1)]],
+                                                 constant VertexAnimationParams& params [[buffer(2)]],
+                                                 texture2d<float, access::read> positions [[texture(0)]],
+                                                 texture2d<float, access::read> normals [[texture(1)]]) {
+    CrowdInstance instance = instances[instanceId];
+    float time = params.time * instance.playbackRate + instance.timeOffset;
+
+    float3 position = sampleBaked(positions, vertexId, time, params);
+    float3 normal = normalize(sampleBaked(normals, vertexId, time, params));
+
+    float3 world = position * instance.scale + float3(instance.position);
+    float light = saturate(dot(normal, normalize(float3(0.4f, 1.0f, 0.3f)))) * 0.8f + 0.2f;
+
+    VertexAnimationOutput o;
+    o.position = params.viewProjection * float4(world, 1.0f);
+    o.color = half3(light);
+    return o;
+}
+
+half4 fragment vertexAnimationFragment(VertexAnimationOutput in [[stage_in]]) {
+    return half4(in.color, 1.0);
+}
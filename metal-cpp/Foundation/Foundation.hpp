@@ -32,6 +32,7 @@
 #include "NSEnumerator.hpp"
 #include "NSError.hpp"
 #include "NSLock.hpp"
+#include "NSMethodCache.hpp"
 #include "NSNotification.hpp"
 #include "NSNumber.hpp"
 #include "NSObject.hpp"
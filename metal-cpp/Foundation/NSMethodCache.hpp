@@ -0,0 +1,114 @@
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+//
+// Foundation/NSMethodCache.hpp
+//
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#pragma once
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#include "NSDefines.hpp"
+
+#include <objc/runtime.h>
+
+#include <atomic>
+#include <type_traits>
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+namespace NS
+{
+// The implementation of one selector for each receiver class seen so far, so a hot call site can jump straight to it instead of going
+// through objc_msgSend. Entries are only ever added and live as long as the process, like the classes they describe; a method replaced
+// after its first call through the cache keeps the old implementation.
+class MethodCache
+{
+public:
+    constexpr MethodCache() = default;
+
+    MethodCache(const MethodCache&) = delete;
+    MethodCache& operator=(const MethodCache&) = delete;
+
+    IMP lookup(Class cls, SEL selector);
+
+    template <typename _Ret, typename... _Args>
+    _Ret send(const void* pObj, SEL selector, _Args... args);
+
+private:
+    struct Entry
+    {
+        Class  cls;
+        IMP    imp;
+        Entry* pNext;
+    };
+
+    IMP resolve(Class cls, SEL selector);
+
+    std::atomic<Entry*> m_pHead { nullptr };
+};
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+_NS_INLINE IMP NS::MethodCache::lookup(Class cls, SEL selector)
+{
+    for (Entry* pEntry = m_pHead.load(std::memory_order_acquire); pEntry; pEntry = pEntry->pNext)
+    {
+        if (pEntry->cls == cls)
+        {
+            return pEntry->imp;
+        }
+    }
+
+    return resolve(cls, selector);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+inline IMP NS::MethodCache::resolve(Class cls, SEL selector)
+{
+    // Threads racing on a new class may both add it; the duplicate is harmless.
+    Entry* pEntry = new Entry { cls, class_getMethodImplementation(cls, selector), m_pHead.load(std::memory_order_relaxed) };
+
+    while (!m_pHead.compare_exchange_weak(pEntry->pNext, pEntry, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+
+    return pEntry->imp;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+template <typename _Ret, typename... _Args>
+_NS_INLINE _Ret NS::MethodCache::send(const void* pObj, SEL selector, _Args... args)
+{
+    // Only returns that come back in registers, the same way objc_msgSend would hand them back.
+    static_assert(std::is_void<_Ret>::value || std::is_integral<_Ret>::value || std::is_pointer<_Ret>::value, "Unsupported return type!");
+
+    if (nullptr == pObj)
+    {
+        if constexpr (!std::is_void<_Ret>::value)
+        {
+            return _Ret(0);
+        }
+        else
+        {
+            return;
+        }
+    }
+
+#ifdef __OBJC__
+    const Class cls = object_getClass((__bridge id)pObj);
+#else
+    const Class cls = object_getClass((id)pObj);
+#endif // __OBJC__
+
+    using MethodProc = _Ret (*)(const void*, SEL, _Args...);
+
+    const MethodProc pProc = reinterpret_cast<MethodProc>(lookup(cls, selector));
+
+    return (*pProc)(pObj, selector, args...);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -23,6 +23,7 @@
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
 #include "NSDefines.hpp"
+#include "NSMethodCache.hpp"
 #include "NSPrivate.hpp"
 #include "NSTypes.hpp"
 
@@ -88,6 +89,8 @@ protected:
     static _Ret sendMessage(const void* pObj, SEL selector, _Args... args);
     template <typename _Ret, typename... _Args>
     static _Ret sendMessageSafe(const void* pObj, SEL selector, _Args... args);
+    template <typename _Ret, typename... _Args>
+    static _Ret sendMessageCached(MethodCache& cache, const void* pObj, SEL selector, _Args... args);
 
 private:
     Object() = delete;
@@ -219,6 +222,21 @@ _NS_INLINE _Ret NS::Object::sendMessage(const void* pObj, SEL selector, _Args...
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+// With METALCPP_CACHED_DISPATCH hot call sites skip objc_msgSend and call the implementation their cache resolved for the receiver's class.
+template <typename _Ret, typename... _Args>
+_NS_INLINE _Ret NS::Object::sendMessageCached(MethodCache& cache, const void* pObj, SEL selector, _Args... args)
+{
+#if defined(METALCPP_CACHED_DISPATCH)
+    return cache.send<_Ret>(pObj, selector, args...);
+#else
+    (void)cache;
+
+    return sendMessage<_Ret>(pObj, selector, args...);
+#endif // METALCPP_CACHED_DISPATCH
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 _NS_INLINE NS::MethodSignature* NS::Object::methodSignatureForSelector(const void* pObj, SEL selector)
 {
     return sendMessage<MethodSignature*>(pObj, _NS_PRIVATE_SEL(methodSignatureForSelector_), selector);
@@ -67,6 +67,50 @@
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+#if defined(METALCPP_LAZY_REGISTRATION)
+
+// Classes and selectors are looked up the first time they are used instead of by static initializers. The function-local statics make
+// the first lookup thread-safe; after that an access is a guard check and a load. Define it for every translation unit or none; the
+// *_PRIVATE_IMPLEMENTATION unit then only defines the string and constant symbols.
+
+#undef _NS_PRIVATE_CLS
+#undef _NS_PRIVATE_SEL
+#undef _NS_PRIVATE_DEF_CLS
+#undef _NS_PRIVATE_DEF_PRO
+#undef _NS_PRIVATE_DEF_SEL
+
+#define _NS_PRIVATE_CLS(symbol) (Private::Class::s_k##symbol())
+#define _NS_PRIVATE_SEL(accessor) (Private::Selector::s_k##accessor())
+
+#ifdef __OBJC__
+#define _NS_PRIVATE_LAZY_BRIDGE(value) ((__bridge void*)(value))
+#else
+#define _NS_PRIVATE_LAZY_BRIDGE(value) ((void*)(value))
+#endif // __OBJC__
+
+#define _NS_PRIVATE_DEF_CLS(symbol)                                                     \
+    inline void* s_k##symbol()                                                          \
+    {                                                                                   \
+        static void* const pClass = _NS_PRIVATE_LAZY_BRIDGE(objc_lookUpClass(#symbol)); \
+        return pClass;                                                                  \
+    }
+#define _NS_PRIVATE_DEF_PRO(symbol)                                                        \
+    inline void* s_k##symbol()                                                             \
+    {                                                                                      \
+        static void* const pProtocol = _NS_PRIVATE_LAZY_BRIDGE(objc_getProtocol(#symbol)); \
+        return pProtocol;                                                                  \
+    }
+#define _NS_PRIVATE_DEF_SEL(accessor, symbol)                 \
+    inline SEL s_k##accessor()                                \
+    {                                                         \
+        static const SEL selector = sel_registerName(symbol); \
+        return selector;                                      \
+    }
+
+#endif // METALCPP_LAZY_REGISTRATION
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 namespace NS
 {
 namespace Private
@@ -136,19 +136,25 @@ _MTL_INLINE MTL::DispatchType MTL::ComputeCommandEncoder::dispatchType() const
 // method: setComputePipelineState:
 _MTL_INLINE void MTL::ComputeCommandEncoder::setComputePipelineState(const MTL::ComputePipelineState* state)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setComputePipelineState_), state);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setComputePipelineState_), state);
 }
 
 // method: setBytes:length:atIndex:
 _MTL_INLINE void MTL::ComputeCommandEncoder::setBytes(const void* bytes, NS::UInteger length, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setBytes_length_atIndex_), bytes, length, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setBytes_length_atIndex_), bytes, length, index);
 }
 
 // method: setBuffer:offset:atIndex:
 _MTL_INLINE void MTL::ComputeCommandEncoder::setBuffer(const MTL::Buffer* buffer, NS::UInteger offset, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setBuffer_offset_atIndex_), buffer, offset, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setBuffer_offset_atIndex_), buffer, offset, index);
 }
 
 // method: setBufferOffset:atIndex:
@@ -220,7 +226,9 @@ _MTL_INLINE void MTL::ComputeCommandEncoder::setAccelerationStructure(const MTL:
 // method: setTexture:atIndex:
 _MTL_INLINE void MTL::ComputeCommandEncoder::setTexture(const MTL::Texture* texture, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setTexture_atIndex_), texture, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setTexture_atIndex_), texture, index);
 }
 
 // method: setTextures:withRange:
@@ -280,7 +288,9 @@ _MTL_INLINE void MTL::ComputeCommandEncoder::setStageInRegion(const MTL::Buffer*
 // method: dispatchThreadgroups:threadsPerThreadgroup:
 _MTL_INLINE void MTL::ComputeCommandEncoder::dispatchThreadgroups(MTL::Size threadgroupsPerGrid, MTL::Size threadsPerThreadgroup)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(dispatchThreadgroups_threadsPerThreadgroup_), threadgroupsPerGrid, threadsPerThreadgroup);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(dispatchThreadgroups_threadsPerThreadgroup_), threadgroupsPerGrid, threadsPerThreadgroup);
 }
 
 // method: dispatchThreadgroupsWithIndirectBuffer:indirectBufferOffset:threadsPerThreadgroup:
@@ -292,7 +302,9 @@ _MTL_INLINE void MTL::ComputeCommandEncoder::dispatchThreadgroups(const MTL::Buf
 // method: dispatchThreads:threadsPerThreadgroup:
 _MTL_INLINE void MTL::ComputeCommandEncoder::dispatchThreads(MTL::Size threadsPerGrid, MTL::Size threadsPerThreadgroup)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(dispatchThreads_threadsPerThreadgroup_), threadsPerGrid, threadsPerThreadgroup);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(dispatchThreads_threadsPerThreadgroup_), threadsPerGrid, threadsPerThreadgroup);
 }
 
 // method: updateFence:
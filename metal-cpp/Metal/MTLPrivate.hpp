@@ -112,6 +112,48 @@ namespace MTL::Private
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+#if defined(METALCPP_LAZY_REGISTRATION)
+
+// Resolved on first use, see Foundation/NSPrivate.hpp.
+
+#undef _MTL_PRIVATE_CLS
+#undef _MTL_PRIVATE_SEL
+#undef _MTL_PRIVATE_DEF_CLS
+#undef _MTL_PRIVATE_DEF_PRO
+#undef _MTL_PRIVATE_DEF_SEL
+
+#define _MTL_PRIVATE_CLS(symbol) (Private::Class::s_k##symbol())
+#define _MTL_PRIVATE_SEL(accessor) (Private::Selector::s_k##accessor())
+
+#ifdef __OBJC__
+#define _MTL_PRIVATE_LAZY_BRIDGE(value) ((__bridge void*)(value))
+#else
+#define _MTL_PRIVATE_LAZY_BRIDGE(value) ((void*)(value))
+#endif // __OBJC__
+
+#define _MTL_PRIVATE_DEF_CLS(symbol)                                                     \
+    inline void* s_k##symbol()                                                           \
+    {                                                                                    \
+        static void* const pClass = _MTL_PRIVATE_LAZY_BRIDGE(objc_lookUpClass(#symbol)); \
+        return pClass;                                                                   \
+    }
+#define _MTL_PRIVATE_DEF_PRO(symbol)                                                        \
+    inline void* s_k##symbol()                                                              \
+    {                                                                                       \
+        static void* const pProtocol = _MTL_PRIVATE_LAZY_BRIDGE(objc_getProtocol(#symbol)); \
+        return pProtocol;                                                                   \
+    }
+#define _MTL_PRIVATE_DEF_SEL(accessor, symbol)                \
+    inline SEL s_k##accessor()                                \
+    {                                                         \
+        static const SEL selector = sel_registerName(symbol); \
+        return selector;                                      \
+    }
+
+#endif // METALCPP_LAZY_REGISTRATION
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 namespace MTL
 {
 namespace Private
@@ -405,25 +405,33 @@ public:
 // method: setRenderPipelineState:
 _MTL_INLINE void MTL::RenderCommandEncoder::setRenderPipelineState(const MTL::RenderPipelineState* pipelineState)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setRenderPipelineState_), pipelineState);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setRenderPipelineState_), pipelineState);
 }
 
 // method: setVertexBytes:length:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setVertexBytes(const void* bytes, NS::UInteger length, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setVertexBytes_length_atIndex_), bytes, length, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setVertexBytes_length_atIndex_), bytes, length, index);
 }
 
 // method: setVertexBuffer:offset:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setVertexBuffer(const MTL::Buffer* buffer, NS::UInteger offset, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setVertexBuffer_offset_atIndex_), buffer, offset, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setVertexBuffer_offset_atIndex_), buffer, offset, index);
 }
 
 // method: setVertexBufferOffset:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setVertexBufferOffset(NS::UInteger offset, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setVertexBufferOffset_atIndex_), offset, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setVertexBufferOffset_atIndex_), offset, index);
 }
 
 // method: setVertexBuffers:offsets:withRange:
@@ -585,13 +593,17 @@ _MTL_INLINE void MTL::RenderCommandEncoder::setTriangleFillMode(MTL::TriangleFil
 // method: setFragmentBytes:length:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setFragmentBytes(const void* bytes, NS::UInteger length, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setFragmentBytes_length_atIndex_), bytes, length, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setFragmentBytes_length_atIndex_), bytes, length, index);
 }
 
 // method: setFragmentBuffer:offset:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setFragmentBuffer(const MTL::Buffer* buffer, NS::UInteger offset, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setFragmentBuffer_offset_atIndex_), buffer, offset, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setFragmentBuffer_offset_atIndex_), buffer, offset, index);
 }
 
 // method: setFragmentBufferOffset:atIndex:
@@ -609,7 +621,9 @@ _MTL_INLINE void MTL::RenderCommandEncoder::setFragmentBuffers(const MTL::Buffer
 // method: setFragmentTexture:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setFragmentTexture(const MTL::Texture* texture, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setFragmentTexture_atIndex_), texture, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setFragmentTexture_atIndex_), texture, index);
 }
 
 // method: setFragmentTextures:withRange:
@@ -621,7 +635,9 @@ _MTL_INLINE void MTL::RenderCommandEncoder::setFragmentTextures(const MTL::Textu
 // method: setFragmentSamplerState:atIndex:
 _MTL_INLINE void MTL::RenderCommandEncoder::setFragmentSamplerState(const MTL::SamplerState* sampler, NS::UInteger index)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(setFragmentSamplerState_atIndex_), sampler, index);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(setFragmentSamplerState_atIndex_), sampler, index);
 }
 
 // method: setFragmentSamplerStates:withRange:
@@ -891,7 +907,9 @@ _MTL_INLINE void MTL::RenderCommandEncoder::drawPrimitives(MTL::PrimitiveType pr
 // method: drawPrimitives:vertexStart:vertexCount:
 _MTL_INLINE void MTL::RenderCommandEncoder::drawPrimitives(MTL::PrimitiveType primitiveType, NS::UInteger vertexStart, NS::UInteger vertexCount)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(drawPrimitives_vertexStart_vertexCount_), primitiveType, vertexStart, vertexCount);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(drawPrimitives_vertexStart_vertexCount_), primitiveType, vertexStart, vertexCount);
 }
 
 // method: drawIndexedPrimitives:indexCount:indexType:indexBuffer:indexBufferOffset:instanceCount:
@@ -903,7 +921,9 @@ _MTL_INLINE void MTL::RenderCommandEncoder::drawIndexedPrimitives(MTL::Primitive
 // method: drawIndexedPrimitives:indexCount:indexType:indexBuffer:indexBufferOffset:
 _MTL_INLINE void MTL::RenderCommandEncoder::drawIndexedPrimitives(MTL::PrimitiveType primitiveType, NS::UInteger indexCount, MTL::IndexType indexType, const MTL::Buffer* indexBuffer, NS::UInteger indexBufferOffset)
 {
-    Object::sendMessage<void>(this, _MTL_PRIVATE_SEL(drawIndexedPrimitives_indexCount_indexType_indexBuffer_indexBufferOffset_), primitiveType, indexCount, indexType, indexBuffer, indexBufferOffset);
+    static NS::MethodCache cache;
+
+    Object::sendMessageCached<void>(cache, this, _MTL_PRIVATE_SEL(drawIndexedPrimitives_indexCount_indexType_indexBuffer_indexBufferOffset_), primitiveType, indexCount, indexType, indexBuffer, indexBufferOffset);
 }
 
 // method: drawPrimitives:vertexStart:vertexCount:instanceCount:baseInstance:
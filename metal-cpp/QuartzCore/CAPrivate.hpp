@@ -69,6 +69,48 @@
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+#if defined(METALCPP_LAZY_REGISTRATION)
+
+// Resolved on first use, see Foundation/NSPrivate.hpp.
+
+#undef _CA_PRIVATE_CLS
+#undef _CA_PRIVATE_SEL
+#undef _CA_PRIVATE_DEF_CLS
+#undef _CA_PRIVATE_DEF_PRO
+#undef _CA_PRIVATE_DEF_SEL
+
+#define _CA_PRIVATE_CLS(symbol) (Private::Class::s_k##symbol())
+#define _CA_PRIVATE_SEL(accessor) (Private::Selector::s_k##accessor())
+
+#ifdef __OBJC__
+#define _CA_PRIVATE_LAZY_BRIDGE(value) ((__bridge void*)(value))
+#else
+#define _CA_PRIVATE_LAZY_BRIDGE(value) ((void*)(value))
+#endif // __OBJC__
+
+#define _CA_PRIVATE_DEF_CLS(symbol)                                                     \
+    inline void* s_k##symbol()                                                          \
+    {                                                                                   \
+        static void* const pClass = _CA_PRIVATE_LAZY_BRIDGE(objc_lookUpClass(#symbol)); \
+        return pClass;                                                                  \
+    }
+#define _CA_PRIVATE_DEF_PRO(symbol)                                                        \
+    inline void* s_k##symbol()                                                             \
+    {                                                                                      \
+        static void* const pProtocol = _CA_PRIVATE_LAZY_BRIDGE(objc_getProtocol(#symbol)); \
+        return pProtocol;                                                                  \
+    }
+#define _CA_PRIVATE_DEF_SEL(accessor, symbol)                 \
+    inline SEL s_k##accessor()                                \
+    {                                                         \
+        static const SEL selector = sel_registerName(symbol); \
+        return selector;                                      \
+    }
+
+#endif // METALCPP_LAZY_REGISTRATION
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 namespace CA
 {
 namespace Private
@@ -62,6 +62,41 @@
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+#if defined(METALCPP_LAZY_REGISTRATION)
+
+// Resolved on first use, see Foundation/NSPrivate.hpp.
+
+#undef _APPKIT_PRIVATE_CLS
+#undef _APPKIT_PRIVATE_SEL
+#undef _APPKIT_PRIVATE_DEF_CLS
+#undef _APPKIT_PRIVATE_DEF_SEL
+
+#define _APPKIT_PRIVATE_CLS(symbol) (Private::Class::s_k##symbol())
+#define _APPKIT_PRIVATE_SEL(accessor) (Private::Selector::s_k##accessor())
+
+#ifdef __OBJC__
+#define _APPKIT_PRIVATE_LAZY_BRIDGE(value) ((__bridge void*)(value))
+#else
+#define _APPKIT_PRIVATE_LAZY_BRIDGE(value) ((void*)(value))
+#endif // __OBJC__
+
+#define _APPKIT_PRIVATE_DEF_CLS(symbol)                                                     \
+    inline void* s_k##symbol()                                                              \
+    {                                                                                       \
+        static void* const pClass = _APPKIT_PRIVATE_LAZY_BRIDGE(objc_lookUpClass(#symbol)); \
+        return pClass;                                                                      \
+    }
+#define _APPKIT_PRIVATE_DEF_SEL(accessor, symbol)             \
+    inline SEL s_k##accessor()                                \
+    {                                                         \
+        static const SEL selector = sel_registerName(symbol); \
+        return selector;                                      \
+    }
+
+#endif // METALCPP_LAZY_REGISTRATION
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 namespace NS::Private::Class {
 
 _APPKIT_PRIVATE_DEF_CLS( NSApplication );
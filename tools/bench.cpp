@@ -0,0 +1,2582 @@
+//
+//  bench.cpp
+//  MetalBones
+//
+//  Micro-benchmarks for the platform-independent parts of the engine.
+//  Builds anywhere, no Metal required:
+//
+//    SOURCES="MetalBones/Animation.cpp MetalBones/MotionMatching.cpp MetalBones/JobSystem.cpp"
+//    SOURCES="$SOURCES MetalBones/SpringBones.cpp MetalBones/PaletteDeltas.cpp MetalBones/TlsfAllocator.cpp"
+//    SOURCES="$SOURCES MetalBones/UploadRing.cpp MetalBones/DeferredRelease.cpp MetalBones/FrameArena.cpp"
+//    SOURCES="$SOURCES MetalBones/ResidencyTracker.cpp MetalBones/TransientAliasing.cpp MetalBones/PipelineCache.cpp"
+//    SOURCES="$SOURCES MetalBones/PipelineArchive.cpp MetalBones/DescriptorTable.cpp MetalBones/GpuCulling.cpp"
+//    SOURCES="$SOURCES MetalBones/FrustumCulling.cpp MetalBones/Bvh.cpp MetalBones/OcclusionCulling.cpp"
+//    SOURCES="$SOURCES MetalBones/LightClusters.cpp MetalBones/MorphTargets.cpp MetalBones/AnimationLOD.cpp"
+//    SOURCES="$SOURCES MetalBones/PoseCache.cpp MetalBones/SkinnedCrowd.cpp"
+//    c++ -std=c++20 -O2 -pthread -IMetalBones tools/bench.cpp $SOURCES -o bench
+//    ./bench [name ...]
+//
+//  Exits with 1 when any check in the selected benchmarks fails, and with 2
+//  on a benchmark name it doesn't know.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Bvh.hpp"
+#include "DeferredRelease.hpp"
+#include "DescriptorTable.hpp"
+#include "FrameArena.hpp"
+#include "FrustumCulling.hpp"
+#include "GpuCulling.hpp"
+#include "HandlePool.hpp"
+#include "JobSystem.hpp"
+#include "LightClusters.hpp"
+#include "MorphTargets.hpp"
+#include "MotionMatching.hpp"
+#include "OcclusionCulling.hpp"
+#include "PaletteDeltas.hpp"
+#include "PipelineArchive.hpp"
+#include "PipelineCache.hpp"
+#include "ResidencyTracker.hpp"
+#include "SkinnedCrowd.hpp"
+#include "SpringBones.hpp"
+#include "TlsfAllocator.hpp"
+#include "TransientAliasing.hpp"
+#include "UploadRing.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Features with a low intrinsic dimension, like real locomotion data: a few
+// latent parameters random-walking through time, mapped into feature space.
+static std::vector<float> makeMotionFeatures(uint32_t frames, uint32_t dims, std::mt19937& rng) {
+    const uint32_t latent = 6;
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    std::vector<float> basis(latent * dims);
+    for (float& b : basis) {
+        b = normal(rng);
+    }
+
+    std::vector<float> state(latent, 0.0f);
+    std::vector<float> features(size_t(frames) * dims);
+    for (uint32_t f = 0; f < frames; ++f) {
+        for (float& s : state) {
+            s = s * 0.995f + normal(rng) * 0.1f;
+        }
+        for (uint32_t d = 0; d < dims; ++d) {
+            float v = normal(rng) * 0.02f;
+            for (uint32_t l = 0; l < latent; ++l) {
+                v += basis[l * dims + d] * state[l];
+            }
+            features[size_t(f) * dims + d] = v;
+        }
+    }
+    return features;
+}
+
+static uint32_t benchMotionMatching() {
+    const uint32_t dims = 27;
+    const uint32_t sizes[] = {10000, 100000, 1000000};
+    const uint32_t queries = 200;
+
+    std::mt19937 rng(7);
+    std::vector<float> weights(dims, 1.0f);
+    uint32_t errors = 0;
+
+    printf("motion-matching (%u dimensions)\n", dims);
+    for (uint32_t size : sizes) {
+        std::vector<float> features = makeMotionFeatures(size, dims, rng);
+        std::vector<MotionFrame> frames(size);
+        for (uint32_t f = 0; f < size; ++f) {
+            frames[f] = {0, f};
+        }
+
+        MotionDatabase database(features.data(), size, dims, weights.data(), frames);
+
+        std::normal_distribution<float> noise(0.0f, 0.05f);
+        std::uniform_int_distribution<uint32_t> pick(0, size - 1);
+        std::vector<float> query(size_t(queries) * dims);
+        for (uint32_t q = 0; q < queries; ++q) {
+            const float* row = &features[size_t(pick(rng)) * dims];
+            for (uint32_t d = 0; d < dims; ++d) {
+                query[size_t(q) * dims + d] = row[d] + noise(rng);
+            }
+            database.normalize(&query[size_t(q) * dims], &query[size_t(q) * dims]);
+        }
+
+        auto buildStart = Clock::now();
+        MotionMatcher matcher(database, MotionSearchBackend::KDTree);
+        double buildSeconds = secondsSince(buildStart);
+
+        std::vector<MotionMatch> results[2];
+        const char* names[2] = {"brute force", "kd-tree"};
+        const MotionSearchBackend backends[2] = {MotionSearchBackend::BruteForce, MotionSearchBackend::KDTree};
+
+        for (int b = 0; b < 2; ++b) {
+            matcher.setBackend(backends[b]);
+            auto start = Clock::now();
+            for (uint32_t q = 0; q < queries; ++q) {
+                results[b].push_back(matcher.searchNormalized(&query[size_t(q) * dims]));
+            }
+            double seconds = secondsSince(start);
+            printf("  %8u frames  %-11s %10.0f queries/s\n", size, names[b], queries / seconds);
+        }
+
+        uint32_t mismatches = 0;
+        for (uint32_t q = 0; q < queries; ++q) {
+            if (std::fabs(results[0][q].cost - results[1][q].cost) > 1e-4f * (1.0f + results[0][q].cost)) {
+                mismatches++;
+            }
+        }
+        printf("  %8u frames  kd-tree build %.1f ms, %u cost mismatches\n", size, buildSeconds * 1e3, mismatches);
+        errors += mismatches;
+    }
+    return errors;
+}
+
+// One chain stepped with plain floats, the same operations in the same order
+// as SpringBoneSystem::step() does for one lane.
+struct ScalarSpringChain {
+    std::vector<Float3> position, previous, animated;
+    std::vector<float> restLength;
+    SpringBoneSettings settings;
+    std::vector<const SpringCollider*> colliders;
+};
+
+static void stepScalarSpringChain(ScalarSpringChain& chain, float timeStep) {
+    const float dt2 = timeStep * timeStep;
+    const Float3 gravity = {chain.settings.gravity.x * dt2, chain.settings.gravity.y * dt2, chain.settings.gravity.z * dt2};
+    const float keep = 1.0f - chain.settings.damping;
+
+    chain.position[0] = chain.previous[0] = chain.animated[0];
+    for (size_t p = 1; p < chain.position.size(); ++p) {
+        Float3 position = chain.position[p];
+        Float3 velocity = (position - chain.previous[p]) * keep;
+        chain.previous[p] = position;
+        position = position + velocity + gravity;
+        position = position + (chain.animated[p] - position) * chain.settings.stiffness;
+
+        Float3 parent = chain.position[p - 1];
+        Float3 d = position - parent;
+        position = parent + d * (chain.restLength[p] / std::max(std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z), 1e-6f));
+
+        for (const SpringCollider* collider : chain.colliders) {
+            const SpringCollider& c = *collider;
+            Float3 ab = c.b - c.a, ap = position - c.a;
+            float t = (ap.x * ab.x + ap.y * ab.y + ap.z * ab.z) / std::max(ab.x * ab.x + ab.y * ab.y + ab.z * ab.z, 1e-6f);
+            t = std::min(std::max(t, 0.0f), 1.0f);
+            Float3 o = ap - ab * t;
+            float distance = std::max(std::sqrt(o.x * o.x + o.y * o.y + o.z * o.z), 1e-6f);
+            position = position + o * (std::max(c.radius + chain.settings.radius - distance, 0.0f) / distance);
+        }
+        chain.position[p] = position;
+    }
+}
+
+// A fixed scenario: chains of mixed lengths and settings in two batches, one of
+// them part empty, swaying through a moving sphere and two capsules at an
+// uneven frame rate. Every chain is compared with the scalar reference, and
+// the final tips with values recorded from this scenario.
+static uint32_t checkSpringBoneReference() {
+    const uint32_t chainCount = 7;
+    const uint32_t frames = 240;
+    // Same build and inputs give the same bits; the slack covers other
+    // compilers, libm sin() and fused multiply-adds.
+    const float tolerance = 1e-4f;
+    const Float3 expectedTips[chainCount] = {
+        {-0.379408f, -0.214003f, 0.011714f},
+        {-0.005344f, -0.177799f, -0.159297f},
+        {0.054102f, -0.259516f, -0.146219f},
+        {0.366982f, -0.142160f, 0.017704f},
+        {0.132353f, -0.444452f, -0.112643f},
+        {-0.354451f, -0.160470f, -0.152430f},
+        {-0.171427f, -0.148588f, -0.029872f},
+    };
+
+    // Raw mt19937 output is the same everywhere, unlike the distributions.
+    std::mt19937 rng(31);
+    auto random = [&rng](float low, float high) { return low + (high - low) * float(rng() >> 8) / 16777216.0f; };
+
+    SpringBoneSystem system;
+    SpringCollider colliders[3] = {
+        {{0.0f, -0.25f, 0.05f}, {0.0f, -0.25f, 0.05f}, 0.08f},
+        {{-0.3f, -0.4f, 0.0f}, {0.3f, -0.4f, 0.1f}, 0.05f},
+        {{0.1f, -0.1f, -0.2f}, {0.1f, -0.6f, 0.2f}, 0.04f},
+    };
+    for (const SpringCollider& collider : colliders) {
+        system.addCollider(collider);
+    }
+
+    std::vector<ScalarSpringChain> references(chainCount);
+    for (uint32_t c = 0; c < chainCount; ++c) {
+        ScalarSpringChain& reference = references[c];
+        uint32_t count = 2 + rng() % 8;
+        Float3 root = {random(-0.2f, 0.2f), 0.0f, random(-0.1f, 0.1f)};
+        for (uint32_t p = 0; p < count; ++p) {
+            reference.position.push_back(root + Float3{random(-0.02f, 0.02f), -0.08f * float(p), random(-0.02f, 0.02f)});
+        }
+        reference.previous = reference.animated = reference.position;
+        reference.restLength.push_back(0.0f);
+        for (uint32_t p = 1; p < count; ++p) {
+            reference.restLength.push_back(length(reference.position[p] - reference.position[p - 1]));
+        }
+        reference.settings.stiffness = random(0.02f, 0.2f);
+        reference.settings.damping = random(0.05f, 0.3f);
+        reference.settings.radius = random(0.01f, 0.04f);
+
+        std::vector<uint32_t> ids;
+        for (uint32_t id = 0; id < 3; ++id) {
+            if (rng() % 2) {
+                ids.push_back(id);
+            }
+        }
+        system.addChain(reference.position.data(), count, reference.settings, ids.data(), uint32_t(ids.size()));
+        for (uint32_t id : ids) {
+            reference.colliders.push_back(&colliders[id]);
+        }
+    }
+
+    std::vector<std::vector<Float3>> rest(chainCount);
+    for (uint32_t c = 0; c < chainCount; ++c) {
+        rest[c] = references[c].position;
+    }
+    for (uint32_t f = 0; f < frames; ++f) {
+        colliders[0].a.x = colliders[0].b.x = std::sin(float(f) * 0.05f) * 0.15f;
+        system.setCollider(0, colliders[0]);
+        for (uint32_t c = 0; c < chainCount; ++c) {
+            ScalarSpringChain& reference = references[c];
+            Float3 sway = {std::sin(float(f) * 0.13f + float(c)) * 0.25f, 0.0f, std::cos(float(f) * 0.07f) * 0.1f};
+            for (size_t p = 0; p < rest[c].size(); ++p) {
+                reference.animated[p] = rest[c][p] + sway;
+            }
+            system.setAnimatedPositions(c, reference.animated.data());
+        }
+        system.simulate(f % 3 == 0 ? 1.0f / 40.0f : 1.0f / 60.0f);
+        for (uint32_t s = 0; s < system.stats().steps; ++s) {
+            for (ScalarSpringChain& reference : references) {
+                stepScalarSpringChain(reference, 1.0f / 60.0f);
+            }
+        }
+    }
+
+    float scalarDifference = 0.0f, tipDifference = 0.0f;
+    std::vector<Float3> simulated(10);
+    for (uint32_t c = 0; c < chainCount; ++c) {
+        system.simulatedPositions(c, simulated.data());
+        for (uint32_t p = 0; p < system.chainLength(c); ++p) {
+            scalarDifference = std::max(scalarDifference, length(simulated[p] - references[c].position[p]));
+        }
+        Float3 tip = simulated[system.chainLength(c) - 1];
+        tipDifference = std::max(tipDifference, length(tip - expectedTips[c]));
+    }
+    uint32_t errors = (scalarDifference > tolerance) + (tipDifference > tolerance);
+    printf("  reference  scalar difference %g  recorded tips difference %g  (tolerance %g)  %u errors\n",
+           scalarDifference, tipDifference, tolerance, errors);
+    return errors;
+}
+
+static uint32_t benchSpringBones() {
+    const uint32_t chainCounts[] = {1000, 10000};
+    const uint32_t frames = 120;
+
+    JobSystem jobs;
+    printf("spring-bones (%u threads)\n", jobs.threadCount());
+    uint32_t errors = 0;
+
+    for (uint32_t chainCount : chainCounts) {
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<uint32_t> lengths(3, 8);
+
+        SpringBoneSystem systems[2];
+        std::vector<std::vector<Float3>> rest(chainCount);
+        for (SpringBoneSystem& system : systems) {
+            uint32_t collider = system.addCollider({{0.0f, -0.3f, 0.1f}, {0.0f, -0.6f, 0.1f}, 0.1f});
+            for (uint32_t c = 0; c < chainCount; ++c) {
+                if (rest[c].empty()) {
+                    rest[c].resize(lengths(rng));
+                    for (uint32_t p = 0; p < rest[c].size(); ++p) {
+                        rest[c][p] = {float(c % 100) * 0.1f, -0.1f * float(p), 0.0f};
+                    }
+                }
+                system.addChain(rest[c].data(), uint32_t(rest[c].size()), {}, &collider, 1);
+            }
+        }
+
+        const char* names[2] = {"1 thread", "jobs"};
+        std::vector<Float3> animated;
+        for (int s = 0; s < 2; ++s) {
+            double seconds = 0.0;
+            uint64_t solved = 0;
+            for (uint32_t f = 0; f < frames; ++f) {
+                float sway = std::sin(float(f) * 0.1f) * 0.2f;
+                for (uint32_t c = 0; c < chainCount; ++c) {
+                    animated = rest[c];
+                    for (Float3& p : animated) {
+                        p.x += sway;
+                    }
+                    systems[s].setAnimatedPositions(c, animated.data());
+                }
+                systems[s].simulate(1.0f / 60.0f, s == 1 ? &jobs : nullptr);
+                seconds += systems[s].stats().seconds;
+                solved += uint64_t(systems[s].stats().chains) * systems[s].stats().steps;
+            }
+            printf("  %6u chains  %-8s %10.0f chains/ms\n", chainCount, names[s], solved / (seconds * 1e3));
+        }
+
+        std::vector<Float3> a(8), b(8);
+        float difference = 0.0f;
+        for (uint32_t c = 0; c < chainCount; ++c) {
+            systems[0].simulatedPositions(c, a.data());
+            systems[1].simulatedPositions(c, b.data());
+            for (uint32_t p = 0; p < systems[0].chainLength(c); ++p) {
+                difference = std::max(difference, length(a[p] - b[p]));
+            }
+        }
+        printf("  %6u chains  max difference between runs %g\n", chainCount, difference);
+        // Batches don't depend on the thread count, so neither do the bits.
+        errors += difference != 0.0f;
+    }
+    return errors + checkSpringBoneReference();
+}
+
+// What paletteScatter in palette_stream.metal does with an encoder's updates.
+static void scatterPaletteRows(const uint32_t* joints, const PaletteRows* rows, uint32_t count, Float4x4* palette) {
+    for (uint32_t i = 0; i < count; ++i) {
+        const float* r = rows[i].rows;
+        palette[joints[i]] = {{
+            r[0], r[4], r[8],  0.0f,
+            r[1], r[5], r[9],  0.0f,
+            r[2], r[6], r[10], 0.0f,
+            r[3], r[7], r[11], 1.0f,
+        }};
+    }
+}
+
+// Characters whose joints are only partly animated, like idle crowds where
+// fingers, face and props rarely move. The updates are scattered into a CPU
+// copy of the GPU palette buffer every frame, which must then hold every
+// character's palette bit for bit; every joint here that moves, moves by
+// more than the encoder's epsilon.
+static uint32_t benchPaletteDeltas() {
+    const uint32_t characterCount = 1000;
+    const uint32_t jointsPerCharacter = 80;
+    const float movingFractions[] = {0.0f, 0.1f, 0.3f, 1.0f};
+    const uint32_t frames = 60;
+
+    printf("palette-deltas (%u characters x %u joints)\n", characterCount, jointsPerCharacter);
+    uint32_t errors = 0;
+    for (float moving : movingFractions) {
+        PaletteDeltaEncoder encoder;
+        for (uint32_t c = 0; c < characterCount; ++c) {
+            encoder.addCharacter(jointsPerCharacter);
+        }
+
+        std::vector<Float4x4> palette(jointsPerCharacter, identity4x4());
+        const uint32_t movingJoints = uint32_t(moving * jointsPerCharacter);
+        std::vector<Float4x4> gpu(encoder.totalJoints()), expected(encoder.totalJoints());
+        uint32_t mismatches = 0;
+
+        double seconds = 0.0;
+        size_t bytes = 0, fullBytes = 0;
+        uint64_t dirty = 0;
+        for (uint32_t f = 0; f < frames + 1; ++f) {
+            encoder.beginFrame();
+            for (uint32_t c = 0; c < characterCount; ++c) {
+                for (uint32_t j = 0; j < movingJoints; ++j) {
+                    palette[j].m[12] = std::sin(float(f + c) * 0.1f + float(j));
+                }
+                encoder.update(c, palette.data());
+                std::copy(palette.begin(), palette.end(), expected.begin() + encoder.firstJoint(c));
+            }
+            scatterPaletteRows(encoder.updateJoints(), encoder.updateRows(), encoder.updateCount(), gpu.data());
+            for (uint32_t j = 0; j < encoder.totalJoints(); ++j) {
+                mismatches += memcmp(&gpu[j], &expected[j], sizeof(Float4x4)) != 0;
+            }
+            // Frame 0 uploads everything once and isn't representative.
+            if (f > 0) {
+                const PaletteStreamStats& stats = encoder.stats();
+                seconds += stats.seconds;
+                bytes += stats.bytesUploaded;
+                fullBytes += stats.fullUploadBytes;
+                dirty += stats.dirtyJoints;
+            }
+        }
+
+        printf("  %3.0f%% moving  %6.2f ns/joint  %8.1f KB/frame (full %8.1f KB)  %6.0f dirty joints/frame  %u mismatched joints\n",
+               moving * 100.0f, seconds * 1e9 / (double(frames) * characterCount * jointsPerCharacter),
+               bytes / 1024.0 / frames, fullBytes / 1024.0 / frames, double(dirty) / frames, mismatches);
+        errors += mismatches;
+    }
+    return errors;
+}
+
+// A chain of joints swaying on a sine, `speed` times per clip length.
+static Skeleton makeChainSkeleton(uint32_t jointCount, float boneLength) {
+    Skeleton skeleton;
+    for (uint32_t j = 0; j < jointCount; ++j) {
+        Float4x4 inverseBind = identity4x4();
+        inverseBind.m[13] = -boneLength * float(j);
+        skeleton.parents.push_back(int16_t(j) - 1);
+        skeleton.bindPose.push_back({{0, 0, 0, 1}, {0, j == 0 ? 0.0f : boneLength, 0}, {1, 1, 1}});
+        skeleton.inverseBindMatrices.push_back(inverseBind);
+    }
+    return skeleton;
+}
+
+static AnimationClip makeSwayClip(const Skeleton& skeleton, uint32_t frames, float speed) {
+    AnimationClip clip(skeleton.jointCount(), frames, 30.0f);
+    for (uint32_t f = 0; f < frames; ++f) {
+        float phase = 6.2831853f * speed * float(f) / float(frames);
+        for (uint32_t j = 0; j < skeleton.jointCount(); ++j) {
+            float angle = 0.2f * std::sin(phase + 0.3f * float(j));
+            JointTransform& t = clip.frame(f)[j];
+            t = skeleton.bindPose[j];
+            t.rotation = {0.0f, 0.0f, std::sin(angle * 0.5f), std::cos(angle * 0.5f)};
+        }
+    }
+    return clip;
+}
+
+// Known distances and screen sizes against the default thresholds of 0.15,
+// 0.06 and 0.015 with 15% hysteresis, then the update cadence of every tier:
+// with interpolation off a palette only changes on the frames its instance
+// samples, which must be every 1st, 2nd and 4th frame, staggered so each
+// frame samples the same share of a tier, and once for frozen instances.
+static uint32_t benchAnimationLod() {
+    const float fovY = 1.0f;
+    const uint32_t perTier = 8;
+    const uint32_t frames = 16;
+
+    Skeleton skeleton = makeChainSkeleton(40, 0.05f);
+    AnimationClip clip = makeSwayClip(skeleton, 60, 1.0f);
+    printf("animation-lod\n");
+    uint32_t errors = 0;
+
+    // Radius 1 at distance d covers 1 / (d tan(fovY / 2)) = 1.83 / d of the view.
+    const struct {
+        float distance;
+        AnimationLODTier tier;
+        uint32_t joints;
+    } distances[] = {
+        {5.0f, AnimationLODTier::EveryFrame, 40},
+        {14.0f, AnimationLODTier::EveryFrame, 40},        // 0.131, within hysteresis of 0.15
+        {16.0f, AnimationLODTier::EverySecondFrame, 40},
+        {40.0f, AnimationLODTier::EveryFourthFrame, 20},
+        {140.0f, AnimationLODTier::EveryFourthFrame, 20}, // 0.0131, within hysteresis of 0.015
+        {150.0f, AnimationLODTier::Frozen, 10},
+    };
+    for (const auto& expected : distances) {
+        AnimationLODManager manager;
+        AnimationLODManager::InstanceId id = manager.addInstance(&skeleton, &clip);
+        manager.setScreenSize(id, AnimationLODManager::projectedSize(1.0f, expected.distance, fovY));
+        manager.update(1.0f / 60.0f);
+        bool good = manager.tier(id) == expected.tier && manager.activeJointCount(id) == expected.joints;
+        errors += !good;
+        printf("  %5.0f m  %.4f of the view  tier %d, %u joints%s\n", expected.distance,
+               AnimationLODManager::projectedSize(1.0f, expected.distance, fovY), int(manager.tier(id)),
+               manager.activeJointCount(id), good ? "" : "  WRONG");
+    }
+
+    // Going back up needs 15% more than the threshold, going down 15% less.
+    const struct {
+        float from;
+        float to;
+        AnimationLODTier tier;
+    } moves[] = {
+        {0.10f, 0.16f, AnimationLODTier::EverySecondFrame},
+        {0.10f, 0.18f, AnimationLODTier::EveryFrame},
+        {0.20f, 0.13f, AnimationLODTier::EveryFrame},
+        {0.20f, 0.12f, AnimationLODTier::EverySecondFrame},
+        {0.001f, 0.5f, AnimationLODTier::EveryFrame},
+    };
+    for (const auto& move : moves) {
+        AnimationLODManager manager;
+        AnimationLODManager::InstanceId id = manager.addInstance(&skeleton, &clip);
+        manager.setScreenSize(id, move.from);
+        manager.update(1.0f / 60.0f);
+        manager.setScreenSize(id, move.to);
+        manager.update(1.0f / 60.0f);
+        errors += manager.tier(id) != move.tier;
+    }
+
+    AnimationLODSettings settings;
+    settings.interpolatePalettes = false;
+    AnimationLODManager manager(settings);
+    const float sizes[4] = {0.5f, 0.1f, 0.03f, 0.001f};
+    const uint32_t periods[4] = {1, 2, 4, 0};
+    std::vector<AnimationLODManager::InstanceId> ids;
+    for (uint32_t i = 0; i < 4 * perTier; ++i) {
+        ids.push_back(manager.addInstance(&skeleton, &clip, float(i) * 0.1f));
+        manager.setScreenSize(ids.back(), sizes[i / perTier]);
+    }
+
+    // Frames on which each palette changed after the first update sampled them all.
+    std::vector<std::vector<Float4x4>> last(ids.size());
+    std::vector<std::vector<uint32_t>> changed(ids.size());
+    for (uint32_t f = 0; f < frames; ++f) {
+        manager.update(1.0f / 60.0f);
+        const AnimationLODStats& stats = manager.stats();
+        for (uint32_t t = 0; t < 4; ++t) {
+            uint32_t expected = f == 0 ? perTier : periods[t] ? perTier / periods[t] : 0;
+            errors += stats.instances[t] != perTier || stats.sampled[t] != expected;
+        }
+        errors += stats.interpolated != 0;
+
+        for (uint32_t i = 0; i < ids.size(); ++i) {
+            const Float4x4* palette = manager.palette(ids[i]);
+            if (f > 0 && memcmp(last[i].data(), palette, last[i].size() * sizeof(Float4x4)) != 0) {
+                changed[i].push_back(f);
+            }
+            last[i].assign(palette, palette + skeleton.jointCount());
+        }
+    }
+    for (uint32_t i = 0; i < ids.size(); ++i) {
+        const uint32_t period = periods[i / perTier];
+        const std::vector<uint32_t>& turns = changed[i];
+        if (period == 0) {
+            errors += !turns.empty();
+            continue;
+        }
+        // Its first turn comes within a period, then exactly every period.
+        errors += turns.empty() || turns.front() > period || turns.back() + period < frames;
+        for (size_t k = 1; k < turns.size(); ++k) {
+            errors += turns[k] - turns[k - 1] != period;
+        }
+    }
+    printf("  cadence over %u frames, %u instances per tier: palettes changed", frames, perTier);
+    for (uint32_t t = 0; t < 4; ++t) {
+        printf(" %zu", changed[t * perTier].size());
+    }
+    printf(" times after the first update\n");
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// A crowd on a grid in front of a camera walking into it, playing two clips
+// at a handful of start times, so many characters share poses. Palette
+// updates are scattered into a CPU copy of the GPU buffer, and every
+// character must skin from a region holding its own palette within the
+// encoder's epsilon. Poses from the cache must match sampling the clip at
+// the quantized time.
+static uint32_t benchSkinnedCrowd() {
+    const uint32_t rows = 40, columns = 50;
+    const uint32_t frames = 240;
+    const float fovY = 1.0f;
+    const float epsilon = 1e-5f;
+
+    Skeleton skeleton = makeChainSkeleton(40, 0.05f);
+    AnimationClip clips[2] = {makeSwayClip(skeleton, 60, 1.0f), makeSwayClip(skeleton, 90, 2.0f)};
+    printf("skinned-crowd (%u characters x %u joints)\n", rows * columns, skeleton.jointCount());
+
+    uint32_t errors = 0;
+    for (bool interpolate : {true, false}) {
+        AnimationLODSettings settings;
+        settings.interpolatePalettes = interpolate;
+        PaletteDeltaEncoder encoder(epsilon);
+        SkinnedCrowd crowd(encoder, 4 << 20, settings);
+        for (uint32_t c = 0; c < rows * columns; ++c) {
+            uint32_t character = crowd.addCharacter(&skeleton, &clips[c % 2], float(c / 2 % 6) * 0.25f, 1.0f);
+            crowd.setPosition(character, {(float(c % columns) - columns * 0.5f) * 1.5f, 0.0f, -2.0f - float(c / columns) * 2.5f});
+        }
+
+        std::vector<Float4x4> gpu(encoder.totalJoints());
+        std::vector<JointTransform> pose(skeleton.jointCount());
+        std::vector<Float4x4> expected(skeleton.jointCount());
+        uint64_t sent = 0, shared = 0, tiers[4] = {};
+        size_t bytes = 0, fullBytes = 0;
+        double seconds = 0.0;
+        for (uint32_t f = 0; f < frames; ++f) {
+            encoder.beginFrame();
+            crowd.update(1.0f / 60.0f, {0.0f, 1.0f, -float(f) * 0.1f}, fovY);
+            scatterPaletteRows(encoder.updateJoints(), encoder.updateRows(), encoder.updateCount(), gpu.data());
+
+            const SkinnedCrowdStats& stats = crowd.stats();
+            seconds += stats.seconds;
+            sent += stats.palettesSent;
+            shared += stats.palettesShared;
+            bytes += encoder.stats().bytesUploaded;
+            fullBytes += crowd.characterCount() * skeleton.jointCount() * sizeof(Float4x4);
+            for (uint32_t t = 0; t < 4; ++t) {
+                tiers[t] += crowd.lod().stats().instances[t];
+            }
+
+            for (uint32_t c = 0; c < crowd.characterCount(); ++c) {
+                const Float4x4* palette = crowd.lod().palette(crowd.instance(c));
+                const Float4x4* skinned = &gpu[encoder.firstJoint(crowd.paletteCharacter(c))];
+                for (uint32_t j = 0; j < skeleton.jointCount(); ++j) {
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        errors += !(std::fabs(skinned[j].m[i] - palette[j].m[i]) <= epsilon);
+                    }
+                }
+
+                const PoseKey* key = crowd.lod().cachedPose(crowd.instance(c));
+                if (key && c % 7 == 0) {
+                    pose = skeleton.bindPose;
+                    key->clip->sample(crowd.poseCache().dequantize(key->quantizedTime), pose.data(),
+                                      crowd.lod().activeJointCount(crowd.instance(c)));
+                    buildMatrixPalette(skeleton, pose.data(), expected.data());
+                    errors += memcmp(expected.data(), palette, expected.size() * sizeof(Float4x4)) != 0;
+                }
+            }
+        }
+
+        const PoseCacheStats& cacheStats = crowd.poseCache().stats();
+        printf("  %s\n", interpolate ? "interpolated palettes" : "palettes held between updates");
+        printf("    tiers per frame: %.0f every frame, %.0f every 2nd, %.0f every 4th, %.0f frozen\n", double(tiers[0]) / frames,
+               double(tiers[1]) / frames, double(tiers[2]) / frames, double(tiers[3]) / frames);
+        printf("    pose cache %.1f%% hits, %.3f ms sampling saved per frame, %zu entries in %.1f KB\n", 100.0 * cacheStats.hitRate(),
+               cacheStats.savedSeconds * 1e3 / frames, crowd.poseCache().entries(), crowd.poseCache().bytes() / 1024.0);
+        printf("    %.0f palettes sent, %.0f shared per frame, %.1f KB uploaded per frame (full %.1f KB), %.3f ms per frame\n",
+               double(sent) / frames, double(shared) / frames, bytes / 1024.0 / frames, fullBytes / 1024.0 / frames,
+               seconds * 1e3 / frames);
+    }
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// A face-like patch with localized blend shapes: each target moves a soft
+// region around its own center and leaves the rest untouched, like brows,
+// lids and lip corners. A few targets are active per frame. The SIMD apply()
+// is compared with a dense scalar accumulation of the float deltas, allowing
+// half a quantization step per component of every active target.
+static uint32_t benchMorphTargets() {
+    const uint32_t side = 128;
+    const uint32_t vertexCount = side * side;
+    const uint32_t targetCount = 64;
+    const uint32_t activePerFrame = 12;
+    const uint32_t frames = 200;
+    printf("morph-targets (%u vertices, %u targets, %u active)\n", vertexCount, targetCount, activePerFrame);
+
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> basePositions(vertexCount * 4), baseNormals(vertexCount * 4);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        float u = float(v % side) / (side - 1), w = float(v / side) / (side - 1);
+        float bulge = 0.2f * std::sin(u * 3.14159f) * std::sin(w * 3.14159f);
+        float* p = &basePositions[v * 4];
+        float* n = &baseNormals[v * 4];
+        p[0] = u - 0.5f, p[1] = w - 0.5f, p[2] = bulge, p[3] = 1.0f;
+        n[0] = 0.0f, n[1] = 0.0f, n[2] = 1.0f, n[3] = 0.0f;
+    }
+
+    std::vector<Float3> positionDeltas(size_t(vertexCount) * targetCount), normalDeltas(positionDeltas.size());
+    for (uint32_t t = 0; t < targetCount; ++t) {
+        float cx = unit(rng) - 0.5f, cy = unit(rng) - 0.5f, radius = 0.04f + unit(rng) * 0.12f;
+        Float3 push = {unit(rng) * 0.02f - 0.01f, unit(rng) * 0.02f - 0.01f, unit(rng) * 0.04f - 0.02f};
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            float dx = basePositions[v * 4] - cx, dy = basePositions[v * 4 + 1] - cy;
+            float falloff = 1.0f - (dx * dx + dy * dy) / (radius * radius);
+            if (falloff <= 0.0f) {
+                continue;
+            }
+            positionDeltas[size_t(t) * vertexCount + v] = push * (falloff * falloff);
+            normalDeltas[size_t(t) * vertexCount + v] = Float3{dx, dy, 0.0f} * (falloff * 0.5f);
+        }
+    }
+
+    MorphTargetSet set(positionDeltas.data(), normalDeltas.data(), vertexCount, targetCount);
+    MorphTargetMemory memory = set.memory();
+    printf("  dense %.2f MB  sparse %.2f MB (%.1f%%)  %zu of %u deltas kept\n", memory.denseBytes / 1048576.0,
+           memory.sparseBytes / 1048576.0, 100.0 * memory.sparseBytes / memory.denseBytes, memory.nonZeroDeltas,
+           vertexCount * targetCount);
+
+    std::vector<float> positions(vertexCount * 4), normals(vertexCount * 4);
+    std::vector<double> expected(vertexCount * 8);
+    std::vector<float> weights(targetCount);
+    double seconds = 0.0;
+    uint64_t activeTargets = 0, deltasApplied = 0;
+    uint32_t errors = 0;
+    for (uint32_t f = 0; f < frames; ++f) {
+        std::fill(weights.begin(), weights.end(), 0.0f);
+        for (uint32_t i = 0; i < activePerFrame; ++i) {
+            weights[rng() % targetCount] = unit(rng) * 2.0f - 0.5f;
+        }
+        MorphTargetStats stats = set.apply(weights.data(), 1e-4f, basePositions.data(), baseNormals.data(),
+                                           positions.data(), normals.data());
+        seconds += stats.seconds;
+        activeTargets += stats.activeTargets;
+        deltasApplied += stats.deltasApplied;
+
+        if (f % 20 != 0) {
+            continue;
+        }
+        double positionBound = 1e-6, normalBound = 1e-6;
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            for (uint32_t c = 0; c < 4; ++c) {
+                expected[v * 8 + c] = basePositions[v * 4 + c];
+                expected[v * 8 + 4 + c] = baseNormals[v * 4 + c];
+            }
+        }
+        for (uint32_t t = 0; t < targetCount; ++t) {
+            if (std::fabs(weights[t]) <= 1e-4f) {
+                continue;
+            }
+            // Half a step from rounding, plus deltas below the set's epsilon
+            // that were dropped altogether.
+            positionBound += std::fabs(weights[t]) * (0.5 * set.target(t).positionScale + 1e-5);
+            normalBound += std::fabs(weights[t]) * (0.5 * set.target(t).normalScale + 1e-5);
+            for (uint32_t v = 0; v < vertexCount; ++v) {
+                const Float3& p = positionDeltas[size_t(t) * vertexCount + v];
+                const Float3& n = normalDeltas[size_t(t) * vertexCount + v];
+                double* e = &expected[v * 8];
+                e[0] += double(weights[t]) * p.x, e[1] += double(weights[t]) * p.y, e[2] += double(weights[t]) * p.z;
+                e[4] += double(weights[t]) * n.x, e[5] += double(weights[t]) * n.y, e[6] += double(weights[t]) * n.z;
+            }
+        }
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            for (uint32_t c = 0; c < 4; ++c) {
+                errors += std::fabs(positions[v * 4 + c] - expected[v * 8 + c]) > positionBound
+                    || std::fabs(normals[v * 4 + c] - expected[v * 8 + 4 + c]) > normalBound;
+            }
+        }
+    }
+    printf("  apply %.1f us per frame  %.2f us per active target  %.1f ns per delta\n", seconds * 1e6 / frames,
+           seconds * 1e6 / activeTargets, seconds * 1e9 / deltasApplied);
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// Random allocate/free traffic with resource-like sizes. The fuzz pass checks
+// the allocator invariants and that no two live ranges overlap; the timed pass
+// runs the same kind of traffic without checks.
+static uint32_t benchTlsf() {
+    const uint64_t poolSize = 64 << 20;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<uint32_t> alignLog(8, 16);
+
+    auto randomSize = [&](uint32_t maxLog) {
+        uint64_t base = uint64_t(1) << std::uniform_int_distribution<uint32_t>(8, maxLog)(rng);
+        return base + rng() % base;
+    };
+
+    printf("tlsf\n");
+    uint32_t totalErrors = 0;
+    {
+        TlsfAllocator allocator(256);
+        allocator.addPool(poolSize);
+        std::vector<TlsfAllocation> live;
+        uint32_t failures = 0, errors = 0;
+
+        for (uint32_t i = 0; i < 200000; ++i) {
+            if (live.empty() || (live.size() < 2000 && rng() % 2)) {
+                uint64_t alignment = uint64_t(1) << alignLog(rng);
+                TlsfAllocation allocation = allocator.allocate(randomSize(22), alignment);
+                if (!allocation.valid()) {
+                    failures++;
+                    allocator.addPool(poolSize);
+                    continue;
+                }
+                errors += allocation.offset % alignment != 0;
+                live.push_back(allocation);
+            } else {
+                size_t index = rng() % live.size();
+                allocator.free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+
+            if (i % 1000 == 0) {
+                errors += !allocator.validate();
+
+                std::vector<TlsfAllocation> sorted = live;
+                std::sort(sorted.begin(), sorted.end(), [](const TlsfAllocation& a, const TlsfAllocation& b) {
+                    return a.pool != b.pool ? a.pool < b.pool : a.offset < b.offset;
+                });
+                for (size_t k = 1; k < sorted.size(); ++k) {
+                    errors += sorted[k].pool == sorted[k - 1].pool && sorted[k].offset < sorted[k - 1].offset + sorted[k - 1].size;
+                }
+            }
+        }
+
+        for (const TlsfAllocation& allocation : live) {
+            allocator.free(allocation);
+        }
+        errors += !allocator.validate();
+        TlsfStats stats = allocator.stats();
+        errors += stats.allocations != 0 || stats.freeBlocks != stats.pools;
+        printf("  fuzz: 200000 operations, %u failed allocations grew it to %u pools, %u errors\n", failures, stats.pools, errors);
+        totalErrors += errors;
+    }
+
+    {
+        // What GpuHeapAllocator does when nothing fits: a new pool of a block,
+        // or of poolSizeFor() when that is larger. The allocation that follows
+        // must succeed, including for requests beyond the block size with
+        // large alignments.
+        const uint64_t blockSize = 1 << 20;
+        TlsfAllocator allocator(256);
+        std::vector<TlsfAllocation> live;
+        uint32_t dedicated = 0, errors = 0;
+        auto place = [&](uint64_t size, uint64_t alignment) {
+            TlsfAllocation allocation = allocator.allocate(size, alignment);
+            if (!allocation.valid()) {
+                uint64_t pool = std::max(blockSize, allocator.poolSizeFor(size, alignment));
+                dedicated += pool > blockSize;
+                allocator.addPool(pool);
+                allocation = allocator.allocate(size, alignment);
+            }
+            errors += !allocation.valid() || allocation.offset % std::max<uint64_t>(alignment, 256) != 0
+                || allocation.size < size;
+            if (allocation.valid()) {
+                live.push_back(allocation);
+            }
+        };
+        // Sizes that came back invalid from a pool of exactly their size.
+        place(16640, 256);
+        place((96 << 20) + 4096, 256);
+        place(100 << 20, 64 << 10);
+        for (uint32_t i = 0; i < 20000; ++i) {
+            if (live.empty() || rng() % 3) {
+                place(randomSize(28), uint64_t(1) << std::uniform_int_distribution<uint32_t>(8, 22)(rng));
+            } else {
+                size_t index = rng() % live.size();
+                allocator.free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+        for (const TlsfAllocation& allocation : live) {
+            allocator.free(allocation);
+        }
+        errors += !allocator.validate();
+        printf("  oversized fuzz: 20000 operations, %u dedicated pools of %u, %u errors\n", dedicated, allocator.stats().pools, errors);
+        totalErrors += errors;
+    }
+
+    {
+        TlsfAllocator allocator(256);
+        allocator.addPool(poolSize);
+
+        const uint32_t operations = 2000000;
+        std::vector<uint64_t> sizes(operations);
+        for (uint64_t& size : sizes) {
+            size = randomSize(16);
+        }
+        std::vector<TlsfAllocation> live;
+        live.reserve(operations);
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < operations; ++i) {
+            if (live.size() < 4000 && (live.size() < 1000 || (sizes[i] & 1))) {
+                live.push_back(allocator.allocate(sizes[i], 256));
+            } else {
+                size_t index = sizes[i] % live.size();
+                allocator.free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+        }
+        double seconds = secondsSince(start);
+
+        TlsfStats stats = allocator.stats();
+        printf("  %.1f M operations/s, %u live, %.1f MB used of %.1f MB, %u free blocks, fragmentation %.3f\n",
+               operations / seconds * 1e-6, stats.allocations, stats.usedBytes / 1048576.0, stats.poolBytes / 1048576.0,
+               stats.freeBlocks, stats.fragmentation());
+    }
+    return totalErrors;
+}
+
+// Streams uploads through a staging ring while a fake GPU completes each
+// frame's fence a few frames later. Live ranges are checked for overlap and
+// data written to staging is checked to survive until its fence completes.
+static uint32_t benchUploadRing() {
+    const size_t capacity = 16 << 20;
+    const uint32_t frames = 20000;
+    const uint32_t latency = 2;
+
+    UploadRing ring(capacity);
+    std::vector<uint8_t> staging(capacity);
+    std::mt19937 rng(9);
+    std::uniform_int_distribution<uint32_t> uploadsPerFrame(0, 40);
+    std::uniform_int_distribution<uint32_t> sizeLog(4, 20);
+
+    struct Live {
+        uint64_t fence;
+        size_t offset;
+        size_t length;
+        uint8_t value;
+    };
+    std::vector<Live> live;
+
+    uint64_t completed = 0;
+    uint64_t bytes = 0;
+    uint32_t errors = 0;
+    double seconds = 0.0;
+
+    for (uint32_t frame = 1; frame <= frames; ++frame) {
+        // The GPU is `latency` frames behind.
+        if (frame > latency) {
+            completed = frame - latency;
+        }
+
+        auto start = Clock::now();
+        ring.retire(completed);
+        seconds += secondsSince(start);
+
+        for (size_t i = 0; i < live.size();) {
+            if (live[i].fence <= completed) {
+                const uint8_t* data = &staging[live[i].offset];
+                errors += data[0] != live[i].value || data[live[i].length - 1] != live[i].value;
+                live[i] = live.back();
+                live.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        uint32_t count = uploadsPerFrame(rng);
+        for (uint32_t u = 0; u < count; ++u) {
+            size_t length = size_t(1) << sizeLog(rng);
+            size_t offset;
+
+            start = Clock::now();
+            bool allocated = ring.allocate(length, 16, offset);
+            if (allocated) {
+                memset(&staging[offset], uint8_t(frame), length);
+            }
+            seconds += secondsSince(start);
+
+            if (!allocated) {
+                continue;
+            }
+            for (const Live& other : live) {
+                errors += offset < other.offset + other.length && other.offset < offset + length;
+            }
+            live.push_back({frame, offset, length, uint8_t(frame)});
+            bytes += length;
+        }
+        ring.submit(frame);
+    }
+
+    const UploadRingStats& stats = ring.stats();
+    printf("upload-ring (%zu MB ring, GPU %u frames behind)\n", capacity >> 20, latency);
+    printf("  %llu uploads, %llu full-ring failures, %.1f%% padding, %.2f GB/s staged, %u errors\n",
+           (unsigned long long)stats.allocations, (unsigned long long)stats.failures,
+           100.0 * double(stats.bytesWasted) / double(stats.bytesAllocated + stats.bytesWasted),
+           bytes / seconds * 1e-9, errors);
+    return errors;
+}
+
+// Stand-ins for a retain/release object and NS::SharedPtr, so the release
+// queue can be exercised without Metal. Destroying an object that a frame
+// still in flight used counts as a use-after-free.
+struct MockObject {
+    uint32_t references = 1;
+    uint64_t lastUsedFrame = 0;
+    const uint64_t* completedFrame;
+    uint32_t* useAfterFree;
+    bool destroyed = false;
+
+    void release() {
+        if (--references == 0) {
+            destroyed = true;
+            *useAfterFree += lastUsedFrame > *completedFrame;
+        }
+    }
+};
+
+template <typename Object>
+class MockSharedPtr {
+public:
+    explicit MockSharedPtr(Object* object) : object(object) {}
+    ~MockSharedPtr() {
+        if (object) {
+            object->release();
+        }
+    }
+
+    Object* detach() {
+        Object* result = object;
+        object = nullptr;
+        return result;
+    }
+
+private:
+    Object* object;
+};
+
+static uint32_t benchDeferredRelease() {
+    const uint32_t frames = 20000;
+    const uint32_t latency = 3;
+
+    std::mt19937 rng(13);
+    std::uniform_int_distribution<uint32_t> perFrame(0, 64);
+
+    DeferredReleaseQueue queue;
+    std::deque<MockObject> objects;
+    std::vector<MockObject*> live;
+    uint64_t completed = 0;
+    uint32_t useAfterFree = 0, leaked = 0;
+    double seconds = 0.0;
+
+    for (uint64_t frame = 1; frame <= frames; ++frame) {
+        completed = frame > latency ? frame - latency : 0;
+
+        auto start = Clock::now();
+        queue.collect(completed);
+        seconds += secondsSince(start);
+
+        uint32_t created = perFrame(rng);
+        for (uint32_t c = 0; c < created; ++c) {
+            objects.push_back({1, 0, &completed, &useAfterFree});
+            live.push_back(&objects.back());
+        }
+        for (MockObject* object : live) {
+            object->lastUsedFrame = frame;
+        }
+
+        uint32_t dropped = std::min<uint32_t>(perFrame(rng), uint32_t(live.size()));
+        start = Clock::now();
+        for (uint32_t d = 0; d < dropped; ++d) {
+            size_t index = rng() % live.size();
+            if (d % 2) {
+                queue.release(live[index], frame);
+            } else {
+                queue.release(MockSharedPtr<MockObject>(live[index]), frame);
+            }
+            live[index] = live.back();
+            live.pop_back();
+        }
+        seconds += secondsSince(start);
+    }
+
+    // Shutdown: the GPU drains, then everything goes.
+    completed = frames;
+    for (MockObject* object : live) {
+        queue.release(object, frames);
+    }
+    queue.flush();
+    for (const MockObject& object : objects) {
+        leaked += !object.destroyed;
+    }
+
+    const DeferredReleaseStats& stats = queue.stats();
+    printf("deferred-release (GPU %u frames behind)\n", latency);
+    printf("  %llu objects queued, peak %u pending, %.1f M releases/s, %u use-after-free, %u leaked\n",
+           (unsigned long long)stats.queued, stats.peakPending, stats.released / seconds * 1e-6, useAfterFree, leaked);
+    return useAfterFree + leaked;
+}
+
+static uint32_t benchHandlePool() {
+    const uint32_t count = 500000;
+    const uint32_t lookups = 4000000;
+
+    struct Bounds {
+        float center[3];
+        float radius;
+    };
+    HandlePool<struct BenchTag, Bounds, uint32_t, uint64_t> pool;
+    using BenchHandle = decltype(pool)::HandleType;
+
+    std::mt19937 rng(17);
+    std::vector<BenchHandle> handles(count);
+    uint32_t errors = 0;
+
+    printf("handle-pool (%u items, 3 columns)\n", count);
+
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < count; ++i) {
+        handles[i] = pool.create({{float(i), 0.0f, 0.0f}, 1.0f}, i, uint64_t(i) * 3);
+    }
+    double createSeconds = secondsSince(start);
+
+    std::vector<uint32_t> order(lookups);
+    for (uint32_t& o : order) {
+        o = rng() % count;
+    }
+    uint64_t sum = 0;
+    start = Clock::now();
+    for (uint32_t o : order) {
+        sum += *pool.get<1>(handles[o]);
+    }
+    double lookupSeconds = secondsSince(start);
+
+    start = Clock::now();
+    float radii = 0.0f;
+    for (int pass = 0; pass < 8; ++pass) {
+        for (const Bounds& bounds : pool.column<0>()) {
+            radii += bounds.radius;
+        }
+    }
+    double iterateSeconds = secondsSince(start);
+
+    // Destroy every other item, then recycle the slots.
+    start = Clock::now();
+    for (uint32_t i = 0; i < count; i += 2) {
+        errors += !pool.destroy(handles[i]);
+    }
+    double destroySeconds = secondsSince(start);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        bool alive = pool.get<1>(handles[i]) != nullptr;
+        errors += alive != (i % 2 == 1);
+        errors += alive && *pool.get<1>(handles[i]) != i;
+    }
+    std::vector<BenchHandle> recycled;
+    for (uint32_t i = 0; i < count; i += 2) {
+        recycled.push_back(pool.create({}, ~0u, 0));
+    }
+    for (uint32_t i = 0; i < count; i += 2) {
+        errors += pool.alive(handles[i]) || pool.destroy(handles[i]);
+    }
+    errors += pool.size() != count || pool.capacity() != count;
+
+    printf("  create %.1f M/s, lookup %.1f M/s, destroy %.1f M/s, dense iteration %.2f ns/item\n",
+           count / createSeconds * 1e-6, lookups / lookupSeconds * 1e-6, (count / 2) / destroySeconds * 1e-6,
+           iterateSeconds * 1e9 / (8.0 * count));
+    printf("  checksum %llu %.0f, %u errors\n", (unsigned long long)sum, radii, errors);
+    return errors;
+}
+
+// Jobs of uneven size pulled dynamically by the pool, each building a few
+// short-lived containers, the way per-frame culling and sorting will.
+template <typename MakeVector>
+static uint64_t runTransientJobs(JobSystem& jobs, uint32_t jobCount, MakeVector makeVector) {
+    std::atomic<uint64_t> checksum{0};
+    jobs.parallelFor(jobCount, 4, [&](uint32_t begin, uint32_t end) {
+        uint64_t local = 0;
+        for (uint32_t job = begin; job < end; ++job) {
+            uint32_t lists = 1 + (job * 2654435761u >> 27);
+            for (uint32_t l = 0; l < lists; ++l) {
+                auto items = makeVector();
+                uint32_t count = 4 + ((job + l) * 40503u & 63);
+                items.reserve(count);
+                for (uint32_t i = 0; i < count; ++i) {
+                    items.push_back(i ^ job);
+                }
+                local += items.size() + items[count / 2];
+            }
+        }
+        checksum += local;
+    });
+    return checksum;
+}
+
+static uint32_t benchFrameArena() {
+    const uint32_t frames = 200;
+    const uint32_t jobCount = 2000;
+
+    JobSystem jobs;
+    FrameArena arena(jobs.threadCount(), 256 << 10);
+
+    printf("frame-arena (%u threads, %u jobs per frame)\n", jobs.threadCount(), jobCount);
+
+    uint64_t checksums[2] = {};
+    double seconds[2] = {};
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        auto start = Clock::now();
+        checksums[0] += runTransientJobs(jobs, jobCount, [] { return std::vector<uint32_t>(); });
+        seconds[0] += secondsSince(start);
+
+        start = Clock::now();
+        checksums[1] += runTransientJobs(jobs, jobCount, [&] { return FrameVector<uint32_t>(FrameAllocator<uint32_t>(arena)); });
+        arena.reset();
+        seconds[1] += secondsSince(start);
+    }
+
+    FrameArenaStats stats = arena.stats();
+    printf("  malloc      %8.3f ms/frame\n", seconds[0] * 1e3 / frames);
+    printf("  frame arena %8.3f ms/frame, high water %.2f MB, %.2f MB reserved in %u blocks\n",
+           seconds[1] * 1e3 / frames, stats.highWaterMark / 1048576.0, stats.reservedBytes / 1048576.0, stats.blocks);
+    printf("  checksums %s\n", checksums[0] == checksums[1] ? "match" : "differ");
+    return checksums[0] != checksums[1];
+}
+
+// A camera moving through a streamed world: each frame touches assets around
+// a drifting position, more often the closer they are, under a simulated
+// device budget well below the total asset size.
+static uint32_t benchResidency() {
+    const uint32_t assetCount = 4000;
+    const uint32_t frames = 5000;
+    const uint32_t framesInFlight = 3;
+    const uint64_t budget = uint64_t(2) << 30;
+
+    std::mt19937 rng(21);
+    std::uniform_int_distribution<uint32_t> sizeMB(1, 16);
+    std::normal_distribution<float> around(0.0f, 60.0f);
+
+    ResidencyTracker tracker(budget, framesInFlight);
+    std::vector<ResidencyHandle> handles(assetCount);
+    std::vector<uint64_t> sizes(assetCount);
+    std::vector<uint64_t> lastUsed(assetCount, 0);
+    uint64_t totalBytes = 0;
+
+    // A few resources that must always stay, like render targets.
+    for (uint32_t i = 0; i < 8; ++i) {
+        tracker.track(nullptr, 32 << 20, ResourceCategory::RenderTarget, false);
+    }
+    for (uint64_t& size : sizes) {
+        size = uint64_t(sizeMB(rng)) << 20;
+        totalBytes += size;
+    }
+
+    std::vector<void*> evicted;
+    uint64_t uses = 0, loads = 0, restores = 0, peakResident = 0;
+    uint32_t violations = 0;
+    double seconds = 0.0;
+
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        float position = float(frame) * 0.5f;
+        auto start = Clock::now();
+        for (uint32_t u = 0; u < 300; ++u) {
+            int asset = int(position + around(rng)) % int(assetCount);
+            asset = asset < 0 ? asset + int(assetCount) : asset;
+            // Assets are streamed in the first time they're needed.
+            if (!handles[asset].valid()) {
+                ResourceCategory category = asset % 3 == 0 ? ResourceCategory::Mesh : ResourceCategory::Texture;
+                handles[asset] = tracker.track(reinterpret_cast<void*>(uintptr_t(asset + 1)), sizes[asset], category, true);
+                loads++;
+            } else {
+                restores += tracker.use(handles[asset]);
+            }
+            lastUsed[asset] = tracker.frame();
+            uses++;
+        }
+
+        evicted.clear();
+        uint64_t frameIndex = tracker.frame();
+        tracker.endFrame(evicted);
+        seconds += secondsSince(start);
+
+        for (void* object : evicted) {
+            uint32_t asset = uint32_t(reinterpret_cast<uintptr_t>(object) - 1);
+            violations += lastUsed[asset] + framesInFlight > frameIndex;
+        }
+        peakResident = std::max(peakResident, tracker.stats().totalResidentBytes());
+    }
+
+    const ResidencyStats& stats = tracker.stats();
+    printf("residency (%u assets, %.1f GB total, %.1f GB budget)\n", assetCount, totalBytes / double(1 << 30), budget / double(1 << 30));
+    printf("  %llu first loads, %.1f%% of uses needed a restore, %llu evictions (%.1f GB), peak resident %.2f GB, %.2f us/frame\n",
+           (unsigned long long)loads, 100.0 * double(restores) / double(uses), (unsigned long long)stats.evictions, stats.evictedBytes / double(1 << 30),
+           peakResident / double(1 << 30), seconds * 1e6 / frames);
+    printf("  resident now: meshes %.2f GB, textures %.2f GB, render targets %.2f GB, %u in-flight evictions\n",
+           stats.residentBytes[size_t(ResourceCategory::Mesh)] / double(1 << 30),
+           stats.residentBytes[size_t(ResourceCategory::Texture)] / double(1 << 30),
+           stats.residentBytes[size_t(ResourceCategory::RenderTarget)] / double(1 << 30), violations);
+    return violations;
+}
+
+// Counts placements where two simultaneously live resources share memory,
+// or where reused memory has no barrier from its previous occupant.
+static uint32_t checkPlacement(const std::vector<TransientResource>& resources, const TransientPlacement& placement) {
+    uint32_t errors = 0;
+    for (uint32_t a = 0; a < resources.size(); ++a) {
+        errors += placement.offsets[a] % resources[a].alignment != 0;
+        errors += placement.offsets[a] + resources[a].size > placement.heapSize;
+        for (uint32_t b = 0; b < resources.size(); ++b) {
+            bool memory = a != b && placement.offsets[a] < placement.offsets[b] + resources[b].size
+                       && placement.offsets[b] < placement.offsets[a] + resources[a].size;
+            bool lives = resources[a].firstPass <= resources[b].lastPass && resources[b].firstPass <= resources[a].lastPass;
+            errors += memory && lives;
+            if (memory && resources[b].lastPass < resources[a].firstPass) {
+                bool found = false;
+                for (const AliasingBarrier& barrier : placement.barriers) {
+                    found |= barrier.resource == a && barrier.previous == b;
+                }
+                errors += !found;
+            }
+        }
+    }
+    return errors;
+}
+
+static uint32_t benchTransientAliasing() {
+    auto target = [](uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t first, uint32_t last) {
+        const uint64_t alignment = 64 << 10;
+        uint64_t size = (uint64_t(width) * height * bytesPerPixel + alignment - 1) / alignment * alignment;
+        return TransientResource{size, alignment, first, last};
+    };
+
+    printf("transient-aliasing\n");
+    uint32_t errors = 0;
+    const uint32_t resolutions[][2] = {{1920, 1080}, {3840, 2160}};
+    for (const auto& resolution : resolutions) {
+        const uint32_t w = resolution[0], h = resolution[1];
+
+        // depth, g-buffer, SSAO, lighting into HDR, a 5 level bloom chain down
+        // and back up, then tonemapping.
+        std::vector<TransientResource> resources = {
+            target(w, h, 4, 0, 3),          // depth
+            target(w, h, 4, 1, 3),          // albedo
+            target(w, h, 8, 1, 3),          // normals
+            target(w, h, 4, 1, 3),          // material
+            target(w / 2, h / 2, 1, 2, 3),  // ssao
+            target(w, h, 8, 3, 14),         // hdr
+        };
+        for (uint32_t level = 1; level <= 5; ++level) {
+            resources.push_back(target(w >> level, h >> level, 8, 3 + level, 14 - level));
+        }
+        resources.push_back(target(w, h, 4, 14, 15));  // tonemapped
+
+        auto start = Clock::now();
+        TransientPlacement placement = placeTransientResources(resources.data(), uint32_t(resources.size()));
+        double seconds = secondsSince(start);
+        uint32_t placementErrors = checkPlacement(resources, placement);
+        errors += placementErrors;
+
+        // No placement can beat the busiest pass.
+        uint64_t lowerBound = 0;
+        for (uint32_t pass = 0; pass <= 15; ++pass) {
+            uint64_t live = 0;
+            for (const TransientResource& resource : resources) {
+                live += resource.firstPass <= pass && pass <= resource.lastPass ? resource.size : 0;
+            }
+            lowerBound = std::max(lowerBound, live);
+        }
+
+        printf("  %ux%u: %zu targets, %.1f MB aliased (bound %.1f) vs %.1f MB separate, %zu barriers, placed in %.1f us, %u errors\n",
+               w, h, resources.size(), placement.heapSize / 1048576.0, lowerBound / 1048576.0, placement.unaliasedSize / 1048576.0,
+               placement.barriers.size(), seconds * 1e6, placementErrors);
+    }
+
+    std::mt19937 rng(23);
+    double saved = 0.0;
+    const uint32_t graphs = 2000;
+    for (uint32_t g = 0; g < graphs; ++g) {
+        std::vector<TransientResource> resources(4 + rng() % 40);
+        for (TransientResource& resource : resources) {
+            resource.alignment = uint64_t(1) << (8 + rng() % 9);
+            resource.size = (1 + rng() % 64) * resource.alignment;
+            resource.firstPass = rng() % 30;
+            resource.lastPass = resource.firstPass + rng() % 8;
+        }
+        TransientPlacement placement = placeTransientResources(resources.data(), uint32_t(resources.size()));
+        errors += checkPlacement(resources, placement);
+        saved += 1.0 - double(placement.heapSize) / double(placement.unaliasedSize);
+    }
+    printf("  %u random frame graphs: %.0f%% memory saved on average, %u errors\n", graphs, 100.0 * saved / graphs, errors);
+    return errors;
+}
+
+struct FakePipeline {
+    uint64_t key;
+};
+
+// Stands in for the Metal compiler service: a few threads taking a fixed time
+// per pipeline. Descriptions with a "broken" fragment function fail. With an
+// archive, the pipelines it lists take `archivedLatency` instead and the others
+// are remembered for adding to it.
+class FakePipelineCompiler : public PipelineCompiler {
+public:
+    FakePipelineCompiler(uint32_t threadCount, std::chrono::microseconds latency,
+                         PipelineArchiveManifest* archive = nullptr, std::chrono::microseconds archivedLatency = {})
+        : latency(latency)
+        , archivedLatency(archivedLatency)
+        , archive(archive)
+    {
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back([this] { run(); });
+        }
+    }
+
+    ~FakePipelineCompiler() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void compile(const PipelineDesc& desc, Completion done) override {
+        uint64_t key = hashPipelineDesc(desc);
+        bool archived = false;
+        if (archive) {
+            archived = archive->contains(key);
+            if (!archived) {
+                unarchived.push_back(key);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({key, desc.fragmentFunction == "broken", archived ? archivedLatency : latency, std::move(done)});
+        }
+        wake.notify_one();
+    }
+
+    void release(void* pipeline) override {
+        delete static_cast<FakePipeline*>(pipeline);
+        released++;
+    }
+
+    std::atomic<uint32_t> compiled{0};
+    std::atomic<uint32_t> released{0};
+    std::vector<uint64_t> unarchived;
+
+private:
+    struct Job {
+        uint64_t key;
+        bool broken;
+        std::chrono::microseconds latency;
+        Completion done;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return quit || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+
+            std::this_thread::sleep_for(job.latency);
+            compiled += !job.broken;
+            job.done(job.broken ? nullptr : new FakePipeline{job.key});
+
+            lock.lock();
+        }
+    }
+
+    std::chrono::microseconds latency;
+    std::chrono::microseconds archivedLatency;
+    PipelineArchiveManifest* archive;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    bool quit = false;
+};
+
+static PipelineDesc randomPipelineDesc(std::mt19937& rng) {
+    PipelineDesc desc;
+    desc.vertexFunction = "vertex" + std::to_string(rng() % 40);
+    desc.fragmentFunction = "fragment" + std::to_string(rng() % 60);
+    uint32_t attributes = 1 + rng() % 4;
+    uint32_t offset = 0;
+    for (uint32_t a = 0; a < attributes; ++a) {
+        uint32_t format = 28 + rng() % 4;    // float .. float4
+        desc.attributes[a] = {format, offset, 0};
+        offset += (format - 27) * 4;
+    }
+    desc.vertexStrides[0] = offset;
+    desc.colorFormats[0] = rng() % 2 ? 81 : 115;        // BGRA8Unorm_sRGB, RGBA16Float
+    desc.blending[0].enabled = rng() % 3 == 0;
+    if (desc.blending[0].enabled) {
+        desc.blending[0].sourceRGBFactor = 4;           // source alpha
+        desc.blending[0].destinationRGBFactor = 5;      // one minus source alpha
+    }
+    desc.depthFormat = rng() % 2 ? 252 : 0;              // Depth32Float
+    desc.sampleCount = rng() % 4 == 0 ? 4 : 1;
+    return desc;
+}
+
+static uint32_t benchPipelineCache() {
+    std::mt19937 rng(29);
+    uint32_t errors = 0;
+
+    // Distinct descriptions must not collide, and every field has to count.
+    std::vector<PipelineDesc> descs;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        descs.push_back(randomPipelineDesc(rng));
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> hashes;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < descs.size(); ++i) {
+        hashes.push_back({hashPipelineDesc(descs[i]), i});
+    }
+    double hashSeconds = secondsSince(start);
+    std::sort(hashes.begin(), hashes.end());
+    uint32_t distinct = 1, collisions = 0;
+    for (size_t i = 1; i < hashes.size(); ++i) {
+        bool sameHash = hashes[i].first == hashes[i - 1].first;
+        bool sameDesc = descs[hashes[i].second] == descs[hashes[i - 1].second];
+        distinct += !sameHash;
+        collisions += sameHash && !sameDesc;
+    }
+
+    PipelineDesc base = descs[0];
+    std::vector<PipelineDesc> variants(10, base);
+    variants[0].vertexFunction += "X";
+    variants[1].fragmentFunction.clear();
+    variants[2].attributes[7].format = 28;
+    variants[3].vertexStrides[3] = 16;
+    variants[4].colorFormats[1] = 81;
+    variants[5].blending[3].writeMask = 0;
+    variants[6].depthFormat = 250;
+    variants[7].stencilFormat = 253;
+    variants[8].sampleCount = 8;
+    variants[9].features = 1;
+    for (const PipelineDesc& variant : variants) {
+        errors += hashPipelineDesc(variant) == hashPipelineDesc(base);
+    }
+    errors += collisions;
+
+    printf("pipeline-cache\n");
+    printf("  %zu descriptions, %u distinct, %u collisions, %.0f ns/hash\n",
+           descs.size(), distinct, collisions, hashSeconds * 1e9 / descs.size());
+
+    // Materials show up a few per frame in a random order; two thirds of their
+    // pipelines were prewarmed at load, the rest are only found when drawn.
+    const uint32_t materialCount = 150;
+    const auto frameTime = std::chrono::milliseconds(4);
+    std::vector<PipelineDesc> materials;
+    while (materials.size() < materialCount) {
+        PipelineDesc desc = randomPipelineDesc(rng);
+        if (std::find(materials.begin(), materials.end(), desc) == materials.end()) {
+            materials.push_back(desc);
+        }
+    }
+    materials[40].fragmentFunction = "broken";
+    materials[120].fragmentFunction = "broken";
+
+    FakePipelineCompiler compiler(4, std::chrono::milliseconds(8));
+    uint32_t frames = 0, fallbackDraws = 0, waitingFrames = 0, waited = 0;
+    double maxFrameSeconds = 0.0, totalFrameSeconds = 0.0;
+    {
+        PipelineCache cache(compiler, 4);
+        std::vector<uint64_t> keys(materialCount, 0);
+        for (uint32_t i = 0; i < materialCount * 2 / 3; ++i) {
+            keys[i] = cache.prewarm(materials[i]);
+        }
+
+        std::vector<uint32_t> order(materialCount);
+        for (uint32_t i = 0; i < materialCount; ++i) {
+            order[i] = i;
+        }
+        std::shuffle(order.begin(), order.end(), rng);
+        std::vector<uint32_t> firstSeen(materialCount, 0);
+
+        uint32_t visible = 0, readyCount = 0;
+        while (readyCount < materialCount - 2 && frames < 2000) {
+            frames++;
+            visible = std::min(materialCount, visible + 3);
+
+            auto frameStart = Clock::now();
+            cache.update();
+            readyCount = 0;
+            for (uint32_t v = 0; v < visible; ++v) {
+                uint32_t material = order[v];
+                void* pipeline;
+                if (keys[material]) {
+                    pipeline = cache.find(keys[material]);
+                } else {
+                    // First sight of a material that wasn't prewarmed.
+                    pipeline = cache.find(materials[material]);
+                    keys[material] = hashPipelineDesc(materials[material]);
+                }
+                if (pipeline) {
+                    readyCount++;
+                    errors += static_cast<FakePipeline*>(pipeline)->key != keys[material];
+                    if (firstSeen[material] != 0) {
+                        waitingFrames += frames - firstSeen[material];
+                        waited++;
+                        firstSeen[material] = 0;
+                    }
+                } else {
+                    fallbackDraws++;
+                    if (firstSeen[material] == 0) {
+                        firstSeen[material] = frames;
+                    }
+                }
+            }
+            double frameSeconds = secondsSince(frameStart);
+            maxFrameSeconds = std::max(maxFrameSeconds, frameSeconds);
+            totalFrameSeconds += frameSeconds;
+
+            std::this_thread::sleep_for(frameTime);
+        }
+
+        const PipelineCacheStats& stats = cache.stats();
+        errors += readyCount != materialCount - 2;
+        errors += stats.failed != 2;
+        printf("  %u materials (8 ms compiles, 4 at a time): all ready after %u frames, %u fallback draws\n",
+               materialCount, frames, fallbackDraws);
+        printf("  %u materials drawn with a fallback first, waiting %.1f frames on average; %llu compiled, %llu failed\n",
+               waited, waited ? double(waitingFrames) / waited : 0.0,
+               (unsigned long long)stats.compiled, (unsigned long long)stats.failed);
+        printf("  cache cost %.1f us/frame, worst %.1f us\n", totalFrameSeconds * 1e6 / frames, maxFrameSeconds * 1e6);
+    }
+    errors += compiler.released != compiler.compiled;
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// A launch that compiles every pipeline behind a loading screen, then adds
+// what it had to compile to the archive, like RenderPipelineCompiler.
+static double launchWithArchive(const std::vector<PipelineDesc>& descs, PipelineArchiveManifest& manifest, const std::string& path) {
+    FakePipelineCompiler compiler(4, std::chrono::milliseconds(8), &manifest, std::chrono::microseconds(500));
+    double seconds;
+    {
+        PipelineCache cache(compiler, 4);
+        auto start = Clock::now();
+        for (const PipelineDesc& desc : descs) {
+            cache.prewarm(desc);
+        }
+        cache.waitIdle();
+        seconds = secondsSince(start);
+    }
+    for (uint64_t key : compiler.unarchived) {
+        manifest.add(key);
+    }
+    manifest.save(path);
+    return seconds;
+}
+
+static void writeFile(const std::string& path, const std::string& contents) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << contents;
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static uint32_t benchPipelineArchive() {
+    std::mt19937 rng(31);
+    uint32_t errors = 0;
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string path = (directory / "metalbones-bench-pipelines.manifest").string();
+    std::string library = (directory / "metalbones-bench-default.metallib").string();
+    std::remove(path.c_str());
+
+    std::string libraryBytes(64 * 1024, '\0');
+    for (char& c : libraryBytes) {
+        c = char(rng());
+    }
+    writeFile(library, libraryBytes);
+    PipelineArchiveVersion version = {"Apple M2 Pro", "Version 15.1 (Build 24B83)", hashFileContents(library)};
+    errors += version.shaderHash == 0;
+    errors += hashFileContents(library + ".missing") != 0;
+
+    std::vector<PipelineDesc> materials;
+    while (materials.size() < 130) {
+        PipelineDesc desc = randomPipelineDesc(rng);
+        if (std::find(materials.begin(), materials.end(), desc) == materials.end()) {
+            materials.push_back(desc);
+        }
+    }
+    std::vector<PipelineDesc> firstLaunch(materials.begin(), materials.begin() + 120);
+
+    // First launch finds nothing; the second has ten new materials.
+    PipelineArchiveManifest cold(version);
+    errors += cold.load(path) != PipelineArchiveStatus::Missing;
+    double coldSeconds = launchWithArchive(firstLaunch, cold, path);
+    errors += cold.stats().hits != 0 || cold.size() != firstLaunch.size();
+
+    PipelineArchiveManifest warm(version);
+    errors += warm.load(path) != PipelineArchiveStatus::Valid;
+    errors += warm.size() != firstLaunch.size();
+    double warmSeconds = launchWithArchive(materials, warm, path);
+    const PipelineArchiveStats& stats = warm.stats();
+    errors += stats.hits != firstLaunch.size() || stats.lookups != materials.size();
+
+    PipelineArchiveManifest reloaded(version);
+    errors += reloaded.load(path) != PipelineArchiveStatus::Valid;
+    for (const PipelineDesc& desc : materials) {
+        errors += !reloaded.contains(hashPipelineDesc(desc));
+    }
+
+    // Anything built for another GPU, OS or shader library is thrown away.
+    uint32_t staleChecks = 0;
+    std::vector<PipelineArchiveVersion> others(3, version);
+    others[0].device = "Apple M3 Max";
+    others[1].osBuild = "Version 15.2 (Build 24C101)";
+    libraryBytes[12345] ^= 1;
+    writeFile(library, libraryBytes);
+    others[2].shaderHash = hashFileContents(library);
+    for (const PipelineArchiveVersion& other : others) {
+        PipelineArchiveManifest manifest(other);
+        errors += manifest.load(path) != PipelineArchiveStatus::Stale || manifest.size() != 0;
+        staleChecks++;
+    }
+
+    // And so is anything that doesn't parse, or comes from another format version.
+    std::string saved = readFile(path);
+    std::vector<std::pair<std::string, PipelineArchiveStatus>> damaged = {
+        {saved.substr(0, saved.size() - 10), PipelineArchiveStatus::Corrupt},
+        {saved.substr(0, saved.find("pipelines")), PipelineArchiveStatus::Corrupt},
+        {"", PipelineArchiveStatus::Corrupt},
+        {std::string(200, '\xff'), PipelineArchiveStatus::Corrupt},
+        {"MetalBonesPipelineArchive 2" + saved.substr(saved.find('\n')), PipelineArchiveStatus::Stale},
+    };
+    std::string corrupted = saved;
+    corrupted[corrupted.size() - 5] = 'z';
+    damaged.push_back({corrupted, PipelineArchiveStatus::Corrupt});
+    for (const auto& [contents, expected] : damaged) {
+        writeFile(path, contents);
+        PipelineArchiveManifest manifest(version);
+        errors += manifest.load(path) != expected || manifest.size() != 0;
+    }
+
+    std::remove(path.c_str());
+    std::remove(library.c_str());
+
+    printf("pipeline-archive\n");
+    printf("  first launch: %zu pipelines compiled in %.0f ms\n", firstLaunch.size(), coldSeconds * 1e3);
+    printf("  next launch: %zu pipelines in %.0f ms, %llu of %llu from the archive (%.0f%%), %.0f ms saved\n",
+           materials.size(), warmSeconds * 1e3, (unsigned long long)stats.hits, (unsigned long long)stats.lookups,
+           100.0 * stats.hits / stats.lookups, (coldSeconds - warmSeconds) * 1e3);
+    printf("  %u stale versions and %zu damaged manifests rejected\n", staleChecks, damaged.size());
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// Records encoder calls the way they reach Metal, each one out of line like
+// objc_msgSend. Only a lower bound for the driver's own work per call.
+class FakeRenderEncoder {
+public:
+    __attribute__((noinline)) void setVertexBuffer(const void* buffer, uint32_t index) {
+        record(1, uint64_t(uintptr_t(buffer)), index);
+    }
+    __attribute__((noinline)) void setVertexBytes(const void* bytes, size_t length, uint32_t index) {
+        // Metal copies the bytes at call time.
+        size_t start = commands.size();
+        commands.resize(start + (length + 7) / 8);
+        memcpy(&commands[start], bytes, length);
+        record(2, length, index);
+    }
+    __attribute__((noinline)) void setFragmentTexture(const void* texture, uint32_t index) {
+        record(3, uint64_t(uintptr_t(texture)), index);
+    }
+    __attribute__((noinline)) void setFragmentSamplerState(const void* sampler, uint32_t index) {
+        record(4, uint64_t(uintptr_t(sampler)), index);
+    }
+    __attribute__((noinline)) void drawIndexed(uint32_t indexCount, uint32_t baseInstance) {
+        record(5, indexCount, baseInstance);
+    }
+
+    void reset() { commands.clear(); calls = 0; }
+
+    std::vector<uint64_t> commands;
+    uint64_t calls = 0;
+
+private:
+    void record(uint64_t op, uint64_t a, uint64_t b) {
+        commands.push_back(op << 56 | b << 32 | (a & 0xffffffff));
+        calls++;
+    }
+};
+
+static uint32_t benchDescriptorTable() {
+    std::mt19937 rng(45);
+    uint32_t errors = 0;
+
+    // Random adds, removes and replacements with three frames in flight. A
+    // slot must never come back while a frame that may read it is running.
+    const uint32_t capacity = 1024;
+    const uint64_t framesInFlight = 3;
+    const uint64_t frameCount = 20000;
+    DescriptorTable table(capacity);
+    std::vector<uint64_t> lastRead(capacity, 0);
+    std::vector<bool> live(capacity, false);
+    std::vector<uint32_t> liveSlots;
+    uint64_t replacements = 0, staleReuses = 0;
+    for (uint64_t frame = 1; frame <= frameCount; ++frame) {
+        uint64_t completed = frame > framesInFlight ? frame - framesInFlight : 0;
+        table.collect(completed);
+
+        for (uint32_t op = 0; op < 24; ++op) {
+            uint32_t choice = rng() % 100;
+            if (choice < 45 || liveSlots.empty()) {
+                uint32_t slot = table.allocate();
+                if (slot == DescriptorTable::invalidSlot) {
+                    continue;
+                }
+                errors += live[slot];
+                staleReuses += lastRead[slot] > completed;
+                live[slot] = true;
+                liveSlots.push_back(slot);
+            } else {
+                size_t index = rng() % liveSlots.size();
+                uint32_t slot = liveSlots[index];
+                // Nothing this frame has read it yet.
+                if (choice < 80) {
+                    table.release(slot, frame - 1);
+                    live[slot] = false;
+                    liveSlots[index] = liveSlots.back();
+                    liveSlots.pop_back();
+                } else {
+                    uint32_t fresh = table.replace(slot, frame - 1);
+                    if (fresh == DescriptorTable::invalidSlot) {
+                        continue;
+                    }
+                    errors += live[fresh];
+                    staleReuses += lastRead[fresh] > completed;
+                    live[slot] = false;
+                    live[fresh] = true;
+                    liveSlots[index] = fresh;
+                    replacements++;
+                }
+            }
+        }
+
+        // The frame reads everything live.
+        for (uint32_t slot : liveSlots) {
+            lastRead[slot] = frame;
+        }
+        errors += table.stats().live != liveSlots.size();
+    }
+    for (uint32_t slot = 0; slot < capacity; ++slot) {
+        errors += table.live(slot) != live[slot];
+    }
+    table.collect(~uint64_t(0));
+    uint32_t refilled = 0;
+    while (table.allocate() != DescriptorTable::invalidSlot) {
+        refilled++;
+    }
+    errors += refilled + liveSlots.size() != capacity;
+    errors += staleReuses;
+    const DescriptorTableStats& stats = table.stats();
+
+    // Steady churn: one slot in, one out, once per frame collected.
+    DescriptorTable churn(capacity);
+    std::vector<uint32_t> churnSlots;
+    for (uint32_t i = 0; i < capacity / 2; ++i) {
+        churnSlots.push_back(churn.allocate());
+    }
+    const uint32_t churnOps = 2000000;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < churnOps; ++i) {
+        uint32_t index = i % churnSlots.size();
+        churn.release(churnSlots[index], i / 64);
+        churnSlots[index] = churn.allocate();
+        if (i % 64 == 63) {
+            churn.collect(i / 64 > framesInFlight ? i / 64 - framesInFlight : 0);
+        }
+    }
+    double churnSeconds = secondsSince(start);
+    errors += churn.stats().failures != 0;
+
+    // Encoding 5000 draws with everything bound per draw, and with bindless
+    // tables where a draw passes its object slot as the base instance and the
+    // CPU writes the object's data instead. Both skip redundant bindings.
+    struct Object {
+        uint32_t mesh, texture, sampler, palette;
+        float transform[16];
+    };
+    struct ObjectData {
+        float transform[16];
+        uint32_t palette, texture, sampler, pad;
+    };
+    const uint32_t drawCount = 5000, frames = 200;
+    std::vector<Object> objects(drawCount);
+    for (Object& object : objects) {
+        object.mesh = rng() % 50;
+        object.texture = rng() % 200;
+        object.sampler = rng() % 4;
+        object.palette = rng() % 4 == 0 ? rng() % 300 : ~0u;
+        for (float& value : object.transform) {
+            value = float(rng() % 1000) * 0.001f;
+        }
+    }
+    std::vector<char> meshes(50), textures(200), samplers(4), palettes(300);
+    std::vector<ObjectData> objectData(drawCount);
+    FakeRenderEncoder encoder;
+
+    start = Clock::now();
+    uint64_t boundCalls = 0;
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        encoder.reset();
+        const void* mesh = nullptr;
+        const void* texture = nullptr;
+        const void* sampler = nullptr;
+        for (const Object& object : objects) {
+            if (&meshes[object.mesh] != mesh) {
+                mesh = &meshes[object.mesh];
+                encoder.setVertexBuffer(mesh, 0);
+            }
+            encoder.setVertexBytes(object.transform, sizeof(object.transform), 6);
+            if (object.palette != ~0u) {
+                encoder.setVertexBuffer(&palettes[object.palette], 4);
+            }
+            if (&textures[object.texture] != texture) {
+                texture = &textures[object.texture];
+                encoder.setFragmentTexture(texture, 0);
+            }
+            if (&samplers[object.sampler] != sampler) {
+                sampler = &samplers[object.sampler];
+                encoder.setFragmentSamplerState(sampler, 0);
+            }
+            encoder.drawIndexed(36, 0);
+        }
+        boundCalls += encoder.calls;
+    }
+    double boundSeconds = secondsSince(start);
+
+    start = Clock::now();
+    uint64_t bindlessCalls = 0;
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        encoder.reset();
+        const void* mesh = nullptr;
+        for (uint32_t i = 0; i < drawCount; ++i) {
+            const Object& object = objects[i];
+            ObjectData& data = objectData[i];
+            memcpy(data.transform, object.transform, sizeof(data.transform));
+            data.palette = object.palette;
+            data.texture = object.texture;
+            data.sampler = object.sampler;
+            if (&meshes[object.mesh] != mesh) {
+                mesh = &meshes[object.mesh];
+                encoder.setVertexBuffer(mesh, 0);
+            }
+            encoder.drawIndexed(36, i);
+        }
+        bindlessCalls += encoder.calls;
+    }
+    double bindlessSeconds = secondsSince(start);
+    errors += objectData[drawCount - 1].texture != objects[drawCount - 1].texture;
+
+    printf("descriptor-table\n");
+    printf("  %llu frames, %llu in flight: %llu slots handed out, %llu replaced, %llu refused when full, peak %u/%u live\n",
+           (unsigned long long)frameCount, (unsigned long long)framesInFlight, (unsigned long long)stats.allocations,
+           (unsigned long long)replacements, (unsigned long long)stats.failures, stats.peakLive, capacity);
+    printf("  %llu slots reused while a frame could still read them\n", (unsigned long long)staleReuses);
+    printf("  release + allocate: %.1f ns\n", churnSeconds * 1e9 / churnOps);
+    printf("  %u draws bound per draw: %.1f encoder calls and %.0f ns each\n",
+           drawCount, double(boundCalls) / (drawCount * frames), boundSeconds * 1e9 / (drawCount * frames));
+    printf("  %u draws with bindless tables: %.1f encoder calls and %.0f ns each, object data writes included\n",
+           drawCount, double(bindlessCalls) / (drawCount * frames), bindlessSeconds * 1e9 / (drawCount * frames));
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// Right handed, looking down -z, depth in [0, 1] like Metal's.
+static Float4x4 perspective(float fovY, float aspect, float zNear, float zFar) {
+    Float4x4 m = {};
+    float f = 1.0f / std::tan(fovY * 0.5f);
+    m.m[0] = f / aspect;
+    m.m[5] = f;
+    m.m[10] = zFar / (zNear - zFar);
+    m.m[11] = -1.0f;
+    m.m[14] = zNear * zFar / (zNear - zFar);
+    return m;
+}
+
+static uint32_t benchGpuCulling() {
+    const uint32_t counts[] = {1003, 100000};
+    const uint32_t views = 64;
+    printf("gpu-culling (CPU reference of the culling kernel)\n");
+
+    uint32_t errors = 0;
+    for (uint32_t count : counts) {
+        std::mt19937 rng(23);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> radius(0.1f, 3.0f);
+        std::vector<CullSphere> spheres(count);
+        std::vector<CullDraw> draws(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            spheres[i] = {position(rng), position(rng), position(rng), radius(rng)};
+            draws[i] = {36, (i % 7) * 36, int32_t(i % 5) * 24, i};
+        }
+
+        std::vector<CullDraw> scalarOut(count), simdOut(count);
+        double seconds[2] = {};
+        uint64_t visible = 0;
+        for (uint32_t v = 0; v < views; ++v) {
+            float angle = float(v) * 6.2831853f / views;
+            Quat turn = {0.0f, std::sin(angle * 0.5f), 0.0f, std::cos(angle * 0.5f)};
+            Float4x4 view = makeTransform({0.0f, 0.0f, 0.0f}, turn, {1.0f, 1.0f, 1.0f});
+            FrustumPlanes frustum = frustumPlanes(perspective(1.0f, 16.0f / 9.0f, 0.1f, 150.0f) * view);
+
+            Clock::time_point start = Clock::now();
+            uint32_t scalarCount = cullDrawsScalar(frustum, spheres.data(), draws.data(), count, scalarOut.data());
+            seconds[0] += secondsSince(start);
+
+            start = Clock::now();
+            uint32_t simdCount = cullDrawsSimd(frustum, spheres.data(), draws.data(), count, simdOut.data());
+            seconds[1] += secondsSince(start);
+
+            visible += scalarCount;
+            if (simdCount != scalarCount) {
+                errors++;
+                continue;
+            }
+            for (uint32_t i = 0; i < scalarCount; ++i) {
+                errors += memcmp(&scalarOut[i], &simdOut[i], sizeof(CullDraw)) != 0;
+            }
+        }
+        printf("  %6u objects  %5.1f%% visible  scalar %5.2f ns/object  simd %5.2f ns/object\n", count,
+               100.0 * visible / (double(count) * views), seconds[0] * 1e9 / (double(count) * views),
+               seconds[1] * 1e9 / (double(count) * views));
+    }
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// Worst plane margin in double precision: > 0 inside, < 0 outside.
+static double boxMargin(const FrustumPlanes& frustum, Float3 center, Float3 extents) {
+    double margin = 1e30;
+    for (const float* plane : frustum.planes) {
+        double distance = double(plane[0]) * center.x + double(plane[1]) * center.y + double(plane[2]) * center.z + plane[3];
+        double reach = std::fabs(plane[0]) * double(extents.x) + std::fabs(plane[1]) * double(extents.y) + std::fabs(plane[2]) * double(extents.z);
+        margin = std::min(margin, distance + reach);
+    }
+    return margin;
+}
+
+static uint32_t benchFrustumCulling() {
+    const uint32_t counts[] = {100000, 1000000};
+    const uint32_t views = 32;
+    uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threads = 1; threads <= std::max(4u, hardware); threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    if (threadCounts.back() != hardware && hardware > 4) {
+        threadCounts.push_back(hardware);
+    }
+    printf("frustum-culling (%u hardware threads)\n", hardware);
+
+    uint32_t errors = 0;
+    for (uint32_t count : counts) {
+        std::mt19937 rng(29);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+        std::vector<Float3> centers(count), extents(count);
+        FrustumCuller culler;
+        for (uint32_t i = 0; i < count; ++i) {
+            centers[i] = {position(rng), position(rng), position(rng)};
+            extents[i] = {extent(rng), extent(rng), extent(rng)};
+            culler.add(centers[i], extents[i]);
+        }
+
+        std::vector<FrustumPlanes> frusta(views);
+        for (uint32_t v = 0; v < views; ++v) {
+            float angle = float(v) * 6.2831853f / views;
+            Quat turn = {0.0f, std::sin(angle * 0.5f), 0.0f, std::cos(angle * 0.5f)};
+            Float4x4 view = makeTransform({0.0f, 0.0f, 0.0f}, turn, {1.0f, 1.0f, 1.0f});
+            frusta[v] = frustumPlanes(perspective(1.0f, 16.0f / 9.0f, 0.1f, 150.0f) * view);
+        }
+
+        // Single threaded results, checked against the double precision test
+        // away from the plane boundaries; every thread count must match them.
+        std::vector<std::vector<uint32_t>> expected(views);
+        uint64_t visible = 0;
+        for (uint32_t v = 0; v < views; ++v) {
+            uint32_t found = culler.cull(frusta[v]);
+            expected[v].assign(culler.visible(), culler.visible() + found);
+            visible += found;
+
+            std::vector<bool> marked(count);
+            for (uint32_t index : expected[v]) {
+                marked[index] = true;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                double margin = boxMargin(frusta[v], centers[i], extents[i]);
+                errors += (margin > 1e-3 && !marked[i]) || (margin < -1e-3 && marked[i]);
+            }
+        }
+
+        for (uint32_t threads : threadCounts) {
+            JobSystem jobs(threads - 1);
+            double seconds = 0.0;
+            for (uint32_t v = 0; v < views; ++v) {
+                uint32_t found = culler.cull(frusta[v], &jobs);
+                seconds += culler.stats().seconds;
+                errors += found != expected[v].size()
+                    || !std::equal(expected[v].begin(), expected[v].end(), culler.visible());
+            }
+            printf("  %7u objects  %4.1f%% visible  %2u threads %8.0f objects/ms\n", count,
+                   100.0 * visible / (double(count) * views), threads, double(count) * views / (seconds * 1e3));
+        }
+    }
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+static bool boxesOverlap(const Aabb& a, const Aabb& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y
+        && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Entry distance along the ray, or infinity when it misses.
+static double rayBoxDistance(const Aabb& box, Float3 origin, Float3 direction) {
+    double near = 0.0, far = INFINITY;
+    const float o[3] = {origin.x, origin.y, origin.z}, d[3] = {direction.x, direction.y, direction.z};
+    const float lo[3] = {box.min.x, box.min.y, box.min.z}, hi[3] = {box.max.x, box.max.y, box.max.z};
+    for (int axis = 0; axis < 3; ++axis) {
+        double t0 = (double(lo[axis]) - o[axis]) / d[axis], t1 = (double(hi[axis]) - o[axis]) / d[axis];
+        near = std::max(near, std::min(t0, t1));
+        far = std::min(far, std::max(t0, t1));
+    }
+    return near <= far ? near : INFINITY;
+}
+
+// Every object reachable exactly once, every node inside its slot in the parent.
+static uint32_t checkBvh(const Bvh& bvh, uint32_t count) {
+    uint32_t errors = 0;
+    std::vector<uint32_t> found;
+    bvh.overlapping({{-INFINITY, -INFINITY, -INFINITY}, {INFINITY, INFINITY, INFINITY}}, found);
+    std::sort(found.begin(), found.end());
+    errors += found.size() != count;
+    for (uint32_t i = 0; i < found.size(); ++i) {
+        errors += found[i] != i;
+    }
+
+    const std::vector<BvhNode>& nodes = bvh.flattened();
+    for (uint32_t n = 0; n < nodes.size(); ++n) {
+        for (uint32_t slot = 0; slot < 4; ++slot) {
+            if (nodes[n].child[slot] == Bvh::emptySlot || nodes[n].count[slot] > 0) {
+                continue;
+            }
+            const BvhNode& child = nodes[nodes[n].child[slot]];
+            errors += nodes[n].child[slot] <= n;
+            for (uint32_t c = 0; c < 4; ++c) {
+                if (child.child[c] == Bvh::emptySlot) {
+                    continue;
+                }
+                errors += child.minX[c] < nodes[n].minX[slot] || child.minY[c] < nodes[n].minY[slot]
+                    || child.minZ[c] < nodes[n].minZ[slot] || child.maxX[c] > nodes[n].maxX[slot]
+                    || child.maxY[c] > nodes[n].maxY[slot] || child.maxZ[c] > nodes[n].maxZ[slot];
+            }
+        }
+    }
+    return errors;
+}
+
+// Box, frustum and ray queries against brute force over `boxes`; returns errors.
+static uint32_t checkBvhQueries(const Bvh& bvh, const std::vector<Aabb>& boxes, float side, std::mt19937& rng) {
+    const uint32_t checks = 20;
+    std::uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    uint32_t errors = 0;
+    std::vector<uint32_t> found, expected;
+    for (uint32_t q = 0; q < checks; ++q) {
+        Float3 corner = {position(rng), position(rng), position(rng)};
+        Aabb query = {corner, corner + Float3{6.0f, 6.0f, 6.0f}};
+        found.clear();
+        expected.clear();
+        bvh.overlapping(query, found);
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            if (boxesOverlap(boxes[i], query)) {
+                expected.push_back(i);
+            }
+        }
+        std::sort(found.begin(), found.end());
+        errors += found != expected;
+
+        float angle = float(q) * 6.2831853f / checks;
+        Quat turn = {0.0f, std::sin(angle * 0.5f), 0.0f, std::cos(angle * 0.5f)};
+        Float4x4 view = makeTransform({0.0f, 0.0f, 0.0f}, turn, {1.0f, 1.0f, 1.0f});
+        FrustumPlanes frustum = frustumPlanes(perspective(1.0f, 16.0f / 9.0f, 0.1f, side * 0.75f) * view);
+        found.clear();
+        bvh.visible(frustum, found);
+        std::vector<bool> marked(boxes.size());
+        for (uint32_t index : found) {
+            errors += marked[index];
+            marked[index] = true;
+        }
+        for (uint32_t i = 0; i < boxes.size(); ++i) {
+            Float3 center = (boxes[i].min + boxes[i].max) * 0.5f, extents = (boxes[i].max - boxes[i].min) * 0.5f;
+            double margin = boxMargin(frustum, center, extents);
+            errors += (margin > 1e-3 && !marked[i]) || (margin < -1e-3 && marked[i]);
+        }
+
+        Float3 origin = {position(rng), position(rng), position(rng)};
+        Float3 direction = {normal(rng), normal(rng), normal(rng)};
+        float distance = INFINITY;
+        uint32_t hit = bvh.raycast(origin, direction, INFINITY, &distance);
+        double nearest = INFINITY;
+        for (const Aabb& box : boxes) {
+            nearest = std::min(nearest, rayBoxDistance(box, origin, direction));
+        }
+        if (hit == Bvh::noObject) {
+            errors += nearest != INFINITY;
+        } else {
+            errors += std::fabs(distance - nearest) > 1e-3 * std::max(1.0, nearest)
+                || std::fabs(rayBoxDistance(boxes[hit], origin, direction) - nearest) > 1e-3 * std::max(1.0, nearest);
+        }
+    }
+    return errors;
+}
+
+static uint32_t benchBvh() {
+    const uint32_t counts[] = {100000, 1000000};
+    const uint32_t queries = 20000;
+    const uint32_t frames = 60;
+
+    JobSystem jobs;
+    printf("bvh (%u threads)\n", jobs.threadCount());
+
+    uint32_t errors = 0;
+    for (uint32_t count : counts) {
+        // The same density at every count.
+        float side = 200.0f * std::cbrt(count / 100000.0f);
+        std::mt19937 rng(37);
+        std::uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f);
+        std::uniform_real_distribution<float> extent(0.1f, 2.0f);
+        std::uniform_real_distribution<float> velocity(-0.5f, 0.5f);
+        std::vector<Aabb> boxes(count);
+        for (Aabb& box : boxes) {
+            Float3 center = {position(rng), position(rng), position(rng)};
+            Float3 half = {extent(rng), extent(rng), extent(rng)};
+            box = {center - half, center + half};
+        }
+
+        Bvh serial, bvh;
+        serial.build(boxes.data(), count);
+        bvh.build(boxes.data(), count, &jobs);
+        errors += serial.flattened().size() != bvh.flattened().size()
+            || memcmp(serial.flattened().data(), bvh.flattened().data(), bvh.flattened().size() * sizeof(BvhNode)) != 0;
+        errors += checkBvh(bvh, count);
+        errors += checkBvhQueries(bvh, boxes, side, rng);
+        printf("  %7u objects  build %7.1f ms, %7.1f ms with jobs  %u nodes  depth %u  SAH cost %.1f\n", count,
+               serial.stats().buildSeconds * 1e3, bvh.stats().buildSeconds * 1e3, bvh.stats().nodes, bvh.stats().depth,
+               bvh.stats().builtCost);
+
+        std::vector<Aabb> boxQueries(queries);
+        std::vector<Float3> origins(queries), directions(queries);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        for (uint32_t q = 0; q < queries; ++q) {
+            Float3 corner = {position(rng), position(rng), position(rng)};
+            boxQueries[q] = {corner, corner + Float3{6.0f, 6.0f, 6.0f}};
+            origins[q] = {position(rng), position(rng), position(rng)};
+            directions[q] = {normal(rng), normal(rng), normal(rng)};
+        }
+        std::vector<uint32_t> found;
+        Clock::time_point start = Clock::now();
+        for (const Aabb& query : boxQueries) {
+            found.clear();
+            bvh.overlapping(query, found);
+        }
+        double boxSeconds = secondsSince(start);
+        uint32_t hits = 0;
+        start = Clock::now();
+        for (uint32_t q = 0; q < queries; ++q) {
+            hits += bvh.raycast(origins[q], directions[q], INFINITY) != Bvh::noObject;
+        }
+        double raySeconds = secondsSince(start);
+        const uint32_t views = 16;
+        uint64_t visible = 0;
+        start = Clock::now();
+        for (uint32_t v = 0; v < views; ++v) {
+            float angle = float(v) * 6.2831853f / views;
+            Quat turn = {0.0f, std::sin(angle * 0.5f), 0.0f, std::cos(angle * 0.5f)};
+            Float4x4 view = makeTransform({0.0f, 0.0f, 0.0f}, turn, {1.0f, 1.0f, 1.0f});
+            found.clear();
+            bvh.visible(frustumPlanes(perspective(1.0f, 16.0f / 9.0f, 0.1f, side * 0.75f) * view), found);
+            visible += found.size();
+        }
+        double frustumSeconds = secondsSince(start);
+        printf("  %7u objects  %6.0f box queries/ms  %6.0f rays/ms (%u%% hit)  frustum %.2f ms for %.1f%% visible\n", count,
+               queries / (boxSeconds * 1e3), queries / (raySeconds * 1e3), hits * 100 / queries,
+               frustumSeconds * 1e3 / views, 100.0 * visible / (double(count) * views));
+
+        // Everything drifts; refit every frame and see when the tree asks for a rebuild.
+        std::vector<Float3> velocities(count);
+        for (Float3& v : velocities) {
+            v = {velocity(rng), velocity(rng), velocity(rng)};
+        }
+        double refitSeconds = 0.0;
+        uint32_t rebuildFrame = 0;
+        for (uint32_t f = 1; f <= frames; ++f) {
+            for (uint32_t i = 0; i < count; ++i) {
+                boxes[i] = {boxes[i].min + velocities[i], boxes[i].max + velocities[i]};
+                bvh.update(i, boxes[i]);
+            }
+            bvh.refit();
+            refitSeconds += bvh.stats().refitSeconds;
+            if (!rebuildFrame && bvh.shouldRebuild()) {
+                rebuildFrame = f;
+            }
+        }
+        errors += checkBvh(bvh, count);
+        errors += checkBvhQueries(bvh, boxes, side, rng);
+        float refitCost = bvh.stats().cost;
+        bvh.build(boxes.data(), count, &jobs);
+        printf("  %7u objects  refit %.2f ms  SAH cost after %u frames of drift %.1f, rebuilt %.1f; rebuild asked for at frame %u\n",
+               count, refitSeconds * 1e3 / frames, frames, refitCost, bvh.stats().builtCost, rebuildFrame);
+    }
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// A grid of city blocks, four buildings each, with props scattered along the
+// streets, seen from street level. The nearest buildings in view are the
+// occluders; every building and prop in view is tested. A box counts as an
+// error when it was culled although a ray from the eye reaches one of its
+// corners or its center past occluders grown by about a pixel.
+static uint32_t benchOcclusion() {
+    const uint32_t blocks = 32;
+    const float blockPitch = 40.0f, streetWidth = 10.0f, alleyWidth = 2.0f;
+    const uint32_t propCount = 20000;
+    const uint32_t occluderCount = 64;
+    const uint32_t width = 320, height = 192;
+    const float fovY = 1.0f, zFar = 1000.0f;
+    const uint32_t frames = 64;
+    printf("occlusion (%ux%u, %u occluders)\n", width, height, occluderCount);
+
+    std::mt19937 rng(41);
+    std::uniform_real_distribution<float> storeys(3.0f, 20.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<Aabb> boxes;
+    float lot = (blockPitch - streetWidth - alleyWidth) * 0.5f;
+    for (uint32_t bx = 0; bx < blocks; ++bx) {
+        for (uint32_t bz = 0; bz < blocks; ++bz) {
+            for (uint32_t b = 0; b < 4; ++b) {
+                float x = bx * blockPitch + streetWidth * 0.5f + (b & 1) * (lot + alleyWidth);
+                float z = bz * blockPitch + streetWidth * 0.5f + (b >> 1) * (lot + alleyWidth);
+                boxes.push_back({{x, 0.0f, z}, {x + lot, storeys(rng) * 3.0f, z + lot}});
+            }
+        }
+    }
+    const uint32_t buildingCount = uint32_t(boxes.size());
+    float citySide = blocks * blockPitch;
+    for (uint32_t i = 0; i < propCount; ++i) {
+        // Along a street running either way, off its center line.
+        float along = unit(rng) * citySide;
+        float across = std::floor(unit(rng) * blocks) * blockPitch + (unit(rng) < 0.5f ? -4.0f : 2.0f);
+        Float3 corner = i & 1 ? Float3{along, 0.0f, across} : Float3{across, 0.0f, along};
+        float size = 0.5f + unit(rng) * 1.5f;
+        boxes.push_back({corner, corner + Float3{size, size * 1.5f, size}});
+    }
+
+    FrustumCuller frustumCuller;
+    for (const Aabb& box : boxes) {
+        frustumCuller.add((box.min + box.max) * 0.5f, (box.max - box.min) * 0.5f);
+    }
+    const uint32_t boxIndices[36] = {0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+                                     2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3};
+    auto corner = [](const Aabb& box, uint32_t c) {
+        return Float3{c & 1 ? box.max.x : box.min.x, c & 2 ? box.max.y : box.min.y, c & 4 ? box.max.z : box.min.z};
+    };
+
+    OcclusionCuller culler(width, height);
+    float pixelAngle = 2.0f * std::tan(fovY * 0.5f) / height;
+    double rasterSeconds = 0.0, testSeconds = 0.0;
+    uint64_t inFrustum = 0, occluded = 0, triangles = 0;
+    uint32_t errors = 0;
+    std::vector<std::pair<float, uint32_t>> nearest;
+    std::vector<Aabb> occluders;
+    for (uint32_t f = 0; f < frames; ++f) {
+        // At an intersection, looking along the street or down a diagonal.
+        Float3 eye = {float(1 + rng() % (blocks - 1)) * blockPitch, 1.7f, float(1 + rng() % (blocks - 1)) * blockPitch};
+        float yaw = float(f % 8) * 6.2831853f / 8 + (unit(rng) - 0.5f) * 0.2f;
+        Quat turn = {0.0f, std::sin(-yaw * 0.5f), 0.0f, std::cos(-yaw * 0.5f)};
+        Float4x4 view = makeTransform({0.0f, 0.0f, 0.0f}, turn, {1.0f, 1.0f, 1.0f})
+            * makeTransform(eye * -1.0f, {0.0f, 0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f});
+        Float4x4 viewProjection = perspective(fovY, float(width) / height, 0.1f, zFar) * view;
+        uint32_t visibleCount = frustumCuller.cull(frustumPlanes(viewProjection));
+        const uint32_t* visible = frustumCuller.visible();
+        inFrustum += visibleCount;
+
+        nearest.clear();
+        for (uint32_t i = 0; i < visibleCount && visible[i] < buildingCount; ++i) {
+            Float3 offset = (boxes[visible[i]].min + boxes[visible[i]].max) * 0.5f - eye;
+            nearest.push_back({dot(offset, offset), visible[i]});
+        }
+        uint32_t selected = std::min(occluderCount, uint32_t(nearest.size()));
+        std::partial_sort(nearest.begin(), nearest.begin() + selected, nearest.end());
+
+        Clock::time_point start = Clock::now();
+        culler.begin(viewProjection);
+        for (uint32_t i = 0; i < selected; ++i) {
+            Float3 vertices[8];
+            for (uint32_t c = 0; c < 8; ++c) {
+                vertices[c] = corner(boxes[nearest[i].second], c);
+            }
+            culler.renderOccluder(vertices, 8, boxIndices, 12);
+        }
+        rasterSeconds += secondsSince(start);
+        triangles += culler.stats().triangles;
+
+        std::vector<uint32_t> culled;
+        start = Clock::now();
+        for (uint32_t i = 0; i < visibleCount; ++i) {
+            if (!culler.visible(boxes[visible[i]])) {
+                culled.push_back(visible[i]);
+            }
+        }
+        testSeconds += secondsSince(start);
+        occluded += culled.size();
+
+        occluders.clear();
+        for (uint32_t i = 0; i < selected; ++i) {
+            const Aabb& box = boxes[nearest[i].second];
+            Float3 far = {std::max(std::fabs(box.min.x - eye.x), std::fabs(box.max.x - eye.x)),
+                          std::max(std::fabs(box.min.y - eye.y), std::fabs(box.max.y - eye.y)),
+                          std::max(std::fabs(box.min.z - eye.z), std::fabs(box.max.z - eye.z))};
+            float margin = 1.5f * pixelAngle * length(far);
+            occluders.push_back({box.min - Float3{margin, margin, margin}, box.max + Float3{margin, margin, margin}});
+        }
+        for (uint32_t index : culled) {
+            const Aabb& box = boxes[index];
+            for (uint32_t c = 0; c <= 8; ++c) {
+                Float3 target = c < 8 ? corner(box, c) : (box.min + box.max) * 0.5f;
+                float clip[4];
+                for (uint32_t row = 0; row < 4; ++row) {
+                    clip[row] = viewProjection.m[row] * target.x + viewProjection.m[4 + row] * target.y
+                        + viewProjection.m[8 + row] * target.z + viewProjection.m[12 + row];
+                }
+                if (std::fabs(clip[0]) > clip[3] || std::fabs(clip[1]) > clip[3]) {
+                    continue;   // outside the image, seen or not
+                }
+                bool hidden = false;
+                for (const Aabb& occluder : occluders) {
+                    hidden |= rayBoxDistance(occluder, eye, target - eye) < 1.0;
+                }
+                errors += !hidden;
+            }
+        }
+    }
+    printf("  %u buildings, %u props  %.1f in frustum, %.1f%% of them occluded\n", buildingCount, propCount,
+           double(inFrustum) / frames, 100.0 * occluded / inFrustum);
+    printf("  raster %.3f ms for %.0f triangles  test %.3f ms (%.0f ns/box)\n", rasterSeconds * 1e3 / frames,
+           double(triangles) / frames, testSeconds * 1e3 / frames, testSeconds * 1e9 / inFrustum);
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// What fragmentMain adds up for a point: every light's color scaled by a
+// falloff that reaches zero at its radius.
+static Float3 shadeLights(const PointLight* lights, const uint16_t* indices, uint32_t count, Float3 position) {
+    Float3 sum = {0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < count; ++i) {
+        const PointLight& light = lights[indices ? indices[i] : i];
+        Float3 offset = light.position - position;
+        float falloff = std::max(1.0f - dot(offset, offset) / (light.radius * light.radius), 0.0f);
+        sum = sum + light.color * (light.intensity * falloff * falloff);
+    }
+    return sum;
+}
+
+// Lights scattered over a street-sized block around a camera that turns
+// between frames. Points inside the view are shaded from their cluster's
+// list and compared with shading from every light.
+static uint32_t benchLightClusters() {
+    const uint32_t counts[] = {1000, 2000, 5000, 10000};
+    const uint32_t views = 32;
+    const uint32_t samples = 2000;
+    const float side = 200.0f;
+
+    JobSystem jobs;
+    LightClusterGrid grid(16, 9, 24);
+    grid.setProjection(1.0f, 16.0f / 9.0f, 0.1f, side);
+    printf("light-clusters (16x9x24 clusters, %u threads)\n", jobs.threadCount());
+
+    uint32_t errors = 0;
+    for (uint32_t count : counts) {
+        std::mt19937 rng(43);
+        std::uniform_real_distribution<float> position(-side * 0.5f, side * 0.5f);
+        std::uniform_real_distribution<float> height(0.0f, 20.0f);
+        std::uniform_real_distribution<float> radius(2.0f, 12.0f);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<PointLight> lights(count);
+        for (PointLight& light : lights) {
+            light = {{position(rng), height(rng), position(rng)}, radius(rng), {unit(rng), unit(rng), unit(rng)}, 1.0f + unit(rng)};
+        }
+
+        double seconds[2] = {};
+        uint64_t indexCount = 0, inRange = 0;
+        uint32_t maxPerCluster = 0;
+        for (uint32_t v = 0; v < views; ++v) {
+            float angle = float(v) * 6.2831853f / views;
+            Quat turn = {0.0f, std::sin(angle * 0.5f), 0.0f, std::cos(angle * 0.5f)};
+            Float4x4 view = makeTransform({0.0f, -1.7f, 0.0f}, turn, {1.0f, 1.0f, 1.0f});
+
+            grid.assign(view, lights.data(), count);
+            seconds[0] += grid.stats().seconds;
+            std::vector<LightCluster> serialClusters(grid.clusters(), grid.clusters() + grid.clusterCount());
+            std::vector<uint16_t> serialIndices(grid.lightIndices(), grid.lightIndices() + grid.stats().indices);
+
+            grid.assign(view, lights.data(), count, &jobs);
+            seconds[1] += grid.stats().seconds;
+            indexCount += grid.stats().indices;
+            inRange += grid.stats().inRange;
+            maxPerCluster = std::max(maxPerCluster, grid.stats().maxPerCluster);
+            errors += memcmp(serialClusters.data(), grid.clusters(), serialClusters.size() * sizeof(LightCluster)) != 0
+                || serialIndices.size() != grid.stats().indices
+                || memcmp(serialIndices.data(), grid.lightIndices(), serialIndices.size() * sizeof(uint16_t)) != 0;
+
+            for (uint32_t i = 0; i < samples; ++i) {
+                Float3 world = {position(rng), height(rng), position(rng)};
+                uint32_t cluster = grid.clusterAt(transformPoint(view, world));
+                if (cluster == ~0u) {
+                    continue;
+                }
+                const LightCluster& range = grid.clusters()[cluster];
+                Float3 clustered = shadeLights(lights.data(), grid.lightIndices() + range.offset, range.count, world);
+                Float3 reference = shadeLights(lights.data(), nullptr, count, world);
+                Float3 difference = clustered - reference;
+                errors += dot(difference, difference) > 1e-8f * (1.0f + dot(reference, reference));
+            }
+        }
+        printf("  %5u lights  %5.1f in range  %6.0f indices (max %u per cluster)  serial %6.3f ms  jobs %6.3f ms\n",
+               count, double(inRange) / views, double(indexCount) / views, maxPerCluster, seconds[0] * 1e3 / views,
+               seconds[1] * 1e3 / views);
+    }
+    printf("  %u errors\n", errors);
+    return errors;
+}
+
+// Each returns the number of errors its checks found.
+struct Benchmark {
+    const char* name;
+    uint32_t (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    {"motion-matching", benchMotionMatching},
+    {"spring-bones", benchSpringBones},
+    {"palette-deltas", benchPaletteDeltas},
+    {"animation-lod", benchAnimationLod},
+    {"skinned-crowd", benchSkinnedCrowd},
+    {"morph-targets", benchMorphTargets},
+    {"tlsf", benchTlsf},
+    {"upload-ring", benchUploadRing},
+    {"deferred-release", benchDeferredRelease},
+    {"handle-pool", benchHandlePool},
+    {"frame-arena", benchFrameArena},
+    {"residency", benchResidency},
+    {"transient-aliasing", benchTransientAliasing},
+    {"pipeline-cache", benchPipelineCache},
+    {"pipeline-archive", benchPipelineArchive},
+    {"descriptor-table", benchDescriptorTable},
+    {"gpu-culling", benchGpuCulling},
+    {"frustum-culling", benchFrustumCulling},
+    {"bvh", benchBvh},
+    {"occlusion", benchOcclusion},
+    {"light-clusters", benchLightClusters},
+};
+
+int main(int argc, const char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        bool known = false;
+        for (const Benchmark& benchmark : benchmarks) {
+            known |= !strcmp(argv[i], benchmark.name);
+        }
+        if (!known) {
+            fprintf(stderr, "unknown benchmark '%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint32_t failed = 0;
+    for (const Benchmark& benchmark : benchmarks) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i) {
+            selected |= !strcmp(argv[i], benchmark.name);
+        }
+        if (selected && benchmark.run() != 0) {
+            fprintf(stderr, "%s: FAILED\n", benchmark.name);
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
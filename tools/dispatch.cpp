@@ -0,0 +1,236 @@
+//
+//  dispatch.cpp
+//  MetalBones
+//
+//  Checks NS::MethodCache against a stub Objective-C runtime: one resolution
+//  per receiver class, subclasses that override a method, nil receivers,
+//  unknown selectors and concurrent callers. Then measures calls per second
+//  through the cache and through a model of objc_msgSend's cache hit path.
+//  The model only approximates the real assembly, so compare on device too.
+//
+//    c++ -std=c++20 -O2 -pthread -Itools/stub -Imetal-cpp tools/dispatch.cpp -o dispatch
+//    ./dispatch
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <Foundation/NSMethodCache.hpp>
+
+struct objc_selector {
+    const char* name;
+};
+
+// Open addressed like the runtime's per-class method cache.
+struct objc_class {
+    struct Method {
+        SEL name;
+        IMP imp;
+    };
+
+    Class superclass;
+    std::vector<Method> methods;
+    Method buckets[16];
+};
+
+struct objc_object {
+    Class isa;
+};
+
+static std::atomic<uint32_t> resolutions{0};
+static std::atomic<uint32_t> forwards{0};
+
+static void forward() {
+    forwards.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" __attribute__((noinline)) Class object_getClass(id object) {
+    return object ? object->isa : nullptr;
+}
+
+extern "C" IMP class_getMethodImplementation(Class cls, SEL name) {
+    resolutions.fetch_add(1, std::memory_order_relaxed);
+    for (; cls; cls = cls->superclass) {
+        for (const objc_class::Method& method : cls->methods) {
+            if (method.name == name) {
+                return method.imp;
+            }
+        }
+    }
+    return forward;
+}
+
+static uint32_t bucketOf(SEL name) {
+    return uint32_t(uintptr_t(name) >> 3) & 15;
+}
+
+static void fillBuckets(Class cls, SEL name) {
+    IMP imp = class_getMethodImplementation(cls, name);
+    for (uint32_t i = bucketOf(name);; i = (i + 1) & 15) {
+        if (!cls->buckets[i].name) {
+            cls->buckets[i] = {name, imp};
+            return;
+        }
+    }
+}
+
+// What objc_msgSend does when the method is in the receiver's cache. It is an
+// out of line call into libobjc, like object_getClass.
+template <typename Ret, typename... Args>
+__attribute__((noinline)) static Ret sendMessage(const void* object, SEL name, Args... args) {
+    Class cls = static_cast<const objc_object*>(object)->isa;
+    uint32_t i = bucketOf(name);
+    while (cls->buckets[i].name != name) {
+        i = (i + 1) & 15;
+    }
+    using Proc = Ret (*)(const void*, SEL, Args...);
+    return reinterpret_cast<Proc>(cls->buckets[i].imp)(object, name, args...);
+}
+
+struct Encoder : objc_object {
+    uint64_t calls = 0;
+    uint64_t debugCalls = 0;
+    uint64_t checksum = 0;
+};
+
+static void setVertexBuffer(const void* self, SEL, const void* buffer, uint64_t offset, uint64_t index) {
+    Encoder* encoder = (Encoder*)self;
+    encoder->calls++;
+    encoder->checksum += uintptr_t(buffer) + offset + index;
+}
+
+static void debugSetVertexBuffer(const void* self, SEL name, const void* buffer, uint64_t offset, uint64_t index) {
+    ((Encoder*)self)->debugCalls++;
+    setVertexBuffer(self, name, buffer, offset, index);
+}
+
+static uint64_t callCount(const void* self, SEL) {
+    return ((const Encoder*)self)->calls;
+}
+
+static objc_selector setVertexBufferName{"setVertexBuffer:offset:atIndex:"};
+static objc_selector callCountName{"callCount"};
+static objc_selector unknownName{"unknown"};
+
+static SEL const setVertexBufferSel = &setVertexBufferName;
+static SEL const callCountSel = &callCountName;
+static SEL const unknownSel = &unknownName;
+
+template <typename Function>
+static void addMethod(Class cls, SEL name, Function function) {
+    cls->methods.push_back({name, reinterpret_cast<IMP>(function)});
+}
+
+int main() {
+    objc_class renderEncoder{};
+    addMethod(&renderEncoder, setVertexBufferSel, setVertexBuffer);
+    addMethod(&renderEncoder, callCountSel, callCount);
+
+    objc_class debugEncoder{};
+    debugEncoder.superclass = &renderEncoder;
+    addMethod(&debugEncoder, setVertexBufferSel, debugSetVertexBuffer);
+
+    uint32_t errors = 0;
+
+    {
+        NS::MethodCache cache;
+        NS::MethodCache countCache;
+        Encoder render;
+        Encoder debug;
+        render.isa = &renderEncoder;
+        debug.isa = &debugEncoder;
+
+        uint32_t before = resolutions.load();
+        for (uint32_t i = 0; i < 1000; ++i) {
+            Encoder* encoder = i & 1 ? &debug : &render;
+            cache.send<void>(encoder, setVertexBufferSel, (const void*)encoder, uint64_t(i), uint64_t(0));
+        }
+        errors += resolutions.load() - before == 2 ? 0 : 1;
+        errors += render.calls == 500 && render.debugCalls == 0 ? 0 : 1;
+        errors += debug.calls == 500 && debug.debugCalls == 500 ? 0 : 1;
+
+        // Inherited method, and a non-void return.
+        errors += countCache.send<uint64_t>(&debug, callCountSel) == 500 ? 0 : 1;
+        errors += countCache.send<uint64_t>(&render, callCountSel) == 500 ? 0 : 1;
+
+        errors += countCache.send<uint64_t>(nullptr, callCountSel) == 0 ? 0 : 1;
+        cache.send<void>(nullptr, setVertexBufferSel, (const void*)nullptr, uint64_t(0), uint64_t(0));
+
+        NS::MethodCache unknownCache;
+        unknownCache.send<void>(&render, unknownSel);
+        errors += forwards.load() == 1 ? 0 : 1;
+    }
+    std::printf("resolution: %u errors\n", errors);
+
+    {
+        const uint32_t threadCount = 8;
+        const uint32_t calls = 200000;
+        NS::MethodCache cache;
+        std::vector<Encoder> encoders(threadCount * 2);
+        for (uint32_t i = 0; i < encoders.size(); ++i) {
+            encoders[i].isa = i & 1 ? &debugEncoder : &renderEncoder;
+        }
+
+        uint32_t before = resolutions.load();
+        std::vector<std::thread> threads;
+        std::atomic<bool> go{false};
+        for (uint32_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&, t] {
+                while (!go.load(std::memory_order_acquire)) {
+                }
+                for (uint32_t i = 0; i < calls; ++i) {
+                    Encoder* encoder = &encoders[t * 2 + (i & 1)];
+                    cache.send<void>(encoder, setVertexBufferSel, (const void*)nullptr, uint64_t(i), uint64_t(1));
+                }
+            });
+        }
+        go.store(true, std::memory_order_release);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        uint32_t threadErrors = 0;
+        for (const Encoder& encoder : encoders) {
+            threadErrors += encoder.calls == calls / 2 ? 0 : 1;
+            threadErrors += encoder.debugCalls == (encoder.isa == &debugEncoder ? calls / 2 : 0) ? 0 : 1;
+        }
+        uint32_t resolved = resolutions.load() - before;
+        threadErrors += resolved >= 2 && resolved <= 2 * threadCount ? 0 : 1;
+        std::printf("%u threads: %u resolutions, %u errors\n", threadCount, resolved, threadErrors);
+        errors += threadErrors;
+    }
+
+    {
+        fillBuckets(&renderEncoder, setVertexBufferSel);
+        fillBuckets(&renderEncoder, callCountSel);
+
+        using Clock = std::chrono::steady_clock;
+        const uint32_t calls = 50000000;
+        Encoder encoder;
+        encoder.isa = &renderEncoder;
+        NS::MethodCache cache;
+
+        Clock::time_point begin = Clock::now();
+        for (uint32_t i = 0; i < calls; ++i) {
+            sendMessage<void>(&encoder, setVertexBufferSel, (const void*)nullptr, uint64_t(i), uint64_t(0));
+        }
+        double messageSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+        begin = Clock::now();
+        for (uint32_t i = 0; i < calls; ++i) {
+            cache.send<void>(&encoder, setVertexBufferSel, (const void*)nullptr, uint64_t(i), uint64_t(0));
+        }
+        double cachedSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+        errors += encoder.calls == 2ull * calls ? 0 : 1;
+        std::printf("message send: %.0f M calls/s\n", calls / messageSeconds * 1e-6);
+        std::printf("cached IMP:   %.0f M calls/s\n", calls / cachedSeconds * 1e-6);
+    }
+
+    std::printf("%u errors\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+//
+//  permutations.cpp
+//  MetalBones
+//
+//  Lists every shader permutation the renderer can ask for, per function and
+//  per vertexMain/fragmentMain pipeline, which is what Renderer prewarms into
+//  the pipeline archive at load. Also checks key packing, which mostly
+//  happens at compile time below, and that material requests for the same
+//  code share one permutation. Builds anywhere, no Metal required:
+//
+//    c++ -std=c++20 -O2 -IMetalBones tools/permutations.cpp MetalBones/ShaderPermutations.cpp -o permutations
+//    ./permutations [--materials N]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_set>
+
+#include "ShaderPermutations.hpp"
+
+constexpr ShaderFeatures skinnedFog = {ShaderFeature::Skinning, ShaderFeature::Fog};
+static_assert(skinnedFog.mask() == 0b1001);
+static_assert(skinnedFog.has(ShaderFeature::Fog) && !skinnedFog.has(ShaderFeature::Instancing));
+static_assert((skinnedFog | ShaderFeatures{ShaderFeature::Instancing}).mask() == 0b1011);
+static_assert(ShaderFeatures::fromMask(~0u).mask() == (1u << shaderFeatureCount) - 1);
+static_assert(shaderPermutation("vertexMain", skinnedFog) == ShaderFeatures{ShaderFeature::Skinning});
+static_assert(shaderPermutation("fragmentMain", skinnedFog) == ShaderFeatures{ShaderFeature::Fog});
+static_assert(shaderPermutation("vertexAnimationMain", skinnedFog).empty());
+static_assert(pipelinePermutation("vertexMain", "fragmentMain", skinnedFog) == skinnedFog);
+
+static std::string describe(ShaderFeatures features) {
+    std::string text;
+    for (uint32_t i = 0; i < shaderFeatureCount; ++i) {
+        if (features.has(ShaderFeature(i))) {
+            text += text.empty() ? "" : " ";
+            text += shaderFeatureName(ShaderFeature(i));
+        }
+    }
+    return text.empty() ? "-" : text;
+}
+
+int main(int argc, const char* argv[]) {
+    uint32_t materialCount = 2000;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--materials") && i + 1 < argc) {
+            materialCount = uint32_t(atoi(argv[++i]));
+        } else {
+            fprintf(stderr, "usage: %s [--materials N]\n", argv[0]);
+            return 1;
+        }
+    }
+    uint32_t errors = 0;
+
+    for (const ShaderFunctionFeatures& entry : shaderFunctionFeatures) {
+        std::vector<ShaderFeatures> permutations = enumerateShaderPermutations(entry.features);
+        printf("%.*s: %zu permutations\n", int(entry.function.size()), entry.function.data(), permutations.size());
+        std::unordered_set<uint32_t> distinct;
+        for (ShaderFeatures features : permutations) {
+            printf("  %02x  %s\n", features.mask(), describe(features).c_str());
+            distinct.insert(features.mask());
+            errors += !(shaderPermutation(entry.function, features) == features);
+        }
+        errors += distinct.size() != permutations.size();
+        errors += permutations.size() != 1u << __builtin_popcount(entry.features.mask());
+    }
+
+    ShaderFeatures used = usedShaderFeatures("vertexMain") | usedShaderFeatures("fragmentMain");
+    std::vector<ShaderFeatures> pipelines = enumerateShaderPermutations(used);
+    printf("vertexMain + fragmentMain: %zu pipelines\n", pipelines.size());
+    errors += !enumerateShaderPermutations({}).front().empty() || enumerateShaderPermutations({}).size() != 1;
+
+    // Materials ask for any mix of features; each function only specializes
+    // on the ones it reads.
+    std::mt19937 rng(44);
+    std::unordered_set<uint32_t> requested, vertexFunctions, fragmentFunctions, pipelineKeys;
+    for (uint32_t i = 0; i < materialCount; ++i) {
+        ShaderFeatures features = ShaderFeatures::fromMask(uint32_t(rng()));
+        requested.insert(features.mask());
+        vertexFunctions.insert(shaderPermutation("vertexMain", features).mask());
+        fragmentFunctions.insert(shaderPermutation("fragmentMain", features).mask());
+        pipelineKeys.insert(pipelinePermutation("vertexMain", "fragmentMain", features).mask());
+    }
+    errors += vertexFunctions.size() > enumerateShaderPermutations(usedShaderFeatures("vertexMain")).size();
+    errors += fragmentFunctions.size() > enumerateShaderPermutations(usedShaderFeatures("fragmentMain")).size();
+    errors += pipelineKeys.size() > pipelines.size();
+    printf("%u materials, %zu distinct feature sets: %zu vertex and %zu fragment functions, %zu pipelines\n",
+           materialCount, requested.size(), vertexFunctions.size(), fragmentFunctions.size(), pipelineKeys.size());
+    printf("%u errors\n", errors);
+    return errors != 0;
+}
@@ -0,0 +1,185 @@
+//
+//  registration.cpp
+//  MetalBones
+//
+//  Counts the classes, protocols and selectors the metal-cpp private
+//  implementation registers before main() and times it, against a stub
+//  Objective-C runtime. Then resolves what a frame of the renderer uses from
+//  several threads at once and times repeated access. Build it eagerly and
+//  with METALCPP_LAZY_REGISTRATION to compare:
+//
+//    c++ -std=c++20 -O2 -pthread -Itools/stub -Imetal-cpp tools/registration.cpp -o registration
+//    c++ -std=c++20 -O2 -pthread -Itools/stub -Imetal-cpp -DMETALCPP_LAZY_REGISTRATION tools/registration.cpp -o registration-lazy
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Dynamic initialization runs in order of definition within a translation
+// unit, so these two bracket everything the private headers define.
+static const Clock::time_point initBegin = Clock::now();
+
+#define NS_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#include <Foundation/NSPrivate.hpp>
+#include <Metal/MTLHeaderBridge.hpp>
+
+static const Clock::time_point initEnd = Clock::now();
+
+static std::atomic<uint32_t> selectorCount{0};
+static std::atomic<uint32_t> classCount{0};
+static std::atomic<uint32_t> protocolCount{0};
+
+// The real runtime interns names in a locked hash table too.
+static const void* intern(const char* name) {
+    static std::mutex mutex;
+    static std::unordered_set<std::string> names;
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.insert(name).first->c_str();
+}
+
+extern "C" SEL sel_registerName(const char* name) {
+    selectorCount.fetch_add(1, std::memory_order_relaxed);
+    return (SEL)intern(name);
+}
+
+extern "C" Class objc_lookUpClass(const char* name) {
+    classCount.fetch_add(1, std::memory_order_relaxed);
+    return (Class)intern(name);
+}
+
+extern "C" Protocol* objc_getProtocol(const char* name) {
+    protocolCount.fetch_add(1, std::memory_order_relaxed);
+    return (Protocol*)intern(name);
+}
+
+struct Lookups {
+    std::vector<void*> classes;
+    std::vector<SEL> selectors;
+
+    bool operator==(const Lookups&) const = default;
+};
+
+// Roughly what one frame of the renderer sends.
+namespace MTL {
+static Lookups frameLookups() {
+    Lookups lookups;
+    lookups.classes = {
+        _MTL_PRIVATE_CLS(MTLRenderPassDescriptor),
+        _MTL_PRIVATE_CLS(MTLRenderPipelineDescriptor),
+        _MTL_PRIVATE_CLS(MTLVertexDescriptor),
+    };
+    lookups.selectors = {
+        _MTL_PRIVATE_SEL(commandBuffer),
+        _MTL_PRIVATE_SEL(renderCommandEncoderWithDescriptor_),
+        _MTL_PRIVATE_SEL(setRenderPipelineState_),
+        _MTL_PRIVATE_SEL(setVertexBuffer_offset_atIndex_),
+        _MTL_PRIVATE_SEL(setFragmentTexture_atIndex_),
+        _MTL_PRIVATE_SEL(drawIndexedPrimitives_indexCount_indexType_indexBuffer_indexBufferOffset_),
+        _MTL_PRIVATE_SEL(endEncoding),
+        _MTL_PRIVATE_SEL(presentDrawable_),
+        _MTL_PRIVATE_SEL(commit),
+        _MTL_PRIVATE_SEL(contents),
+    };
+    return lookups;
+}
+
+static SEL hotSelector() {
+    return _MTL_PRIVATE_SEL(setVertexBuffer_offset_atIndex_);
+}
+} // MTL
+
+namespace NS {
+static void appendLookups(Lookups& lookups) {
+    lookups.classes.push_back(_NS_PRIVATE_CLS(NSAutoreleasePool));
+    lookups.selectors.push_back(_NS_PRIVATE_SEL(alloc));
+    lookups.selectors.push_back(_NS_PRIVATE_SEL(init));
+    lookups.selectors.push_back(_NS_PRIVATE_SEL(retain));
+    lookups.selectors.push_back(_NS_PRIVATE_SEL(release));
+}
+} // NS
+
+static Lookups resolveFrame() {
+    Lookups lookups = MTL::frameLookups();
+    NS::appendLookups(lookups);
+    return lookups;
+}
+
+int main() {
+#ifdef METALCPP_LAZY_REGISTRATION
+    const char* mode = "lazy";
+#else
+    const char* mode = "eager";
+#endif
+    uint32_t initSelectors = selectorCount.load();
+    uint32_t initClasses = classCount.load();
+    uint32_t initProtocols = protocolCount.load();
+    double initMicroseconds = std::chrono::duration<double, std::micro>(initEnd - initBegin).count();
+
+    std::printf("%s registration\n", mode);
+    std::printf("  before main: %u selectors, %u classes, %u protocols in %.1f us\n",
+                initSelectors, initClasses, initProtocols, initMicroseconds);
+
+    // Every thread races to resolve the same names first.
+    const uint32_t threadCount = 8;
+    std::vector<Lookups> results(threadCount);
+    std::vector<std::thread> threads;
+    std::atomic<bool> go{false};
+    for (uint32_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t] {
+            while (!go.load(std::memory_order_acquire)) {
+            }
+            results[t] = resolveFrame();
+        });
+    }
+    go.store(true, std::memory_order_release);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    uint32_t errors = 0;
+    Lookups first = resolveFrame();
+    for (const Lookups& result : results) {
+        errors += result == first ? 0 : 1;
+    }
+    for (void* object : first.classes) {
+        errors += object ? 0 : 1;
+    }
+    for (SEL selector : first.selectors) {
+        errors += selector ? 0 : 1;
+    }
+
+    uint32_t frameSelectors = selectorCount.load() - initSelectors;
+    uint32_t frameClasses = classCount.load() - initClasses;
+#ifdef METALCPP_LAZY_REGISTRATION
+    // Exactly one lookup per name, however many threads asked.
+    errors += frameSelectors == first.selectors.size() ? 0 : 1;
+    errors += frameClasses == first.classes.size() ? 0 : 1;
+#else
+    errors += frameSelectors == 0 && frameClasses == 0 ? 0 : 1;
+#endif
+    std::printf("  one frame from %u threads: %u selectors, %u classes looked up\n",
+                threadCount, frameSelectors, frameClasses);
+
+    const uint32_t accesses = 100000000;
+    uintptr_t sink = 0;
+    Clock::time_point begin = Clock::now();
+    for (uint32_t i = 0; i < accesses; ++i) {
+        sink += uintptr_t(MTL::hotSelector());
+        asm volatile("" ::: "memory");
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    errors += sink == uintptr_t(MTL::hotSelector()) * accesses ? 0 : 1;
+    std::printf("  cached access: %.2f ns\n", seconds * 1e9 / accesses);
+
+    std::printf("  %u errors\n", errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+//
+//  runtime.h
+//  MetalBones
+//
+//  The part of the Objective-C runtime that the metal-cpp private headers and
+//  method cache call, so the tools can include them on any platform. Each tool
+//  defines the functions it needs.
+//
+
+#pragma once
+
+typedef struct objc_selector* SEL;
+typedef struct objc_class* Class;
+typedef struct objc_object* id;
+typedef struct objc_object Protocol;
+typedef void (*IMP)(void);
+
+extern "C" {
+SEL sel_registerName(const char* name);
+Class objc_lookUpClass(const char* name);
+Protocol* objc_getProtocol(const char* name);
+Class object_getClass(id object);
+IMP class_getMethodImplementation(Class cls, SEL name);
+}
@@ -0,0 +1,187 @@
+//
+//  vatbake.cpp
+//  MetalBones
+//
+//  Bakes a procedural skinned character into vertex animation textures and
+//  reports bake throughput. Builds anywhere, no Metal required:
+//
+//    c++ -std=c++20 -O2 -IMetalBones tools/vatbake.cpp MetalBones/Animation.cpp MetalBones/VertexAnimation.cpp -o vatbake
+//    ./vatbake [--vertices N] [--joints N] [--seconds S] [--rate FPS] [--float32] [--repeat N] [--out file]
+//
+//  Exits with 1 when baked positions are further from direct skinning than
+//  two quantization steps of the chosen format.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "VertexAnimation.hpp"
+
+struct Options {
+    uint32_t vertices = 8192;
+    uint32_t joints = 32;
+    float seconds = 2.0f;
+    float rate = 30.0f;
+    uint32_t repeat = 5;
+    bool float32 = false;
+    const char* out = nullptr;
+};
+
+static Options parseOptions(int argc, const char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--vertices") && value) { options.vertices = uint32_t(atoi(value)); ++i; }
+        else if (!strcmp(arg, "--joints") && value) { options.joints = uint32_t(atoi(value)); ++i; }
+        else if (!strcmp(arg, "--seconds") && value) { options.seconds = float(atof(value)); ++i; }
+        else if (!strcmp(arg, "--rate") && value) { options.rate = float(atof(value)); ++i; }
+        else if (!strcmp(arg, "--repeat") && value) { options.repeat = uint32_t(atoi(value)); ++i; }
+        else if (!strcmp(arg, "--out") && value) { options.out = value; ++i; }
+        else if (!strcmp(arg, "--float32")) { options.float32 = true; }
+        else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            exit(1);
+        }
+    }
+    return options;
+}
+
+// A vertical chain of joints with a cylinder skinned along it, swaying on a sine.
+static Skeleton makeSkeleton(uint32_t jointCount, float boneLength) {
+    Skeleton skeleton;
+    for (uint32_t j = 0; j < jointCount; ++j) {
+        JointTransform bind = {{0, 0, 0, 1}, {0, j == 0 ? 0.0f : boneLength, 0}, {1, 1, 1}};
+        Float4x4 inverseBind = identity4x4();
+        inverseBind.m[13] = -boneLength * float(j);
+
+        skeleton.parents.push_back(int16_t(j) - 1);
+        skeleton.bindPose.push_back(bind);
+        skeleton.inverseBindMatrices.push_back(inverseBind);
+    }
+    return skeleton;
+}
+
+static AnimationClip makeClip(const Skeleton& skeleton, float seconds) {
+    const float sampleRate = 60.0f;
+    const uint32_t frames = std::max(1u, uint32_t(seconds * sampleRate));
+
+    AnimationClip clip(skeleton.jointCount(), frames, sampleRate);
+    for (uint32_t f = 0; f < frames; ++f) {
+        float phase = 2.0f * float(M_PI) * float(f) / float(frames);
+        for (uint32_t j = 0; j < skeleton.jointCount(); ++j) {
+            float angle = 0.15f * std::sin(phase + 0.3f * float(j));
+            JointTransform& t = clip.frame(f)[j];
+            t = skeleton.bindPose[j];
+            t.rotation = {0.0f, 0.0f, std::sin(angle * 0.5f), std::cos(angle * 0.5f)};
+        }
+    }
+    return clip;
+}
+
+static std::vector<SkinnedVertex> makeMesh(uint32_t vertexCount, uint32_t jointCount, float boneLength) {
+    const uint32_t ring = 16;
+    const float height = boneLength * float(jointCount - 1);
+
+    std::vector<SkinnedVertex> vertices(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        float angle = 2.0f * float(M_PI) * float(v % ring) / float(ring);
+        float y = height * float(v / ring) / float(std::max(1u, (vertexCount - 1) / ring));
+        float bone = std::min(y / boneLength, float(jointCount - 1));
+
+        uint16_t j0 = uint16_t(bone);
+        uint16_t j1 = uint16_t(std::min<uint32_t>(j0 + 1, jointCount - 1));
+        float w1 = bone - float(j0);
+
+        vertices[v] = {
+            {0.2f * std::cos(angle), y, 0.2f * std::sin(angle)},
+            {std::cos(angle), 0.0f, std::sin(angle)},
+            {j0, j1, 0, 0},
+            {1.0f - w1, w1, 0.0f, 0.0f},
+        };
+    }
+    return vertices;
+}
+
+int main(int argc, const char* argv[]) {
+    Options options = parseOptions(argc, argv);
+    if (options.vertices == 0 || options.joints < 2 || options.repeat == 0) {
+        fprintf(stderr, "need at least 1 vertex, 2 joints and 1 repeat\n");
+        return 1;
+    }
+
+    const float boneLength = 0.25f;
+    Skeleton skeleton = makeSkeleton(options.joints, boneLength);
+    AnimationClip clip = makeClip(skeleton, options.seconds);
+    std::vector<SkinnedVertex> mesh = makeMesh(options.vertices, options.joints, boneLength);
+
+    VertexAnimationBakeSettings settings;
+    settings.frameRate = options.rate;
+    settings.format = options.float32 ? VertexAnimationFormat::Float32 : VertexAnimationFormat::Float16;
+
+    VertexAnimationTexture baked;
+    double best = 1e30;
+    for (uint32_t r = 0; r < options.repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        baked = bakeVertexAnimation(skeleton, clip, mesh.data(), options.vertices, settings);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+
+    // Check the baked data against direct skinning at every baked frame.
+    std::vector<JointTransform> pose(skeleton.jointCount());
+    std::vector<Float4x4> palette(skeleton.jointCount());
+    float maxError = 0.0f, maxComponent = 0.0f;
+    for (uint32_t f = 0; f < baked.frameCount; ++f) {
+        float time = float(f) / baked.frameRate;
+        clip.sample(time, pose.data(), clip.jointCount());
+        buildMatrixPalette(skeleton, pose.data(), palette.data());
+        for (uint32_t v = 0; v < options.vertices; v += 7) {
+            Float3 reference = skinPosition(palette.data(), mesh[v]);
+            Float3 d = sampleBakedPosition(baked, v, time) - reference;
+            maxError = std::max(maxError, length(d));
+            maxComponent = std::max({maxComponent, std::fabs(reference.x), std::fabs(reference.y), std::fabs(reference.z)});
+        }
+    }
+
+    const double texels = double(baked.vertexCount) * baked.frameCount;
+    const double bytes = double(baked.positions.size() + baked.normals.size());
+    printf("baked %u vertices x %u frames (%ux%u %s, %.2f MB)\n",
+           baked.vertexCount, baked.frameCount, baked.width, baked.height(),
+           options.float32 ? "RGBA32Float" : "RGBA16Float", bytes / (1024.0 * 1024.0));
+    printf("best of %u: %.3f ms, %.2f Mvertex-frames/s, %.1f MB/s\n",
+           options.repeat, best * 1e3, texels / best * 1e-6, bytes / best / (1024.0 * 1024.0));
+    // Rounding to the format is at most half a step per component, so under
+    // 0.87 steps over a vector; two steps leave room for sampling arithmetic.
+    // The step is the format's at the largest coordinate, which bounds them all.
+    int exponent;
+    std::frexp(std::max(maxComponent, 1e-30f), &exponent);
+    const float step = std::ldexp(1.0f, exponent - (options.float32 ? 24 : 11));
+    const float tolerance = 2.0f * step;
+    printf("max reference error: %g (%.2f quantization steps of %g, tolerance %g)\n",
+           double(maxError), double(maxError / step), double(step), double(tolerance));
+
+    if (options.out) {
+        FILE* file = fopen(options.out, "wb");
+        if (!file) {
+            fprintf(stderr, "cannot open %s\n", options.out);
+            return 1;
+        }
+        const uint32_t header[6] = {0x54415642u /* 'BVAT' */, baked.vertexCount, baked.frameCount, baked.width, baked.rowsPerFrame, uint32_t(baked.format)};
+        fwrite(header, sizeof(header), 1, file);
+        fwrite(&baked.frameRate, sizeof(float), 1, file);
+        fwrite(baked.positions.data(), 1, baked.positions.size(), file);
+        fwrite(baked.normals.data(), 1, baked.normals.size(), file);
+        fclose(file);
+    }
+
+    if (!(maxError <= tolerance)) {
+        fprintf(stderr, "reference error over tolerance\n");
+        return 1;
+    }
+    return 0;
+}